@@ -0,0 +1,126 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+namespace {
+
+// every operator new in the process, the library's included
+std::atomic<unsigned long> allocations{0u};
+
+} // anonymous
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1u, std::memory_order_relaxed);
+    if(void* ptr = std::malloc(size ? size : 1u)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace bench {
+
+// Heap allocations per record on the paths that fill thread-owned memory: enumeration,
+// cache hits copied out by getpwnam()/getgrnam(), and courtesy names. Also checks the
+// BSD ownership rules: the last record survives courtesy calls, and a courtesy name
+// survives a few hundred more of them.
+int Arena(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    wuser_cache_invalidate();
+    int failed = 0;
+
+    std::size_t records = 0u;
+    setpwent();
+    getpwent(); // warm up: the first page and the thread's own memory
+    unsigned long before = allocations.load();
+    auto start = Clock::now();
+    while(getpwent()) ++records;
+    const double enum_seconds = Seconds(start);
+    const double enum_allocs = double(allocations.load() - before) / records;
+    endpwent();
+    failed |= records + 1u != opts.users + 2u; // + Administrator, Guest
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "user%06zu", opts.users / 2u);
+    failed |= !getpwnam(name); // cached from now on
+    before = allocations.load();
+    start = Clock::now();
+    for(std::size_t round = 0; round < opts.rounds; ++round) {
+        const struct passwd* pwd = getpwnam(name);
+        failed |= !pwd || std::strcmp(pwd->pw_name, name);
+    }
+    const double hit_seconds = Seconds(start);
+    const double hit_allocs = double(allocations.load() - before) / opts.rounds;
+
+    std::snprintf(name, sizeof(name), "group%06u", 0u);
+    failed |= !getgrnam(name);
+    before = allocations.load();
+    for(std::size_t round = 0; round < opts.rounds; ++round) {
+        const struct group* grp = getgrnam(name);
+        failed |= !grp || !grp->gr_mem || std::strcmp(grp->gr_name, name);
+    }
+    const double group_allocs = double(allocations.load() - before) / opts.rounds;
+
+    // courtesy names: warm up the cache for `keys` accounts, then count
+    const struct passwd* last = getpwuid(1000u);
+    const std::size_t keys = opts.keys < opts.users ? opts.keys : opts.users;
+    for(std::size_t k = 0; k < keys; ++k) {
+        user_from_uid(1000u + k, 0);
+    }
+    const char* kept = user_from_uid(1000u + keys - 1u, 0);
+    const std::string kept_copy = kept ? kept : "";
+    before = allocations.load();
+    for(std::size_t round = 0; round < opts.rounds; ++round) {
+        const char* courtesy = user_from_uid(1000u + round % keys, 0);
+        failed |= !courtesy;
+        if(round == 200u) {
+            failed |= kept_copy != kept; // still there after a couple hundred calls
+        }
+    }
+    const double courtesy_allocs = double(allocations.load() - before) / opts.rounds;
+    failed |= !last || last->pw_uid != 1000u || std::strcmp(last->pw_name, "user000000");
+
+    Record("arena")("users", opts.users)("getpwent_allocs_per_record", enum_allocs)
+                   ("getpwent_records_per_s", records / enum_seconds)
+                   ("getpwnam_hit_allocs_per_call", hit_allocs)("getpwnam_hit_calls_per_s", opts.rounds / hit_seconds)
+                   ("getgrnam_hit_allocs_per_call", group_allocs)
+                   ("user_from_uid_allocs_per_call", courtesy_allocs);
+    (void) directory;
+    return failed;
+}
+
+} // namespace bench
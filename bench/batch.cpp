@@ -0,0 +1,112 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_batch.h"
+#include "wusers/wuser_cache.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// An archive listing: 10k owner uids (some repeated, some unknown), resolved cold by
+// 10k getpwuid_r() calls and then by one wuser_getpwuid_batch() call. The batch must
+// cost one enumeration and no lookups by name; the results must be the same.
+int Batch(const Options& opts) {
+    Options big = opts;
+    big.users = opts.users > 10000u ? opts.users : 10000u;
+    wusers_impl::StandIn& directory = Directory(big);
+
+    const std::size_t count = 10000u;
+    std::mt19937 rng(opts.seed);
+    std::uniform_int_distribution<std::size_t> pick(0u, big.users + big.users / 20u);
+    std::vector<uid_t> uids(count);
+    std::vector<std::string> names(count);
+    std::vector<const char*> name_ptrs(count);
+    for(std::size_t i = 0; i < count; ++i) {
+        uids[i] = 1000u + pick(rng); // one in twenty is past the last user
+        char name[32];
+        std::snprintf(name, sizeof(name), "USER%06zu", static_cast<std::size_t>(uids[i] - 1000u));
+        names[i] = name;
+        name_ptrs[i] = names[i].c_str();
+    }
+
+    int failed = 0;
+    std::vector<std::string> single(count);
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+    auto start = Clock::now();
+    for(std::size_t i = 0; i < count; ++i) {
+        char buf[1024];
+        struct passwd pwd, *pwd_ptr = nullptr;
+        getpwuid_r(uids[i], &pwd, buf, sizeof(buf), &pwd_ptr);
+        single[i] = pwd_ptr ? pwd.pw_name : "";
+    }
+    const double single_seconds = Seconds(start);
+    const auto single_calls = directory.counts();
+
+    std::vector<struct passwd> pwds(count);
+    std::vector<struct passwd*> pwd_ptrs(count);
+    std::vector<char> buf(count * 16u); // too small: ERANGE, then retried from the cache
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+    start = Clock::now();
+    int status;
+    std::size_t retries = 0u;
+    while(ERANGE == (status = wuser_getpwuid_batch(uids.data(), count, pwds.data(), buf.data(), buf.size(), pwd_ptrs.data()))) {
+        buf.resize(buf.size() * 4u);
+        ++retries;
+    }
+    const double batch_seconds = Seconds(start);
+    const auto batch_calls = directory.counts();
+    failed |= status || batch_calls.user_get_info || batch_calls.user_enum != single_calls.user_enum;
+    for(std::size_t i = 0; i < count; ++i) {
+        failed |= single[i] != (pwd_ptrs[i] ? pwd_ptrs[i]->pw_name : "");
+    }
+
+    // the other entry points, cold
+    std::vector<const char*> out_names(count);
+    std::vector<char> name_buf(count * 16u);
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+    failed |= wuser_user_from_uid_batch(uids.data(), count, 0, name_buf.data(), name_buf.size(), out_names.data());
+    for(std::size_t i = 0; i < count; ++i) {
+        const std::string want = single[i].empty() ? std::to_string(uids[i]) : single[i];
+        failed |= !out_names[i] || want != out_names[i];
+    }
+    std::vector<uid_t> out_uids(count);
+    failed |= wuser_uid_from_user_batch(name_ptrs.data(), count, out_uids.data());
+    for(std::size_t i = 0; i < count; ++i) {
+        failed |= out_uids[i] != (single[i].empty() ? static_cast<uid_t>(-1) : uids[i]);
+    }
+    const auto other_calls = directory.counts();
+    failed |= other_calls.user_get_info || other_calls.user_enum > 2u * batch_calls.user_enum;
+
+    gid_t gids[] = {1000u + static_cast<gid_t>(big.users), 1u, 513u};
+    const char* group_names[3];
+    gid_t out_gids[3];
+    failed |= wuser_group_from_gid_batch(gids, 3u, 1, name_buf.data(), name_buf.size(), group_names);
+    failed |= !group_names[0] || std::strcmp(group_names[0], "group000000") || group_names[1] || !group_names[2];
+    failed |= wuser_gid_from_group_batch(group_names, 1u, out_gids) || out_gids[0] != gids[0];
+    struct group grps[2], *grp_ptrs[2];
+    failed |= wuser_getgrgid_batch(gids, 2u, grps, name_buf.data(), name_buf.size(), grp_ptrs); // 513 is everyone
+    failed |= !grp_ptrs[0] || !grp_ptrs[0]->gr_mem[0] || grp_ptrs[1];
+
+    Record("batch")("users", big.users)("keys", count)
+                   ("single_seconds", single_seconds)("single_directory_calls", single_calls.directory())
+                   ("batch_seconds", batch_seconds)("batch_directory_calls", batch_calls.directory())
+                   ("batch_buffer_bytes", buf.size())("batch_retries", retries);
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,162 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace bench {
+
+int SharedCache(const Options& opts); // cache.cpp
+int RidIndex(const Options& opts);    // index.cpp
+int NameIndex(const Options& opts);   // names.cpp
+int Snapshot(const Options& opts);    // snapshot.cpp
+int PwFile(const Options& opts);      // pwfile.cpp
+int Arena(const Options& opts);       // arena.cpp
+int PwCache(const Options& opts);     // pwcache.cpp
+int Batch(const Options& opts);       // batch.cpp
+int GroupList(const Options& opts);   // grouplist.cpp
+int Prefetch(const Options& opts);    // prefetch.cpp
+int ReadAhead(const Options& opts);   // readahead.cpp
+int PageSize(const Options& opts);    // pagesize.cpp
+int Stats(const Options& opts);       // stats.cpp
+int EntryPoints(const Options& opts); // entrypoints.cpp
+int Transcode(const Options& opts);   // transcode.cpp
+int Records(const Options& opts);     // records.cpp
+int Host(const Options& opts);        // host.cpp
+int Whoami(const Options& opts);      // whoami.cpp
+int Fields(const Options& opts);      // fields.cpp
+int Negative(const Options& opts);    // negative.cpp
+int RcuScaling(const Options& opts);  // scaling.cpp
+int Refresh(const Options& opts);     // refresh.cpp
+int Cursor(const Options& opts);      // cursor.cpp
+int Range(const Options& opts);       // range.cpp
+
+} // namespace bench
+
+namespace {
+
+struct Entry {
+    const char* name;
+    bench::Scenario run;
+    const char* what;
+};
+
+const Entry SCENARIOS[] = {
+    {"shared_cache", &bench::SharedCache, "backend calls vs. thread count for the same lookups (must stay flat)"},
+    {"rid_index", &bench::RidIndex, "getpwuid across directory sizes: one enumeration, then O(1) per lookup"},
+    {"name_index", &bench::NameIndex, "name lookups in mixed case: one backend call per account, hit after that"},
+    {"snapshot", &bench::Snapshot, "first lookup in a cold process, live vs. from a mapped snapshot"},
+    {"pwfile", &bench::PwFile, "passwd(5) parser throughput on a generated file of users*1000 lines"},
+    {"arena", &bench::Arena, "heap allocations per record returned in thread-owned memory"},
+    {"pwcache", &bench::PwCache, "user_from_uid/group_from_gid over a Zipf-distributed stream of ids"},
+    {"batch", &bench::Batch, "10k cold getpwuid_r calls vs. one wuser_getpwuid_batch call"},
+    {"grouplist", &bench::GroupList, "groups of a user at 50k users/5k groups: getgrent scan vs. getgrouplist"},
+    {"prefetch", &bench::Prefetch, "getgrent wall time vs. member prefetch workers, with injected latency"},
+    {"readahead", &bench::ReadAhead, "getpwent throughput with and without page read-ahead, with injected latency"},
+    {"pagesize", &bench::PageSize, "enumeration round trips across directory sizes, fixed vs. adaptive page size"},
+    {"stats", &bench::Stats, "wuser_stats_snapshot() vs. the stand-in's own counts, and the cost of counting"},
+    {"entrypoints", &bench::EntryPoints, "ns per call of every public lookup, pw_dup and the string conversions"},
+    {"transcode", &bench::Transcode, "UTF-8 from/to wide strings, ASCII/Latin/CJK/emoji names: vectorized vs. scalar"},
+    {"records", &bench::Records, "ns per reentrant lookup of a cached record, pw_dup and gr_dup; exact buffer sizes"},
+    {"host", &bench::Host, "host calls behind pw_dir/pw_shell: once per generation, one listing per getpwent pass"},
+    {"whoami", &bench::Whoami, "ns per get[e]{u|g}id(): token and memo vs. a directory lookup per call"},
+    {"fields", &bench::Fields, "NetUserGetInfo bytes and ns per field-selective lookup vs. a full record"},
+    {"negative", &bench::Negative, "directory calls for owners that don't exist, with and without the negative cache"},
+    {"rcu", &bench::RcuScaling, "warm reentrant lookups/s from 1 to --threads threads, lock-free from published tables"},
+    {"refresh", &bench::Refresh, "refresh passes over a changing stand-in: the change feed and what the cache drops"},
+    {"cursor", &bench::Cursor, "100k-user enumeration: getpwent vs. getpwent_r vs. caller-owned cursors, N per call"},
+    {"range", &bench::Range, "100k-user scan of one field: getpwent vs. wusers::users() with lazily transcoded views"},
+};
+
+bool Parse(const char* arg, bench::Options& opts) {
+    const char* eq = std::strchr(arg, '=');
+    if(std::strncmp(arg, "--", 2) || !eq) {
+        return false;
+    }
+    const std::string key(arg + 2, eq);
+    unsigned long value = std::strtoul(eq + 1, nullptr, 10);
+    if(key == "users") opts.users = value;
+    else if(key == "groups") opts.groups = value;
+    else if(key == "fanout") opts.fanout = value;
+    else if(key == "name-len") opts.name_len = value;
+    else if(key == "non-ascii" && value <= 100u) opts.non_ascii = value;
+    else if(key == "threads") opts.threads = value;
+    else if(key == "keys") opts.keys = value;
+    else if(key == "rounds") opts.rounds = value;
+    else if(key == "latency-us") opts.latency_us = value;
+    else if(key == "seed") opts.seed = value;
+    else return false;
+    return true;
+}
+
+int Usage() {
+    std::fprintf(stderr, "Usage: wusers_bench [--users=N] [--groups=N] [--fanout=N] [--name-len=N] [--non-ascii=PERCENT]\n"
+                         "                    [--threads=N] [--keys=N] [--rounds=N] [--latency-us=N] [--seed=N] [scenario...]\n\n"
+                         "Runs all scenarios if none is named. Results are printed as JSON lines.\n\n");
+    for(const Entry& entry : SCENARIOS) {
+        std::fprintf(stderr, "    %-16s %s\n", entry.name, entry.what);
+    }
+    return 2;
+}
+
+} // anonymous
+
+namespace bench {
+
+wusers_impl::StandIn& Directory(const Options& opts) {
+    static wusers_impl::StandIn standin;
+    wusers_impl::StandIn::Shape shape;
+    shape.users = opts.users;
+    shape.groups = opts.groups;
+    shape.fanout = opts.fanout;
+    shape.name_len = opts.name_len;
+    shape.non_ascii = opts.non_ascii;
+    shape.latency = std::chrono::microseconds(opts.latency_us);
+    shape.seed = opts.seed;
+    standin.Populate(shape);
+    standin.ResetCounts();
+    wusers_impl::set_backend(&standin);
+    return standin;
+}
+
+} // namespace bench
+
+int main(int argc, char** argv) {
+    bench::Options opts;
+    std::vector<const Entry*> chosen;
+    for(int argi = 1; argi < argc; ++argi) {
+        if(!std::strncmp(argv[argi], "--", 2)) {
+            if(!Parse(argv[argi], opts)) {
+                return Usage();
+            }
+            continue;
+        }
+        const Entry* found = nullptr;
+        for(const Entry& entry : SCENARIOS) {
+            if(!std::strcmp(entry.name, argv[argi])) found = &entry;
+        }
+        if(!found) {
+            return Usage();
+        }
+        chosen.push_back(found);
+    }
+    if(chosen.empty()) {
+        for(const Entry& entry : SCENARIOS) chosen.push_back(&entry);
+    }
+
+    int status = 0;
+    for(const Entry* entry : chosen) {
+        if(int failed = entry->run(opts)) {
+            std::fprintf(stderr, "%s: self-check failed\n", entry->name);
+            status = failed;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,82 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include "standin.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace bench {
+
+// command line knobs shared by all scenarios; a scenario is free to ignore any of them
+struct Options {
+    std::size_t users = 1000u;
+    std::size_t groups = 100u;
+    std::size_t fanout = 8u;
+    std::size_t name_len = 0u;   // see StandIn::Shape
+    unsigned int non_ascii = 0u; // percent
+    std::size_t threads = 64u;   // upper bound for scaling scenarios
+    std::size_t keys = 64u;      // distinct lookup keys
+    std::size_t rounds = 10000u; // lookups per measurement
+    long latency_us = 0;
+    unsigned int seed = 1u;
+};
+
+// scenarios return a process exit code: nonzero means a self-check failed
+using Scenario = int (*)(const Options&);
+
+// the process-wide stand-in, (re)populated according to `opts` and installed as the backend
+wusers_impl::StandIn& Directory(const Options& opts);
+
+using Clock = std::chrono::steady_clock;
+
+inline double Seconds(Clock::time_point since) {
+    return std::chrono::duration<double>(Clock::now() - since).count();
+}
+
+// one JSON object per line, printed when the record goes out of scope:
+//   Record("scenario")("threads", 8)("calls", 123);
+class Record {
+public:
+    explicit Record(const char* scenario) : line("{\"scenario\":\"") {
+        line.append(scenario).append("\"");
+    }
+
+    Record& operator()(const char* key, double value) {
+        char num[32];
+        std::snprintf(num, sizeof(num), "%.9g", value);
+        return field(key).append(num), *this;
+    }
+
+    Record& operator()(const char* key, unsigned long value) {
+        return field(key).append(std::to_string(value)), *this;
+    }
+
+    Record& operator()(const char* key, const char* value) {
+        return field(key).append("\"").append(value).append("\""), *this;
+    }
+
+    ~Record() {
+        std::fprintf(stdout, "%s}\n", line.c_str());
+        std::fflush(stdout);
+    }
+
+private:
+    std::string& field(const char* key) {
+        return line.append(",\"").append(key).append("\":");
+    }
+
+    std::string line;
+};
+
+} // namespace bench
+
+#endif /* !_BENCH_H_ */
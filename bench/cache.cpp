@@ -0,0 +1,88 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// the mix an ls -l / ps style worker would run: ids first, then names, reentrant and not
+void Lookups(const std::vector<uid_t>& uids, const std::vector<gid_t>& gids) {
+    char buf[4096];
+    for(uid_t uid : uids) {
+        struct passwd* pwd = getpwuid(uid);
+        const std::string name = pwd ? pwd->pw_name : "";
+        struct passwd out_pwd, *out_ptr;
+        getpwuid_r(uid, &out_pwd, buf, sizeof(buf), &out_ptr);
+        getpwnam(name.c_str());
+        getpwnam_r(name.c_str(), &out_pwd, buf, sizeof(buf), &out_ptr);
+        uid_t dupl_uid;
+        uid_from_user(name.c_str(), &dupl_uid);
+        user_from_uid(uid, 0);
+    }
+    for(gid_t gid : gids) {
+        struct group* grp = getgrgid(gid);
+        const std::string name = grp ? grp->gr_name : "";
+        struct group out_grp, *out_ptr;
+        getgrgid_r(gid, &out_grp, buf, sizeof(buf), &out_ptr);
+        getgrnam(name.c_str());
+        getgrnam_r(name.c_str(), &out_grp, buf, sizeof(buf), &out_ptr);
+        gid_t dupl_gid;
+        gid_from_group(name.c_str(), &dupl_gid);
+        group_from_gid(gid, 0);
+    }
+}
+
+} // anonymous
+
+namespace bench {
+
+// Every thread resolves the same keys. With a per-thread cache, backend calls grew
+// linearly with the thread count; with the shared one they must not grow at all.
+int SharedCache(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    std::vector<uid_t> uids;
+    std::vector<gid_t> gids;
+    for(std::size_t i = 0; i < opts.keys; ++i) {
+        uids.push_back(1000u + (i * opts.users) / opts.keys);
+        if(i < opts.groups) gids.push_back(1000u + opts.users + i);
+    }
+
+    int failed = 0;
+    unsigned long baseline = 0u;
+    for(std::size_t threads = 1u; threads <= opts.threads; threads <<= 1) {
+        wuser_cache_invalidate();
+        directory.ResetCounts();
+        const auto start = Clock::now();
+        std::vector<std::thread> pool;
+        for(std::size_t t = 0; t < threads; ++t) {
+            pool.emplace_back(&Lookups, std::cref(uids), std::cref(gids));
+        }
+        for(auto& thread : pool) {
+            thread.join();
+        }
+        const double elapsed = Seconds(start);
+        const unsigned long calls = directory.counts().directory();
+        Record("shared_cache")("threads", threads)("keys", uids.size() + gids.size())
+                              ("backend_calls", calls)("seconds", elapsed);
+        if(threads == 1u) {
+            baseline = calls;
+        } else if(calls > baseline) { // fewer is fine: later passes page with learned sizes
+            failed = 1;
+        }
+    }
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,257 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "grp.h"
+#include "pwd.h"
+#include "wusers/wuser_cursor.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Pass {
+    std::size_t records;
+    std::size_t digest;
+    double seconds;
+};
+
+void Add(Pass& pass, const struct passwd& pwd) {
+    ++pass.records;
+    pass.digest = pass.digest * 31u + std::hash<std::string>()(pwd.pw_name) + pwd.pw_uid;
+    pass.digest = pass.digest * 31u + std::hash<std::string>()(pwd.pw_dir ? pwd.pw_dir : "");
+}
+
+void Add(Pass& pass, const struct group& grp) {
+    ++pass.records;
+    pass.digest = pass.digest * 31u + std::hash<std::string>()(grp.gr_name) + grp.gr_gid;
+    for(char** member = grp.gr_mem; member && *member; ++member) {
+        pass.digest = pass.digest * 31u + std::hash<std::string>()(*member);
+    }
+}
+
+Pass GetPwEnt() {
+    Pass pass = {0u, 0u, 0.0};
+    const auto start = bench::Clock::now();
+    setpwent();
+    while(const struct passwd* pwd = getpwent()) {
+        Add(pass, *pwd);
+    }
+    endpwent();
+    pass.seconds = bench::Seconds(start);
+    return pass;
+}
+
+Pass GetPwEntR(std::size_t buf_len) {
+    Pass pass = {0u, 0u, 0.0};
+    std::vector<char> buf(buf_len);
+    const auto start = bench::Clock::now();
+    setpwent();
+    struct passwd pwd;
+    struct passwd* out = nullptr;
+    while(!getpwent_r(&pwd, buf.data(), buf.size(), &out)) {
+        Add(pass, *out);
+    }
+    endpwent();
+    pass.seconds = bench::Seconds(start);
+    return pass;
+}
+
+// `batch` records per call into `buf_len` bytes, to the end or `at_most` records;
+// records is -1 if the cursor fails before either
+Pass Drain(struct wuser_pwcursor* cursor, std::size_t batch, std::size_t buf_len, std::size_t at_most = -1) {
+    Pass pass = {0u, 0u, 0.0};
+    std::vector<struct passwd> pwds(batch);
+    std::vector<char> buf(buf_len);
+    std::size_t count = 0u;
+    int err;
+    const auto start = bench::Clock::now();
+    while(pass.records < at_most && !(err = wuser_pwcursor_next(cursor, pwds.data(), std::min(batch, at_most - pass.records),
+                                                                buf.data(), buf.size(), &count))) {
+        for(std::size_t i = 0; i < count; ++i) {
+            Add(pass, pwds[i]);
+        }
+    }
+    pass.seconds = bench::Seconds(start);
+    if(pass.records < at_most && ENOENT != err) {
+        pass.records = -1;
+    }
+    return pass;
+}
+
+// open to close, as GetPwEnt() times setpwent() to endpwent()
+Pass Batched(std::size_t batch, std::size_t buf_len) {
+    const auto start = bench::Clock::now();
+    struct wuser_pwcursor* cursor = wuser_pwcursor_open();
+    if(!cursor) {
+        return {static_cast<std::size_t>(-1), 0u, 0.0};
+    }
+    Pass pass = Drain(cursor, batch, buf_len);
+    wuser_pwcursor_close(cursor);
+    pass.seconds = bench::Seconds(start);
+    return pass;
+}
+
+// a cursor taken over by another thread halfway, with the calling thread's own getpwent()
+// enumeration interleaved with it; both must come out whole
+int Handover(std::size_t half, const Pass& whole) {
+    struct wuser_pwcursor* cursor = wuser_pwcursor_open();
+    if(!cursor) {
+        return 1;
+    }
+    int failed = 0;
+    Pass first = {0u, 0u, 0.0};
+    Pass inner = {0u, 0u, 0.0};
+    std::vector<struct passwd> pwds(16u);
+    char buf[4096];
+    std::size_t count = 0u;
+    setpwent();
+    while(first.records < half && !wuser_pwcursor_next(cursor, pwds.data(), 16u, buf, sizeof(buf), &count)) {
+        for(std::size_t i = 0; i < count; ++i) {
+            Add(first, pwds[i]);
+        }
+        const struct passwd* pwd = getpwent();
+        failed |= !pwd;
+        if(pwd) Add(inner, *pwd);
+    }
+    Pass second = {0u, 0u, 0.0};
+    std::thread([&]() { second = Drain(cursor, 64u, 16384u); }).join();
+    while(const struct passwd* pwd = getpwent()) {
+        Add(inner, *pwd);
+    }
+    endpwent();
+    wuser_pwcursor_close(cursor);
+    failed |= inner.records != whole.records || inner.digest != whole.digest;
+    failed |= first.records + second.records != whole.records;
+    // the digest is a polynomial over the sequence: carry `first` over `second`
+    std::size_t carried = first.digest;
+    for(std::size_t i = 0; i < 2u * second.records; ++i) carried *= 31u;
+    failed |= carried + second.digest != whole.digest;
+    return failed;
+}
+
+// a buffer too small for even one record: ERANGE, and nothing is skipped; one that takes
+// only a few: a short batch, and the rest comes next
+int Sizes(const Pass& whole) {
+    int failed = 0;
+    struct wuser_pwcursor* cursor = wuser_pwcursor_open();
+    if(!cursor) {
+        return 1;
+    }
+    struct passwd pwds[64];
+    char tiny[4];
+    std::size_t count = 1u;
+    failed |= ERANGE != wuser_pwcursor_next(cursor, pwds, 64u, tiny, sizeof(tiny), &count) || count;
+    char some[160];
+    failed |= wuser_pwcursor_next(cursor, pwds, 64u, some, sizeof(some), &count) || !count || count >= 64u;
+    failed |= count && std::strcmp(pwds[0].pw_name, "Administrator");
+    Pass pass = {0u, 0u, 0.0};
+    for(std::size_t i = 0; i < count; ++i) {
+        Add(pass, pwds[i]);
+    }
+    while(!wuser_pwcursor_next(cursor, pwds, 64u, some, sizeof(some), &count)) {
+        for(std::size_t i = 0; i < count; ++i) {
+            Add(pass, pwds[i]);
+        }
+    }
+    failed |= ENOENT != errno;
+    wuser_pwcursor_close(cursor);
+    failed |= pass.records != whole.records || pass.digest != whole.digest;
+
+    struct passwd pwd;
+    struct passwd* out = &pwd;
+    setpwent();
+    failed |= ERANGE != getpwent_r(&pwd, tiny, sizeof(tiny), &out) || out;
+    failed |= getpwent_r(&pwd, some, sizeof(some), &out) || out != &pwd;
+    failed |= out && std::strcmp(out->pw_name, "Administrator");
+    endpwent();
+    return failed;
+}
+
+// "None" has every user in it: the buffer must take 100k member names
+int Groups() {
+    Pass classic = {0u, 0u, 0.0};
+    setgrent();
+    while(const struct group* grp = getgrent()) {
+        Add(classic, *grp);
+    }
+    endgrent();
+
+    Pass reentrant = {0u, 0u, 0.0};
+    std::vector<char> buf(std::size_t(1u) << 22);
+    struct group grp;
+    struct group* out = nullptr;
+    setgrent();
+    while(!getgrent_r(&grp, buf.data(), buf.size(), &out)) {
+        Add(reentrant, *out);
+    }
+    endgrent();
+
+    Pass batched = {0u, 0u, 0.0};
+    struct wuser_grcursor* cursor = wuser_grcursor_open();
+    if(!cursor) {
+        return 1;
+    }
+    struct group grps[16];
+    std::size_t count = 0u;
+    while(!wuser_grcursor_next(cursor, grps, 16u, buf.data(), buf.size(), &count)) {
+        for(std::size_t i = 0; i < count; ++i) {
+            Add(batched, grps[i]);
+        }
+    }
+    wuser_grcursor_close(cursor);
+    return !classic.records || reentrant.records != classic.records || reentrant.digest != classic.digest
+        || batched.records != classic.records || batched.digest != classic.digest;
+}
+
+} // anonymous
+
+namespace bench {
+
+// Enumeration of 100k+ users: getpwent(), getpwent_r() and caller-owned cursors that fill
+// 1, 16 and 256 records per call. All of them must return the same records in the same
+// order; a cursor must survive an interleaved getpwent() and a move to another thread,
+// and a buffer that's too small must leave the record for the next call. Groups likewise.
+int Cursor(const Options& opts) {
+    Options big = opts;
+    big.users = std::max<std::size_t>(opts.users, 100000u);
+    Directory(big);
+    int failed = 0;
+
+    GetPwEnt(); // page sizes settle, host facts are listed
+    const Pass classic = GetPwEnt();
+    const Pass reentrant = GetPwEntR(1024u);
+    const Pass single = Batched(1u, 1024u);
+    const Pass batch16 = Batched(16u, 16u * 256u);
+    const Pass batch256 = Batched(256u, 256u * 256u);
+    failed |= classic.records != big.users + 2u; // + Administrator, Guest
+    for(const Pass* pass : {&reentrant, &single, &batch16, &batch256}) {
+        failed |= pass->records != classic.records || pass->digest != classic.digest;
+    }
+    failed |= Handover(classic.records / 2u, classic);
+    failed |= Sizes(classic);
+    failed |= Groups();
+
+    Record("cursor")("users", classic.records)
+                    ("getpwent_records_per_s", classic.records / classic.seconds)
+                    ("getpwent_r_records_per_s", reentrant.records / reentrant.seconds)
+                    ("cursor1_records_per_s", single.records / single.seconds)
+                    ("cursor16_records_per_s", batch16.records / batch16.seconds)
+                    ("cursor256_records_per_s", batch256.records / batch256.seconds)
+                    ("speedup_256_vs_getpwent", classic.seconds / batch256.seconds);
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,301 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wus.h"
+#include "wusers/wuser_cache.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// what the lookups ask for: up to `keys` ordinary accounts, evenly spread over the directory
+struct Keys {
+    std::vector<std::string> names;
+    std::vector<unsigned int> ids;
+    std::size_t all = 0u; // records getpwent()/getgrent() return, built-in ones included
+};
+
+void Thin(Keys& keys, std::size_t at_most) {
+    const std::size_t have = keys.ids.size();
+    if(have <= at_most || !at_most) return;
+    Keys kept;
+    for(std::size_t k = 0; k < at_most; ++k) {
+        kept.names.push_back(keys.names[k * have / at_most]);
+        kept.ids.push_back(keys.ids[k * have / at_most]);
+    }
+    keys.names.swap(kept.names);
+    keys.ids.swap(kept.ids);
+}
+
+Keys UserKeys(std::size_t at_most) {
+    Keys keys;
+    setpwent();
+    while(struct passwd* pwd = getpwent()) {
+        ++keys.all;
+        if(pwd->pw_uid >= 1000u) {
+            keys.names.emplace_back(pwd->pw_name);
+            keys.ids.push_back(pwd->pw_uid);
+        }
+    }
+    endpwent();
+    Thin(keys, at_most);
+    return keys;
+}
+
+Keys GroupKeys(std::size_t at_most) {
+    Keys keys;
+    setgrent();
+    while(struct group* grp = getgrent()) {
+        ++keys.all;
+        if(grp->gr_gid >= 1000u) {
+            keys.names.emplace_back(grp->gr_name);
+            keys.ids.push_back(grp->gr_gid);
+        }
+    }
+    endgrent();
+    Thin(keys, at_most);
+    return keys;
+}
+
+struct Timing {
+    double cold_ns;   // per call, over the first pass right after wuser_cache_invalidate()
+    double warm_ns;   // per call, over `rounds` calls after that
+    unsigned long cold_calls; // directory calls made by the first pass
+    unsigned long warm_calls;
+};
+
+// `call(i)` for i below `n` once cold, then `rounds` times round robin; false if a call fails
+template<typename F>
+bool Time(wusers_impl::StandIn& directory, std::size_t n, std::size_t rounds, Timing& out, F call) {
+    bool ok = true;
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+    auto start = bench::Clock::now();
+    for(std::size_t i = 0; i < n; ++i) {
+        ok &= call(i);
+    }
+    out.cold_ns = bench::Seconds(start) * 1e9 / n;
+    out.cold_calls = directory.counts().directory();
+
+    directory.ResetCounts();
+    start = bench::Clock::now();
+    for(std::size_t r = 0; r < rounds; ++r) {
+        ok &= call(r % n);
+    }
+    out.warm_ns = bench::Seconds(start) * 1e9 / rounds;
+    out.warm_calls = directory.counts().directory();
+    return ok;
+}
+
+void Report(const bench::Options& opts, const char* entry, const Timing& timing, double bytes_per_call = 0.0) {
+    bench::Record record("entrypoints");
+    record("entry", entry)("users", static_cast<unsigned long>(opts.users))
+          ("groups", static_cast<unsigned long>(opts.groups))("fanout", static_cast<unsigned long>(opts.fanout))
+          ("name_len", static_cast<unsigned long>(opts.name_len))("non_ascii", static_cast<unsigned long>(opts.non_ascii))
+          ("cold_ns", timing.cold_ns)("cold_backend_calls", timing.cold_calls)
+          ("warm_ns", timing.warm_ns)("warm_backend_calls", timing.warm_calls)
+          ("warm_calls_per_second", 1e9 / timing.warm_ns);
+    if(bytes_per_call) {
+        record("warm_mb_per_second", bytes_per_call * 1e3 / timing.warm_ns);
+    }
+}
+
+} // anonymous
+
+namespace bench {
+
+// Every public lookup, pw_dup() and the string conversions underneath them, each timed on
+// its own: once cold, right after wuser_cache_invalidate(), and then warm, against
+// whatever directory shape the command line asks for (--name-len and --non-ascii included).
+// Checks that every call finds what it was asked for.
+int EntryPoints(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    wuser_cache_invalidate();
+    const Keys users = UserKeys(opts.keys);
+    const Keys groups = GroupKeys(opts.keys);
+    if(users.ids.empty() || groups.ids.empty()) {
+        return 1;
+    }
+    const std::size_t rounds = opts.rounds;
+    const std::size_t nu = users.ids.size();
+    const std::size_t ng = groups.ids.size();
+    int failed = 0;
+    Timing timing;
+
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        struct passwd* pwd = getpwuid(users.ids[i]);
+        return pwd && users.names[i] == pwd->pw_name;
+    });
+    Report(opts, "getpwuid", timing);
+
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        struct passwd* pwd = getpwnam(users.names[i].c_str());
+        return pwd && pwd->pw_uid == users.ids[i];
+    });
+    Report(opts, "getpwnam", timing);
+
+    std::vector<char> buf(1u << 16);
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        struct passwd pwd, *pwd_ptr = nullptr;
+        return !getpwuid_r(users.ids[i], &pwd, buf.data(), buf.size(), &pwd_ptr) && pwd_ptr
+            && users.names[i] == pwd.pw_name;
+    });
+    Report(opts, "getpwuid_r", timing);
+
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        struct passwd pwd, *pwd_ptr = nullptr;
+        return !getpwnam_r(users.names[i].c_str(), &pwd, buf.data(), buf.size(), &pwd_ptr) && pwd_ptr
+            && pwd.pw_uid == users.ids[i];
+    });
+    Report(opts, "getpwnam_r", timing);
+
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        uid_t uid = 0u;
+        return !uid_from_user(users.names[i].c_str(), &uid) && uid == users.ids[i];
+    });
+    Report(opts, "uid_from_user", timing);
+
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        const char* name = user_from_uid(users.ids[i], 1);
+        return name && users.names[i] == name;
+    });
+    Report(opts, "user_from_uid", timing);
+
+    // per record; a pass is a whole enumeration
+    failed |= !Time(directory, users.all, rounds, timing, [](std::size_t i) {
+        if(!i) setpwent();
+        return !!getpwent();
+    });
+    endpwent();
+    Report(opts, "getpwent", timing);
+
+    failed |= !Time(directory, ng, rounds, timing, [&](std::size_t i) {
+        struct group* grp = getgrgid(groups.ids[i]);
+        return grp && groups.names[i] == grp->gr_name;
+    });
+    Report(opts, "getgrgid", timing);
+
+    failed |= !Time(directory, ng, rounds, timing, [&](std::size_t i) {
+        struct group* grp = getgrnam(groups.names[i].c_str());
+        return grp && grp->gr_gid == groups.ids[i];
+    });
+    Report(opts, "getgrnam", timing);
+
+    failed |= !Time(directory, ng, rounds, timing, [&](std::size_t i) {
+        struct group grp, *grp_ptr = nullptr;
+        return !getgrgid_r(groups.ids[i], &grp, buf.data(), buf.size(), &grp_ptr) && grp_ptr
+            && groups.names[i] == grp.gr_name;
+    });
+    Report(opts, "getgrgid_r", timing);
+
+    failed |= !Time(directory, ng, rounds, timing, [&](std::size_t i) {
+        struct group grp, *grp_ptr = nullptr;
+        return !getgrnam_r(groups.names[i].c_str(), &grp, buf.data(), buf.size(), &grp_ptr) && grp_ptr
+            && grp.gr_gid == groups.ids[i];
+    });
+    Report(opts, "getgrnam_r", timing);
+
+    failed |= !Time(directory, ng, rounds, timing, [&](std::size_t i) {
+        gid_t gid = 0u;
+        return !gid_from_group(groups.names[i].c_str(), &gid) && gid == groups.ids[i];
+    });
+    Report(opts, "gid_from_group", timing);
+
+    failed |= !Time(directory, ng, rounds, timing, [&](std::size_t i) {
+        const char* name = group_from_gid(groups.ids[i], 1);
+        return name && groups.names[i] == name;
+    });
+    Report(opts, "group_from_gid", timing);
+
+    failed |= !Time(directory, groups.all, rounds, timing, [](std::size_t i) {
+        if(!i) setgrent();
+        return !!getgrent();
+    });
+    endgrent();
+    Report(opts, "getgrent", timing);
+
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        gid_t list[64];
+        int count = 64;
+        return getgrouplist(users.names[i].c_str(), 513u, list, &count) >= 0 && count >= 1;
+    });
+    Report(opts, "getgrouplist", timing);
+
+    // pw_dup() of records that are already at hand; the copies go straight back
+    std::vector<struct passwd*> held;
+    for(const std::string& name : users.names) {
+        struct passwd* pwd = getpwnam(name.c_str());
+        failed |= !pwd;
+        held.push_back(pwd ? pw_dup(pwd) : nullptr);
+    }
+    if(!failed) {
+        failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+            struct passwd* copy = pw_dup(held[i]);
+            const bool ok = copy && !std::strcmp(copy->pw_name, held[i]->pw_name);
+            std::free(copy);
+            return ok;
+        });
+        Report(opts, "pw_dup", timing);
+    }
+    for(struct passwd* pwd : held) {
+        std::free(pwd);
+    }
+
+    // the conversions, over the user names: narrow to wide and back, and case folding
+    std::vector<std::wstring> wide;
+    double bytes = 0.0;
+    for(const std::string& name : users.names) {
+        wide.push_back(wusers_impl::from_utf8(name.data(), name.size()));
+        failed |= wide.back().empty();
+        bytes += name.size();
+    }
+    bytes /= nu;
+
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        return wusers_impl::to_win_str(users.names[i].c_str()) == wide[i];
+    });
+    Report(opts, "to_win_str", timing, bytes);
+
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        return wusers_impl::from_utf8(users.names[i].data(), users.names[i].size()) == wide[i];
+    });
+    Report(opts, "from_utf8", timing, bytes);
+
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        return wusers_impl::fold_name(users.names[i].c_str()).size() == users.names[i].size();
+    });
+    Report(opts, "fold_name", timing, bytes);
+
+    wusers_impl::Arena arena;
+    const wusers_impl::ArenaWriter to_arena(arena);
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        arena.reset();
+        const char* out = to_arena(wide[i].c_str());
+        return out && users.names[i] == out;
+    });
+    Report(opts, "ArenaWriter", timing, bytes);
+
+    failed |= !Time(directory, nu, rounds, timing, [&](std::size_t i) {
+        char* out_buf = buf.data();
+        size_t buf_len = buf.size();
+        const wusers_impl::BufferWriter to_buffer(out_buf, buf_len);
+        const char* out = to_buffer(wide[i].c_str());
+        return out && users.names[i] == out;
+    });
+    Report(opts, "BufferWriter", timing, bytes);
+
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,141 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "wusers/wuser_cache.h"
+#include "wusers/wuser_fields.h"
+
+#include <errno.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct Expected {
+    std::string name;
+    uid_t uid;
+    std::string gecos;
+    std::string dir;
+    std::string shell;
+};
+
+bool Same(const char* actual, const std::string& expected, bool asked) {
+    return asked ? actual && expected == actual : !actual;
+}
+
+// what was asked for is what getpwnam() says; the rest is NULL or 0
+bool Check(const struct passwd& pwd, const Expected& exp, unsigned int fields) {
+    return Same(pwd.pw_name, exp.name, fields & WUSER_PW_NAME)
+        && Same(pwd.pw_gecos, exp.gecos, fields & WUSER_PW_GECOS)
+        && Same(pwd.pw_dir, exp.dir, fields & WUSER_PW_DIR)
+        && Same(pwd.pw_shell, exp.shell, fields & WUSER_PW_SHELL)
+        && pwd.pw_uid == ((fields & WUSER_PW_UID) ? exp.uid : 0u)
+        && (!pwd.pw_class == !(fields & WUSER_PW_CLASS));
+}
+
+struct Pass {
+    double ns;               // per lookup
+    unsigned long bytes;     // NetUserGetInfo payload per lookup
+    bool ok;
+};
+
+// cold lookups of every key by name, or by uid, for `fields` (by uid, that includes the RID index)
+Pass Run(wusers_impl::StandIn& directory, const std::vector<Expected>& keys, unsigned int fields, bool by_uid) {
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+    Pass pass = {0.0, 0u, true};
+    char buf[1024];
+    const auto start = bench::Clock::now();
+    for(const Expected& exp : keys) {
+        struct passwd pwd;
+        struct passwd* out = nullptr;
+        const int err = by_uid ? wuser_getpwuid_fields(exp.uid, fields, &pwd, buf, sizeof(buf), &out)
+                               : wuser_getpwnam_fields(exp.name.c_str(), fields, &pwd, buf, sizeof(buf), &out);
+        pass.ok &= !err && out == &pwd && Check(pwd, exp, fields);
+    }
+    pass.ns = bench::Seconds(start) * 1e9 / keys.size();
+    const auto counts = directory.counts();
+    pass.bytes = counts.user_info_bytes / keys.size();
+    return pass;
+}
+
+} // anonymous
+
+namespace bench {
+
+// wuser_getpw{nam|uid}_fields(): the NetUserGetInfo payload and the time per cold lookup
+// for a name, a uid and full name, and everything (which is getpwnam_r()). Also checks that
+// uid_from_user() and user_from_uid() don't ask for more than level 20 has.
+int Fields(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    wuser_cache_invalidate();
+    std::vector<Expected> keys;
+    for(uid_t uid = 1000u; uid < 1000u + opts.users && keys.size() < opts.keys; ++uid) {
+        struct passwd* pwd = getpwuid(uid);
+        if(!pwd) return 1;
+        keys.push_back({pwd->pw_name, pwd->pw_uid, pwd->pw_gecos, pwd->pw_dir, pwd->pw_shell});
+    }
+    if(keys.empty()) return 1;
+
+    int failed = 0;
+    unsigned long level3_bytes = 0u;
+    const struct { const char* name; unsigned int fields; } masks[] = {
+        {"name", WUSER_PW_NAME},
+        {"name_shell", WUSER_PW_NAME | WUSER_PW_SHELL},
+        {"uid_gecos", WUSER_PW_UID | WUSER_PW_GECOS},
+        {"dir", WUSER_PW_DIR},
+        {"all", WUSER_PW_ALL},
+    };
+    for(bool by_uid : {false, true}) {
+        unsigned long all_bytes = 0u;
+        std::vector<Pass> passes;
+        for(const auto& mask : masks) {
+            passes.push_back(Run(directory, keys, mask.fields, by_uid));
+            all_bytes = passes.back().bytes; // "all" is the last
+        }
+        level3_bytes = all_bytes;
+        for(std::size_t m = 0; m < passes.size(); ++m) {
+            const Pass& pass = passes[m];
+            const bool lean = !(masks[m].fields & ~(WUSER_PW_NAME | WUSER_PW_SHELL | WUSER_PW_UID | WUSER_PW_GECOS));
+            failed |= !pass.ok || !pass.bytes || (lean && pass.bytes >= all_bytes) || (!lean && pass.bytes != all_bytes);
+            Record("fields")("entry", by_uid ? "getpwuid_fields" : "getpwnam_fields")("fields", masks[m].name)
+                            ("lookups", static_cast<unsigned long>(keys.size()))("ns", pass.ns)
+                            ("bytes", pass.bytes)("bytes_all", all_bytes);
+        }
+    }
+
+    // too small a buffer, and nobody (which getpwuid_r() doesn't count as an error)
+    char tiny[4];
+    struct passwd pwd;
+    struct passwd* out = &pwd;
+    wuser_cache_invalidate();
+    failed |= ERANGE != wuser_getpwnam_fields(keys.front().name.c_str(), WUSER_PW_NAME, &pwd, tiny, sizeof(tiny), &out) || out;
+    out = &pwd;
+    failed |= ENOENT != wuser_getpwnam_fields("nobody", WUSER_PW_UID, &pwd, tiny, sizeof(tiny), &out) || out;
+    out = &pwd;
+    failed |= 0 != wuser_getpwuid_fields(999u, WUSER_PW_NAME, &pwd, tiny, sizeof(tiny), &out) || out;
+
+    // the pwcache pair needs no level 3 record
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+    for(const Expected& exp : keys) {
+        uid_t uid = -1;
+        const char* name = user_from_uid(exp.uid, 1);
+        failed |= uid_from_user(exp.name.c_str(), &uid) || uid != exp.uid || !name || exp.name != name;
+    }
+    const auto pwcache = directory.counts();
+    failed |= !pwcache.user_get_info || pwcache.user_info_bytes >= pwcache.user_get_info * level3_bytes;
+    Record("fields")("entry", "pwcache")("lookups", static_cast<unsigned long>(keys.size()))
+                    ("bytes", pwcache.user_info_bytes / pwcache.user_get_info)("bytes_all", level3_bytes);
+    return failed;
+}
+
+} // namespace bench
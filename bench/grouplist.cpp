@@ -0,0 +1,97 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+#include "wusers/wuser_eugid.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// `id`-style queries at scale (50k users, 5k groups unless asked for more): the groups
+// of one user the old way (getgrent() over everything, comparing members), then through
+// getgrouplist(), whose index costs one pass to build and no directory calls after that.
+int GroupList(const Options& opts) {
+    Options big = opts;
+    big.users = std::max<std::size_t>(opts.users, 50000u);
+    big.groups = std::max<std::size_t>(opts.groups, 5000u);
+    wusers_impl::StandIn& directory = Directory(big);
+    wuser_cache_invalidate();
+    int failed = 0;
+
+    std::mt19937 rng(opts.seed);
+    std::uniform_int_distribution<std::size_t> pick(0u, big.users - 1u);
+    char name[32];
+    std::snprintf(name, sizeof(name), "user%06zu", pick(rng));
+
+    // the only way there was: every group, every member
+    directory.ResetCounts();
+    auto start = Clock::now();
+    std::vector<gid_t> scanned;
+    setgrent();
+    while(const struct group* grp = getgrent()) {
+        for(char** mem = grp->gr_mem; *mem; ++mem) {
+            if(!strcmp(*mem, name)) scanned.push_back(grp->gr_gid);
+        }
+    }
+    endgrent();
+    const double scan_seconds = Seconds(start);
+    const auto scan_calls = directory.counts();
+
+    // the first getgrouplist() builds the index
+    directory.ResetCounts();
+    std::vector<gid_t> gids(64u);
+    int ngroups = gids.size();
+    start = Clock::now();
+    failed |= getgrouplist(name, 513u, gids.data(), &ngroups);
+    const double build_seconds = Seconds(start);
+    const auto build_calls = directory.counts();
+    gids.resize(ngroups);
+    std::vector<gid_t> indexed(gids.begin() + 1, gids.end()); // minus the primary group, which is a member anyway
+    std::sort(scanned.begin(), scanned.end());
+    scanned.erase(std::remove(scanned.begin(), scanned.end(), 513u), scanned.end());
+    std::sort(indexed.begin(), indexed.end());
+    failed |= scanned != indexed || gids.empty() || gids[0] != 513u;
+
+    // everyone else costs a hash lookup
+    directory.ResetCounts();
+    std::size_t memberships = 0u;
+    start = Clock::now();
+    for(std::size_t round = 0; round < opts.rounds; ++round) {
+        std::snprintf(name, sizeof(name), "user%06zu", pick(rng));
+        gid_t out[256];
+        int n = 256;
+        failed |= getgrouplist(name, 513u, out, &n);
+        memberships += n;
+    }
+    const double query_seconds = Seconds(start);
+    failed |= !!directory.counts().directory();
+
+    // too small: -1 and the real count; getgroups() sizes
+    int one = 1;
+    gid_t first;
+    failed |= getgrouplist(name, 513u, &first, &one) != -1 || one < 2 || first != 513u;
+    failed |= initgroups(name, 513u) || getgroups(0, nullptr) != one;
+    failed |= getgroups(1, &first) != -1;
+
+    Record("grouplist")("users", big.users)("groups", big.groups)("fanout", opts.fanout)
+                       ("getgrent_scan_seconds", scan_seconds)("getgrent_scan_directory_calls", scan_calls.directory())
+                       ("index_build_seconds", build_seconds)("index_build_directory_calls", build_calls.directory())
+                       ("getgrouplist_us", 1e6 * query_seconds / opts.rounds)
+                       ("groups_per_user", double(memberships) / opts.rounds);
+    return failed;
+}
+
+} // namespace bench
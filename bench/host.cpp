@@ -0,0 +1,141 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "wusers/wuser_cache.h"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr const char* SHELL = "C:\\Windows\\system32\\cmd.exe"; // what Populate() sets
+constexpr const char* PWSH = "C:\\Program Files\\PowerShell\\7\\pwsh.exe";
+
+struct Pass {
+    std::size_t users;
+    std::size_t homeless;     // accounts without a profile directory, as enumerated
+    bool dirs_ok;             // everyone has the pw_dir they should, and nobody else does
+    bool shells_ok;           // everyone has `shell`
+    wusers_impl::StandIn::Counts host;
+    double seconds;
+    std::vector<std::string> names;
+};
+
+bool Homeless(const char* name) {
+    return !std::strncmp(name, "nohome", 6);
+}
+
+bool DirOk(const struct passwd& pwd) {
+    const std::string expected = std::string("C:\\Users\\") + pwd.pw_name;
+    const bool has = pwd.pw_dir && *pwd.pw_dir;
+    return Homeless(pwd.pw_name) ? !has : has && expected == pwd.pw_dir;
+}
+
+Pass Enumerate(wusers_impl::StandIn& directory, const char* shell) {
+    Pass pass = {0u, 0u, true, true, {}, 0.0, {}};
+    directory.ResetCounts();
+    const auto start = bench::Clock::now();
+    setpwent();
+    while(struct passwd* pwd = getpwent()) {
+        ++pass.users;
+        pass.names.push_back(pwd->pw_name);
+        pass.homeless += Homeless(pwd->pw_name);
+        pass.dirs_ok &= DirOk(*pwd);
+        pass.shells_ok &= pwd->pw_shell && !std::strcmp(pwd->pw_shell, shell);
+    }
+    endpwent();
+    pass.seconds = bench::Seconds(start);
+    pass.host = directory.counts();
+    return pass;
+}
+
+unsigned long HostCalls(const wusers_impl::StandIn::Counts& counts) {
+    return counts.expand_environment + counts.file_attributes + counts.list_directories;
+}
+
+// what a record with no usri3_profile used to cost: %USERNAME%, %USERPROFILE% and %ComSpec%,
+// and a probe unless it's the logged on user's
+unsigned long Unmemoized(std::size_t records) {
+    return static_cast<unsigned long>(records ? 4u * records - 1u : 0u);
+}
+
+} // anonymous
+
+namespace bench {
+
+// Host calls behind pw_dir and pw_shell: %USERNAME%, %USERPROFILE% and %ComSpec% are read once
+// per cache generation, and an enumeration lists the profile directory once instead of probing
+// a path per account. A tenth of the accounts have no profile directory and must get no pw_dir.
+// Environment changes show only after wuser_cache_refresh_host().
+int Host(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    const std::size_t homeless = opts.users / 10u + 1u;
+    for(std::size_t i = 0; i < homeless; ++i) {
+        directory.AddUser({L"nohome" + std::to_wstring(i), L"", L"", static_cast<DWORD>(1000u + opts.users + opts.groups + i),
+                           513u, USER_PRIV_USER, TIMEQ_FOREVER, false});
+    }
+    wuser_cache_invalidate();
+    const std::size_t everyone = opts.users + 2u + homeless;
+
+    int failed = 0;
+    const Pass first = Enumerate(directory, SHELL);  // reads the environment
+    const Pass second = Enumerate(directory, SHELL); // only lists
+    for(const Pass* pass : {&first, &second}) {
+        failed |= pass->users != everyone || pass->homeless != homeless || !pass->dirs_ok || !pass->shells_ok;
+        failed |= pass->host.file_attributes || pass->host.list_directories != 1u;
+    }
+    failed |= first.host.expand_environment != 3u || second.host.expand_environment;
+
+    // lookups outside an enumeration: by what the last one listed, and by probing once the
+    // cache generation has moved on (one per account other than the logged on user's)
+    directory.ResetCounts();
+    for(const std::string& name : first.names) {
+        struct passwd* pwd = getpwnam(name.c_str());
+        failed |= !pwd || !DirOk(*pwd);
+    }
+    failed |= HostCalls(directory.counts()) != 0u;
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+    std::vector<std::string> keys(1u, "nohome0");
+    for(const std::string& name : first.names) {
+        if(keys.size() <= opts.keys && name.compare(0u, 4u, "user") == 0) keys.push_back(name);
+    }
+    const auto start = Clock::now();
+    for(const std::string& name : keys) {
+        struct passwd* pwd = getpwnam(name.c_str());
+        failed |= !pwd || !DirOk(*pwd);
+    }
+    const double lookup_seconds = Seconds(start);
+    const auto probed = directory.counts();
+    failed |= probed.expand_environment != 3u || probed.list_directories || probed.file_attributes != keys.size() - 1u;
+
+    // a new %ComSpec% is not seen until the hook is called
+    directory.SetEnv(L"ComSpec", L"C:\\Program Files\\PowerShell\\7\\pwsh.exe");
+    const Pass unseen = Enumerate(directory, SHELL);
+    wuser_cache_refresh_host();
+    const Pass seen = Enumerate(directory, PWSH);
+    failed |= !unseen.shells_ok || unseen.host.expand_environment;
+    failed |= !seen.shells_ok || !seen.dirs_ok || seen.host.expand_environment != 3u || seen.host.list_directories != 1u;
+    directory.SetEnv(L"ComSpec", L"C:\\Windows\\system32\\cmd.exe");
+    wuser_cache_refresh_host();
+
+    Record("host")("entry", "getpwent")("users", static_cast<unsigned long>(first.users))
+                  ("homeless", static_cast<unsigned long>(homeless))
+                  ("first_host_calls", HostCalls(first.host))("second_host_calls", HostCalls(second.host))
+                  ("host_calls_before", Unmemoized(first.users))
+                  ("first_seconds", first.seconds)("second_seconds", second.seconds);
+    Record("host")("entry", "getpwnam")("lookups", static_cast<unsigned long>(keys.size()))
+                  ("host_calls", HostCalls(probed))("host_calls_before", Unmemoized(keys.size()))
+                  ("seconds", lookup_seconds);
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,61 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "wusers/wuser_cache.h"
+
+#include <random>
+
+namespace bench {
+
+// Lookups by uid across directory sizes. The first one enumerates (and builds the RID
+// index); every later record cache miss must cost one NetUserGetInfo and no enumeration,
+// and a uid nobody has must cost no backend call at all, whatever the directory size.
+int RidIndex(const Options& opts) {
+    int failed = 0;
+    for(std::size_t users = 100u; users <= opts.users * 10u; users *= 10u) {
+        Options sized = opts;
+        sized.users = users;
+        wusers_impl::StandIn& directory = Directory(sized);
+        wuser_cache_invalidate();
+        directory.ResetCounts();
+
+        auto start = Clock::now();
+        getpwuid(1000u);
+        const double build = Seconds(start);
+        const unsigned long enums = directory.counts().user_enum;
+
+        std::mt19937 rng(opts.seed);
+        std::uniform_int_distribution<uid_t> pick(1000u, 1000u + users - 1u);
+        unsigned long misses = 0u, absent = 0u;
+        start = Clock::now();
+        for(std::size_t round = 0; round < opts.rounds; ++round) {
+            const uid_t uid = round % 8u ? pick(rng) : 1000u + users + round; // 1 in 8 doesn't exist
+            struct passwd* pwd = getpwuid(uid);
+            if(uid < 1000u + users) {
+                failed |= !pwd || pwd->pw_uid != uid;
+            } else {
+                failed |= !!pwd;
+                ++absent;
+            }
+            ++misses;
+        }
+        const double elapsed = Seconds(start);
+        const auto counts = directory.counts();
+        failed |= counts.user_enum != enums;                                // no rescans
+        failed |= counts.user_get_info > misses - absent;                   // at most one fetch per uid
+        Record("rid_index")("users", users)("build_seconds", build)("enum_calls", enums)
+                           ("lookups", misses)("absent", absent)
+                           ("get_info_calls", counts.user_get_info)
+                           ("ns_per_lookup", elapsed * 1e9 / misses);
+    }
+    return failed;
+}
+
+} // namespace bench
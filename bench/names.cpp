@@ -0,0 +1,94 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+
+#include <errno.h>
+
+#include <cctype>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string Spelling(const std::string& name, std::size_t variant) {
+    std::string spelled(name);
+    for(std::size_t i = 0; i < spelled.size(); ++i) {
+        if((variant >> (i % 8)) & 1u) spelled[i] = std::toupper(static_cast<unsigned char>(spelled[i]));
+    }
+    return spelled;
+}
+
+} // anonymous
+
+namespace bench {
+
+// A chown-style workload: the same few names, spelled every which way, through every
+// name-based entry point. Each account must cost one backend call the first time it's
+// seen under any spelling and none after that; unknown names must still miss, and are
+// asked about once.
+int NameIndex(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+
+    std::vector<std::string> users, groups;
+    for(std::size_t i = 0; i < opts.keys; ++i) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "user%06zu", (i * opts.users) / opts.keys);
+        users.push_back(name);
+        if(i < opts.groups) {
+            std::snprintf(name, sizeof(name), "group%06zu", i);
+            groups.push_back(name);
+        }
+    }
+
+    int failed = 0;
+    char buf[4096];
+    const auto start = Clock::now();
+    for(std::size_t round = 0; round < opts.rounds; ++round) {
+        const std::size_t k = round % opts.keys;
+        const uid_t want_uid = 1000u + (k * opts.users) / opts.keys;
+        const std::string user = Spelling(users[k], round / opts.keys);
+        struct passwd* pwd = getpwnam(user.c_str());
+        failed |= !pwd || pwd->pw_uid != want_uid || users[k] != pwd->pw_name; // canonical spelling
+        struct passwd out_pwd, *out_ptr = nullptr;
+        getpwnam_r(user.c_str(), &out_pwd, buf, sizeof(buf), &out_ptr);
+        failed |= !out_ptr || out_pwd.pw_uid != want_uid;
+        uid_t uid = 0;
+        failed |= uid_from_user(user.c_str(), &uid) || uid != want_uid;
+        if(k < groups.size()) {
+            const std::string group = Spelling(groups[k], round / opts.keys);
+            struct group out_grp, *out_grp_ptr = nullptr;
+            getgrnam_r(group.c_str(), &out_grp, buf, sizeof(buf), &out_grp_ptr);
+            failed |= !out_grp_ptr || out_grp.gr_gid != 1000u + opts.users + k;
+        }
+    }
+    const double elapsed = Seconds(start);
+    const auto hits = directory.counts();
+    // every account fetched once, whatever its spelling
+    failed |= hits.user_get_info != users.size();
+    failed |= hits.group_get_info != groups.size();
+
+    directory.ResetCounts();
+    for(std::size_t round = 0; round < opts.keys; ++round) {
+        failed |= !!getpwnam(Spelling("nobody-at-all", round).c_str()) || ENOENT != errno;
+    }
+    const unsigned long misses = directory.counts().user_get_info;
+    failed |= misses != 1u; // remembered as missing, under any spelling
+
+    Record("name_index")("rounds", opts.rounds)("keys", users.size() + groups.size())
+                        ("get_info_calls", hits.user_get_info + hits.group_get_info)
+                        ("miss_calls", misses)("ns_per_round", elapsed * 1e9 / opts.rounds);
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,132 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_batch.h"
+#include "wusers/wuser_cache.h"
+
+#include <errno.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t ROUNDS = 10u;
+constexpr unsigned int NEGATIVE_TTL = 20000u; // the default
+
+struct Orphans {
+    std::vector<std::string> names;
+    std::vector<const char*> c_names;
+    std::vector<uid_t> ids;
+};
+
+// what an archive listing does with each owner, on a thread of its own every round so that
+// the per-thread pwcache doesn't hide anything; true if nobody was found
+bool Round(const Orphans& orphans) {
+    bool ok = true;
+    std::thread([&]() {
+        for(std::size_t i = 0; i < orphans.ids.size(); ++i) {
+            ok &= !user_from_uid(orphans.ids[i], 1) && !group_from_gid(orphans.ids[i], 1);
+            ok &= !getpwuid(orphans.ids[i]) && !getgrgid(orphans.ids[i]);
+            ok &= !getpwnam(orphans.c_names[i]) && ENOENT == errno;
+            ok &= !getgrnam(orphans.c_names[i]) && ENOENT == errno;
+            uid_t uid;
+            ok &= uid_from_user(orphans.c_names[i], &uid) < 0;
+        }
+        std::vector<uid_t> uids(orphans.ids.size());
+        wuser_uid_from_user_batch(orphans.c_names.data(), uids.size(), uids.data());
+        for(uid_t uid : uids) ok &= static_cast<uid_t>(-1) == uid;
+    }).join();
+    return ok;
+}
+
+struct Pass {
+    unsigned long first;  // directory calls in the first round
+    unsigned long later;  // ...and in all the others
+    unsigned long scans;  // enumeration pages, all rounds
+    double seconds;
+    bool ok;
+};
+
+Pass Run(wusers_impl::StandIn& directory, const Orphans& orphans, unsigned int negative_ttl) {
+    wuser_cache_set_negative_ttl(negative_ttl);
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+    Pass pass = {0u, 0u, 0u, 0.0, true};
+    const auto start = bench::Clock::now();
+    for(std::size_t r = 0; r < ROUNDS; ++r) {
+        pass.ok &= Round(orphans);
+        if(!r) pass.first = directory.counts().directory();
+    }
+    pass.seconds = bench::Seconds(start);
+    const auto counts = directory.counts();
+    pass.later = counts.directory() - pass.first;
+    pass.scans = counts.user_enum + counts.group_enum;
+    return pass;
+}
+
+} // anonymous
+
+namespace bench {
+
+// Owners that don't exist (deleted, or from another domain): every kind of lookup by id and
+// by name, `keys` orphans, ten rounds. With the negative cache, the first round asks about
+// each once and the others not at all; without it (TTL 0), every name lookup goes to the
+// directory and every batch by name enumerates. Also checks that what's remembered missing
+// goes away on invalidation and on expiry.
+int Negative(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    Orphans orphans;
+    for(std::size_t i = 0; i < opts.keys; ++i) {
+        orphans.names.push_back("orphan" + std::to_string(i));
+        orphans.ids.push_back(static_cast<uid_t>(1000u + opts.users + opts.groups + 100000u + i));
+    }
+    for(const std::string& name : orphans.names) orphans.c_names.push_back(name.c_str());
+
+    int failed = 0;
+    const Pass with = Run(directory, orphans, NEGATIVE_TTL);
+    const Pass without = Run(directory, orphans, 0u);
+    failed |= !with.ok || !without.ok || with.later || !with.first || without.later <= with.later;
+
+    // remembered missing: not seen until invalidated (or enumerated past)
+    wuser_cache_set_negative_ttl(NEGATIVE_TTL);
+    wuser_cache_invalidate();
+    failed |= !!getpwnam("latecomer");
+    directory.AddUser({L"latecomer", L"", L"", static_cast<DWORD>(orphans.ids.back() + 1u), 513u,
+                       USER_PRIV_USER, TIMEQ_FOREVER, false});
+    failed |= !!getpwnam("latecomer");
+    wuser_cache_invalidate();
+    failed |= !getpwnam("latecomer");
+    directory.RemoveUser(L"latecomer");
+
+    // ...and for no longer than the TTL
+    wuser_cache_set_negative_ttl(1u);
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+    failed |= !!getpwnam(orphans.c_names[0]);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    failed |= !!getpwnam(orphans.c_names[0]);
+    failed |= directory.counts().user_get_info != 2u;
+    wuser_cache_set_negative_ttl(NEGATIVE_TTL);
+    wuser_cache_invalidate();
+
+    for(const Pass* pass : {&with, &without}) {
+        Record("negative")("negative_ttl_ms", static_cast<unsigned long>(pass == &with ? NEGATIVE_TTL : 0u))
+                          ("orphans", static_cast<unsigned long>(opts.keys))("rounds", static_cast<unsigned long>(ROUNDS))
+                          ("first_round_calls", pass->first)("later_round_calls", pass->later)
+                          ("enum_pages", pass->scans)("seconds", pass->seconds);
+    }
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,85 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+
+namespace {
+
+struct Pass {
+    std::size_t users;
+    std::size_t groups;
+    unsigned long user_pages;
+    unsigned long group_pages;
+    std::size_t user_bytes;  // the last page size asked for
+    std::size_t group_bytes;
+    double seconds;
+};
+
+Pass Enumerate(wusers_impl::StandIn& directory) {
+    Pass pass = {0u, 0u, 0u, 0u, 0u, 0u, 0.0};
+    directory.ResetCounts();
+    const auto start = bench::Clock::now();
+    setpwent();
+    while(getpwent()) ++pass.users;
+    endpwent();
+    setgrent();
+    while(getgrent()) ++pass.groups;
+    endgrent();
+    pass.seconds = bench::Seconds(start);
+    pass.user_pages = directory.counts().user_enum;
+    pass.group_pages = directory.counts().group_enum;
+    wuser_cache_get_page_sizes(&pass.user_bytes, &pass.group_bytes);
+    return pass;
+}
+
+} // anonymous
+
+namespace bench {
+
+// Enumeration round trips across directory sizes (10 to users * 100), fixed 32 KiB pages
+// vs. adaptive ones. "first" is the first adaptive pass at each size, when all the sizer
+// knows comes from the ten times smaller directory before; "learned" is the pass after it.
+int PageSize(const Options& opts) {
+    int failed = 0;
+    for(std::size_t users = 10u; users <= opts.users * 100u; users *= 10u) {
+        Options sized = opts;
+        sized.users = users;
+        sized.groups = users / 100u;
+        sized.latency_us = opts.latency_us ? opts.latency_us : 200;
+        wusers_impl::StandIn& directory = Directory(sized);
+
+        wuser_cache_set_page_bounds(4096u, 1u << 20);
+        const Pass first = Enumerate(directory);
+        const Pass learned = Enumerate(directory);
+        wuser_cache_set_page_bounds(32768u, 32768u);
+        const Pass fixed = Enumerate(directory);
+        wuser_cache_set_page_bounds(4096u, 1u << 20);
+
+        for(const Pass* pass : {&first, &learned, &fixed}) {
+            failed |= pass->users != users + 2u || pass->groups != sized.groups + 1u;
+        }
+        failed |= learned.user_pages > fixed.user_pages || learned.group_pages > fixed.group_pages;
+        failed |= users >= 10000u && learned.user_pages >= fixed.user_pages;
+        failed |= users == 10u && learned.user_bytes >= fixed.user_bytes; // less memory on a workstation
+
+        Record("pagesize")("users", users)("groups", sized.groups)
+                          ("latency_us", static_cast<unsigned long>(sized.latency_us))
+                          ("fixed_user_pages", fixed.user_pages)("fixed_group_pages", fixed.group_pages)
+                          ("first_user_pages", first.user_pages)("first_group_pages", first.group_pages)
+                          ("learned_user_pages", learned.user_pages)("learned_group_pages", learned.group_pages)
+                          ("learned_user_page_bytes", static_cast<unsigned long>(learned.user_bytes))
+                          ("learned_group_page_bytes", static_cast<unsigned long>(learned.group_bytes))
+                          ("fixed_seconds", fixed.seconds)("learned_seconds", learned.seconds);
+    }
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,62 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string>
+
+namespace bench {
+
+// getgrent() over 1000+ groups with an injected latency (500us unless asked for another),
+// by worker count. 0 workers is the serial chain of NetGroupGetUsers() round trips; the
+// member lists must come out the same whatever the number.
+int Prefetch(const Options& opts) {
+    Options slow = opts;
+    slow.groups = std::max<std::size_t>(opts.groups, 1000u);
+    slow.latency_us = opts.latency_us ? opts.latency_us : 500;
+    wusers_impl::StandIn& directory = Directory(slow);
+
+    int failed = 0;
+    std::size_t want_digest = 0u;
+    double serial = 0.0;
+    for(unsigned int workers : {0u, 1u, 2u, 4u, 8u, 16u}) {
+        if(workers > opts.threads) {
+            break;
+        }
+        wuser_cache_set_prefetch(workers);
+        directory.ResetCounts();
+        std::size_t groups = 0u, members = 0u, digest = 0u;
+        const auto start = Clock::now();
+        setgrent();
+        while(const struct group* grp = getgrent()) {
+            ++groups;
+            for(char** mem = grp->gr_mem; *mem; ++mem, ++members) {
+                digest = digest * 31u + std::hash<std::string>()(*mem);
+            }
+        }
+        endgrent();
+        const double elapsed = Seconds(start);
+        if(!workers) {
+            serial = elapsed;
+            want_digest = digest;
+        }
+        failed |= groups != slow.groups + 1u || digest != want_digest; // + None
+        failed |= directory.counts().group_get_users != groups;
+        Record("prefetch")("groups", groups)("members", members)("latency_us", static_cast<unsigned long>(slow.latency_us))
+                          ("workers", static_cast<unsigned long>(workers))("seconds", elapsed)("speedup", serial / elapsed);
+    }
+    wuser_cache_set_prefetch(4u);
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,111 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// ranks 0..n-1, rank k drawn with probability proportional to 1/(k+1)
+std::vector<std::size_t> Zipf(std::size_t n, std::size_t count, unsigned int seed) {
+    std::vector<double> weights(n);
+    for(std::size_t k = 0; k < n; ++k) {
+        weights[k] = 1.0 / (k + 1u);
+    }
+    std::discrete_distribution<std::size_t> pick(weights.begin(), weights.end());
+    std::mt19937 rng(seed);
+    std::vector<std::size_t> stream(count);
+    for(std::size_t& rank : stream) {
+        rank = pick(rng);
+    }
+    return stream;
+}
+
+} // anonymous
+
+namespace bench {
+
+// What `ls -l` and `ps` do: owner and group names for a skewed stream of ids, one in
+// twenty of which has no account (a file from another machine). Every distinct id may
+// cost the directory one call at most; repeats are served by the per-thread pwcache.
+int PwCache(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+
+    const std::size_t lookups = opts.rounds * 10u;
+    const std::vector<std::size_t> users = Zipf(opts.users + opts.users / 20u, lookups, opts.seed);
+    const std::vector<std::size_t> groups = Zipf(opts.groups + opts.groups / 20u + 1u, lookups, opts.seed + 1u);
+    const uid_t first_gid = 1000u + opts.users;
+
+    int failed = 0;
+    std::vector<bool> seen_users(opts.users), seen_groups(opts.groups);
+    char want[32];
+    const auto start = Clock::now();
+    for(std::size_t i = 0; i < lookups; ++i) {
+        const uid_t uid = 1000u + users[i]; // past opts.users: no such account
+        const char* user = user_from_uid(uid, 0);
+        if(users[i] < opts.users) {
+            std::snprintf(want, sizeof(want), "user%06zu", users[i]);
+        } else {
+            std::snprintf(want, sizeof(want), "%u", uid);
+        }
+        failed |= !user || std::strcmp(user, want);
+
+        const gid_t gid = first_gid + groups[i];
+        const char* group = group_from_gid(gid, 0);
+        if(groups[i] < opts.groups) {
+            std::snprintf(want, sizeof(want), "group%06zu", groups[i]);
+        } else {
+            std::snprintf(want, sizeof(want), "%u", gid);
+        }
+        failed |= !group || std::strcmp(group, want);
+    }
+    const double elapsed = Seconds(start);
+    const auto calls = directory.counts();
+
+    // the distinct accounts in the stream, plus one enumeration per table for the RID index
+    std::size_t distinct_users = 0u, distinct_groups = 0u;
+    for(std::size_t i = 0; i < lookups; ++i) {
+        if(users[i] < opts.users && !seen_users[users[i]]) ++distinct_users, seen_users[users[i]] = true;
+        if(groups[i] < opts.groups && !seen_groups[groups[i]]) ++distinct_groups, seen_groups[groups[i]] = true;
+    }
+    failed |= calls.user_get_info > distinct_users || calls.group_get_info > distinct_groups;
+
+    // negative entries: nouser/nogroup, and names that aren't there
+    directory.ResetCounts();
+    uid_t uid = 0;
+    gid_t gid = 0;
+    for(std::size_t round = 0; round < 100u; ++round) {
+        failed |= !!user_from_uid(1000u + opts.users, 1);
+        failed |= !!group_from_gid(first_gid + opts.groups, 1);
+        failed |= uid_from_user("nobody-at-all", &uid) != -1;
+        failed |= gid_from_group("nogroup-at-all", &gid) != -1;
+        failed |= uid_from_user("USER000000", &uid) || uid != 1000u;
+    }
+    const auto negative = directory.counts();
+    failed |= negative.user_get_info > 2u || negative.group_get_info > 1u;
+
+    Record("pwcache")("users", opts.users)("groups", opts.groups)("lookups", lookups)
+                     ("lookups_per_s", 2u * lookups / elapsed)
+                     ("distinct_users", distinct_users)("distinct_groups", distinct_groups)
+                     ("user_get_info", calls.user_get_info)("group_get_info", calls.group_get_info)
+                     ("enumerations", calls.user_enum + calls.group_enum)
+                     ("negative_directory_calls", negative.directory());
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,127 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+#include "wusers/wuser_files.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace {
+
+constexpr const char* PASSWD = "wusers_bench.passwd";
+constexpr const char* GROUP = "wusers_bench.group";
+
+// `lines` accounts, with a comment and a malformed line thrown in to be skipped
+bool Generate(std::size_t lines, std::size_t groups, std::size_t fanout, std::size_t& bytes) {
+    std::FILE* file = std::fopen(PASSWD, "wb");
+    if(!file) {
+        return false;
+    }
+    std::fprintf(file, "# generated by wusers_bench\nroot:x:0:0:root:/root:/bin/sh\nbroken:line\n");
+    for(std::size_t i = 1; i < lines; ++i) {
+        std::fprintf(file, "user%07zu:x:%zu:100:Test User %zu,Room %zu,,:/home/user%07zu:/bin/sh\n", i, 1000u + i, i, i % 100u, i);
+    }
+    bytes = std::ftell(file);
+    std::fclose(file);
+    if(!(file = std::fopen(GROUP, "wb"))) {
+        return false;
+    }
+    std::fprintf(file, "users:x:100:\n");
+    for(std::size_t i = 0; i < groups; ++i) {
+        std::fprintf(file, "group%06zu:x:%zu:", i, 100000000u + i);
+        for(std::size_t k = 0; k < fanout; ++k) {
+            std::fprintf(file, "%suser%07zu", k ? "," : "", 1u + (i * fanout + k) % (lines - 1u));
+        }
+        std::fprintf(file, "\n");
+    }
+    std::fclose(file);
+    return true;
+}
+
+} // anonymous
+
+namespace bench {
+
+// Throughput of the passwd(5) parser behind fgetpwent(), fgetpwent_r() and the file
+// backend, on a generated file of `users` * 1000 lines (a million by default).
+int PwFile(const Options& opts) {
+    const std::size_t lines = opts.users * 1000u;
+    std::size_t bytes = 0u;
+    if(!Generate(lines, opts.groups, opts.fanout, bytes)) {
+        return 1;
+    }
+    int failed = 0;
+    const double megabytes = bytes / 1e6;
+
+    std::FILE* file = std::fopen(PASSWD, "rb");
+    std::size_t parsed = 0u;
+    auto start = Clock::now();
+    while(const struct passwd* pwd = fgetpwent(file)) {
+        parsed += !!pwd->pw_name;
+    }
+    const double plain = Seconds(start);
+    failed |= parsed != lines;
+
+    std::rewind(file);
+    char buf[256];
+    struct passwd pwd, *pwd_ptr = nullptr;
+    std::size_t reentrant = 0u;
+    uid_t last_uid = 0;
+    start = Clock::now();
+    while(!fgetpwent_r(file, &pwd, buf, sizeof(buf), &pwd_ptr)) {
+        ++reentrant;
+        last_uid = pwd.pw_uid;
+    }
+    const double reent = Seconds(start);
+    failed |= reentrant != lines || last_uid != 1000u + lines - 1u;
+    std::rewind(file);
+    failed |= fgetpwent_r(file, &pwd, buf, 16u, &pwd_ptr) != ERANGE; // too small...
+    failed |= fgetpwent_r(file, &pwd, buf, sizeof(buf), &pwd_ptr) || std::strcmp(pwd.pw_name, "root"); // ...retried
+    std::fclose(file);
+
+    file = std::fopen(GROUP, "rb");
+    std::size_t members = 0u;
+    while(const struct group* grp = fgetgrent(file)) {
+        for(char** mem = grp->gr_mem; *mem; ++mem) ++members;
+    }
+    failed |= members != opts.groups * opts.fanout;
+    std::fclose(file);
+
+    // the whole library on top of the files
+    failed |= wuser_use_files(PASSWD, GROUP);
+    start = Clock::now();
+    const struct passwd* first = getpwnam("USER0000001"); // maps and indexes the file
+    const double indexed = Seconds(start);
+    failed |= !first || first->pw_uid != 1001u || std::strcmp(first->pw_gecos, "Test User 1")
+            || std::strcmp(first->pw_shell, "/bin/sh") || std::strcmp(first->pw_dir, "/home/user0000001");
+    std::size_t enumerated = 0u;
+    start = Clock::now();
+    setpwent();
+    while(getpwent()) ++enumerated;
+    endpwent();
+    const double enumeration = Seconds(start);
+    failed |= enumerated != lines;
+    const struct group* grp = getgrnam("group000000");
+    failed |= !grp || !grp->gr_mem[0] || grp->gr_mem[opts.fanout];
+    wuser_use_files(nullptr, nullptr);
+
+    std::remove(PASSWD);
+    std::remove(GROUP);
+    Record("pwfile")("lines", lines)("megabytes", megabytes)
+                    ("fgetpwent_mb_per_s", megabytes / plain)("fgetpwent_r_mb_per_s", megabytes / reent)
+                    ("lines_per_s", lines / plain)("backend_index_seconds", indexed)
+                    ("backend_getpwent_seconds", enumeration);
+    return failed;
+}
+
+} // namespace bench
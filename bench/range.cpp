@@ -0,0 +1,142 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "grp.h"
+#include "pwd.h"
+#include "wusers/wuser_cache.h"
+#include "wusers/wuser_range.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+
+namespace {
+
+struct Pass {
+    std::size_t records;
+    std::size_t digest;
+    double seconds;
+};
+
+// what a scan that touches one field computes: all uids, or all names
+Pass GetPwEnt(bool names) {
+    Pass pass = {0u, 0u, 0.0};
+    const auto start = bench::Clock::now();
+    setpwent();
+    while(const struct passwd* pwd = getpwent()) {
+        ++pass.records;
+        pass.digest = pass.digest * 31u + (names ? std::hash<std::string>()(pwd->pw_name) : pwd->pw_uid);
+    }
+    endpwent();
+    pass.seconds = bench::Seconds(start);
+    return pass;
+}
+
+Pass Users(bool names) {
+    Pass pass = {0u, 0u, 0.0};
+    std::string scratch;
+    const auto start = bench::Clock::now();
+    wusers::range<wusers::user> users = wusers::users();
+    for(const wusers::user& user : users) {
+        ++pass.records;
+        pass.digest = pass.digest * 31u + (names ? std::hash<std::string_view>()(user.name.view(scratch)) : user.uid);
+    }
+    pass.seconds = bench::Seconds(start);
+    if(users.error()) {
+        pass.records = -1;
+    }
+    return pass;
+}
+
+// find_user() finds what getpwuid() and getpwnam() find, and nothing where they find nothing
+int Find() {
+    int failed = 0;
+    setpwent();
+    for(std::size_t i = 0; i < 16u; ++i) {
+        const struct passwd* pwd = getpwent();
+        if(!pwd) {
+            return 1;
+        }
+        const std::string name = pwd->pw_name;
+        const uid_t uid = pwd->pw_uid;
+        const std::string gecos = pwd->pw_gecos;
+        const wusers::found_user by_uid = wusers::find_user(uid);
+        const wusers::found_user by_name = wusers::find_user(name);
+        failed |= !by_uid || by_uid->name.str() != name || by_uid->gecos.str() != gecos || by_uid.error();
+        failed |= !by_name || by_name->uid != uid || by_name->name.str() != name;
+    }
+    endpwent();
+    const wusers::found_user nobody = wusers::find_user(static_cast<uid_t>(999999u));
+    const wusers::found_user noname = wusers::find_user("no such user");
+    failed |= nobody || nobody.error() || noname || noname.error();
+    return failed;
+}
+
+// groups() has what getgrent() has; members() is gr_mem
+int Groups() {
+    std::size_t classic = 0u;
+    std::size_t classic_members = 0u;
+    setgrent();
+    while(const struct group* grp = getgrent()) {
+        ++classic;
+        for(char** member = grp->gr_mem; *member; ++member) ++classic_members;
+    }
+    endgrent();
+    std::size_t ranged = 0u;
+    std::size_t ranged_members = 0u;
+    wusers::range<wusers::group> groups = wusers::groups();
+    for(const wusers::group& group : groups) {
+        ++ranged;
+        ranged_members += group.members().size();
+        if(errno) return 1;
+    }
+    return groups.error() || !classic || ranged != classic || ranged_members != classic_members;
+}
+
+} // anonymous
+
+namespace bench {
+
+// A scan of 100k+ users that touches one field, the uid or the name: getpwent(), which
+// translates every field of every record, vs. wusers::users(), which transcodes only the
+// names and only when the name is the field. Both must see the same records in the same
+// order. Also checks find_user() against getpwuid()/getpwnam() and groups() against getgrent().
+int Range(const Options& opts) {
+    Options big = opts;
+    big.users = std::max<std::size_t>(opts.users, 100000u);
+    Directory(big);
+    int failed = 0;
+
+    GetPwEnt(false); // page sizes settle, host facts are listed
+    const Pass uids = GetPwEnt(false);
+    const Pass range_uids = Users(false);
+    const Pass names = GetPwEnt(true);
+    const Pass range_names = Users(true);
+    failed |= uids.records != big.users + 2u; // + Administrator, Guest
+    failed |= range_uids.records != uids.records || range_uids.digest != uids.digest;
+    failed |= names.records != uids.records || range_names.records != names.records || range_names.digest != names.digest;
+
+    Directory(opts); // member lists of 100k would only measure NetGroupGetUsers
+    wuser_cache_invalidate(); // records cached by earlier scenarios are of another directory
+    failed |= Find();
+    failed |= Groups();
+
+    Record("range")("users", uids.records)
+                   ("getpwent_uid_records_per_s", uids.records / uids.seconds)
+                   ("range_uid_records_per_s", range_uids.records / range_uids.seconds)
+                   ("uid_speedup", uids.seconds / range_uids.seconds)
+                   ("getpwent_name_records_per_s", names.records / names.seconds)
+                   ("range_name_records_per_s", range_names.records / range_names.seconds)
+                   ("name_speedup", names.seconds / range_names.seconds);
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,111 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "wusers/wuser_cache.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <string>
+
+namespace {
+
+struct Pass {
+    std::size_t records;
+    std::size_t digest;
+    unsigned long pages;
+    double seconds;
+};
+
+// a caller that does something with each record, e.g. stats the user's home directory
+void Work(std::chrono::microseconds per_record) {
+    const auto until = bench::Clock::now() + per_record;
+    while(bench::Clock::now() < until) {}
+}
+
+Pass Enumerate(wusers_impl::StandIn& directory, std::chrono::microseconds work = {}) {
+    Pass pass = {0u, 0u, 0u, 0.0};
+    directory.ResetCounts();
+    const auto start = bench::Clock::now();
+    setpwent();
+    while(const struct passwd* pwd = getpwent()) {
+        ++pass.records;
+        pass.digest = pass.digest * 31u + std::hash<std::string>()(pwd->pw_name) + pwd->pw_uid;
+        Work(work);
+    }
+    endpwent();
+    pass.seconds = bench::Seconds(start);
+    pass.pages = directory.counts().user_enum;
+    return pass;
+}
+
+} // anonymous
+
+namespace bench {
+
+// getpwent() over 20k+ users with an injected per-page latency (2ms unless asked for
+// another), with and without read-ahead, for a bare loop and for a caller that spends
+// 20us on each record. The records must come out the same and cost the same number of
+// pages; read-ahead only moves the round trips off the caller's path.
+int ReadAhead(const Options& opts) {
+    Options slow = opts;
+    slow.users = std::max<std::size_t>(opts.users, 20000u);
+    slow.latency_us = opts.latency_us ? opts.latency_us : 2000;
+    wusers_impl::StandIn& directory = Directory(slow);
+    int failed = 0;
+
+    wuser_cache_set_readahead(0);
+    const Pass sync = Enumerate(directory);
+    wuser_cache_set_readahead(1);
+    const Pass ahead = Enumerate(directory);
+    const std::chrono::microseconds work(20);
+    wuser_cache_set_readahead(0);
+    const Pass sync_work = Enumerate(directory, work);
+    wuser_cache_set_readahead(1);
+    const Pass ahead_work = Enumerate(directory, work);
+    failed |= sync.records != slow.users + 2u || ahead.records != sync.records; // + Administrator, Guest
+    failed |= ahead.digest != sync.digest || ahead.pages != sync.pages;
+    failed |= sync_work.digest != sync.digest || ahead_work.digest != sync.digest;
+
+    // an enumeration abandoned halfway: endpwent() lets go of the page on its way,
+    // and the next enumeration starts over from the top
+    setpwent();
+    for(std::size_t i = 0; i < slow.users / 2u; ++i) {
+        failed |= !getpwent();
+    }
+    endpwent();
+    setpwent();
+    const struct passwd* first = getpwent();
+    failed |= !first || std::strcmp(first->pw_name, "Administrator") || errno;
+    endpwent();
+
+    // nothing to read ahead with: back to the synchronous path, same results
+    wuser_cache_set_prefetch(0u);
+    const Pass no_workers = Enumerate(directory);
+    failed |= no_workers.digest != sync.digest || no_workers.pages != sync.pages;
+    wuser_cache_set_prefetch(4u);
+    wuser_cache_set_readahead(0);
+
+    Record("readahead")("users", sync.records)("pages", sync.pages)
+                       ("latency_us", static_cast<unsigned long>(slow.latency_us))
+                       ("sync_seconds", sync.seconds)("readahead_seconds", ahead.seconds)
+                       ("sync_records_per_s", sync.records / sync.seconds)
+                       ("readahead_records_per_s", ahead.records / ahead.seconds)
+                       ("speedup", sync.seconds / ahead.seconds)
+                       ("work_us_per_record", static_cast<unsigned long>(work.count()))
+                       ("work_sync_seconds", sync_work.seconds)("work_readahead_seconds", ahead_work.seconds)
+                       ("work_speedup", sync_work.seconds / ahead_work.seconds);
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,231 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+
+#include <errno.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// a record as plain strings: what every copy of it must say
+using Fields = std::vector<std::string>;
+
+std::string Str(const char* str) {
+    return str ? str : "(null)";
+}
+
+Fields Of(const struct passwd& pwd) {
+    return {Str(pwd.pw_name), Str(pwd.pw_passwd), Str(pwd.pw_class), Str(pwd.pw_gecos), Str(pwd.pw_dir),
+            Str(pwd.pw_shell), std::to_string(pwd.pw_uid), std::to_string(pwd.pw_gid)};
+}
+
+Fields Of(const struct group& grp) {
+    Fields fields = {Str(grp.gr_name), Str(grp.gr_passwd), std::to_string(grp.gr_gid)};
+    for(char** member = grp.gr_mem; member && *member; ++member) {
+        fields.push_back(*member);
+    }
+    return fields;
+}
+
+// whether everything `rec` points to is within [lo, hi), pointer arrays aligned
+bool Within(const char* str, const char* lo, const char* hi) {
+    return !str || (str >= lo && str + std::strlen(str) < hi);
+}
+
+bool Within(const struct passwd& pwd, const char* lo, const char* hi) {
+    for(const char* str : {pwd.pw_name, pwd.pw_passwd, pwd.pw_class, pwd.pw_gecos, pwd.pw_dir, pwd.pw_shell}) {
+        if(!Within(str, lo, hi)) return false;
+    }
+    return true;
+}
+
+bool Within(const struct group& grp, const char* lo, const char* hi) {
+    const char* mem = reinterpret_cast<const char*>(grp.gr_mem);
+    if(!Within(grp.gr_name, lo, hi) || !Within(grp.gr_passwd, lo, hi) || !mem || mem < lo || mem >= hi
+        || reinterpret_cast<std::uintptr_t>(mem) % alignof(char*)) {
+        return false;
+    }
+    for(char** member = grp.gr_mem; *member; ++member) {
+        if(!Within(*member, lo, hi) || reinterpret_cast<const char*>(member + 1) >= hi) return false;
+    }
+    return true;
+}
+
+template<typename RECORD_T, typename KEY_T>
+using Reentrant = int (*)(KEY_T, RECORD_T*, char*, size_t, RECORD_T**);
+
+// The smallest buffer the record at `key` fits in, at every alignment: one byte less has to
+// fail with ERANGE and no record, and the copy has to stay within the buffer.
+template<typename RECORD_T, typename KEY_T>
+bool Fits(Reentrant<RECORD_T, KEY_T> call, KEY_T key, const Fields& expected) {
+    std::vector<char> buf(1u << 12);
+    for(std::size_t skew = 0; skew < sizeof(char*); ++skew) {
+        char* at = buf.data() + skew;
+        RECORD_T out;
+        RECORD_T* ptr = nullptr;
+        std::size_t len = 0u;
+        int err;
+        while(ERANGE == (err = call(key, &out, at, len, &ptr)) && len + skew < buf.size()) {
+            if(ptr) return false;
+            ++len;
+        }
+        if(err || ptr != &out || Of(out) != expected || !Within(out, at, at + len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// warm calls to `call` over `keys`, round robin; ns per call, or a negative value if one failed
+template<typename RECORD_T, typename KEY_T>
+double Time(Reentrant<RECORD_T, KEY_T> call, const std::vector<KEY_T>& keys, const std::vector<Fields>& expected,
+            std::size_t rounds) {
+    std::vector<char> buf(1u << 16);
+    RECORD_T out;
+    RECORD_T* ptr = nullptr;
+    bool ok = true;
+    for(std::size_t i = 0; i < keys.size(); ++i) { // cold; not timed
+        ok &= !call(keys[i], &out, buf.data(), buf.size(), &ptr) && ptr && Of(out) == expected[i];
+    }
+    const auto start = bench::Clock::now();
+    for(std::size_t r = 0; r < rounds; ++r) {
+        ok &= !call(keys[r % keys.size()], &out, buf.data(), buf.size(), &ptr) && !!ptr;
+    }
+    const double ns = bench::Seconds(start) * 1e9 / rounds;
+    return ok ? ns : -1.0;
+}
+
+// `dup` of records that are at hand; each copy must be independent of the original
+template<typename RECORD_T>
+double TimeDup(RECORD_T* (*dup)(const RECORD_T*), const std::vector<RECORD_T*>& held, std::size_t rounds) {
+    bool ok = true;
+    for(RECORD_T* rec : held) {
+        RECORD_T* copy = dup(rec);
+        RECORD_T* copy_of_copy = copy ? dup(copy) : nullptr;
+        ok &= copy && copy_of_copy && Of(*copy) == Of(*rec);
+        if(copy) std::memset(copy, 0, sizeof(RECORD_T)); // the second copy doesn't point into the first
+        ok &= copy_of_copy && Of(*copy_of_copy) == Of(*rec);
+        std::free(copy);
+        std::free(copy_of_copy);
+    }
+    const auto start = bench::Clock::now();
+    for(std::size_t r = 0; r < rounds; ++r) {
+        RECORD_T* copy = dup(held[r % held.size()]);
+        ok &= !!copy;
+        std::free(copy);
+    }
+    const double ns = bench::Seconds(start) * 1e9 / rounds;
+    return ok ? ns : -1.0;
+}
+
+void Report(const bench::Options& opts, const char* entry, double ns) {
+    bench::Record("records")("entry", entry)("users", static_cast<unsigned long>(opts.users))
+        ("groups", static_cast<unsigned long>(opts.groups))("fanout", static_cast<unsigned long>(opts.fanout))
+        ("name_len", static_cast<unsigned long>(opts.name_len))("warm_ns", ns)
+        ("warm_calls_per_second", ns > 0.0 ? 1e9 / ns : 0.0);
+}
+
+} // anonymous
+
+namespace bench {
+
+// The reentrant lookups once their records are cached, which copy a cached record out
+// into the caller's buffer, and pw_dup()/gr_dup(). Checks that every copy says what the
+// non-reentrant lookup says, stays within the smallest buffer that fits it, at any
+// alignment, and that a byte less is ERANGE.
+int Records(const Options& opts) {
+    Directory(opts);
+    wuser_cache_invalidate();
+    std::vector<uid_t> uids;
+    std::vector<gid_t> gids;
+    std::vector<std::string> user_names, group_names;
+    std::vector<Fields> users, groups;
+    setpwent();
+    while(struct passwd* pwd = getpwent()) {
+        if(pwd->pw_uid >= 1000u && uids.size() < opts.keys) {
+            uids.push_back(pwd->pw_uid);
+            user_names.push_back(pwd->pw_name);
+        }
+    }
+    endpwent();
+    setgrent();
+    while(struct group* grp = getgrent()) {
+        if(grp->gr_gid >= 1000u && gids.size() < opts.keys) {
+            gids.push_back(grp->gr_gid);
+            group_names.push_back(grp->gr_name);
+        }
+    }
+    endgrent();
+    for(uid_t uid : uids) {
+        struct passwd* pwd = getpwuid(uid);
+        users.push_back(pwd ? Of(*pwd) : Fields());
+    }
+    for(gid_t gid : gids) {
+        struct group* grp = getgrgid(gid);
+        groups.push_back(grp ? Of(*grp) : Fields());
+    }
+    if(uids.empty() || gids.empty()) {
+        return 1;
+    }
+    std::vector<const char*> user_keys, group_keys;
+    for(const std::string& name : user_names) user_keys.push_back(name.c_str());
+    for(const std::string& name : group_names) group_keys.push_back(name.c_str());
+
+    int failed = 0;
+    for(std::size_t i = 0; i < uids.size() && i < 8u; ++i) {
+        failed |= !Fits<struct passwd, uid_t>(&getpwuid_r, uids[i], users[i]);
+        failed |= !Fits<struct passwd, const char*>(&getpwnam_r, user_keys[i], users[i]);
+    }
+    for(std::size_t i = 0; i < gids.size() && i < 8u; ++i) {
+        failed |= !Fits<struct group, gid_t>(&getgrgid_r, gids[i], groups[i]);
+        failed |= !Fits<struct group, const char*>(&getgrnam_r, group_keys[i], groups[i]);
+    }
+
+    double ns;
+    failed |= (ns = Time<struct passwd, uid_t>(&getpwuid_r, uids, users, opts.rounds)) < 0.0;
+    Report(opts, "getpwuid_r", ns);
+    failed |= (ns = Time<struct passwd, const char*>(&getpwnam_r, user_keys, users, opts.rounds)) < 0.0;
+    Report(opts, "getpwnam_r", ns);
+    failed |= (ns = Time<struct group, gid_t>(&getgrgid_r, gids, groups, opts.rounds)) < 0.0;
+    Report(opts, "getgrgid_r", ns);
+    failed |= (ns = Time<struct group, const char*>(&getgrnam_r, group_keys, groups, opts.rounds)) < 0.0;
+    Report(opts, "getgrnam_r", ns);
+
+    std::vector<struct passwd*> held_users;
+    std::vector<struct group*> held_groups;
+    for(uid_t uid : uids) {
+        struct passwd* pwd = getpwuid(uid);
+        held_users.push_back(pwd ? pw_dup(pwd) : nullptr);
+        failed |= !held_users.back();
+    }
+    for(gid_t gid : gids) {
+        struct group* grp = getgrgid(gid);
+        held_groups.push_back(grp ? gr_dup(grp) : nullptr);
+        failed |= !held_groups.back();
+    }
+    if(!failed) {
+        failed |= (ns = TimeDup(&pw_dup, held_users, opts.rounds)) < 0.0;
+        Report(opts, "pw_dup", ns);
+        failed |= (ns = TimeDup(&gr_dup, held_groups, opts.rounds)) < 0.0;
+        Report(opts, "gr_dup", ns);
+    }
+    for(struct passwd* pwd : held_users) std::free(pwd);
+    for(struct group* grp : held_groups) std::free(grp);
+    return failed;
+}
+
+} // namespace bench
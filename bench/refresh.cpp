@@ -0,0 +1,178 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "wus.h"
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+#include "wusers/wuser_changes.h"
+
+#include <errno.h>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::vector<wuser_change> Since(unsigned long generation, int& error) {
+    std::vector<wuser_change> changes(16u);
+    std::size_t count = 0u;
+    error = wuser_changes_since(generation, changes.data(), changes.size(), &count);
+    if(ERANGE == error) {
+        changes.resize(count);
+        error = wuser_changes_since(generation, changes.data(), changes.size(), &count);
+    }
+    changes.resize(error ? 0u : count);
+    return changes;
+}
+
+std::size_t Count(const std::vector<wuser_change>& changes, int account) {
+    std::size_t count = 0u;
+    for(const wuser_change& change : changes) count += change.account == account;
+    return count;
+}
+
+bool Has(const std::vector<wuser_change>& changes, int account, int kind, unsigned int id) {
+    for(const wuser_change& change : changes) {
+        if(change.account == account && change.kind == kind && change.id == id) return true;
+    }
+    return false;
+}
+
+wusers_impl::StandIn::User Someone(const std::wstring& name, DWORD rid, const std::wstring& full_name) {
+    return {name, full_name, L"", rid, 513u, USER_PRIV_USER, TIMEQ_FOREVER, false};
+}
+
+} // anonymous
+
+namespace bench {
+
+// Refresh passes against a stand-in that is changed in between: a user added, one removed,
+// one renamed, one given another full name, a group given another member (and the groups
+// of the users that were removed or renamed have other members, too). Each pass that
+// finds changes is one generation, with exactly those changes in the feed; the cache drops
+// those accounts (the next lookup sees them as they are) and keeps the rest (no directory
+// call for them). Also: nothing found, no generation; a feed that no longer goes back far
+// enough; and the background thread.
+int Refresh(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    wuser_cache_invalidate();
+    int failed = 0;
+    int error = 0;
+    failed |= wuser_refresh_now(); // takes stock
+    const unsigned long start = wuser_generation();
+    failed |= wuser_refresh_now() || wuser_generation() != start; // nothing has changed
+
+    const uid_t base = 1000u;
+    const uid_t renamed = base + 1u, regecosed = base + 2u, removed = base + 3u, kept = base + 4u;
+    const uid_t added = static_cast<uid_t>(base + opts.users + opts.groups + 1000u);
+    const gid_t group = static_cast<gid_t>(base + opts.users);
+    std::string names[5];
+    for(uid_t uid = base; uid <= kept; ++uid) {
+        struct passwd* pwd = getpwuid(uid);
+        if(!pwd) return 1;
+        names[uid - base] = pwd->pw_name;
+    }
+    struct group* grp = getgrgid(group);
+    if(!grp) return 1;
+    const std::wstring group_name = wusers_impl::to_win_str(grp->gr_name);
+    std::vector<std::wstring> members;
+    for(char** member = grp->gr_mem; *member; ++member) members.push_back(wusers_impl::to_win_str(*member));
+    failed |= !!getpwuid(added) || !!getpwnam("newcomer"); // remembered as missing
+
+    directory.RemoveUser(wusers_impl::to_win_str(names[renamed - base]));
+    directory.AddUser(Someone(L"renamed", renamed, L""));
+    directory.RemoveUser(wusers_impl::to_win_str(names[regecosed - base]));
+    directory.AddUser(Someone(wusers_impl::to_win_str(names[regecosed - base]), regecosed, L"Full Name"));
+    directory.RemoveUser(wusers_impl::to_win_str(names[removed - base]));
+    directory.AddUser(Someone(L"newcomer", added, L""));
+    directory.RemoveGroup(group_name);
+    members.push_back(L"newcomer");
+    directory.AddGroup({group_name, L"", group, members});
+
+    const auto refresh_start = Clock::now();
+    failed |= wuser_refresh_now();
+    const double refresh_seconds = Seconds(refresh_start);
+    const unsigned long first = wuser_generation();
+    failed |= first != start + 1u;
+    const std::vector<wuser_change> changes = Since(start, error);
+    failed |= error || Count(changes, WUSER_ACCOUNT_USER) != 4u;
+    failed |= !Has(changes, WUSER_ACCOUNT_USER, WUSER_CHANGE_MODIFIED, renamed);
+    failed |= !Has(changes, WUSER_ACCOUNT_USER, WUSER_CHANGE_MODIFIED, regecosed);
+    failed |= !Has(changes, WUSER_ACCOUNT_USER, WUSER_CHANGE_REMOVED, removed);
+    failed |= !Has(changes, WUSER_ACCOUNT_USER, WUSER_CHANGE_ADDED, added);
+    failed |= !Has(changes, WUSER_ACCOUNT_GROUP, WUSER_CHANGE_MODIFIED, group);
+    for(const wuser_change& change : changes) {
+        failed |= change.generation != first;
+        failed |= change.account == WUSER_ACCOUNT_GROUP && change.kind != WUSER_CHANGE_MODIFIED;
+    }
+    failed |= !Since(first, error).empty() || error;
+
+    // the cache, without wuser_cache_invalidate()
+    directory.ResetCounts();
+    struct passwd* pwd = getpwuid(kept);
+    failed |= !pwd || names[kept - base] != pwd->pw_name || directory.counts().directory(); // still cached
+    pwd = getpwuid(renamed);
+    failed |= !pwd || std::strcmp(pwd->pw_name, "renamed");
+    failed |= !!getpwnam(names[renamed - base].c_str());
+    pwd = getpwuid(regecosed);
+    failed |= !pwd || std::strcmp(pwd->pw_gecos, "Full Name");
+    failed |= !!getpwuid(removed) || !!getpwnam(names[removed - base].c_str());
+    pwd = getpwnam("newcomer");
+    failed |= !pwd || pwd->pw_uid != added;
+    failed |= !getpwuid(added);
+    const char* name = user_from_uid(renamed, 1);
+    failed |= !name || std::strcmp(name, "renamed");
+    grp = getgrgid(group);
+    bool newcomer = false;
+    for(char** member = grp ? grp->gr_mem : nullptr; member && *member; ++member) {
+        newcomer |= !std::strcmp(*member, "newcomer");
+    }
+    failed |= !newcomer;
+    const unsigned long lookup_calls = directory.counts().directory();
+
+    // more changes than the feed keeps
+    const std::size_t crowd = 5000u;
+    for(std::size_t i = 0; i < crowd; ++i) {
+        directory.AddUser(Someone(L"crowd" + std::to_wstring(i), static_cast<DWORD>(added + 1u + i), L""));
+    }
+    failed |= wuser_refresh_now();
+    for(std::size_t i = 0; i < crowd; ++i) {
+        directory.RemoveUser(L"crowd" + std::to_wstring(i));
+    }
+    failed |= wuser_refresh_now();
+    failed |= wuser_generation() != first + 2u;
+    Since(start, error);
+    failed |= EOVERFLOW != error;
+    failed |= Since(first + 1u, error).size() != crowd || error; // the last one is kept whole
+
+    // in the background
+    wuser_refresh_start(10u);
+    directory.RemoveUser(L"newcomer");
+    const auto wait_start = Clock::now();
+    while(wuser_generation() == first + 2u && Seconds(wait_start) < 5.0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const double background_seconds = Seconds(wait_start);
+    wuser_refresh_start(0u);
+    const std::vector<wuser_change> last = Since(first + 2u, error);
+    failed |= error || Count(last, WUSER_ACCOUNT_USER) != 1u || !Has(last, WUSER_ACCOUNT_USER, WUSER_CHANGE_REMOVED, added);
+    failed |= !Has(last, WUSER_ACCOUNT_GROUP, WUSER_CHANGE_MODIFIED, group); // a member no more
+    failed |= !!getpwnam("newcomer");
+
+    Record("refresh")("users", static_cast<unsigned long>(opts.users))("groups", static_cast<unsigned long>(opts.groups))
+                     ("refresh_seconds", refresh_seconds)("changes", static_cast<unsigned long>(changes.size()))
+                     ("lookup_calls_after", lookup_calls)("background_seconds", background_seconds);
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,108 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Keys {
+    std::vector<uid_t> uids;
+    std::vector<std::string> users;
+    std::vector<gid_t> gids;
+    std::vector<std::string> groups;
+};
+
+// the four reentrant lookups, `rounds` times over the keys; false if any came back wrong
+bool Reentrant(const Keys& keys, std::size_t rounds) {
+    char buf[4096];
+    bool ok = true;
+    for(std::size_t r = 0; r < rounds; ++r) {
+        const std::size_t u = r % keys.uids.size(), g = r % keys.gids.size();
+        struct passwd pwd, *pwd_ptr = nullptr;
+        struct group grp, *grp_ptr = nullptr;
+        ok &= !getpwuid_r(keys.uids[u], &pwd, buf, sizeof(buf), &pwd_ptr) && pwd_ptr && keys.users[u] == pwd.pw_name;
+        ok &= !getpwnam_r(keys.users[u].c_str(), &pwd, buf, sizeof(buf), &pwd_ptr) && pwd_ptr && keys.uids[u] == pwd.pw_uid;
+        ok &= !getgrgid_r(keys.gids[g], &grp, buf, sizeof(buf), &grp_ptr) && grp_ptr && keys.groups[g] == grp.gr_name;
+        ok &= !getgrnam_r(keys.groups[g].c_str(), &grp, buf, sizeof(buf), &grp_ptr) && grp_ptr && keys.gids[g] == grp.gr_gid;
+    }
+    return ok;
+}
+
+// lookups per second over `threads` threads doing `rounds` rounds of four each
+double Throughput(const Keys& keys, std::size_t threads, std::size_t rounds, bool& ok) {
+    std::atomic<bool> all_ok{true};
+    std::vector<std::thread> pool;
+    const auto start = bench::Clock::now();
+    for(std::size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&]() { if(!Reentrant(keys, rounds)) all_ok = false; });
+    }
+    for(auto& thread : pool) {
+        thread.join();
+    }
+    const double seconds = bench::Seconds(start);
+    ok &= all_ok;
+    return 4.0 * threads * rounds / seconds;
+}
+
+} // anonymous
+
+namespace bench {
+
+// Warm reentrant lookups from 1 to `threads` threads: copies out of the published table,
+// with no lock and no shared reference count, should scale with the cores there are.
+// The speedup is over one thread; on fewer cores than threads, flat is the best there is.
+// Must cost no directory calls.
+int RcuScaling(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    wuser_cache_invalidate();
+    Keys keys;
+    for(std::size_t i = 0; i < opts.keys; ++i) {
+        keys.uids.push_back(1000u + (i * opts.users) / opts.keys);
+        if(i < opts.groups) keys.gids.push_back(1000u + opts.users + i);
+    }
+    for(uid_t uid : keys.uids) {
+        struct passwd* pwd = getpwuid(uid);
+        if(!pwd) return 1;
+        keys.users.push_back(pwd->pw_name);
+    }
+    for(gid_t gid : keys.gids) {
+        struct group* grp = getgrgid(gid);
+        if(!grp) return 1;
+        keys.groups.push_back(grp->gr_name);
+    }
+    if(keys.gids.empty()) return 1;
+    Reentrant(keys, keys.uids.size()); // by name too, so that everything is published
+
+    int failed = 0;
+    bool ok = true;
+    const std::size_t rounds = opts.rounds;
+    directory.ResetCounts();
+    const unsigned int cores = std::thread::hardware_concurrency();
+    double one = 0.0;
+    for(std::size_t threads = 1u; threads <= opts.threads; threads <<= 1) {
+        const double lookups = Throughput(keys, threads, rounds, ok);
+        if(threads == 1u) {
+            one = lookups;
+        }
+        Record("rcu")("threads", static_cast<unsigned long>(threads))("cores", static_cast<unsigned long>(cores))
+                     ("lookups_per_s", lookups)("speedup", lookups / one)
+                     ("per_core_efficiency", lookups / one / (threads < cores ? threads : cores));
+    }
+    failed |= !ok || directory.counts().directory();
+    return failed;
+}
+
+} // namespace bench
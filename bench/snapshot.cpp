@@ -0,0 +1,109 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+#include "wusers/wuser_snapshot.h"
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+constexpr const char* SNAPSHOT = "wusers_bench.snap";
+
+// what a freshly started `ls -l` asks first
+unsigned long FirstLookup(wusers_impl::StandIn& directory, uid_t uid, gid_t gid, double& seconds) {
+    directory.ResetCounts();
+    const auto start = bench::Clock::now();
+    getpwuid(uid);
+    getgrgid(gid);
+    seconds = bench::Seconds(start);
+    return directory.counts().directory();
+}
+
+bool Same(const struct passwd& a, const struct passwd& b) {
+    return a.pw_uid == b.pw_uid && a.pw_gid == b.pw_gid && a.pw_change == b.pw_change && a.pw_expire == b.pw_expire
+        && std::string(a.pw_name) == b.pw_name && std::string(a.pw_gecos) == b.pw_gecos
+        && std::string(a.pw_dir) == b.pw_dir && std::string(a.pw_shell) == b.pw_shell
+        && std::string(a.pw_passwd) == b.pw_passwd && std::string(a.pw_class) == b.pw_class;
+}
+
+std::size_t Members(const struct group* grp) {
+    std::size_t n = 0u;
+    while(grp && grp->gr_mem && grp->gr_mem[n]) ++n;
+    return n;
+}
+
+} // anonymous
+
+namespace bench {
+
+// First-lookup latency of a cold process, with and without a snapshot. Also checks that
+// mapped records match live ones, that misses and invalidation fall through to the backend.
+int Snapshot(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    wuser_snapshot_close();
+    wuser_cache_invalidate();
+    const uid_t uid = 1000u + opts.users / 2u;
+    const gid_t gid = 1000u + opts.users;
+
+    int failed = 0;
+    double live_seconds, mapped_seconds;
+    const unsigned long live_calls = FirstLookup(directory, uid, gid, live_seconds);
+    char buf[4096];
+    struct passwd live, *live_ptr = nullptr;
+    getpwuid_r(uid, &live, buf, sizeof(buf), &live_ptr);
+    const std::size_t live_members = Members(getgrgid(gid));
+
+    const auto start = Clock::now();
+    failed |= wuser_snapshot_write(SNAPSHOT, 0ul);
+    const double write_seconds = Seconds(start);
+    wuser_cache_invalidate(); // a cold process...
+    failed |= wuser_snapshot_open(SNAPSHOT); // ...that finds a snapshot
+    const unsigned long mapped_calls = FirstLookup(directory, uid, gid, mapped_seconds);
+    failed |= mapped_calls != 0u;
+
+    directory.ResetCounts();
+    struct passwd* mapped = getpwuid(uid);
+    failed |= !live_ptr || !mapped || !Same(live, *mapped);
+    std::string upper(mapped ? mapped->pw_name : "");
+    for(char& c : upper) if(c >= 'a' && c <= 'z') c += 'A' - 'a';
+    struct passwd by_name, *by_name_ptr = nullptr;
+    getpwnam_r(upper.c_str(), &by_name, buf, sizeof(buf), &by_name_ptr);
+    failed |= !by_name_ptr || by_name.pw_uid != uid;
+    failed |= Members(getgrgid(gid)) != live_members;
+    failed |= directory.counts().directory() != 0u;
+
+    const auto hits = Clock::now();
+    for(std::size_t round = 0; round < opts.rounds; ++round) {
+        getpwuid(1000u + round % opts.users);
+    }
+    const double hit_seconds = Seconds(hits);
+
+    // added after the snapshot was taken: a miss goes to the backend
+    directory.AddUser({L"latecomer", L"", L"", 99999u, 513u, USER_PRIV_USER, TIMEQ_FOREVER, false});
+    failed |= !getpwuid(99999u) || !directory.counts().directory();
+    // the directory changed: stop trusting the snapshot
+    wuser_cache_invalidate();
+    directory.ResetCounts();
+    getpwuid(uid);
+    failed |= !directory.counts().directory();
+
+    wuser_snapshot_close();
+    std::remove(SNAPSHOT);
+    Record("snapshot")("users", opts.users)("write_seconds", write_seconds)
+                      ("live_first_seconds", live_seconds)("live_backend_calls", live_calls)
+                      ("mapped_first_seconds", mapped_seconds)("mapped_backend_calls", mapped_calls)
+                      ("mapped_ns_per_lookup", hit_seconds * 1e9 / opts.rounds);
+    return failed;
+}
+
+} // namespace bench
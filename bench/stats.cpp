@@ -0,0 +1,106 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "pwd.h"
+#include "grp.h"
+#include "wusers/wuser_cache.h"
+#include "wusers/wuser_stats.h"
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace {
+
+unsigned long long Sum(const unsigned long long* counts, std::size_t n) {
+    unsigned long long sum = 0u;
+    for(std::size_t i = 0; i < n; ++i) sum += counts[i];
+    return sum;
+}
+
+} // anonymous
+
+namespace bench {
+
+// The statistics must agree with what the stand-in has served, call for call, and with
+// what the entry points were asked, threads that have exited included. Also reports the
+// cost of a counted cache hit.
+int Stats(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    wuser_cache_invalidate();
+    wuser_stats_reset();
+    directory.ResetCounts();
+    int failed = 0;
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "user%06zu", opts.users / 2u);
+    const auto start = Clock::now();
+    for(std::size_t round = 0; round < opts.rounds; ++round) {
+        failed |= !getpwnam(name); // one miss, then hits
+    }
+    const double hit_ns = Seconds(start) * 1e9 / opts.rounds;
+
+    char small[8], large[4096];
+    struct passwd pwd, *pwd_ptr = nullptr;
+    failed |= getpwnam_r(name, &pwd, small, sizeof(small), &pwd_ptr) != ERANGE;
+    failed |= getpwnam_r(name, &pwd, large, sizeof(large), &pwd_ptr) || !pwd_ptr;
+    failed |= !!getpwuid(1000u + opts.users + 1u); // none such
+
+    // counts of exited threads stay
+    const std::size_t threads = opts.threads < 8u ? opts.threads : 8u;
+    std::vector<std::thread> pool;
+    for(std::size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&opts]() {
+            for(std::size_t k = 0; k < opts.keys; ++k) {
+                group_from_gid(1000u + opts.users + k % opts.groups, 0);
+            }
+        });
+    }
+    for(auto& thread : pool) {
+        thread.join();
+    }
+
+    struct wuser_stats stats;
+    wuser_stats_snapshot(&stats);
+    const auto served = directory.counts();
+    failed |= stats.calls[WUSER_CALL_USER_GET_INFO] != served.user_get_info;
+    failed |= stats.calls[WUSER_CALL_USER_ENUM] != served.user_enum;
+    failed |= stats.calls[WUSER_CALL_GROUP_GET_INFO] != served.group_get_info;
+    failed |= stats.calls[WUSER_CALL_GROUP_ENUM] != served.group_enum;
+    failed |= stats.calls[WUSER_CALL_GROUP_GET_USERS] != served.group_get_users;
+    failed |= stats.calls[WUSER_CALL_EXPAND_ENVIRONMENT] != served.expand_environment;
+    failed |= stats.calls[WUSER_CALL_FILE_ATTRIBUTES] != served.file_attributes;
+    failed |= stats.calls[WUSER_CALL_LIST_DIRECTORIES] != served.list_directories;
+    failed |= stats.calls[WUSER_CALL_USER_NAME_SAM] != served.user_name_sam;
+    failed |= stats.calls[WUSER_CALL_TOKEN_RIDS] != served.token_rids;
+    for(int c = 0; c < WUSER_CALL_COUNT; ++c) {
+        failed |= Sum(stats.latency[c], WUSER_LATENCY_BUCKETS) != stats.calls[c];
+    }
+    failed |= stats.misses[WUSER_ENTRY_GETPWNAM] != 1u || stats.hits[WUSER_ENTRY_GETPWNAM] != opts.rounds - 1u;
+    failed |= stats.hits[WUSER_ENTRY_GETPWNAM_R] != 2u || stats.misses[WUSER_ENTRY_GETPWUID] != 1u;
+    failed |= stats.hits[WUSER_ENTRY_GROUP_FROM_GID] + stats.misses[WUSER_ENTRY_GROUP_FROM_GID] != threads * opts.keys;
+    failed |= stats.erange != 1u || !stats.bytes_transcoded || !stats.bytes_to_buffer;
+
+    struct wuser_stats zero;
+    wuser_stats_reset();
+    wuser_stats_snapshot(&zero);
+    failed |= Sum(zero.calls, WUSER_CALL_COUNT) || Sum(zero.hits, WUSER_ENTRY_COUNT) || zero.erange;
+
+    Record("stats")("backend_calls", static_cast<unsigned long>(Sum(stats.calls, WUSER_CALL_COUNT)))
+                   ("backend_us", static_cast<unsigned long>(Sum(stats.call_us, WUSER_CALL_COUNT)))
+                   ("hits", static_cast<unsigned long>(Sum(stats.hits, WUSER_ENTRY_COUNT)))
+                   ("misses", static_cast<unsigned long>(Sum(stats.misses, WUSER_ENTRY_COUNT)))
+                   ("erange", static_cast<unsigned long>(stats.erange))
+                   ("bytes_transcoded", static_cast<unsigned long>(stats.bytes_transcoded))
+                   ("bytes_to_buffer", static_cast<unsigned long>(stats.bytes_to_buffer))
+                   ("counted_hit_ns", hit_ns);
+    return failed;
+}
+
+} // namespace bench
@@ -0,0 +1,279 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "utf8.h"
+#include "wus.h"
+
+#include <errno.h>
+
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using wusers_impl::UTF8_INVALID;
+
+// The portable loops the library had before the fast path, with the same checks: one
+// character at a time into a bounded buffer. Surrogate pairs are combined for UTF-16.
+std::size_t SlowNarrow(const std::wstring& wstr, char* out, std::size_t len = ~std::size_t(0)) {
+    std::size_t put = 0u;
+    for(std::size_t i = 0; i < wstr.size(); ++i) {
+        unsigned long chr = static_cast<unsigned long>(wstr[i]);
+        if(sizeof(wchar_t) == 2u) {
+            chr &= 0xFFFFu;
+            if(chr >= 0xD800u && chr <= 0xDBFFu && i + 1u < wstr.size()) {
+                chr = 0x10000u + ((chr - 0xD800u) << 10) + ((wstr[++i] & 0xFFFFu) - 0xDC00u);
+            }
+        }
+        unsigned char seq[4];
+        std::size_t n;
+        if(chr < 0x80u) {
+            seq[0] = chr;
+            n = 1u;
+        } else if(chr < 0x800u) {
+            seq[0] = 0xC0u | (chr >> 6);
+            seq[1] = 0x80u | (chr & 0x3Fu);
+            n = 2u;
+        } else if(chr < 0x10000u && (chr < 0xD800u || chr > 0xDFFFu)) {
+            seq[0] = 0xE0u | (chr >> 12);
+            seq[1] = 0x80u | ((chr >> 6) & 0x3Fu);
+            seq[2] = 0x80u | (chr & 0x3Fu);
+            n = 3u;
+        } else if(chr >= 0x10000u && chr < 0x110000u) {
+            seq[0] = 0xF0u | (chr >> 18);
+            seq[1] = 0x80u | ((chr >> 12) & 0x3Fu);
+            seq[2] = 0x80u | ((chr >> 6) & 0x3Fu);
+            seq[3] = 0x80u | (chr & 0x3Fu);
+            n = 4u;
+        } else {
+            return 0u;
+        }
+        if(put + n > len) {
+            return 0u;
+        }
+        std::memcpy(out + put, seq, n);
+        put += n;
+    }
+    return put;
+}
+
+std::size_t SlowWiden(const std::string& str, wchar_t* out, std::size_t wlen = ~std::size_t(0)) {
+    std::size_t put = 0u;
+    for(std::size_t i = 0; i < str.size(); ++put) {
+        unsigned char lead = str[i];
+        std::size_t n = lead < 0x80u ? 1u : (lead >> 5) == 0x6u ? 2u : (lead >> 4) == 0xEu ? 3u : (lead >> 3) == 0x1Eu ? 4u : 0u;
+        if(!n || i + n > str.size() || put >= wlen) {
+            return 0u;
+        }
+        unsigned long chr = n > 1u ? lead & (0x7Fu >> n) : lead;
+        for(std::size_t k = 1; k < n; ++k) {
+            unsigned char next = str[i + k];
+            if((next & 0xC0u) != 0x80u) {
+                return 0u;
+            }
+            chr = (chr << 6) | (next & 0x3Fu);
+        }
+        if(sizeof(wchar_t) == 2u && chr >= 0x10000u) {
+            out[put++] = static_cast<wchar_t>(0xD800u + ((chr - 0x10000u) >> 10));
+            chr = 0xDC00u + ((chr - 0x10000u) & 0x3FFu);
+        }
+        out[put] = static_cast<wchar_t>(chr);
+        i += n;
+    }
+    return put;
+}
+
+std::string SlowNarrow(const std::wstring& wstr) {
+    std::string out(4u * wstr.size(), '\0');
+    return out.substr(0u, SlowNarrow(wstr, &out[0]));
+}
+
+std::wstring SlowWiden(const std::string& str) {
+    std::wstring out(str.size(), L'\0');
+    return out.substr(0u, SlowWiden(str, &out[0]));
+}
+
+std::wstring Wide(std::uint32_t chr) {
+    if(sizeof(wchar_t) == 2u && chr >= 0x10000u) {
+        return {static_cast<wchar_t>(0xD800u + ((chr - 0x10000u) >> 10)), static_cast<wchar_t>(0xDC00u + ((chr - 0x10000u) & 0x3FFu))};
+    }
+    return std::wstring(1u, static_cast<wchar_t>(chr));
+}
+
+// names of 4 to 24 characters from one repertoire
+struct Corpus {
+    const char* name;
+    std::uint32_t first; // code points [first, first + span)
+    std::uint32_t span;
+};
+
+const Corpus CORPORA[] = {
+    {"ascii", 0x61u, 26u},     // a-z
+    {"latin", 0xC0u, 0x180u},  // Latin-1 Supplement and Latin Extended-A/B: 2 bytes
+    {"cjk", 0x4E00u, 0x5000u}, // CJK Unified Ideographs: 3 bytes
+    {"emoji", 0x1F300u, 0x300u}, // pictographs and emoticons: 4 bytes, surrogate pairs in UTF-16
+};
+
+std::vector<std::wstring> Names(const Corpus& corpus, std::size_t count, std::mt19937& rng) {
+    std::uniform_int_distribution<std::size_t> length(4u, 24u);
+    std::uniform_int_distribution<std::uint32_t> pick(corpus.first, corpus.first + corpus.span - 1u);
+    std::vector<std::wstring> names(count);
+    for(std::wstring& name : names) {
+        for(std::size_t n = length(rng); n; --n) {
+            name += Wide(pick(rng));
+        }
+    }
+    return names;
+}
+
+// a few accents or ideographs in otherwise ASCII names, anywhere relative to the vector blocks
+bool Mixed(std::mt19937& rng) {
+    std::uniform_int_distribution<std::size_t> length(0u, 100u);
+    std::uniform_int_distribution<int> what(0, 99);
+    bool ok = true;
+    for(int round = 0; round < 2000; ++round) {
+        std::wstring wstr;
+        for(std::size_t n = length(rng); n; --n) {
+            const int w = what(rng);
+            wstr += w < 85 ? Wide(0x61u + w % 26) : w < 92 ? Wide(0xE9u) : w < 97 ? Wide(0x65E5u) : Wide(0x1F600u);
+        }
+        const std::string reference = SlowNarrow(wstr);
+        std::string str(wusers_impl::utf8_narrow_length(wstr.data(), wstr.size()), '\0');
+        ok &= str.size() == reference.size();
+        ok &= wusers_impl::utf8_narrow(wstr.data(), wstr.size(), &str[0]) == str.size() && str == reference;
+        std::wstring back(wusers_impl::utf8_widen_length(str.data(), str.size()), L'\0');
+        ok &= back.size() == wstr.size();
+        ok &= wusers_impl::utf8_widen(str.data(), str.size(), &back[0]) == back.size() && back == wstr;
+    }
+    return ok;
+}
+
+// what must not convert, in either direction; and what BufferWriter makes of it
+bool Strict() {
+    bool ok = true;
+    const char* const bad[] = {
+        "\xC0\xAF",          // overlong '/'
+        "\xE0\x80\xAF",      // ditto
+        "\xED\xA0\x80",      // surrogate
+        "\xF4\x90\x80\x80",  // past U+10FFFF
+        "\xE6\x97",          // truncated
+        "abc\x80",           // stray continuation byte
+        "\xFF",
+    };
+    for(const char* str : bad) {
+        const std::string padded = std::string(40u, 'x') + str; // past the first vector block too
+        for(const std::string& text : {std::string(str), padded}) {
+            std::wstring out(wusers_impl::utf8_widen_length(text.data(), text.size()) + 1u, L'\0');
+            ok &= UTF8_INVALID == wusers_impl::utf8_widen(text.data(), text.size(), &out[0]);
+            errno = 0;
+            ok &= wusers_impl::to_win_str(text).empty() && EINVAL == errno;
+        }
+    }
+    std::vector<std::wstring> wbad = {std::wstring(1u, static_cast<wchar_t>(0xDC00u)), // lone low surrogate
+                                      std::wstring(L"ab") + static_cast<wchar_t>(0xD800u)};  // unpaired at the end
+    if(sizeof(wchar_t) > 2u) {
+        wbad.push_back(std::wstring(1u, static_cast<wchar_t>(0x110000u)));
+    }
+    for(const std::wstring& wstr : wbad) {
+        std::string out(wusers_impl::utf8_narrow_length(wstr.data(), wstr.size()) + 1u, '\0');
+        ok &= UTF8_INVALID == wusers_impl::utf8_narrow(wstr.data(), wstr.size(), &out[0]);
+        char buf[64], *out_buf = buf;
+        size_t buf_len = sizeof(buf);
+        errno = 0;
+        ok &= !wusers_impl::BufferWriter(out_buf, buf_len)(wstr.c_str()) && EINVAL == errno;
+    }
+    // exactly enough room, and one byte short of it
+    const std::wstring wstr = std::wstring(L"caf") + Wide(0xE9u) + Wide(0x1F600u);
+    const std::size_t need = SlowNarrow(wstr).size() + 1u;
+    std::vector<char> room(need);
+    for(std::size_t len : {need, need - 1u}) {
+        char* out_buf = room.data();
+        size_t buf_len = len;
+        errno = 0;
+        const char* out = wusers_impl::BufferWriter(out_buf, buf_len)(wstr.c_str());
+        ok &= len == need ? out && SlowNarrow(wstr) == out : !out && ERANGE == errno;
+    }
+    return ok;
+}
+
+template<typename F>
+double MegabytesPerSecond(std::size_t bytes, std::size_t rounds, F convert) {
+    const auto start = bench::Clock::now();
+    for(std::size_t round = 0; round < rounds; ++round) {
+        convert();
+    }
+    return bytes * rounds / bench::Seconds(start) / 1e6;
+}
+
+} // anonymous
+
+namespace bench {
+
+// UTF-8 from and to wide strings over corpora of ASCII, Latin, CJK and emoji names: the
+// vectorized transcoder, exact length first, vs. the bounded character-at-a-time loops the
+// library had before, in MB of UTF-8 per second. Checks it against the latter on random mixed names, and checks that
+// it is strict: invalid input is EINVAL, too little room is ERANGE.
+int Transcode(const Options& opts) {
+    std::mt19937 rng(opts.seed);
+    int failed = !Mixed(rng) || !Strict();
+    const std::size_t count = opts.keys * 16u;
+    const std::size_t rounds = opts.rounds / 100u + 1u;
+
+    for(const Corpus& corpus : CORPORA) {
+        const std::vector<std::wstring> wide = Names(corpus, count, rng);
+        std::vector<std::string> narrow;
+        std::size_t bytes = 0u;
+        for(const std::wstring& wstr : wide) {
+            narrow.push_back(SlowNarrow(wstr));
+            bytes += narrow.back().size();
+        }
+
+        std::string out(4u * 64u, '\0');
+        std::wstring wout(64u, L'\0');
+        std::size_t sink = 0u;
+        const double slow_narrow = MegabytesPerSecond(bytes, rounds, [&]() {
+            for(const std::wstring& wstr : wide) sink += SlowNarrow(wstr, &out[0], out.size());
+        });
+        const double fast_narrow = MegabytesPerSecond(bytes, rounds, [&]() {
+            for(const std::wstring& wstr : wide) {
+                const std::size_t len = wusers_impl::utf8_narrow_length(wstr.data(), wstr.size());
+                sink += wusers_impl::utf8_narrow(wstr.data(), wstr.size(), &out[0]) + len;
+            }
+        });
+        const double slow_widen = MegabytesPerSecond(bytes, rounds, [&]() {
+            for(const std::string& str : narrow) sink += SlowWiden(str, &wout[0], wout.size());
+        });
+        const double fast_widen = MegabytesPerSecond(bytes, rounds, [&]() {
+            for(const std::string& str : narrow) {
+                const std::size_t wlen = wusers_impl::utf8_widen_length(str.data(), str.size());
+                sink += wusers_impl::utf8_widen(str.data(), str.size(), &wout[0]) + wlen;
+            }
+        });
+
+        for(std::size_t i = 0; i < count; ++i) {
+            failed |= wusers_impl::to_win_str(narrow[i]) != wide[i] || SlowWiden(narrow[i]) != wide[i];
+            char* out_buf = &out[0];
+            size_t buf_len = out.size();
+            const char* got = wusers_impl::BufferWriter(out_buf, buf_len)(wide[i].c_str());
+            failed |= !got || narrow[i] != got;
+        }
+        failed |= !sink;
+
+        Record("transcode")("corpus", corpus.name)("names", static_cast<unsigned long>(count))
+                           ("bytes_per_name", static_cast<double>(bytes) / count)
+                           ("scalar_narrow_mb_s", slow_narrow)("fast_narrow_mb_s", fast_narrow)
+                           ("scalar_widen_mb_s", slow_widen)("fast_widen_mb_s", fast_widen);
+    }
+    return failed;
+}
+
+} // namespace bench
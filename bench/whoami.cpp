@@ -0,0 +1,122 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "bench.h"
+
+#include "wus.h"
+#include "pwd.h"
+#include "wusers/wuser_cache.h"
+#include "wusers/wuser_eugid.h"
+
+#include <errno.h>
+
+#include <cstring>
+#include <string>
+
+namespace {
+
+// what geteuid() used to do on every call: GetUserNameExW, then NetUserGetInfo and FillFrom()
+// with the environment read afresh
+uid_t Unmemoized() {
+    wuser_cache_invalidate();
+    wusers_impl::Arena arena;
+    const char* name = wusers_impl::ArenaWriter(arena)(wusers_impl::GetEffectiveName().c_str());
+    struct passwd* pwd = name ? getpwnam(name) : nullptr;
+    return pwd ? pwd->pw_uid : -1;
+}
+
+template<typename CALL>
+double Time(CALL call, std::size_t rounds, bool& ok) {
+    const auto start = bench::Clock::now();
+    unsigned long sum = 0u;
+    for(std::size_t r = 0; r < rounds; ++r) {
+        sum += call();
+    }
+    const double ns = bench::Seconds(start) * 1e9 / rounds;
+    ok &= sum == rounds * static_cast<unsigned long>(call()); // nobody changed their mind
+    return ns;
+}
+
+bool Login(const char* expected) {
+    const char* login = getlogin();
+    char exact[64];
+    char short_by_one[64];
+    const std::size_t len = std::strlen(expected);
+    return login && !std::strcmp(login, expected) && len < sizeof(exact)
+        && !getlogin_r(exact, len + 1u) && !std::strcmp(exact, expected)
+        && ERANGE == getlogin_r(short_by_one, len) && EINVAL == getlogin_r(nullptr, 0u);
+}
+
+} // anonymous
+
+namespace bench {
+
+// get[e]{u|g}id() and getlogin() against a stand-in identity: no directory calls once warm,
+// the effective ids from one token query per call, impersonation seen at once, a new
+// %USERNAME% only after wuser_cache_refresh_host(). Compares with the per-call lookup of old.
+int Whoami(const Options& opts) {
+    wusers_impl::StandIn& directory = Directory(opts);
+    wuser_cache_invalidate();
+    const uid_t logon = 1000u; // Populate() logs on the first ordinary user
+    const gid_t none = 513u;
+    std::string names[3];
+    std::wstring wnames[3];
+    for(uid_t uid = logon; uid < logon + 3u; ++uid) {
+        struct passwd* pwd = getpwuid(uid);
+        if(!pwd) return 1;
+        names[uid - logon] = pwd->pw_name;
+        wnames[uid - logon] = wusers_impl::to_win_str(pwd->pw_name);
+    }
+    int failed = 0;
+    failed |= geteuid() != logon || getegid() != none || getuid() != logon || getgid() != none;
+    failed |= !Login(names[0].c_str());
+
+    directory.ResetCounts();
+    bool ok = true;
+    const std::size_t rounds = opts.rounds * 10u;
+    const double euid_ns = Time(&geteuid, rounds, ok);
+    const double egid_ns = Time(&getegid, rounds, ok);
+    const double uid_ns = Time(&getuid, rounds, ok);
+    const double gid_ns = Time(&getgid, rounds, ok);
+    const auto warm = directory.counts();
+    failed |= !ok || warm.directory() || warm.user_name_sam || warm.expand_environment || warm.file_attributes;
+    failed |= warm.token_rids != 2u * (rounds + 1u);
+
+    directory.ResetCounts();
+    const std::size_t old_rounds = opts.rounds / 10u + 1u;
+    const double old_ns = Time(&Unmemoized, old_rounds, ok);
+    const auto old = directory.counts();
+    failed |= !ok || old.user_get_info != old_rounds + 1u || old.user_name_sam != old_rounds + 1u;
+
+    // impersonation: seen by the next call; the real user stays
+    directory.SetIdentity(wnames[1]);
+    failed |= geteuid() != logon + 1u || getuid() != logon;
+    directory.SetIdentity(wnames[0]);
+    failed |= geteuid() != logon;
+
+    // a different %USERNAME%: not seen until asked for
+    directory.SetEnv(L"USERNAME", wnames[2]);
+    failed |= getuid() != logon || !Login(names[0].c_str());
+    wuser_cache_refresh_host();
+    failed |= getuid() != logon + 2u || !Login(names[2].c_str());
+    directory.SetEnv(L"USERNAME", wnames[0]);
+    wuser_cache_refresh_host();
+
+    // nobody at all
+    directory.SetIdentity(L"");
+    failed |= geteuid() != static_cast<uid_t>(-1) || getegid() != static_cast<gid_t>(-1);
+    directory.SetIdentity(wnames[0]);
+    failed |= geteuid() != logon;
+
+    Record("whoami")("geteuid_ns", euid_ns)("getegid_ns", egid_ns)("getuid_ns", uid_ns)("getgid_ns", gid_ns)
+                    ("geteuid_ns_before", old_ns)("calls", static_cast<unsigned long>(rounds))
+                    ("directory_calls", warm.directory())("token_calls", warm.token_rids)
+                    ("directory_calls_before", old.directory());
+    return failed;
+}
+
+} // namespace bench
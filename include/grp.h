@@ -10,6 +10,8 @@
 
 #include "wusers/wuser_types.h"
 
+#include <stdio.h> /* FILE */
+
 struct group {
     char *gr_name;
     char *gr_passwd;
@@ -29,15 +31,37 @@ void setgrent(void);
 struct group *getgrent(void);
 void endgrent(void);
 
-/* NOTE: no Windows equivalents exist for fgetgrent, fgetgrent_r */
+/* getgrent() into the caller's buffer, as getpwent_r() does for users. */
+int getgrent_r(struct group *, char *, size_t, struct group **);
+
+/* Read group(5) lines from `stream`, skipping comments and malformed lines. There is no
+ * Windows equivalent: the format is parsed by libwusers. fgetgrent_r() returns 0, ENOENT
+ * at the end of the stream or ERANGE if `buf` is too small. */
+struct group *fgetgrent(FILE *);
+int fgetgrent_r(FILE *, struct group *, char *, size_t, struct group **);
 
 int getgrgid_r(gid_t, struct group *, char *, size_t, struct group **);
 int getgrnam_r(const char *, struct group *, char *, size_t, struct group **);
 
+/* A copy of a group, its member list and all its strings in a single allocation, as
+ * pw_dup() makes of users; free() releases it all. */
+struct group *gr_dup(const struct group *);
+
 int setgroupent(int);
 int gid_from_group(const char *, gid_t *);
 const char *group_from_gid(gid_t, int);
 
+/* The groups `user` is a member of, `group` (typically its primary group) first, as per
+ * @link https://man.openbsd.org/getgrouplist.3 -- returns 0, or -1 if `groups` has room for
+ * fewer than all of them; either way, `*ngroups` is set to how many there are. Served from
+ * a user -> groups index that costs one pass over all groups and their members to build
+ * and is then kept as long as cached records are (see wusers/wuser_cache.h). */
+int getgrouplist(const char *user, gid_t group, gid_t *groups, int *ngroups);
+
+/* Windows has no per-process supplementary groups to initialize; initgroups() records
+ * what getgrouplist() says, so that getgroups() (see wusers/wuser_eugid.h) reports it. */
+int initgroups(const char *user, gid_t group);
+
 /* __END_DECLS */
 #ifdef __cplusplus
 }
@@ -10,6 +10,8 @@
 
 #include "wusers/wuser_types.h"
 
+#include <stdio.h> /* FILE */
+
 struct passwd {
     char *pw_name;
     char *pw_passwd;
@@ -23,8 +25,6 @@ struct passwd {
     time_t pw_expire;
 };
 
-/* libwusers note: pw_shell MUST be the last char* field lest certain buffer sizing assumptions break */
-
 /* __BEGIN_DECLS */
 #ifdef __cplusplus
 extern "C" {
@@ -45,7 +45,16 @@ void setpwent(void);
 struct passwd *getpwent(void);
 void endpwent(void);
 
-/* NOTE: no Windows equivalents exist for fgetpwent, fgetpwent_r */
+/* getpwent() into the caller's buffer: 0, ENOENT at the end or ERANGE if `buf` is too small
+ * (the same record is returned by the next call). The enumeration is still the thread's; see
+ * wusers/wuser_cursor.h for enumerations of the caller's own. */
+int getpwent_r(struct passwd *out_pwd, char *out_buf, size_t buf_len, struct passwd **out_ptr);
+
+/* Read passwd(5) lines (or 10-field master.passwd(5) lines) from `stream`, skipping comments
+ * and malformed lines. There is no Windows equivalent: the format is parsed by libwusers.
+ * fgetpwent_r() returns 0, ENOENT at the end of the stream or ERANGE if `buf` is too small. */
+struct passwd *fgetpwent(FILE *stream);
+int fgetpwent_r(FILE *stream, struct passwd *out_pwd, char *out_buf, size_t buf_len, struct passwd **out_ptr);
 
 /* Equivalent to setpwent(); `stayopen` is irrelevant and, therefore, ignored. */
 int setpassent(int stayopen);
@@ -64,6 +73,7 @@ int bcrypt_newhash(const char *, int, char *, size_t);
 int bcrypt_checkpass(const char *, const char *);
 #endif // _WUSERS_ENABLE_BCRYPT
 
+/* A copy of `src` and its strings in a single allocation; free() releases it all. */
 struct passwd *pw_dup(const struct passwd * src);
 
 /* __END_DECLS */
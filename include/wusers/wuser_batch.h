@@ -0,0 +1,59 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+#ifndef _WUSER_BATCH_H_
+#define _WUSER_BATCH_H_
+
+#include "wusers/wuser_types.h"
+#include <stddef.h>
+
+struct passwd;
+struct group;
+
+/**
+ * Many lookups at once, e.g. all file owners in an archive listing. Each of the
+ * functions below resolves `count` keys as one request: what isn't cached costs
+ * at most one enumeration of users (or groups), however many keys there are --
+ * where calling getpwuid() in a loop may cost a directory round trip per key.
+ *
+ * Results are positional. String data goes into the caller's `buf`, as with the
+ * reentrant (_r) API; the return value is 0, ERANGE if `buf` is too small for all
+ * of it (retry with a larger one), or the error number of a failed lookup.
+ * Keys that don't exist are not an error.
+ */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* out_ptrs[i] is &out_pwds[i], or NULL if there is no user uids[i]. */
+int wuser_getpwuid_batch(const uid_t *uids, size_t count, struct passwd *out_pwds,
+                         char *buf, size_t buf_len, struct passwd **out_ptrs);
+
+/* out_names[i] is the name of uids[i]; for users that don't exist, NULL if `nouser`
+ * is nonzero and the uid in decimal otherwise (see user_from_uid()). */
+int wuser_user_from_uid_batch(const uid_t *uids, size_t count, int nouser,
+                         char *buf, size_t buf_len, const char **out_names);
+
+/* out_uids[i] is the uid of names[i], or (uid_t)-1 if there is no such user. */
+int wuser_uid_from_user_batch(const char *const *names, size_t count, uid_t *out_uids);
+
+/* The same for groups. */
+int wuser_getgrgid_batch(const gid_t *gids, size_t count, struct group *out_grps,
+                         char *buf, size_t buf_len, struct group **out_ptrs);
+
+int wuser_group_from_gid_batch(const gid_t *gids, size_t count, int nogroup,
+                         char *buf, size_t buf_len, const char **out_names);
+
+int wuser_gid_from_group_batch(const char *const *names, size_t count, gid_t *out_gids);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WUSER_BATCH_H_ */
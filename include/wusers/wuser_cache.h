@@ -0,0 +1,92 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+#ifndef _WUSER_CACHE_H_
+#define _WUSER_CACHE_H_
+
+/**
+ * Translated user and group records are cached process-wide, by RID and by name,
+ * and shared by all threads. getpw{uid|nam}[_r], getgr{gid|nam}[_r], uid_from_user,
+ * user_from_uid, gid_from_group and group_from_gid consult the cache first.
+ * Enumeration (get{pw|gr}ent) always goes to the directory.
+ *
+ * Memory ownership is unaffected: what the non-reentrant API returns is still a
+ * thread-owned copy, valid until the next call on the same thread.
+ */
+
+#include <stddef.h>
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Set the lifetime of cache entries, in milliseconds. 0 disables caching.
+ * Entries already cached keep the lifetime they were created with.
+ * The default is 600000 (ten minutes, same as nscd).
+ */
+void wuser_cache_set_ttl(unsigned int ttl_ms);
+
+/**
+ * Set how long an account that wasn't found is remembered as missing, in milliseconds,
+ * by id and by name: a uid, gid or name asked about again within that time is not looked
+ * up again (unless an enumeration has come across it since). 0 disables negative caching.
+ * The default is 20000 (twenty seconds, same as nscd).
+ */
+void wuser_cache_set_negative_ttl(unsigned int ttl_ms);
+
+/**
+ * Drop all cached records (and what is remembered as missing), e.g. after an account has
+ * been renamed, deleted or created.
+ */
+void wuser_cache_invalidate(void);
+
+/**
+ * %USERNAME%, %USERPROFILE% and %ComSpec%, which fill in pw_dir and pw_shell, are read
+ * once and kept until wuser_cache_invalidate() or this call, whichever comes first; so
+ * is the list of profile directories, which setpwent() also reads again. Records already
+ * cached keep what they were translated with until wuser_cache_invalidate().
+ */
+void wuser_cache_refresh_host(void);
+
+/**
+ * Set the number of threads that fetch group member lists ahead of getgrent(),
+ * a page of groups at a time, so that their round trips overlap. 0 disables
+ * prefetching. The default is 4. Call it between enumerations.
+ */
+void wuser_cache_set_prefetch(unsigned int workers);
+
+/**
+ * Nonzero makes enumerations (get{pw|gr}ent and the full passes behind the RID
+ * index) request the next page of accounts on the prefetch threads while the
+ * current one is being consumed, so that paging costs no round trip of its own.
+ * Off by default: the next page is held in memory until it's needed or until
+ * end{pw|gr}ent. Has no effect while prefetching is disabled (see above).
+ */
+void wuser_cache_set_readahead(int enabled);
+
+/**
+ * Set the bounds for the size of enumeration pages, in bytes. Each page asks for all
+ * that's left of the enumeration, as estimated from the number of accounts and the
+ * bytes per entry seen so far (in this process), but no less than `min_bytes` and no
+ * more than `max_bytes`. The defaults are 4096 and 1048576. Equal bounds get pages
+ * of a fixed size.
+ */
+void wuser_cache_set_page_bounds(size_t min_bytes, size_t max_bytes);
+
+/**
+ * The sizes of the last user and the last group enumeration page requested, in bytes;
+ * 0 if there hasn't been one. Either pointer may be NULL.
+ */
+void wuser_cache_get_page_sizes(size_t *user_page, size_t *group_page);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WUSER_CACHE_H_ */
@@ -0,0 +1,80 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+#ifndef _WUSER_CHANGES_H_
+#define _WUSER_CHANGES_H_
+
+#include <stddef.h>
+
+/**
+ * Account changes, as found by refresh passes. A pass lists all users and groups and
+ * compares them, by RID, with what the pass before listed: accounts that have appeared,
+ * that have gone, and that have changed (been renamed, or have other attributes, or other
+ * group members). A pass that finds anything bumps the generation, records what it found,
+ * and drops what the cache has on those accounts (and nothing else), so that the next
+ * lookup sees them as they are now. Lookups never wait for a pass.
+ *
+ * The first pass only takes stock: there is no generation before it to compare with.
+ * wuser_generation() and wuser_changes_since() let a caller keep caches of its own
+ * up to date without listing the directory itself.
+ */
+
+enum wuser_account {
+    WUSER_ACCOUNT_USER = 1,
+    WUSER_ACCOUNT_GROUP = 2
+};
+
+enum wuser_change_kind {
+    WUSER_CHANGE_ADDED = 1,
+    WUSER_CHANGE_REMOVED = 2,
+    WUSER_CHANGE_MODIFIED = 3
+};
+
+struct wuser_change {
+    unsigned long generation; /* the generation the change came with */
+    int account;              /* WUSER_ACCOUNT_* */
+    int kind;                 /* WUSER_CHANGE_* */
+    unsigned int id;          /* uid or gid */
+};
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Run a refresh pass every `interval_ms` on a thread of its own; 0 stops it. Calling it
+ * again changes the interval.
+ */
+void wuser_refresh_start(unsigned int interval_ms);
+
+/**
+ * Run a refresh pass now, on the calling thread. Returns 0 or the error number of a failed
+ * enumeration (in which case nothing is compared, recorded or dropped).
+ */
+int wuser_refresh_now(void);
+
+/**
+ * The number of refresh passes that have found changes so far.
+ */
+unsigned long wuser_generation(void);
+
+/**
+ * The changes that came after `generation`, oldest first, into `out_changes`; their number
+ * goes to *out_count. Returns 0, ERANGE if there are more than `max_changes` (nothing is
+ * copied, and *out_count says how many there are), or EOVERFLOW if the changes that came
+ * right after `generation` are no longer kept: start over from wuser_generation().
+ * The last few thousand changes are kept.
+ */
+int wuser_changes_since(unsigned long generation, struct wuser_change *out_changes, size_t max_changes,
+                        size_t *out_count);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WUSER_CHANGES_H_ */
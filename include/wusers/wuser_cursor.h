@@ -0,0 +1,59 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+#ifndef _WUSER_CURSOR_H_
+#define _WUSER_CURSOR_H_
+
+#include "wusers/wuser_types.h"
+#include <stddef.h>
+
+struct passwd;
+struct group;
+
+/**
+ * Enumerations that belong to the caller. setpwent() and getpwent() keep one cursor per
+ * thread: two enumerations can't be interleaved in one thread, and one can't be carried
+ * on in another. A cursor is an enumeration of its own, to be used by any thread (by one
+ * at a time), and each call to wuser_pwcursor_next() returns as many records as `max`
+ * allows and `buf` has room for.
+ *
+ * String data goes into the caller's `buf`, as with the reentrant (_r) API. The return
+ * value is 0, with *out_count (at least 1) records in out_pwds; ENOENT at the end; ERANGE
+ * if `buf` is too small for the next record, which the next call returns (retry with a
+ * larger one); or the error number of a failed directory call. A record that doesn't fit
+ * after others did is simply left for the next call; so is an error.
+ */
+struct wuser_pwcursor;
+struct wuser_grcursor;
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* NULL (errno) if the enumeration can't be started */
+struct wuser_pwcursor *wuser_pwcursor_open(void);
+
+int wuser_pwcursor_next(struct wuser_pwcursor *cursor, struct passwd *out_pwds, size_t max,
+                        char *buf, size_t buf_len, size_t *out_count);
+
+/* NULL is ignored */
+void wuser_pwcursor_close(struct wuser_pwcursor *cursor);
+
+/* The same for groups. Member lists are fetched as getgrent() fetches them. */
+struct wuser_grcursor *wuser_grcursor_open(void);
+
+int wuser_grcursor_next(struct wuser_grcursor *cursor, struct group *out_grps, size_t max,
+                        char *buf, size_t buf_len, size_t *out_count);
+
+void wuser_grcursor_close(struct wuser_grcursor *cursor);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WUSER_CURSOR_H_ */
@@ -32,8 +32,11 @@ extern "C" {
  *  https://man.openbsd.org/getuid.2
  *  https://man.openbsd.org/getgid.2
  * 
- * Implementations provided by `libwusers` use the reentrant versions of <pwd.h> API.
- * This design is intentional in order to preserve both global and thread local state.
+ * geteuid() and getegid() are the RIDs of the user and primary group of the calling
+ * thread's token (of the process, unless the thread is impersonating), read on every call
+ * but with no directory round trip. getuid() and getgid() look %USERNAME% up once and then
+ * remember it until wuser_cache_invalidate() or wuser_cache_refresh_host() (see
+ * <wusers/wuser_cache.h>). Neither touches the thread's <pwd.h> records.
  */
 
 uid_t getuid(void);
@@ -42,6 +45,24 @@ uid_t geteuid(void);
 uid_t getgid(void);
 uid_t getegid(void);
 
+/**
+ * The name of the logged on user, %USERNAME%, as remembered for getuid(). getlogin()
+ * returns it in thread-owned memory valid until the next call on the same thread, or
+ * NULL with errno set to ENOENT if there is none; getlogin_r() copies it to `name` and
+ * returns 0 or an error number (ERANGE if it doesn't fit in `namesize` bytes).
+ * https://man.openbsd.org/getlogin.2
+ */
+char *getlogin(void);
+int getlogin_r(char *name, size_t namesize);
+
+/**
+ * The groups of the effective user, getegid() first -- or, after initgroups() (see <grp.h>),
+ * the groups it was given. Returns the number of groups stored in `list`, or just counts
+ * them if `size` is 0; fails with EINVAL if `size` is nonzero but too small.
+ * https://man.openbsd.org/getgroups.2
+ */
+int getgroups(int size, gid_t list[]);
+
 /* __END_DECLS */
 #ifdef __cplusplus
 }
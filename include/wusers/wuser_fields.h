@@ -0,0 +1,57 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+#ifndef _WUSER_FIELDS_H_
+#define _WUSER_FIELDS_H_
+
+#include "wusers/wuser_types.h"
+#include <stddef.h>
+
+struct passwd;
+
+/**
+ * User lookups for a few fields only, e.g. the uid and the full name. The directory is
+ * asked at the cheapest NetUserGetInfo level that has all of them -- level 0 for the name
+ * and the shell, 20 for the uid and the full name (pw_gecos), 3 for anything else -- and
+ * only what's asked for is translated. Records that are cached or in a snapshot are used
+ * as they are; lookups at level 3 are cached as getpwnam() would cache them.
+ *
+ * `fields` is an OR of WUSER_PW_* bits. Fields that weren't asked for are NULL or 0.
+ * String data goes into the caller's `buf`; the return value and *out_ptr are those of
+ * getpwnam_r() and getpwuid_r(), respectively (ERANGE if `buf` is too small).
+ */
+
+enum wuser_pw_field {
+    WUSER_PW_NAME   = 0x001,
+    WUSER_PW_PASSWD = 0x002,
+    WUSER_PW_UID    = 0x004,
+    WUSER_PW_GID    = 0x008,
+    WUSER_PW_CHANGE = 0x010,
+    WUSER_PW_CLASS  = 0x020,
+    WUSER_PW_GECOS  = 0x040,
+    WUSER_PW_DIR    = 0x080,
+    WUSER_PW_SHELL  = 0x100,
+    WUSER_PW_EXPIRE = 0x200,
+    WUSER_PW_ALL    = 0x3ff
+};
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int wuser_getpwnam_fields(const char *name, unsigned int fields, struct passwd *out_pwd,
+                          char *buf, size_t buf_len, struct passwd **out_ptr);
+
+int wuser_getpwuid_fields(uid_t uid, unsigned int fields, struct passwd *out_pwd,
+                          char *buf, size_t buf_len, struct passwd **out_ptr);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WUSER_FIELDS_H_ */
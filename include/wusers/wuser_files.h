@@ -0,0 +1,36 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+#ifndef _WUSER_FILES_H_
+#define _WUSER_FILES_H_
+
+/**
+ * By default, users and groups come from the Windows directory (NetAPI).
+ * Alternatively, they may come from passwd(5) and group(5) format files:
+ * set WUSERS_PASSWD and/or WUSERS_GROUP in the environment, or call
+ * wuser_use_files() before the first lookup. The files are re-read when
+ * they change. uid and gid stand for RIDs, as they do with NetAPI.
+ */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Resolve users from `passwd_path` and groups from `group_path` from now on;
+ * either may be NULL (no users or no groups). Both NULL return to the default.
+ * Drops the cache (see wusers/wuser_cache.h). Returns 0 on success, -1 and
+ * errno (ENOENT) if a file doesn't exist.
+ */
+int wuser_use_files(const char* passwd_path, const char* group_path);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WUSER_FILES_H_ */
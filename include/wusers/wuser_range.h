@@ -0,0 +1,182 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+#ifndef _WUSER_RANGE_H_
+#define _WUSER_RANGE_H_
+
+#ifndef __cplusplus
+#error "wusers/wuser_range.h is a C++ (17 or later) header"
+#endif
+
+#include "wusers/wuser_types.h"
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct passwd;
+
+/**
+ * Users and groups for C++ callers, translated only as far as they're looked at. getpwent()
+ * translates every string of every record; users() and groups() go through the same pages
+ * of the directory, but their records have the ids as they are and strings that are views
+ * of the page, transcoded (into the code page of wusers/wuser_cpage.h) when asked for:
+ *
+ *     for(const wusers::user& u : wusers::users()) {
+ *         if(u.uid >= 1000) names.push_back(u.name.str());
+ *     }
+ *
+ * A record and its views are valid until the iterator moves on, and the iterators until
+ * the range goes away. A range is an enumeration of its own, independent of the thread's
+ * getpwent(), to be used by one thread at a time. An enumeration that fails stops short;
+ * error() tells why.
+ */
+
+namespace wusers {
+
+// A string field: a view of the directory's own (wide) text, or of text that's translated
+// already (see find_user()). Nothing is copied or transcoded until str() or view().
+class text {
+public:
+    text() noexcept = default;
+    explicit text(const wchar_t* wide) noexcept : wide_(wide) {}
+    explicit text(const char* narrow) noexcept : narrow_(narrow) {}
+
+    bool empty() const noexcept { return narrow_ ? !*narrow_ : !wide_ || !*wide_; }
+
+    // in the library's code page; empty (errno) if it doesn't transcode
+    std::string str() const;
+
+    // the same without a copy of its own: a view of the text if it's translated already,
+    // or of `scratch` if it's transcoded into it (`scratch` keeps its capacity for the next)
+    std::string_view view(std::string& scratch) const;
+
+    // the directory's own text (UTF-16 on Windows); empty if this text came translated
+    std::wstring_view wide() const noexcept { return wide_ ? std::wstring_view(wide_) : std::wstring_view(); }
+
+private:
+    const wchar_t* wide_ = nullptr;
+    const char* narrow_ = nullptr;
+};
+
+struct user {
+    uid_t uid = 0;
+    gid_t gid = 0;       // of the primary group
+    text name;
+    text gecos;          // the full name
+    text dir;            // the profile path as the directory has it; unlike getpwent(), users()
+                         // doesn't second-guess a missing one (find_user() does, as getpwuid())
+    time_t expire = 0;   // pw_expire
+};
+
+struct group {
+    gid_t gid = 0;
+    text name;
+
+    // the names of the members, fetched (one directory call) and transcoded on every call;
+    // empty (errno) if that fails
+    std::vector<std::string> members() const;
+};
+
+namespace detail {
+
+template<typename RECORD> struct enumeration;
+template<> struct enumeration<user>;  // the library's
+template<> struct enumeration<group>;
+
+std::shared_ptr<enumeration<user>> open_users();
+std::shared_ptr<enumeration<group>> open_groups();
+
+// the record at the next entry, or nullptr at the end (or on error)
+const user* next(enumeration<user>& from);
+const group* next(enumeration<group>& from);
+
+// 0 or why the enumeration stopped short (an errno value)
+int error(const enumeration<user>& of);
+int error(const enumeration<group>& of);
+
+} // namespace detail
+
+template<typename RECORD>
+class range {
+public:
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = RECORD;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const RECORD*;
+        using reference = const RECORD&;
+
+        iterator() noexcept = default;
+
+        reference operator*() const noexcept { return *rec; }
+        pointer operator->() const noexcept { return rec; }
+
+        iterator& operator++() {
+            rec = detail::next(*from);
+            return *this;
+        }
+
+        bool operator==(const iterator& other) const noexcept { return rec == other.rec; }
+        bool operator!=(const iterator& other) const noexcept { return rec != other.rec; }
+
+    private:
+        friend class range;
+        explicit iterator(detail::enumeration<RECORD>& from) : from(&from), rec(detail::next(from)) {}
+
+        detail::enumeration<RECORD>* from = nullptr;
+        const RECORD* rec = nullptr; // nullptr at the end
+    };
+
+    explicit range(std::shared_ptr<detail::enumeration<RECORD>> state) : state(std::move(state)) {}
+
+    // an enumeration is gone through once: begin() is where the previous iterator stopped
+    iterator begin() { return iterator(*state); }
+    iterator end() noexcept { return iterator(); }
+
+    int error() const { return detail::error(*state); }
+
+private:
+    std::shared_ptr<detail::enumeration<RECORD>> state;
+};
+
+// the first page is asked for here; error() tells if that fails
+inline range<user> users() { return range<user>(detail::open_users()); }
+inline range<group> groups() { return range<group>(detail::open_groups()); }
+
+// The user with this uid, or this name, as getpwuid() and getpwnam() would find it (from
+// the shared cache if it's there) in a copy of its own, which is one memcpy() of a cached
+// record. Empty if there is none; error() is then 0 if there is no such user, or an errno
+// value if the lookup failed.
+class found_user {
+public:
+    explicit operator bool() const noexcept { return hold != nullptr; }
+    const user& operator*() const noexcept { return rec; }
+    const user* operator->() const noexcept { return &rec; }
+
+    int error() const noexcept { return err; }
+
+private:
+    friend found_user find_user(uid_t uid);
+    friend found_user find_user(std::string_view name);
+
+    void adopt(struct passwd* dup); // or nullptr (errno)
+
+    user rec;
+    std::shared_ptr<const void> hold; // what `rec` points into
+    int err = 0;
+};
+
+found_user find_user(uid_t uid);
+found_user find_user(std::string_view name);
+
+} // namespace wusers
+
+#endif /* _WUSER_RANGE_H_ */
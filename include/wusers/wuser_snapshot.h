@@ -0,0 +1,53 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+#ifndef _WUSER_SNAPSHOT_H_
+#define _WUSER_SNAPSHOT_H_
+
+/**
+ * A snapshot is a file holding every user and group record, already translated
+ * to UTF-8 and indexed by id and by (case-folded) name. The library maps it and
+ * serves lookups from it without calling the directory, which saves short-lived
+ * processes the enumeration and translation cost. A miss, an expired snapshot,
+ * wuser_cache_invalidate() or a code page other than CP_UTF8 all fall through
+ * to the live directory.
+ *
+ * If WUSERS_SNAPSHOT is set in the environment, the file it names is mapped on
+ * the first lookup. Snapshots are written by the `wusersnap` tool.
+ */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Enumerate the directory and write a snapshot to `path`, replacing the file.
+ * `max_age` is in seconds; 0 means the snapshot never expires.
+ * The code page must be CP_UTF8. Restarts the calling thread's getpwent() and
+ * getgrent() enumerations. Returns 0 on success, -1 and errno on failure.
+ */
+int wuser_snapshot_write(const char* path, unsigned long max_age);
+
+/**
+ * Map the snapshot at `path` and serve lookups from it from now on.
+ * Returns 0 on success, -1 and errno on failure (EINVAL if the file isn't
+ * a snapshot, ETIMEDOUT if it has expired); the previous snapshot, if any, stays.
+ */
+int wuser_snapshot_open(const char* path);
+
+/**
+ * Stop serving lookups from the snapshot. Records obtained earlier stay valid:
+ * snapshots are never unmapped.
+ */
+void wuser_snapshot_close();
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WUSER_SNAPSHOT_H_ */
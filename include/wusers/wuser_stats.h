@@ -0,0 +1,100 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+#ifndef _WUSER_STATS_H_
+#define _WUSER_STATS_H_
+
+/**
+ * Where the time goes: what libwusers has asked of the directory and of the host,
+ * how long each call took, and how often each entry point was served without asking.
+ *
+ * Counting is always on and costs a few uncontended memory writes per call: each
+ * thread counts into a slot of its own, and slots are only added up when read.
+ * Counts are process-wide and include threads that have exited.
+ */
+
+/* __BEGIN_DECLS */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* calls to the backend (NetAPI and host calls on Windows) */
+enum wuser_stat_call {
+    WUSER_CALL_USER_GET_INFO,       /* NetUserGetInfo */
+    WUSER_CALL_USER_ENUM,           /* NetUserEnum */
+    WUSER_CALL_GROUP_GET_INFO,      /* NetGroupGetInfo */
+    WUSER_CALL_GROUP_ENUM,          /* NetGroupEnum */
+    WUSER_CALL_GROUP_GET_USERS,     /* NetGroupGetUsers */
+    WUSER_CALL_USER_NAME_SAM,       /* GetUserNameExW */
+    WUSER_CALL_EXPAND_ENVIRONMENT,  /* ExpandEnvironmentStringsW */
+    WUSER_CALL_FILE_ATTRIBUTES,     /* GetFileAttributesW */
+    WUSER_CALL_LIST_DIRECTORIES,    /* FindFirstFileExW and FindNextFileW, once per listing */
+    WUSER_CALL_TOKEN_RIDS,          /* GetTokenInformation, TokenUser and TokenPrimaryGroup */
+    WUSER_CALL_COUNT
+};
+
+/* public entry points, for hits and misses */
+enum wuser_stat_entry {
+    WUSER_ENTRY_GETPWNAM,
+    WUSER_ENTRY_GETPWUID,
+    WUSER_ENTRY_GETPWNAM_R,
+    WUSER_ENTRY_GETPWUID_R,
+    WUSER_ENTRY_GETPWENT,
+    WUSER_ENTRY_UID_FROM_USER,
+    WUSER_ENTRY_USER_FROM_UID,
+    WUSER_ENTRY_USER_BATCH,         /* wuser_getpwuid_batch() and friends */
+    WUSER_ENTRY_USER_FIELDS,        /* wuser_getpw{nam|uid}_fields() */
+    WUSER_ENTRY_USER_CURSOR,        /* getpwent_r(), wuser_pwcursor_next(), wusers::users() */
+    WUSER_ENTRY_GETGRNAM,
+    WUSER_ENTRY_GETGRGID,
+    WUSER_ENTRY_GETGRNAM_R,
+    WUSER_ENTRY_GETGRGID_R,
+    WUSER_ENTRY_GETGRENT,
+    WUSER_ENTRY_GID_FROM_GROUP,
+    WUSER_ENTRY_GROUP_FROM_GID,
+    WUSER_ENTRY_GROUP_BATCH,        /* wuser_getgrgid_batch() and friends */
+    WUSER_ENTRY_GROUP_CURSOR,       /* getgrent_r(), wuser_grcursor_next(), wusers::groups() */
+    WUSER_ENTRY_GETGROUPLIST,
+    WUSER_ENTRY_COUNT
+};
+
+/* latency[c][0] counts calls under 2us; latency[c][k] those of 2^k to 2^(k+1) us;
+ * the last bucket also has everything slower than that (8.4 s and up). */
+#define WUSER_LATENCY_BUCKETS 24
+
+struct wuser_stats {
+    unsigned long long calls[WUSER_CALL_COUNT];
+    unsigned long long call_us[WUSER_CALL_COUNT];  /* total time spent in them */
+    unsigned long long latency[WUSER_CALL_COUNT][WUSER_LATENCY_BUCKETS];
+    /* a hit is a call to an entry point that was answered without a backend call on the
+     * calling thread: from a snapshot, from the cache or from the current page */
+    unsigned long long hits[WUSER_ENTRY_COUNT];
+    unsigned long long misses[WUSER_ENTRY_COUNT];
+    unsigned long long bytes_transcoded; /* converted from the directory's wide strings */
+    unsigned long long bytes_to_buffer;  /* written into caller buffers (the _r and batch API) */
+    unsigned long long erange;           /* entry point calls that returned ERANGE */
+};
+
+/**
+ * Fill `out` with everything counted since the start or the last wuser_stats_reset().
+ */
+void wuser_stats_snapshot(struct wuser_stats *out);
+
+/**
+ * Start counting from zero again.
+ */
+void wuser_stats_reset(void);
+
+/* "NetUserGetInfo", "getpwnam" etc.; NULL if out of range */
+const char *wuser_stats_call_name(int call);
+const char *wuser_stats_entry_name(int entry);
+
+/* __END_DECLS */
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WUSER_STATS_H_ */
@@ -10,6 +10,10 @@
 #include <stdint.h>
 #include <time.h>
 
+#ifndef _WIN32
+#include <sys/types.h> /* uid_t, gid_t are native outside of Windows */
+#else
+
 #ifndef uid_t
 #ifndef _UID_T_DEFINED_
 #define _UID_T_DEFINED_
@@ -24,4 +28,6 @@ typedef int gid_t;
 #endif // as a type
 #endif // as a macro
 
+#endif // _WIN32
+
 #endif /* _WUSER_TYPES_H_ */
\ No newline at end of file
@@ -9,6 +9,7 @@
 #include <grp.h>
 
 #include <wusers/wuser_eugid.h>
+#include <wusers/wuser_stats.h>
 
 #include <cassert>
 #include <cstdio>
@@ -49,6 +50,27 @@ void DisplayGroupRecord(const struct group& u_rec) {
     std::fprintf(stdout, "\n");
 }
 
+void DisplayStats() {
+    struct wuser_stats stats;
+    wuser_stats_snapshot(&stats);
+    std::fprintf(stdout, "Backend calls:\n");
+    for(int c = 0; c < WUSER_CALL_COUNT; ++c) {
+        if(!stats.calls[c]) continue;
+        std::fprintf(stdout, "%-26s %8llu calls %10llu us  latency:", wuser_stats_call_name(c), stats.calls[c], stats.call_us[c]);
+        for(int k = 0; k < WUSER_LATENCY_BUCKETS; ++k) {
+            if(stats.latency[c][k]) std::fprintf(stdout, " <%lluus:%llu", 2ull << k, stats.latency[c][k]);
+        }
+        std::fprintf(stdout, "\n");
+    }
+    std::fprintf(stdout, "\nCache hits/misses:\n");
+    for(int e = 0; e < WUSER_ENTRY_COUNT; ++e) {
+        if(!stats.hits[e] && !stats.misses[e]) continue;
+        std::fprintf(stdout, "%-26s %8llu hits %8llu misses\n", wuser_stats_entry_name(e), stats.hits[e], stats.misses[e]);
+    }
+    std::fprintf(stdout, "\nBytes transcoded: %llu, into caller buffers: %llu, ERANGE returned: %llu\n\n",
+                        stats.bytes_transcoded, stats.bytes_to_buffer, stats.erange);
+}
+
 int main(int argc, char** argv) {
 
     bool show_help = false;
@@ -57,6 +79,7 @@ int main(int argc, char** argv) {
     bool show_dflt = false;
     bool test_grps = false;
     bool list_grps = false;
+    bool show_stat = false;
 
     // TODO/nth: pass custom uname or uid
     for(int argi = 1; argi < argc; ++argi) {
@@ -68,6 +91,7 @@ int main(int argc, char** argv) {
             show_dflt |= 'd' == opt;
             test_grps |= 'g' == opt;
             list_grps |= 'l' == opt;
+            show_stat |= 's' == opt;
         }
     }
 
@@ -77,7 +101,7 @@ This sample command-line tool uses POSIX APIs implemented on Windows (2000+)
 with libwusers to display account information on the local Windows machine.
 
 Usage:
-    wuserinfo.exe [/h] [/a] [/t] [/d] [/g] [/l]
+    wuserinfo.exe [/h] [/a] [/t] [/d] [/g] [/l] [/stats]
 
 The meaning of the switches is as follows:
 
@@ -86,6 +110,7 @@ The meaning of the switches is as follows:
     /g  test group lookup API (id<-to->name, reentrancy, etc.)
     /l  list all groups with members
     /t  display test log messages ("this feature works! this, too!")
+    /stats  display lookup statistics (backend calls, latencies, cache hits) at exit
     /h  display this help text
 
     The order of the command-line switches does not affect the display order.
@@ -262,5 +287,9 @@ Further reading: https://github.com/treeswift/libwusers
         endgrent();
     }
 
+    if(show_stat) {
+        DisplayStats();
+    }
+
     return 0;
 }
\ No newline at end of file
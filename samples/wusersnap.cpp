@@ -0,0 +1,37 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file demonstrates use of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include <wusers/wuser_snapshot.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv) {
+    if(argc < 2 || argc > 3 || '/' == *argv[1]) {
+        std::fprintf(stdout,
+R"NOMOREHELP(
+This sample command-line tool writes a snapshot of all local Windows accounts
+and groups, which libwusers clients map to skip the directory at startup.
+
+Usage:
+    wusersnap.exe <file> [<max-age-seconds>]
+
+Then set WUSERS_SNAPSHOT=<file> in the environment of the client processes.
+The snapshot never expires unless <max-age-seconds> is given; regenerate it
+whenever accounts change (e.g. from a scheduled task).
+)NOMOREHELP");
+        return argc < 2 ? 1 : 0;
+    }
+
+    unsigned long max_age = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0ul;
+    if(wuser_snapshot_write(argv[1], max_age)) {
+        std::perror(argv[1]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _BACKEND_H_
+#define _BACKEND_H_
+
+#include "lmshim.h"
+
+#include <string>
+#include <vector>
+
+namespace wusers_impl {
+
+// Everything the library asks of the outside world: the directory (NetAPI)
+// and the few host facts (environment, identity, file system) used to guess
+// what NetAPI doesn't tell. Signatures mirror the Windows calls one-to-one
+// (names drop the "Net" prefix; host calls are renamed to keep clear of the
+// A/W macros), so that the NetAPI backend is a plain forwarder and the other
+// backends can be read against the MSDN pages.
+//
+// Buffers returned by the directory calls are released with BufferFree() of
+// the same backend. Install a backend before the first lookup; swapping it
+// while enumerations are open leaves their buffers to the wrong deallocator.
+struct Backend
+{
+    virtual NET_API_STATUS UserEnum(LPCWSTR servername, DWORD level, DWORD filter, LPBYTE* bufptr, DWORD prefmaxlen,
+                                LPDWORD entriesread, LPDWORD totalentries, LPDWORD resume_handle) = 0;
+
+    virtual NET_API_STATUS UserGetInfo(LPCWSTR servername, LPCWSTR username, DWORD level, LPBYTE* bufptr) = 0;
+
+    virtual NET_API_STATUS GroupEnum(LPCWSTR servername, DWORD level, LPBYTE* bufptr, DWORD prefmaxlen,
+                                LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) = 0;
+
+    virtual NET_API_STATUS GroupGetInfo(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr) = 0;
+
+    virtual NET_API_STATUS GroupGetUsers(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr,
+                                DWORD prefmaxlen, LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) = 0;
+
+    virtual NET_API_STATUS BufferFree(LPVOID buffer) = 0;
+
+    // ExpandEnvironmentStringsW: returns the required length including the terminator
+    virtual DWORD ExpandEnvironment(LPCWSTR src, LPWSTR dst, DWORD size) = 0;
+
+    // GetFileAttributesW: INVALID_FILE_ATTRIBUTES if there is no such path
+    virtual DWORD FileAttributes(LPCWSTR path) = 0;
+
+    // FindFirstFileExW(`path`\*), FindNextFileW and FindClose in one: the names of the
+    // directories in `path`. false if it can't be listed.
+    virtual bool ListDirectories(LPCWSTR path, std::vector<std::wstring>& names) = 0;
+
+    // GetUserNameExW(NameSamCompatible, ...): returns a Win32 error code rather than
+    // a BOOL, so that ERROR_MORE_DATA doesn't travel through a thread-local side channel
+    virtual DWORD UserNameSam(LPWSTR name, PULONG size) = 0;
+
+    // OpenThreadToken (OpenProcessToken if the thread isn't impersonating) and
+    // GetTokenInformation(TokenUser, TokenPrimaryGroup): the RIDs of the token's user and
+    // primary group, without asking the directory. Returns a Win32 error code.
+    virtual DWORD TokenRids(LPDWORD user_rid, LPDWORD group_rid) = 0;
+
+    // not a Windows call: the login shell of `username`, for the backends that know one.
+    // empty means "don't know", in which case %ComSpec% is used.
+    virtual std::wstring LoginShell(LPCWSTR username) {
+        (void) username;
+        return {};
+    }
+
+    Backend() = default;
+    Backend(const Backend&) = delete;
+    Backend& operator=(const Backend&) = delete;
+    virtual ~Backend() = default;
+};
+
+// the backend all lookups currently go to, with its calls counted (see stats.h)
+Backend& backend();
+
+// install `bkd` process-wide; nullptr restores the default, which is the files
+// named in the environment (see files.h) or else the platform backend. not owned.
+void set_backend(Backend* bkd);
+
+// NetAPI on Windows, an (empty) StandIn elsewhere
+Backend& platform_backend();
+
+#ifdef _WIN32
+Backend& netapi_backend();
+#endif
+
+} // namespace wusers_impl
+
+#endif /* !_BACKEND_H_ */
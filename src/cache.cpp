@@ -0,0 +1,156 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "wusers/wuser_cache.h"
+#include "cache.h"
+#include "pool.h"
+
+#include <atomic>
+
+namespace {
+constexpr unsigned int WUSER_DEFAULT_TTL = 600000u; // ms
+constexpr unsigned int WUSER_DEFAULT_NEGATIVE_TTL = 20000u; // ms
+
+static std::atomic<unsigned int> ttl_ms{WUSER_DEFAULT_TTL};
+static std::atomic<unsigned int> negative_ttl_ms{WUSER_DEFAULT_NEGATIVE_TTL};
+static std::atomic<unsigned long> generation{0u};
+static std::atomic<unsigned long> host_refreshes{0u};
+static std::atomic<unsigned long> directory_changes{0u};
+static std::atomic<bool> readahead{false};
+static std::atomic<std::size_t> page_min{4096u};
+static std::atomic<std::size_t> page_max{1u << 20};
+
+// what an entry takes on top of its fixed part, until a full page tells us better
+constexpr std::size_t STRINGS_GUESS = 256u;
+
+std::size_t Bounded(std::size_t bytes) {
+    const std::size_t lo = page_min, hi = page_max;
+    return bytes < lo ? lo : bytes > hi ? hi : bytes;
+}
+}
+
+namespace wusers_impl {
+
+std::chrono::milliseconds cache_ttl() {
+    return std::chrono::milliseconds(ttl_ms.load(std::memory_order_relaxed));
+}
+
+std::chrono::milliseconds negative_ttl() {
+    return std::chrono::milliseconds(negative_ttl_ms.load(std::memory_order_relaxed));
+}
+
+unsigned long cache_generation() {
+    return generation.load(std::memory_order_acquire);
+}
+
+unsigned long host_generation() {
+    return cache_generation() + host_refreshes.load(std::memory_order_acquire);
+}
+
+unsigned long directory_generation() {
+    return directory_changes.load(std::memory_order_acquire);
+}
+
+unsigned long bump_directory_generation() {
+    return ++directory_changes;
+}
+
+unsigned long record_generation() {
+    return cache_generation() + directory_generation();
+}
+
+std::size_t PageSizer::fit(std::size_t entries, std::size_t record) {
+    const std::size_t known = bytes_per_entry;
+    const std::size_t per_entry = known ? known : record + STRINGS_GUESS;
+    std::size_t bytes = entries * per_entry;
+    // names longer than those seen so far: one byte too few costs a whole round trip
+    bytes += bytes / 8u + per_entry;
+    return Bounded(bytes);
+}
+
+std::size_t PageSizer::first(std::size_t record) {
+    const std::size_t seen = total;
+    return seen ? fit(seen, record) : Bounded(PAGE);
+}
+
+std::size_t PageSizer::next(std::size_t left, std::size_t record) {
+    return fit(left, record);
+}
+
+void PageSizer::observe(std::size_t page, std::size_t read, std::size_t full, bool more) {
+    chosen = page;
+    total = full;
+    if(more && read) { // a page that ran out of room is about as full as it gets
+        bytes_per_entry = (page + read - 1u) / read;
+    }
+}
+
+PageSizer& user_pages() {
+    static PageSizer pages;
+    return pages;
+}
+
+PageSizer& group_pages() {
+    static PageSizer pages;
+    return pages;
+}
+
+bool ReadAhead(std::function<void()> fetch) {
+    if(!readahead.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    std::vector<Pool::Task> tasks(1u, std::move(fetch));
+    return Pool::instance().submit(tasks);
+}
+
+} // namespace wusers_impl
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void wuser_cache_set_ttl(unsigned int ttl) {
+    ttl_ms = ttl;
+}
+
+void wuser_cache_set_negative_ttl(unsigned int ttl) {
+    negative_ttl_ms = ttl;
+}
+
+void wuser_cache_invalidate(void) {
+    ++generation;
+}
+
+void wuser_cache_refresh_host(void) {
+    ++host_refreshes;
+}
+
+void wuser_cache_set_prefetch(unsigned int workers) {
+    wusers_impl::Pool::instance().resize(workers);
+}
+
+void wuser_cache_set_readahead(int enabled) {
+    readahead = !!enabled;
+}
+
+void wuser_cache_set_page_bounds(size_t min_bytes, size_t max_bytes) {
+    // the largest value below MAX_PREFERRED_LENGTH, which means "no limit at all"
+    const std::size_t limit = 0x7fffffffu;
+    min_bytes = min_bytes ? (min_bytes < limit ? min_bytes : limit) : 1u;
+    max_bytes = max_bytes < min_bytes ? min_bytes : max_bytes < limit ? max_bytes : limit;
+    page_max = max_bytes;
+    page_min = min_bytes;
+}
+
+void wuser_cache_get_page_sizes(size_t* user_page, size_t* group_page) {
+    if(user_page) *user_page = wusers_impl::user_pages().last();
+    if(group_page) *group_page = wusers_impl::group_pages().last();
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,570 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include "wus.h"
+#include "rcu.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wusers_impl {
+
+// process-wide knobs, see wusers/wuser_cache.h
+std::chrono::milliseconds cache_ttl();
+std::chrono::milliseconds negative_ttl(); // for what isn't there
+unsigned long cache_generation();
+unsigned long host_generation(); // bumped by wuser_cache_refresh_host() as well
+unsigned long directory_generation(); // wuser_generation(): refresh passes that found changes
+unsigned long bump_directory_generation();
+unsigned long record_generation(); // cache_generation() + directory_generation()
+
+// Translated records shared by all threads, keyed by RID and by folded name. Entries are
+// immutable once published and handed out as shared pointers, so that a reader can
+// copy one out (into thread-owned or caller-provided memory) without holding a lock.
+// Translation depends on the code page, therefore so does a hit.
+//
+// Warm lookups don't take the lock either: the maps are republished every so often as
+// an immutable table (see readById()), which readers use under Rcu, touching no cache
+// line that another reader writes to. The locked maps serve what's newer than that.
+template<typename POSIX_RECORD_T>
+class Cache {
+public:
+    using IA = InfoAdapter<POSIX_RECORD_T>;
+    using id_t = typename IA::id_t;
+    using NETAPI_INFO_T = typename IA::NETAPI_INFO_T;
+    using QueryState = EnumQueryState<NETAPI_INFO_T, IA::LVL, &IA::Enumerate, &IA::Pages>;
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        Packed<POSIX_RECORD_T> packed; // copied out with one memcpy() each
+        unsigned int cp;
+        unsigned long generation;
+        Clock::time_point expiry;
+    };
+    using Hit = std::shared_ptr<const Entry>;
+
+    static Cache& instance() {
+        static Cache cache;
+        return cache;
+    }
+
+    ~Cache() {
+        delete published.load(); // at exit
+    }
+
+    // `use` the entry for `id` in the published table, if it has a fresh one, without a
+    // lock and without taking a reference: it can't go away before `use` returns. false
+    // if there is none, for byId() to take it from there.
+    template<typename USE>
+    bool readById(id_t id, USE use) {
+        Rcu::Reader reader;
+        const Published* table = published.load();
+        return table && readFrom(*table, table->by_id, id, use);
+    }
+
+    template<typename USE>
+    bool readByName(const std::string& key, USE use) {
+        Rcu::Reader reader;
+        const Published* table = published.load();
+        return table && readFrom(*table, table->by_name, key, use);
+    }
+
+    Hit byId(id_t id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return missedByReaders(fresh(by_id, id));
+    }
+
+    // `key` is the fold_name() of the name asked for
+    Hit byName(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return missedByReaders(fresh(by_name, key));
+    }
+
+    // translate `info` and publish the result, unless the TTL is zero (then it's merely translated).
+    // returns nullptr (and leaves errno set) if the translation fails.
+    Hit insert(const NETAPI_INFO_T& info) {
+        // how much room the record takes is only known once it's translated
+        static thread_local Arena scratch;
+        POSIX_RECORD_T translated;
+        scratch.reset();
+        if(!FillFrom(translated, info, ArenaWriter(scratch))) {
+            return nullptr;
+        }
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+        entry->packed.pack(translated);
+        const POSIX_RECORD_T& record = entry->packed.record();
+        const std::string key = fold_name(IA::NameOf(record)); // folded once, here
+        entry->cp = get_cp();
+        entry->generation = cache_generation();
+        const auto ttl = cache_ttl();
+        entry->expiry = Clock::now() + ttl;
+        if(ttl.count() > 0) {
+            std::lock_guard<std::mutex> lock(mtx);
+            sync(cache_generation());
+            if(entry->generation == seen_generation) { // else invalidated while we were translating
+                by_id[IA::IdOf(record)] = entry;
+                by_name[key] = entry;
+                absent_ids.erase(IA::IdOf(record)); // created since
+                absent_names.erase(key);
+                if(++unpublished > published_size) { // as many copies per entry as it takes to double
+                    publish();
+                }
+                if(!(++inserts % SWEEP)) {
+                    sweep();
+                }
+            }
+        }
+        return entry;
+    }
+
+    // ids that Stateless::LeanByName() found, by folded name: no record to share, but no
+    // round trip to repeat either. Kept as long as records are.
+    bool leanId(const std::string& key, id_t& id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        sync(cache_generation());
+        auto itr = lean_ids.find(key);
+        if(itr == lean_ids.end() || itr->second.expiry <= Clock::now()) {
+            return false;
+        }
+        return id = itr->second.id, true;
+    }
+
+    void putLeanId(const std::string& key, id_t id) {
+        const auto ttl = cache_ttl();
+        if(ttl.count() > 0) {
+            std::lock_guard<std::mutex> lock(mtx);
+            sync(cache_generation());
+            lean_ids[key] = {id, Clock::now() + ttl};
+            if(!(++inserts % SWEEP)) {
+                sweep();
+            }
+        }
+    }
+
+    // Accounts that weren't there when last asked about, so that orphaned owners (of files,
+    // archive entries etc.) cost one round trip each rather than one per lookup. Bounded,
+    // and kept for negative_ttl() unless created (as far as we can tell) or invalidated.
+    bool absentId(id_t id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return absent(absent_ids, id);
+    }
+
+    bool absentName(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mtx);
+        return absent(absent_names, key);
+    }
+
+    void putAbsentId(id_t id) {
+        std::lock_guard<std::mutex> lock(mtx);
+        putAbsent(absent_ids, id);
+    }
+
+    void putAbsentName(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mtx);
+        putAbsent(absent_names, key);
+    }
+
+    // accounts that a refresh pass found changed (see refresh.h): their entries by id and by
+    // name (`keys`, folded) go, and so does anything that says they aren't there. So does the
+    // RID index if it may be wrong about who is there (`reindex`). Republishes what's left.
+    void forget(const std::vector<id_t>& ids, const std::vector<std::string>& keys, bool reindex) {
+        std::lock_guard<std::mutex> lock(mtx);
+        sync(cache_generation());
+        for(id_t id : ids) {
+            auto itr = by_id.find(id);
+            if(itr != by_id.end()) {
+                by_name.erase(fold_name(IA::NameOf(itr->second->packed.record()))); // if cached by another name
+                by_id.erase(itr);
+            }
+            absent_ids.erase(id);
+        }
+        for(const std::string& key : keys) {
+            by_name.erase(key);
+            lean_ids.erase(key);
+            absent_names.erase(key);
+        }
+        if(reindex) {
+            rid_index.reset();
+        }
+        publish();
+    }
+
+    // NetXxxGetInfo() by name; the translated record is published as with insert()
+    Hit fetch(const std::wstring& wname) {
+        return ProcessInfoByName<NETAPI_INFO_T, IA::LVL, &IA::GetInfo, IA::NotFound, Hit>(wname,
+                [this](const NETAPI_INFO_T& wu_infoX) { return insert(wu_infoX); },
+                nullptr);
+    }
+
+    // There is no lookup by RID in NetAPI, only enumeration. The first id miss enumerates
+    // everything once and keeps RID -> name; later misses cost a single fetch() by name.
+    // An id that a complete index doesn't know didn't exist at indexing time: no scan.
+    enum Known { UNKNOWN, FOUND, ABSENT };
+
+    // what the RID index says about `id`, without fetching or enumerating anything: FOUND
+    // (and its name, as of indexing), ABSENT, or UNKNOWN if there is no index to ask
+    Known indexedName(id_t id, std::wstring& wname) {
+        unsigned long serial;
+        return indexed(id, wname, serial);
+    }
+
+    Hit byIdIndexed(id_t id) {
+        if(absentId(id)) {
+            return nullptr;
+        }
+        std::wstring wname;
+        unsigned long serial;
+        Known known = indexed(id, wname, serial);
+        if(FOUND == known) {
+            Hit hit = fetch(wname);
+            if(hit && IA::IdOf(hit->packed.record()) == id) {
+                return hit;
+            }
+            set_last_error(0); // renamed, deleted or recycled since indexing
+            known = UNKNOWN;
+        }
+        Hit hit = UNKNOWN == known ? reindex(id, serial) : nullptr;
+        if(!hit && !errno) {
+            putAbsentId(id); // the index will have expired before this does, or not be there at all
+        }
+        return hit;
+    }
+
+    // Many lookups at once (the batch API). What isn't cached is translated during a single
+    // enumeration, which also rebuilds the RID index, rather than fetched one at a time.
+    // Results are positional: null for accounts that don't exist (or on error; see errno).
+    std::vector<Hit> byIds(const std::vector<id_t>& ids) {
+        std::vector<Hit> hits(ids.size());
+        Wanted wanted;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for(std::size_t i = 0; i < ids.size(); ++i) {
+                if(!(hits[i] = fresh(by_id, ids[i])) && !absent(absent_ids, ids[i])) {
+                    wanted.ids.emplace(ids[i], nullptr);
+                }
+            }
+            if(rid_index && rid_index->expiry > Clock::now()) { // nothing to look for if it isn't there
+                for(auto itr = wanted.ids.begin(); itr != wanted.ids.end();) {
+                    itr = rid_index->at.count(itr->first) ? std::next(itr) : wanted.ids.erase(itr);
+                }
+            }
+        }
+        if(!wanted.ids.empty()) {
+            std::lock_guard<std::mutex> fill(index_fill);
+            enumerate(wanted);
+            for(std::size_t i = 0; i < ids.size(); ++i) {
+                auto itr = wanted.ids.find(ids[i]);
+                if(!hits[i] && itr != wanted.ids.end()) {
+                    hits[i] = itr->second;
+                    if(!hits[i] && !errno) putAbsentId(ids[i]); // a partial enumeration proves nothing
+                }
+            }
+        }
+        return hits;
+    }
+
+    // the same by fold_name() keys
+    std::vector<Hit> byNames(const std::vector<std::string>& keys) {
+        std::vector<Hit> hits(keys.size());
+        std::vector<bool> known_absent(keys.size());
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            for(std::size_t i = 0; i < keys.size(); ++i) {
+                hits[i] = fresh(by_name, keys[i]);
+                known_absent[i] = !hits[i] && absent(absent_names, keys[i]);
+            }
+        }
+        Wanted wanted;
+        std::vector<std::wstring> wkeys(keys.size());
+        for(std::size_t i = 0; i < keys.size(); ++i) {
+            if(!hits[i] && !known_absent[i] && !(wkeys[i] = fold_name(to_win_str(keys[i], false))).empty()) {
+                wanted.names.emplace(wkeys[i], nullptr);
+            }
+        }
+        if(!wanted.names.empty()) {
+            std::lock_guard<std::mutex> fill(index_fill);
+            enumerate(wanted);
+            for(std::size_t i = 0; i < keys.size(); ++i) {
+                auto itr = wanted.names.find(wkeys[i]);
+                if(!hits[i] && itr != wanted.names.end()) {
+                    hits[i] = itr->second;
+                    if(!hits[i] && !errno) putAbsentName(keys[i]);
+                }
+            }
+        }
+        return hits;
+    }
+
+    // misses on the same key queue up behind the first one, so that 64 threads asking
+    // for the same record produce one backend round trip rather than 64. distinct keys
+    // mostly land on distinct stripes and are fetched in parallel.
+    std::mutex& fillLock(std::size_t key_hash) {
+        return stripes[key_hash % STRIPES];
+    }
+
+private:
+    static constexpr const std::size_t STRIPES = 64u;
+    static constexpr const std::size_t SWEEP = 1024u; // inserts between expired entry sweeps
+    static constexpr const std::size_t MAX_ABSENT = 4096u; // per kind of key
+
+    // RID -> account name, as of the last complete enumeration
+    struct RidIndex {
+        std::unordered_map<id_t, std::size_t> at; // offsets into `names`
+        std::wstring names;                       // null-separated
+        unsigned long generation;
+        unsigned long serial;
+        Clock::time_point expiry;
+    };
+
+    Known indexed(id_t id, std::wstring& wname, unsigned long& serial) {
+        std::lock_guard<std::mutex> lock(mtx);
+        sync(cache_generation());
+        serial = rid_index ? rid_index->serial : 0u;
+        if(!rid_index || rid_index->expiry <= Clock::now()) {
+            return UNKNOWN;
+        }
+        auto itr = rid_index->at.find(id);
+        if(itr == rid_index->at.end()) {
+            return ABSENT;
+        }
+        wname = rid_index->names.c_str() + itr->second;
+        return FOUND;
+    }
+
+    // accounts a full enumeration should translate on its way; the values are filled in
+    struct Wanted {
+        std::unordered_map<id_t, Hit> ids;
+        std::unordered_map<std::wstring, Hit> names; // folded
+    };
+
+    // (re)build the index with a full enumeration, translating `id` on the way if it's there.
+    // one thread enumerates; whoever queued up behind it uses the index it has published.
+    Hit reindex(id_t id, unsigned long stale_serial) {
+        std::lock_guard<std::mutex> lock(index_fill);
+        std::wstring wname;
+        unsigned long serial;
+        Known known = indexed(id, wname, serial);
+        if(UNKNOWN != known && serial != stale_serial) {
+            return FOUND == known ? fetch(wname) : nullptr;
+        }
+
+        Wanted wanted;
+        wanted.ids.emplace(id, nullptr);
+        enumerate(wanted);
+        return wanted.ids[id];
+    }
+
+    // one full enumeration: (re)builds the index and translates (and publishes) whatever
+    // is `wanted` as it comes across it. callers hold index_fill.
+    void enumerate(Wanted& wanted) {
+        std::shared_ptr<RidIndex> index = std::make_shared<RidIndex>();
+        index->generation = cache_generation();
+        int fill_error = 0;
+        QueryState local_query;
+        local_query.reset();
+        local_query.query();
+        index->at.reserve(local_query.entries_full);
+        const NETAPI_INFO_T * candidate = nullptr;
+        while((candidate = local_query.step())) {
+            index->at.emplace(IA::IdOf(candidate), index->names.size());
+            index->names.append(IA::WNameOf(candidate)).push_back(L'\0');
+            auto id_itr = wanted.ids.find(IA::IdOf(candidate));
+            auto name_itr = wanted.names.empty() ? wanted.names.end() : wanted.names.find(fold_name(IA::WNameOf(candidate)));
+            Hit* want_id = id_itr != wanted.ids.end() && !id_itr->second ? &id_itr->second : nullptr;
+            Hit* want_name = name_itr != wanted.names.end() && !name_itr->second ? &name_itr->second : nullptr;
+            if(want_id || want_name) {
+                Hit hit = insert(*candidate);
+                if(!fill_error) fill_error = errno;
+                set_last_error(0);
+                if(want_id) *want_id = hit;
+                if(want_name) *want_name = hit;
+            }
+        }
+        const auto ttl = cache_ttl();
+        if(!errno && ttl.count() > 0) { // a partial index would make present ids look absent
+            index->expiry = Clock::now() + ttl;
+            std::lock_guard<std::mutex> lock(mtx);
+            sync(cache_generation());
+            if(index->generation == seen_generation) {
+                index->serial = ++index_serial;
+                rid_index = index;
+                for(auto itr = absent_ids.begin(); itr != absent_ids.end();) {
+                    itr = index->at.count(itr->first) ? absent_ids.erase(itr) : std::next(itr);
+                }
+            }
+        }
+        if(fill_error) {
+            set_last_error(fill_error);
+        }
+    }
+
+    // what readers see without a lock: the maps as they were at publish()
+    struct Published {
+        std::unordered_map<id_t, Hit> by_id;
+        std::unordered_map<std::string, Hit> by_name;
+        unsigned long generation;
+    };
+
+    template<typename MAP_T, typename KEY_T, typename USE>
+    static bool readFrom(const Published& table, const MAP_T& map, const KEY_T& key, USE& use) {
+        if(table.generation != cache_generation()) {
+            return false; // stale until somebody's sync() unpublishes it
+        }
+        auto itr = map.find(key);
+        if(itr == map.end()) {
+            return false;
+        }
+        const Entry& entry = *itr->second;
+        if(entry.expiry <= Clock::now() || entry.cp != get_cp()) {
+            return false;
+        }
+        use(entry.packed);
+        return true;
+    }
+
+    // a hit that the published table didn't have: inserts since the last publish() are
+    // asked for, so it's time for another one (before the table has doubled)
+    Hit missedByReaders(Hit hit) {
+        if(hit && unpublished && ++stale_hits > published_size / 4u + 16u) {
+            publish();
+        }
+        return hit;
+    }
+
+    // callers hold mtx
+    void publish() {
+        swap(new Published{by_id, by_name, seen_generation});
+        published_size = by_id.size();
+    }
+
+    void swap(const Published* table) {
+        if(const Published* old = published.exchange(table)) {
+            Rcu::instance().retire([old]() { delete old; });
+        }
+        unpublished = 0u;
+        stale_hits = 0u;
+    }
+
+    template<typename KEY_T>
+    bool absent(std::unordered_map<KEY_T, Clock::time_point>& map, const KEY_T& key) {
+        sync(cache_generation());
+        auto itr = map.find(key);
+        if(itr == map.end()) {
+            return false;
+        }
+        if(itr->second <= Clock::now()) {
+            map.erase(itr);
+            return false;
+        }
+        return true;
+    }
+
+    template<typename KEY_T>
+    void putAbsent(std::unordered_map<KEY_T, Clock::time_point>& map, const KEY_T& key) {
+        const auto ttl = negative_ttl();
+        if(ttl.count() <= 0) {
+            return;
+        }
+        sync(cache_generation());
+        const auto now = Clock::now();
+        if(map.size() >= MAX_ABSENT && !map.count(key)) {
+            for(auto itr = map.begin(); itr != map.end();) {
+                itr = itr->second <= now ? map.erase(itr) : std::next(itr);
+            }
+            if(map.size() >= MAX_ABSENT) {
+                map.erase(map.begin()); // whichever; it will be asked about again at worst
+            }
+        }
+        map[key] = now + ttl;
+    }
+
+    template<typename MAP_T, typename KEY_T>
+    Hit fresh(MAP_T& map, const KEY_T& key) {
+        sync(cache_generation());
+        auto itr = map.find(key);
+        if(itr == map.end()) {
+            return nullptr;
+        }
+        const Entry& entry = *itr->second;
+        if(entry.expiry <= Clock::now()) {
+            map.erase(itr);
+            return nullptr;
+        }
+        return entry.cp == get_cp() ? itr->second : nullptr;
+    }
+
+    // wuser_cache_invalidate() bumps the generation; drop everything older
+    void sync(unsigned long generation) {
+        if(generation != seen_generation) {
+            by_id.clear();
+            by_name.clear();
+            lean_ids.clear();
+            absent_ids.clear();
+            absent_names.clear();
+            rid_index.reset();
+            swap(nullptr);
+            published_size = 0u;
+            seen_generation = generation;
+        }
+    }
+
+    // entries that are never asked for again would otherwise linger until invalidation
+    void sweep() {
+        const auto now = Clock::now();
+        auto drop = [now](auto& map) {
+            for(auto itr = map.begin(); itr != map.end();) {
+                itr = itr->second->expiry <= now ? map.erase(itr) : std::next(itr);
+            }
+        };
+        drop(by_id);
+        drop(by_name);
+        for(auto itr = lean_ids.begin(); itr != lean_ids.end();) {
+            itr = itr->second.expiry <= now ? lean_ids.erase(itr) : std::next(itr);
+        }
+        auto drop_absent = [now](auto& map) {
+            for(auto itr = map.begin(); itr != map.end();) {
+                itr = itr->second <= now ? map.erase(itr) : std::next(itr);
+            }
+        };
+        drop_absent(absent_ids);
+        drop_absent(absent_names);
+    }
+
+    struct LeanId {
+        id_t id;
+        Clock::time_point expiry;
+    };
+
+    std::mutex mtx;
+    std::unordered_map<id_t, Hit> by_id;
+    std::unordered_map<std::string, Hit> by_name;
+    std::unordered_map<std::string, LeanId> lean_ids;
+    std::unordered_map<id_t, Clock::time_point> absent_ids;
+    std::unordered_map<std::string, Clock::time_point> absent_names; // folded
+    std::atomic<const Published*> published{nullptr};
+    std::size_t published_size = 0u;
+    std::size_t unpublished = 0u; // inserts since
+    std::size_t stale_hits = 0u;  // locked hits since
+    unsigned long seen_generation = 0u;
+    std::size_t inserts = 0u;
+    std::shared_ptr<const RidIndex> rid_index;
+    unsigned long index_serial = 0u;
+    std::mutex index_fill;
+    std::mutex stripes[STRIPES];
+};
+
+} // namespace wusers_impl
+
+#endif /* !_CACHE_H_ */
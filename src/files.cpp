@@ -0,0 +1,294 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "wusers/wuser_files.h"   // API
+#include "wusers/wuser_cache.h"   // wuser_cache_invalidate()
+
+#include "files.h"
+#include "pack.h"
+#include "wus.h"      // from_utf8(), fold_name(), set_last_error()
+#include <errno.h>    // error codes
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+namespace {
+using namespace wusers_impl;
+using pwfile::Span;
+
+std::wstring Wide(const Span& span) {
+    return span.str ? from_utf8(span.str, span.len) : std::wstring();
+}
+
+// gecos is "full name,office,phone,..."; only the full name has a NetAPI counterpart
+std::wstring FullName(const Span& gecos) {
+    const char* comma = gecos.str ? static_cast<const char*>(std::memchr(gecos.str, ',', gecos.len)) : nullptr;
+    return Wide(comma ? Span{gecos.str, static_cast<std::size_t>(comma - gecos.str)} : gecos);
+}
+
+void FillUser0(const pwfile::PwLine& line, USER_INFO_0& out, Strings& str) {
+    out.usri0_name = str(Wide(line.name));
+}
+
+void FillUser20(const pwfile::PwLine& line, USER_INFO_20& out, Strings& str) {
+    out.usri20_name = str(Wide(line.name));
+    out.usri20_full_name = str(FullName(line.gecos));
+    out.usri20_comment = str(std::wstring());
+    out.usri20_flags = 0x0201u; // UF_SCRIPT | UF_NORMAL_ACCOUNT
+    out.usri20_user_id = line.uid;
+}
+
+void FillUser3(const pwfile::PwLine& line, USER_INFO_3& out, Strings& str) {
+    static const std::wstring none;
+    out.usri3_name = str(Wide(line.name));
+    out.usri3_priv = line.uid ? USER_PRIV_USER : USER_PRIV_ADMIN;
+    out.usri3_home_dir = str(none);
+    out.usri3_comment = str(none);
+    out.usri3_script_path = str(none);
+    out.usri3_full_name = str(FullName(line.gecos));
+    out.usri3_usr_comment = str(none);
+    out.usri3_parms = str(none);
+    out.usri3_workstations = str(none);
+    out.usri3_acct_expires = line.expire ? static_cast<DWORD>(line.expire) : TIMEQ_FOREVER;
+    out.usri3_max_storage = ~DWORD(0);
+    out.usri3_logon_server = str(L"\\\\*");
+    out.usri3_user_id = line.uid;
+    out.usri3_primary_group_id = line.gid;
+    out.usri3_profile = str(Wide(line.dir));
+    out.usri3_home_dir_drive = str(none);
+    out.usri3_password_expired = line.change && line.change <= std::time(nullptr);
+}
+
+void FillGroup0(const pwfile::GrLine& line, GROUP_INFO_0& out, Strings& str) {
+    out.grpi0_name = str(Wide(line.name));
+}
+
+void FillGroup2(const pwfile::GrLine& line, GROUP_INFO_2& out, Strings& str) {
+    out.grpi2_name = str(Wide(line.name));
+    out.grpi2_comment = str(std::wstring());
+    out.grpi2_group_id = line.gid;
+    out.grpi2_attributes = 0x7u; // SE_GROUP_MANDATORY | SE_GROUP_ENABLED_BY_DEFAULT | SE_GROUP_ENABLED
+}
+
+void FillMember0(const std::wstring& name, GROUP_USERS_INFO_0& out, Strings& str) {
+    out.grui0_name = str(name);
+}
+
+NET_API_STATUS PackUsers(const pwfile::PwLine* items, std::size_t count, std::size_t& next, DWORD level, DWORD prefmaxlen,
+                    LPBYTE* bufptr, LPDWORD entriesread, LPDWORD totalentries) {
+    switch(level) {
+    case 0:
+        return Pack<USER_INFO_0>(items, count, next, prefmaxlen, &FillUser0, bufptr, entriesread, totalentries);
+    case 20:
+        return Pack<USER_INFO_20>(items, count, next, prefmaxlen, &FillUser20, bufptr, entriesread, totalentries);
+    case 3:
+        return Pack<USER_INFO_3>(items, count, next, prefmaxlen, &FillUser3, bufptr, entriesread, totalentries);
+    default:
+        return ERROR_INVALID_LEVEL;
+    }
+}
+
+NET_API_STATUS PackGroups(const pwfile::GrLine* items, std::size_t count, std::size_t& next, DWORD level, DWORD prefmaxlen,
+                    LPBYTE* bufptr, LPDWORD entriesread, LPDWORD totalentries) {
+    switch(level) {
+    case 0:
+        return Pack<GROUP_INFO_0>(items, count, next, prefmaxlen, &FillGroup0, bufptr, entriesread, totalentries);
+    case 2:
+        return Pack<GROUP_INFO_2>(items, count, next, prefmaxlen, &FillGroup2, bufptr, entriesread, totalentries);
+    default:
+        return ERROR_INVALID_LEVEL;
+    }
+}
+
+std::string Env(const char* name) {
+    const char* value = std::getenv(name);
+    return value ? value : "";
+}
+
+} // anonymous
+
+namespace wusers_impl {
+
+Files::Files(const std::string& passwd_path, const std::string& group_path, Backend& host)
+    : passwd_path(passwd_path), group_path(group_path), host(host) {}
+
+template<typename LINE_T>
+std::shared_ptr<const Files::Table<LINE_T>> Files::load(const std::string& path, std::shared_ptr<const Table<LINE_T>>& table) {
+    std::lock_guard<std::mutex> lock(mtx);
+    const std::uint64_t stamp = path.empty() ? 0u : MappedFile::Stamp(path.c_str());
+    if(table && (table->file ? table->file->stamp() : 0u) == stamp) {
+        return table;
+    }
+    std::shared_ptr<Table<LINE_T>> fresh = std::make_shared<Table<LINE_T>>();
+    if(stamp) {
+        int err = errno;
+        fresh->file = MappedFile::Open(path.c_str()); // an unreadable file is an empty one
+        set_last_error(err);
+    }
+    if(fresh->file) {
+        pwfile::Lines lines(fresh->file->data(), fresh->file->size());
+        Span text;
+        LINE_T line;
+        while(lines.next(text)) {
+            if(pwfile::Parse(text.str, text.len, line)) {
+                if(fresh->at.emplace(fold_name(Wide(line.name)), fresh->lines.size()).second) {
+                    fresh->lines.push_back(line);
+                }
+            }
+        }
+    }
+    return table = fresh;
+}
+
+std::shared_ptr<const Files::Users> Files::users() {
+    return load(passwd_path, user_table);
+}
+
+std::shared_ptr<const Files::Groups> Files::groups() {
+    return load(group_path, group_table);
+}
+
+NET_API_STATUS Files::UserEnum(LPCWSTR, DWORD level, DWORD, LPBYTE* bufptr, DWORD prefmaxlen,
+                        LPDWORD entriesread, LPDWORD totalentries, LPDWORD resume_handle) {
+    std::shared_ptr<const Users> table = users();
+    std::size_t next = resume_handle ? *resume_handle : 0u;
+    NET_API_STATUS status = PackUsers(table->lines.data(), table->lines.size(), next, level, prefmaxlen,
+                                        bufptr, entriesread, totalentries);
+    if(resume_handle) *resume_handle = next < table->lines.size() ? next : 0u;
+    return status;
+}
+
+NET_API_STATUS Files::UserGetInfo(LPCWSTR, LPCWSTR username, DWORD level, LPBYTE* bufptr) {
+    std::shared_ptr<const Users> table = users();
+    *bufptr = nullptr;
+    auto itr = table->at.find(fold_name(username));
+    if(itr == table->at.end()) {
+        return NERR_UserNotFound;
+    }
+    std::size_t next = 0u;
+    DWORD read;
+    return PackUsers(&table->lines[itr->second], 1u, next, level, MAX_PREFERRED_LENGTH, bufptr, &read, nullptr);
+}
+
+NET_API_STATUS Files::GroupEnum(LPCWSTR, DWORD level, LPBYTE* bufptr, DWORD prefmaxlen,
+                        LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) {
+    std::shared_ptr<const Groups> table = groups();
+    std::size_t next = resume_handle ? *resume_handle : 0u;
+    NET_API_STATUS status = PackGroups(table->lines.data(), table->lines.size(), next, level, prefmaxlen,
+                                        bufptr, entriesread, totalentries);
+    if(resume_handle) *resume_handle = next < table->lines.size() ? next : 0u;
+    return status;
+}
+
+NET_API_STATUS Files::GroupGetInfo(LPCWSTR, LPCWSTR groupname, DWORD level, LPBYTE* bufptr) {
+    std::shared_ptr<const Groups> table = groups();
+    *bufptr = nullptr;
+    auto itr = table->at.find(fold_name(groupname));
+    if(itr == table->at.end()) {
+        return NERR_GroupNotFound;
+    }
+    std::size_t next = 0u;
+    DWORD read;
+    return PackGroups(&table->lines[itr->second], 1u, next, level, MAX_PREFERRED_LENGTH, bufptr, &read, nullptr);
+}
+
+NET_API_STATUS Files::GroupGetUsers(LPCWSTR, LPCWSTR groupname, DWORD level, LPBYTE* bufptr,
+                        DWORD prefmaxlen, LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) {
+    std::shared_ptr<const Groups> table = groups();
+    *bufptr = nullptr;
+    auto itr = table->at.find(fold_name(groupname));
+    if(itr == table->at.end()) {
+        return NERR_GroupNotFound;
+    }
+    if(level) {
+        return ERROR_INVALID_LEVEL;
+    }
+    std::vector<std::wstring> members;
+    Span list = table->lines[itr->second].members;
+    Span member;
+    while(pwfile::NextMember(list, member)) {
+        members.push_back(Wide(member));
+    }
+    std::size_t next = resume_handle ? *resume_handle : 0u;
+    NET_API_STATUS status = Pack<GROUP_USERS_INFO_0>(members.data(), members.size(), next, prefmaxlen,
+                                        &FillMember0, bufptr, entriesread, totalentries);
+    if(resume_handle) *resume_handle = next < members.size() ? next : 0u;
+    return status;
+}
+
+NET_API_STATUS Files::BufferFree(LPVOID buffer) {
+    std::free(buffer);
+    return NERR_Success;
+}
+
+DWORD Files::ExpandEnvironment(LPCWSTR src, LPWSTR dst, DWORD size) {
+    return host.ExpandEnvironment(src, dst, size);
+}
+
+DWORD Files::FileAttributes(LPCWSTR path) {
+    return host.FileAttributes(path);
+}
+
+bool Files::ListDirectories(LPCWSTR path, std::vector<std::wstring>& names) {
+    return host.ListDirectories(path, names);
+}
+
+DWORD Files::UserNameSam(LPWSTR name, PULONG size) {
+    return host.UserNameSam(name, size);
+}
+
+DWORD Files::TokenRids(LPDWORD user_rid, LPDWORD group_rid) {
+    // the host's RIDs needn't be the uid and gid the files give the same account; go by name
+    (void) user_rid;
+    (void) group_rid;
+    return ERROR_NOT_SUPPORTED;
+}
+
+std::wstring Files::LoginShell(LPCWSTR username) {
+    std::shared_ptr<const Users> table = users();
+    auto itr = table->at.find(fold_name(username));
+    return itr == table->at.end() ? std::wstring() : Wide(table->lines[itr->second].shell);
+}
+
+Backend* files_from_env(Backend& host) {
+    const std::string passwd_path = Env("WUSERS_PASSWD");
+    const std::string group_path = Env("WUSERS_GROUP");
+    if(passwd_path.empty() && group_path.empty()) {
+        return nullptr;
+    }
+    static Files files(passwd_path, group_path, host);
+    return &files;
+}
+
+} // namespace wusers_impl
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int wuser_use_files(const char* passwd_path, const char* group_path) {
+    set_last_error(0);
+    for(const char* path : {passwd_path, group_path}) {
+        if(path && *path && !MappedFile::Stamp(path)) {
+            set_last_error(ENOENT);
+            return -1;
+        }
+    }
+    if(!passwd_path && !group_path) {
+        set_backend(nullptr);
+    } else {
+        // never deleted: lookups in flight may still be talking to the previous one
+        set_backend(new Files(passwd_path ? passwd_path : "", group_path ? group_path : "", platform_backend()));
+    }
+    wuser_cache_invalidate();
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,81 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _FILES_H_
+#define _FILES_H_
+
+#include "backend.h"
+#include "mapfile.h"
+#include "pwfile.h"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wusers_impl {
+
+// Answers the directory calls from passwd(5) and group(5) files, for hosts without
+// SAM access (containers) or with accounts of their own. The files are mapped and
+// their lines split in place; a file that changes on disk is mapped again on the
+// next call. uid and gid are reported as RIDs, gecos (up to the first comma) as the
+// full name, the home directory as the profile path; uid 0 is an administrator.
+// Host calls (environment, file system, identity) go to `host`.
+class Files : public Backend
+{
+public:
+    // an empty path stands for an empty file
+    Files(const std::string& passwd_path, const std::string& group_path, Backend& host);
+
+    NET_API_STATUS UserEnum(LPCWSTR servername, DWORD level, DWORD filter, LPBYTE* bufptr, DWORD prefmaxlen,
+                            LPDWORD entriesread, LPDWORD totalentries, LPDWORD resume_handle) override;
+    NET_API_STATUS UserGetInfo(LPCWSTR servername, LPCWSTR username, DWORD level, LPBYTE* bufptr) override;
+    NET_API_STATUS GroupEnum(LPCWSTR servername, DWORD level, LPBYTE* bufptr, DWORD prefmaxlen,
+                            LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) override;
+    NET_API_STATUS GroupGetInfo(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr) override;
+    NET_API_STATUS GroupGetUsers(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr,
+                            DWORD prefmaxlen, LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) override;
+    NET_API_STATUS BufferFree(LPVOID buffer) override;
+    DWORD ExpandEnvironment(LPCWSTR src, LPWSTR dst, DWORD size) override;
+    DWORD FileAttributes(LPCWSTR path) override;
+    bool ListDirectories(LPCWSTR path, std::vector<std::wstring>& names) override;
+    DWORD UserNameSam(LPWSTR name, PULONG size) override;
+    DWORD TokenRids(LPDWORD user_rid, LPDWORD group_rid) override;
+    std::wstring LoginShell(LPCWSTR username) override;
+
+private:
+    template<typename LINE_T>
+    struct Table {
+        std::shared_ptr<const MappedFile> file;
+        std::vector<LINE_T> lines;
+        std::unordered_map<std::wstring, std::size_t> at; // by folded name; the first line wins
+    };
+    using Users = Table<pwfile::PwLine>;
+    using Groups = Table<pwfile::GrLine>;
+
+    template<typename LINE_T>
+    std::shared_ptr<const Table<LINE_T>> load(const std::string& path, std::shared_ptr<const Table<LINE_T>>& table);
+
+    std::shared_ptr<const Users> users();
+    std::shared_ptr<const Groups> groups();
+
+    const std::string passwd_path;
+    const std::string group_path;
+    Backend& host;
+
+    std::mutex mtx;
+    std::shared_ptr<const Users> user_table;
+    std::shared_ptr<const Groups> group_table;
+};
+
+// the backend WUSERS_PASSWD and WUSERS_GROUP ask for, if any (see wusers/wuser_files.h)
+Backend* files_from_env(Backend& host);
+
+} // namespace wusers_impl
+
+#endif /* !_FILES_H_ */
@@ -6,13 +6,31 @@
  */
 
 #include "grp.h"      // API
+#include "wusers/wuser_batch.h" // bonus API
+#include "wusers/wuser_eugid.h" // getgroups()
+#include "wusers/wuser_cursor.h" // bonus API
+#include "wusers/wuser_range.h" // C++ API
 #include "wus.h"  // library state
-#include <windows.h>  // *backend deps
-#include <lm.h>       // backend
+#include "cache.h"    // shared state
+#include "pwcache.h"  // courtesy names
+#include "backend.h"  // NetAPI or stand-in
+#include "pwfile.h"   // group(5) parser
+#include "pool.h"     // member list prefetch
+#include "refresh.h"  // refresh passes
+#include "stats.h"    // hits and misses
 #include <errno.h>    // error codes
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace wusers_impl {
 
@@ -27,11 +45,11 @@ void GetUsersFrom(const wchar_t* group_name, std::function<void(const wchar_t*)>
     // we only need names, hence level 0 and GROUP_USERS_INFO_0
     std::unique_ptr<BYTE, FreeNetBuffer> buf;
     std::size_t n = 0u;
-    DWORD query_resume = 0u; // starting from nonzero resume cookie kills the client badly
+    DWORD_PTR query_resume = 0u; // starting from nonzero resume cookie kills the client badly
     DWORD entries_full = 0u; // clearing the rest of the state ...
     DWORD entries_read = 0u; //  ... is mere abundance of caution
     LPBYTE raw_records;
-    do switch(NetGroupGetUsers(nullptr, group_name, 0, &raw_records, MAX_PREFERRED_LENGTH,
+    do switch(backend().GroupGetUsers(nullptr, group_name, 0, &raw_records, MAX_PREFERRED_LENGTH,
                                         &entries_read, &entries_full, &query_resume)) {
     case ERROR_ACCESS_DENIED:
         set_last_error(EACCES);
@@ -67,6 +85,75 @@ void GetUsersFrom(const wchar_t* group_name, std::function<void(const wchar_t*)>
     } while(!errno);
 }
 
+// A member list fetched ahead of getgrent(), by a Pool worker or by getgrent() itself,
+// whichever gets to it first.
+struct Members {
+    enum { QUEUED, FETCHING, FETCHED };
+    std::wstring group;
+    std::atomic<int> state{QUEUED};
+    std::vector<std::wstring> names;
+    int error = 0;
+};
+
+// set by getgrent() for the group being translated; FillFrom() takes its members from here
+static thread_local const Members* prefetched = nullptr;
+
+// the member lists of one page of GroupEnum() results
+class PrefetchPage {
+public:
+    PrefetchPage(const GROUP_INFO_X* entries, std::size_t count)
+        : members(new Members[count]), count(count) {
+        for(std::size_t i = 0; i < count; ++i) {
+            members[i].group = entries[i].GRPI(name); // the page itself may be gone by the time we fetch
+        }
+    }
+
+    std::size_t size() const { return count; }
+
+    // fetch the members of the i-th group unless someone already has; false if someone has
+    bool fetch(std::size_t i) {
+        Members& slot = members[i];
+        int queued = Members::QUEUED;
+        if(cancelled || !slot.state.compare_exchange_strong(queued, Members::FETCHING)) {
+            return false;
+        }
+        set_last_error(0);
+        GetUsersFrom(slot.group.c_str(), [&slot](const wchar_t* member) {
+            slot.names.emplace_back(member);
+        });
+        slot.error = errno;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            slot.state = Members::FETCHED;
+        }
+        done.notify_all();
+        return true;
+    }
+
+    // the members of the i-th group: fetched inline if no worker has started on them yet
+    const Members& await(std::size_t i) {
+        const int error = errno;
+        if(!fetch(i)) {
+            std::unique_lock<std::mutex> lock(mtx);
+            done.wait(lock, [&]() { return Members::FETCHED == members[i].state; });
+        }
+        set_last_error(error); // the fetch's own is in Members::error
+        return members[i];
+    }
+
+    // workers skip what they haven't started on
+    void cancel() {
+        cancelled = true;
+    }
+
+private:
+    std::unique_ptr<Members[]> members;
+    const std::size_t count;
+    std::atomic<bool> cancelled{false};
+    std::mutex mtx;
+    std::condition_variable done;
+};
+
 // no heuristics and/or second guesses here, unlike FillFrom() in grp.cpp.
 // getting the member list requires a catch-up call to NetGroupGetUsers();
 // storing it requires passing a raw memory range into `writer`. therefore
@@ -81,13 +168,22 @@ bool FillFrom(struct group& grp, const GROUP_INFO_X& wg_infoX, const OutWriter&
     // the member list, however, is a null-terminated array of pointers.
     // we represent this special case as a string containing raw data.
     // don't be surprised if you see supposedly "garbage" text at the end
-    // of `out_buf` (reentrant API) or in the terminal OutBinder records
-    // (non-reentrant API).
+    // of the Arena it's translated into (see Packing for how it's copied).
     std::basic_string<uintptr_t> mem_name_ptrs; // nullptr-terminated
 
-    GetUsersFrom(wg_infoX.GRPI(name), [&](const wchar_t* member) {
+    auto on_member = [&](const wchar_t* member) {
         mem_name_ptrs.push_back(reinterpret_cast<uintptr_t>(writer(member)));
-    });
+    };
+    if(prefetched && prefetched->group == wg_infoX.GRPI(name)) {
+        for(std::size_t i = 0; i < prefetched->names.size() && !errno; ++i) {
+            on_member(prefetched->names[i].c_str());
+        }
+        if(!errno && prefetched->error) {
+            set_last_error(prefetched->error);
+        }
+    } else {
+        GetUsersFrom(wg_infoX.GRPI(name), on_member);
+    }
 
     grp.gr_mem = reinterpret_cast<char**>(writer(mem_name_ptrs.c_str(),
                         (mem_name_ptrs.size() + 1u) * sizeof(uintptr_t)));
@@ -95,6 +191,58 @@ bool FillFrom(struct group& grp, const GROUP_INFO_X& wg_infoX, const OutWriter&
     return grp.gr_name && !errno;
 }
 
+// the gr_mem array first, for alignment, then the name, the "password" and the members
+std::size_t Packing<struct group>::Measure(const struct group& src) {
+    auto len = [](const char* str) { return str ? std::strlen(str) + 1u : 0u; };
+    std::size_t size = len(src.gr_name) + len(src.gr_passwd);
+    if(src.gr_mem) {
+        char** member = src.gr_mem;
+        for(; *member; ++member) {
+            size += std::strlen(*member) + 1u;
+        }
+        size += (member - src.gr_mem + 1u) * sizeof(char*);
+    }
+    return size;
+}
+
+void Packing<struct group>::Lay(const struct group& src, struct group& out, char* at) {
+    std::size_t count = 0u;
+    while(src.gr_mem && src.gr_mem[count]) ++count;
+    out.gr_mem = src.gr_mem ? reinterpret_cast<char**>(at) : nullptr;
+    if(src.gr_mem) {
+        at += (count + 1u) * sizeof(char*);
+    }
+    auto pass = [&at](const char* str) {
+        if(!str) {
+            return static_cast<char*>(nullptr);
+        }
+        const std::size_t len = std::strlen(str) + 1u;
+        char* fld = static_cast<char*>(memcpy(at, str, len));
+        at += len;
+        return fld;
+    };
+    out.gr_name = pass(src.gr_name);
+    out.gr_passwd = pass(src.gr_passwd);
+    for(std::size_t i = 0; i < count; ++i) {
+        out.gr_mem[i] = pass(src.gr_mem[i]);
+    }
+    if(out.gr_mem) {
+        out.gr_mem[count] = nullptr;
+    }
+}
+
+void Packing<struct group>::Relocate(struct group& rec, const char* from, char* to) {
+    auto rebase = [from, to](char*& ptr) { if(ptr) ptr = to + (ptr - from); };
+    rebase(rec.gr_name);
+    rebase(rec.gr_passwd);
+    if(rec.gr_mem) {
+        rec.gr_mem = reinterpret_cast<char**>(to + (reinterpret_cast<char*>(rec.gr_mem) - from));
+        for(char** member = rec.gr_mem; *member; ++member) {
+            rebase(*member); // the array has moved already
+        }
+    }
+}
+
 // IA = InfoAdapter/Infodapter
 template<> struct IA<struct group>
 {
@@ -105,19 +253,43 @@ template<> struct IA<struct group>
 
     static id_t IdOf(const struct group& grp) { return grp.gr_gid; }
     static id_t IdOf(const NETAPI_INFO_T* wui) { return wui->GRPI(group_id); }
-    static const char* NameOf(struct group& grp) { return grp.gr_name; }
+    static const char* NameOf(const struct group& grp) { return grp.gr_name; }
     static const wchar_t* WNameOf(const NETAPI_INFO_T* wui) { return wui->GRPI(name); }
 
+    // the same level without asking for the members (see Stateless::LeanByName())
+    using LEAN_INFO_T = NETAPI_INFO_T;
+    static constexpr int LEAN_LVL = LVL;
+
     static NET_API_STATUS Enumerate(LPCWSTR servername, DWORD level, LPBYTE *bufptr, DWORD prefmaxlen,
                                 LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) {
-        return NetGroupEnum(servername, level, bufptr, prefmaxlen, entriesread, totalentries, resume_handle);
+        return backend().GroupEnum(servername, level, bufptr, prefmaxlen, entriesread, totalentries, resume_handle);
     }
 
+    static PageSizer& Pages() { return group_pages(); }
+
     static NET_API_STATUS GetInfo(LPCWSTR servername, LPCWSTR name, DWORD level, LPBYTE* bufptr) {
-        return NetGroupGetInfo(servername, name, level, bufptr);
+        return backend().GroupGetInfo(servername, name, level, bufptr);
+    }
+
+    // what FillFrom() translates, members included (see refresh.h)
+    static std::size_t Digest(const NETAPI_INFO_T& wg_infoX) {
+        std::size_t digest = Mix(0u, wg_infoX.GRPI(name));
+        GetUsersFrom(wg_infoX.GRPI(name), [&digest](const wchar_t* member) { digest = Mix(digest, member); });
+        if(ENOENT == errno) {
+            set_last_error(0); // deleted since enumerated; the next pass will see it gone
+        }
+        return digest;
     }
 };
 
+int GroupCensus(Census& census) {
+    return TakeCensus<struct group>(census);
+}
+
+void ForgetGroups(const std::vector<Stale>& stale) {
+    ForgetStale<struct group>(stale);
+}
+
 } // namespace wusers_impl
 
 namespace
@@ -126,105 +298,507 @@ using namespace wusers_impl;
 
 static thread_local State<struct group> tls;
 
+// fgetgrent(): the last line read, split in place
+struct FileEntry {
+    std::vector<char> line;
+    std::vector<char*> members;
+    struct group grp;
+};
+
+static thread_local FileEntry file_entry;
+
+std::size_t CountMembers(pwfile::Span list) {
+    std::size_t count = 0u;
+    pwfile::Span member;
+    while(pwfile::NextMember(list, member)) {
+        ++count;
+    }
+    return count;
+}
+
+// `members` has room for CountMembers() + 1 pointers
+void FillInPlace(struct group& grp, const pwfile::GrLine& gr_line, char** members) {
+    pwfile::Span list = gr_line.members;
+    pwfile::Span member;
+    grp.gr_mem = members;
+    while(pwfile::NextMember(list, member)) {
+        *members++ = pwfile::Terminate(member);
+    }
+    *members = nullptr;
+    grp.gr_name = pwfile::Terminate(gr_line.name);
+    grp.gr_passwd = pwfile::Terminate(gr_line.passwd);
+    grp.gr_gid = gr_line.gid;
+}
+
+// the page of groups that getgrent() is going through, with their member lists on the way
+class Prefetch {
+public:
+    using QueryState = EnumQueryState<GROUP_INFO_X, GLVL, &IA<struct group>::Enumerate, &IA<struct group>::Pages>;
+
+    // queue up the member lists of the current page
+    void start(const QueryState& query) {
+        stop();
+        offset = query.offset;
+        if(!query.buffer() || !query.entries_read || !Pool::instance().size()) {
+            return;
+        }
+        page = std::make_shared<PrefetchPage>(query.buffer(), query.entries_read);
+        std::vector<Pool::Task> tasks;
+        tasks.reserve(page->size());
+        for(std::size_t i = 0; i < page->size(); ++i) {
+            std::shared_ptr<PrefetchPage> hold = page; // workers may outlive the enumeration
+            tasks.push_back([hold, i]() { hold->fetch(i); });
+        }
+        Pool::instance().submit(tasks);
+    }
+
+    void stop() {
+        if(page) {
+            page->cancel();
+            page.reset();
+        }
+    }
+
+    // the members of the entry step() has just returned; nullptr if they aren't being prefetched
+    const Members* members(const QueryState& query) {
+        if(query.offset != offset) {
+            start(query); // step() has moved on to the next page
+        }
+        return page && query.cursor ? &page->await(query.cursor - 1u) : nullptr;
+    }
+
+private:
+    std::shared_ptr<PrefetchPage> page;
+    std::size_t offset = 0u;
+};
+
+static thread_local Prefetch prefetch;
+
+// getgrent_r() and wuser_grcursor_next(): records as getgrent() translates them, into `out_buf`
+int NextGroups(Prefetch::QueryState& query, Prefetch& ahead, struct group* out_grps, std::size_t max,
+               char* out_buf, size_t buf_len, std::size_t& count) {
+    const int err = FillBatch(query, out_grps, max, out_buf, buf_len, count,
+        [&](struct group& grp, const GROUP_INFO_X& info, const OutWriter& writer) {
+            prefetched = ahead.members(query);
+            return FillFrom(grp, info, writer);
+        });
+    prefetched = nullptr;
+    return err;
+}
+
+// Which groups a user is in. NetAPI only answers the other way around (members of a
+// group), so the answer comes from a reverse index, built from one pass over all groups
+// and their members and kept as long as the shared cache would keep a record.
+class Membership {
+public:
+    static Membership& instance() {
+        static Membership membership;
+        return membership;
+    }
+
+    // the gids of the groups `wname` is a member of, in enumeration order; false (errno) if unknown
+    bool groupsOf(const std::wstring& wname, std::vector<gid_t>& gids) {
+        std::shared_ptr<const Index> index = current();
+        if(!index) {
+            return false;
+        }
+        auto itr = index->of.find(fold_name(wname));
+        if(itr != index->of.end()) {
+            gids = itr->second;
+        }
+        return true;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using QueryState = EnumQueryState<GROUP_INFO_X, GLVL, &IA<struct group>::Enumerate, &IA<struct group>::Pages>;
+
+    struct Index {
+        std::unordered_map<std::wstring, std::vector<gid_t>> of; // by folded member name
+        unsigned long generation;
+        Clock::time_point expiry;
+    };
+
+    bool fresh(const std::shared_ptr<const Index>& index) const {
+        return index && index->generation == record_generation() && Clock::now() < index->expiry;
+    }
+
+    std::shared_ptr<const Index> current() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(fresh(index)) {
+                return index;
+            }
+        }
+        std::lock_guard<std::mutex> fill(build_mtx); // one thread builds, the rest wait for it
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(fresh(index)) {
+                return index;
+            }
+        }
+        std::shared_ptr<Index> built = build();
+        if(built && cache_ttl().count() > 0) {
+            std::lock_guard<std::mutex> lock(mtx);
+            index = built;
+        }
+        return built;
+    }
+
+    static std::shared_ptr<Index> build() {
+        std::shared_ptr<Index> built = std::make_shared<Index>();
+        built->generation = record_generation();
+        built->expiry = Clock::now() + cache_ttl();
+        QueryState query;
+        query.reset();
+        query.query();
+        while(const GROUP_INFO_X* info = query.step()) {
+            const gid_t gid = info->GRPI(group_id);
+            GetUsersFrom(info->GRPI(name), [&](const wchar_t* member) {
+                built->of[fold_name(member)].push_back(gid);
+            });
+            if(ENOENT == errno) {
+                set_last_error(0); // deleted since enumerated
+            }
+            if(errno) {
+                return nullptr; // a partial index would make memberships look absent
+            }
+        }
+        return errno ? nullptr : built;
+    }
+
+    std::mutex mtx;
+    std::mutex build_mtx;
+    std::shared_ptr<const Index> index;
+};
+
+// `group` first, then whatever else `wname` is a member of
+int GroupList(const std::wstring& wname, gid_t group, std::vector<gid_t>& gids) {
+    std::vector<gid_t> member_of;
+    if(!Membership::instance().groupsOf(wname, member_of)) {
+        return -1;
+    }
+    gids.assign(1u, group);
+    for(gid_t gid : member_of) {
+        if(std::find(gids.begin(), gids.end(), gid) == gids.end()) {
+            gids.push_back(gid);
+        }
+    }
+    return 0;
+}
+
+// set by initgroups(); reported by getgroups() instead of the effective user's groups
+std::mutex init_mtx;
+std::unique_ptr<std::vector<gid_t>> init_groups;
+
 } // anonymous
 
+// wusers/wuser_cursor.h: what setgrent() keeps per thread, kept by the caller instead
+struct wuser_grcursor {
+    Prefetch::QueryState query;
+    Prefetch prefetch;
+};
+
+namespace wusers {
+namespace detail {
+
+// wusers::groups(): as users(); members are only asked for by group::members()
+template<> struct enumeration<group> {
+    Prefetch::QueryState query;
+    group current;
+    int error = 0;
+};
+
+std::shared_ptr<enumeration<group>> open_groups() {
+    std::shared_ptr<enumeration<group>> opened = std::make_shared<enumeration<group>>();
+    opened->query.reset();
+    opened->query.query();
+    opened->error = errno;
+    return opened;
+}
+
+const group* next(enumeration<group>& from) {
+    Lookup lookup(WUSER_ENTRY_GROUP_CURSOR);
+    set_last_error(0);
+    const GROUP_INFO_X* info = from.error ? nullptr : from.query.step();
+    if(!info) {
+        from.error = from.error ? from.error : errno;
+        return nullptr;
+    }
+    from.current.gid = info->GRPI(group_id);
+    from.current.name = text(info->GRPI(name));
+    return &from.current;
+}
+
+int error(const enumeration<group>& of) {
+    return of.error;
+}
+
+} // namespace detail
+
+std::vector<std::string> group::members() const {
+    std::vector<std::string> names;
+    const std::wstring_view wname = name.wide();
+    if(wname.empty()) {
+        set_last_error(EINVAL);
+        return names;
+    }
+    set_last_error(0);
+    GetUsersFrom(wname.data(), [&names](const wchar_t* member) { // the view ends where the page's string does
+        names.emplace_back();
+        to_posix_str(member, std::wcslen(member), names.back());
+    });
+    if(errno) {
+        names.clear();
+    }
+    return names;
+}
+
+} // namespace wusers
+
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 struct group *getgrgid(gid_t gid) {
+    Lookup lookup(WUSER_ENTRY_GETGRGID);
     return tls.queryById(gid);
 }
 
 struct group *getgrnam(const char * group_name) {
+    Lookup lookup(WUSER_ENTRY_GETGRNAM);
     return tls.queryByName(group_name);
 }
 
 void setgrent(void) {
     tls.beginEnum();
+    prefetch.start(tls.query_state);
 }
 
 struct group *getgrent(void) {
-    return tls.nextEntry();
+    Lookup lookup(WUSER_ENTRY_GETGRENT);
+    const GROUP_INFO_X* info = tls.query_state.step();
+    prefetched = info ? prefetch.members(tls.query_state) : nullptr;
+    struct group* grp = tls.fillInternalEntry(info);
+    prefetched = nullptr;
+    return grp;
 }
 
 void endgrent(void) {
+    prefetch.stop();
     tls.endEnum();
 }
 
-int getgrnam_r(const char * group_name, struct group * out_grp, char * out_buf, size_t buf_len, struct group ** out_ptr) {
-    // the code is identical to getpwnam_r, but set_last_error() would probably look funny in Stateless<>; leave for now
-    set_last_error(0);
+int getgrent_r(struct group * out_grp, char * out_buf, size_t buf_len, struct group ** out_ptr) {
+    Lookup lookup(WUSER_ENTRY_GROUP_CURSOR);
+    std::size_t count;
+    const int err = NextGroups(tls.query_state, prefetch, out_grp, 1u, out_buf, buf_len, count);
+    *out_ptr = count ? out_grp : nullptr;
+    return err;
+}
+
+struct wuser_grcursor *wuser_grcursor_open(void) {
+    std::unique_ptr<wuser_grcursor> cursor(new (std::nothrow) wuser_grcursor);
+    if(!cursor) {
+        set_last_error(ENOMEM);
+        return nullptr;
+    }
+    cursor->query.reset();
+    cursor->query.query();
+    if(errno) {
+        return nullptr;
+    }
+    cursor->prefetch.start(cursor->query);
+    return cursor.release();
+}
+
+int wuser_grcursor_next(struct wuser_grcursor *cursor, struct group *out_grps, size_t max,
+                        char *buf, size_t buf_len, size_t *out_count) {
+    Lookup lookup(WUSER_ENTRY_GROUP_CURSOR);
+    *out_count = 0u;
+    if(!cursor) {
+        set_last_error(EINVAL);
+        return errno;
+    }
+    return NextGroups(cursor->query, cursor->prefetch, out_grps, max, buf, buf_len, *out_count);
+}
+
+void wuser_grcursor_close(struct wuser_grcursor *cursor) {
+    if(cursor) {
+        cursor->prefetch.stop();
+        delete cursor;
+    }
+}
+
+struct group *fgetgrent(FILE * stream) {
+    if(!stream) {
+        set_last_error(EINVAL);
+        return nullptr;
+    }
+    pwfile::GrLine gr_line;
+    std::size_t len;
+    while(pwfile::ReadLine(stream, file_entry.line, len)) {
+        if(pwfile::Parse(file_entry.line.data(), len, gr_line)) {
+            file_entry.members.resize(CountMembers(gr_line.members) + 1u);
+            FillInPlace(file_entry.grp, gr_line, file_entry.members.data());
+            return &file_entry.grp;
+        }
+    }
+    return nullptr;
+}
+
+int fgetgrent_r(FILE * stream, struct group * out_grp, char * out_buf, size_t buf_len, struct group ** out_ptr) {
     *out_ptr = nullptr;
-    const std::wstring wgroup_name = to_win_str(group_name);
-    if(wgroup_name.size()) {
-        *out_ptr = Stateless<struct group>::QueryByName(wgroup_name, out_grp, BufferWriter(out_buf, buf_len));
-        if(errno) *out_ptr = nullptr; // kill partial|inconsistent output
+    if(!stream) {
+        set_last_error(EINVAL);
+        return errno;
+    }
+    pwfile::GrLine gr_line;
+    std::size_t len;
+    std::fpos_t start;
+    int err;
+    for(;;) {
+        const bool rewindable = !std::fgetpos(stream, &start);
+        if((err = pwfile::ReadLine(stream, out_buf, buf_len, len))) {
+            break;
+        }
+        if(pwfile::Parse(out_buf, len, gr_line)) {
+            // the member array goes after the line, aligned
+            const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(out_buf);
+            std::size_t at = ((base + len + alignof(char*)) & ~std::uintptr_t(alignof(char*) - 1u)) - base;
+            std::size_t need = (CountMembers(gr_line.members) + 1u) * sizeof(char*);
+            if(at > buf_len || need > buf_len - at) {
+                if(rewindable) std::fsetpos(stream, &start); // retry with a larger buffer
+                err = ERANGE;
+            } else {
+                FillInPlace(*out_grp, gr_line, reinterpret_cast<char**>(out_buf + at));
+                *out_ptr = out_grp;
+            }
+            break;
+        }
     }
+    set_last_error(err);
+    return err;
+}
+
+int getgrnam_r(const char * group_name, struct group * out_grp, char * out_buf, size_t buf_len, struct group ** out_ptr) {
+    Lookup lookup(WUSER_ENTRY_GETGRNAM_R);
+    // the code is identical to getpwnam_r
+    *out_ptr = nullptr;
+    Stateless<struct group>::QueryByNameAndMap<int>(group_name,
+        [&](const Packed<struct group>& grp) {
+            return grp.copyTo(*out_grp, out_buf, buf_len) ? (*out_ptr = out_grp, 0) : -1;
+        },
+        [](){ return -1; });
+    if(errno) *out_ptr = nullptr; // kill partial|inconsistent output
     return errno;
 }
 
 int getgrgid_r(gid_t gid, struct group * out_grp, char * out_buf, size_t buf_len, struct group ** out_ptr) {
-    // most of the (e.g. visual) complexity of getpwuid_r comes from the owned entry duplication block.
-    // as the comment in pwd.cpp correctly indicates (I know: I wrote it), it's still worth the saved trip
-    // to the kernel and system services. however, getpwuid_r takes pw_dup for granted. there is no gr_dup.
-    // instead of creating it for the sole purpose of abusing it, we'd rather code a faithful cloning op /
-    // buffer writeout here.
+    Lookup lookup(WUSER_ENTRY_GETGRGID_R);
+    // ditto getpwuid_r: a cached record is copied out with one memcpy(), gr_mem included
     set_last_error(0);
     *out_ptr = nullptr;
-    BufferWriter writer(out_buf, buf_len);
     tls.queryByIdAndMap<int>(gid,
-        [&](struct group& grp) {
-            std::size_t name_sz = std::strlen(grp.gr_name) + 1u;
-            std::size_t pass_sz = std::strlen(grp.gr_passwd) + 1u;
-            std::size_t estimate = sizeof(struct group) + name_sz + pass_sz;
-            std::basic_string<std::size_t> mem_lengths;
-            const char* mem_ptr;
-            while((estimate <= buf_len) && (mem_ptr = grp.gr_mem[mem_lengths.size()])) {
-                mem_lengths.push_back(std::strlen(mem_ptr) + 1u);
-                estimate += mem_lengths.back();
-            }
-            if(estimate > buf_len) {
-                set_last_error(ERANGE);
-                return -1;
-            }
-
-            memcpy(out_grp, &grp, sizeof(struct group)); // only copies the gid
-                // ... but if more fixed-size fields are added, we are covered
-            out_grp->gr_mem = reinterpret_cast<char**>(out_buf);
-            std::size_t msz = sizeof(uintptr_t) * (mem_lengths.size() + 1u);
-            out_buf += msz;
-            buf_len -= msz;
-            out_grp->gr_name = writer(grp.gr_name, name_sz);
-            out_grp->gr_passwd = writer(grp.gr_passwd, pass_sz);
-            for(std::size_t i = 0; i < mem_lengths.size(); ++i) {
-                out_grp->gr_mem[i] = writer(grp.gr_mem[i], mem_lengths.at(i));
-            }
-            return 0;
-        },
-        [&](const GROUP_INFO_X* wu_info) {
-            return FillFrom(*out_grp, *wu_info, writer) && !errno
-                ? (*out_ptr = out_grp, 0)
-                : (*out_ptr = nullptr, -1);
+        [&](const Packed<struct group>& grp) {
+            return grp.copyTo(*out_grp, out_buf, buf_len) ? (*out_ptr = out_grp, 0) : -1;
         },
         [](){ return -1; });
     return errno;
 }
 
+struct group *gr_dup(const struct group * src) {
+    if(!src) {
+        set_last_error(EINVAL);
+        return nullptr;
+    }
+    return Packed<struct group>(*src).dup();
+}
+
 int setgroupent(int) {
     setgrent();
     return !errno;
 }
 
 int gid_from_group(const char * group_name, gid_t * out_gid) {
+    Lookup lookup(WUSER_ENTRY_GID_FROM_GROUP);
     return tls.nameToId(group_name, out_gid);
 }
 
 const char *group_from_gid(gid_t gid, int nogroup) {
+    Lookup lookup(WUSER_ENTRY_GROUP_FROM_GID);
     return tls.idToName(gid, nogroup);
 }
 
+int getgrouplist(const char * user_name, gid_t group, gid_t * out_groups, int * ngroups) {
+    Lookup lookup(WUSER_ENTRY_GETGROUPLIST);
+    set_last_error(0);
+    const std::wstring wname = to_win_str(user_name);
+    std::vector<gid_t> gids;
+    if(wname.empty() || GroupList(wname, group, gids)) {
+        return -1;
+    }
+    const std::size_t room = *ngroups > 0 ? *ngroups : 0u;
+    std::copy_n(gids.begin(), std::min(room, gids.size()), out_groups);
+    *ngroups = gids.size();
+    return gids.size() <= room ? 0 : -1;
+}
+
+int initgroups(const char * user_name, gid_t group) {
+    set_last_error(0);
+    const std::wstring wname = to_win_str(user_name);
+    std::unique_ptr<std::vector<gid_t>> gids(new std::vector<gid_t>());
+    if(wname.empty() || GroupList(wname, group, *gids)) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(init_mtx);
+    init_groups = std::move(gids);
+    return 0;
+}
+
+int getgroups(int size, gid_t * out_groups) {
+    set_last_error(0);
+    std::vector<gid_t> gids;
+    {
+        std::lock_guard<std::mutex> lock(init_mtx);
+        if(init_groups) {
+            gids = *init_groups;
+        }
+    }
+    if(gids.empty()) {
+        const gid_t egid = getegid();
+        if(static_cast<gid_t>(-1) == egid || GroupList(GetEffectiveName(), egid, gids)) {
+            return -1;
+        }
+    }
+    if(size && static_cast<std::size_t>(size) < gids.size()) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    if(size) {
+        std::copy(gids.begin(), gids.end(), out_groups);
+    }
+    return gids.size();
+}
+
+int wuser_getgrgid_batch(const gid_t *gids, size_t count, struct group *out_grps,
+                         char *buf, size_t buf_len, struct group **out_ptrs) {
+    Lookup lookup(WUSER_ENTRY_GROUP_BATCH);
+    return Stateless<struct group>::RecordsByIds(gids, count, out_grps, buf, buf_len, out_ptrs);
+}
+
+int wuser_group_from_gid_batch(const gid_t *gids, size_t count, int nogroup,
+                         char *buf, size_t buf_len, const char **out_names) {
+    Lookup lookup(WUSER_ENTRY_GROUP_BATCH);
+    return Stateless<struct group>::NamesByIds(gids, count, nogroup, buf, buf_len, out_names);
+}
+
+int wuser_gid_from_group_batch(const char *const *names, size_t count, gid_t *out_gids) {
+    Lookup lookup(WUSER_ENTRY_GROUP_BATCH);
+    return Stateless<struct group>::IdsByNames(names, count, out_gids);
+}
+
 #ifdef __cplusplus
 }
 #endif
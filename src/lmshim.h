@@ -0,0 +1,137 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _LMSHIM_H_
+#define _LMSHIM_H_
+
+// On Windows, this is simply <windows.h> + <lm.h>. Elsewhere, we declare the
+// (small) subset of NetAPI types and status codes that the library core uses,
+// so that the core and the in-memory stand-in backend build and run anywhere.
+// Values match the Windows SDK; layouts match <lmaccess.h> field by field.
+
+#ifdef _WIN32
+
+#include <windows.h> // SID -> sid.h, sid.cpp
+#include <lm.h>      // NetApiBufferFree
+
+#else // !_WIN32
+
+#include <cstdint>
+#include <cwchar>
+
+using BYTE = unsigned char;
+using PBYTE = BYTE*;
+using LPBYTE = BYTE*;
+using BOOL = int;
+using DWORD = std::uint32_t;
+using LPDWORD = DWORD*;
+using ULONG = std::uint32_t;
+using PULONG = ULONG*;
+using DWORD_PTR = std::uintptr_t;
+using PDWORD_PTR = DWORD_PTR*;
+using LPVOID = void*;
+using PSID = void*;
+using WCHAR = wchar_t;
+using LPWSTR = wchar_t*;
+using LPCWSTR = const wchar_t*;
+using LMSTR = wchar_t*;
+using NET_API_STATUS = DWORD;
+
+constexpr DWORD ERROR_SUCCESS = 0;
+constexpr DWORD ERROR_ACCESS_DENIED = 5;
+constexpr DWORD ERROR_NOT_ENOUGH_MEMORY = 8;
+constexpr DWORD ERROR_NOT_SUPPORTED = 50;
+constexpr DWORD ERROR_BAD_NETPATH = 53;
+constexpr DWORD ERROR_INSUFFICIENT_BUFFER = 122;
+constexpr DWORD ERROR_INVALID_LEVEL = 124;
+constexpr DWORD ERROR_MORE_DATA = 234;
+constexpr DWORD ERROR_NO_UNICODE_TRANSLATION = 1113;
+
+constexpr NET_API_STATUS NERR_Success = 0;
+constexpr NET_API_STATUS NERR_BufTooSmall = 2123;
+constexpr NET_API_STATUS NERR_InternalError = 2140;
+constexpr NET_API_STATUS NERR_GroupNotFound = 2220;
+constexpr NET_API_STATUS NERR_UserNotFound = 2221;
+constexpr NET_API_STATUS NERR_InvalidComputer = 2351;
+
+constexpr DWORD MAX_PREFERRED_LENGTH = ~DWORD(0);
+constexpr DWORD FILTER_NORMAL_ACCOUNT = 0x0002;
+constexpr DWORD TIMEQ_FOREVER = ~DWORD(0);
+
+constexpr DWORD USER_PRIV_GUEST = 0;
+constexpr DWORD USER_PRIV_USER = 1;
+constexpr DWORD USER_PRIV_ADMIN = 2;
+
+constexpr DWORD MAX_PATH = 260;
+constexpr DWORD FILE_ATTRIBUTE_DIRECTORY = 0x10;
+constexpr DWORD INVALID_FILE_ATTRIBUTES = ~DWORD(0);
+
+struct USER_INFO_0 {
+    LPWSTR usri0_name;
+};
+
+struct USER_INFO_20 {
+    LPWSTR usri20_name;
+    LPWSTR usri20_full_name;
+    LPWSTR usri20_comment;
+    DWORD  usri20_flags;
+    DWORD  usri20_user_id;
+};
+
+struct USER_INFO_3 {
+    LPWSTR usri3_name;
+    LPWSTR usri3_password;
+    DWORD  usri3_password_age;
+    DWORD  usri3_priv;
+    LPWSTR usri3_home_dir;
+    LPWSTR usri3_comment;
+    DWORD  usri3_flags;
+    LPWSTR usri3_script_path;
+    DWORD  usri3_auth_flags;
+    LPWSTR usri3_full_name;
+    LPWSTR usri3_usr_comment;
+    LPWSTR usri3_parms;
+    LPWSTR usri3_workstations;
+    DWORD  usri3_last_logon;
+    DWORD  usri3_last_logoff;
+    DWORD  usri3_acct_expires;
+    DWORD  usri3_max_storage;
+    DWORD  usri3_units_per_week;
+    PBYTE  usri3_logon_hours;
+    DWORD  usri3_bad_pw_count;
+    DWORD  usri3_num_logons;
+    LPWSTR usri3_logon_server;
+    DWORD  usri3_country_code;
+    DWORD  usri3_code_page;
+    DWORD  usri3_user_id;
+    DWORD  usri3_primary_group_id;
+    LPWSTR usri3_profile;
+    LPWSTR usri3_home_dir_drive;
+    DWORD  usri3_password_expired;
+};
+
+struct GROUP_INFO_0 {
+    LPWSTR grpi0_name;
+};
+
+struct GROUP_INFO_2 {
+    LPWSTR grpi2_name;
+    LPWSTR grpi2_comment;
+    DWORD  grpi2_group_id;
+    DWORD  grpi2_attributes;
+};
+
+struct GROUP_USERS_INFO_0 {
+    LPWSTR grui0_name;
+};
+
+// case-insensitive comparison as spelled by the MS CRT
+inline int _wcsicmp(const wchar_t* lhs, const wchar_t* rhs) { return wcscasecmp(lhs, rhs); }
+
+#endif // _WIN32
+
+#endif /* !_LMSHIM_H_ */
@@ -0,0 +1,90 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "mapfile.h"
+#include "wus.h"      // set_last_error()
+#include <errno.h>    // error codes
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <windows.h> // CreateFileMapping, MapViewOfFile
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace wusers_impl {
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const char* path) {
+    const std::uint64_t stamped = Stamp(path);
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(INVALID_HANDLE_VALUE == file) {
+        set_last_error(ERROR_ACCESS_DENIED == GetLastError() ? EACCES : ENOENT);
+        return nullptr;
+    }
+    LARGE_INTEGER file_size;
+    const void* view = nullptr;
+    std::size_t size = 0u;
+    if(GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        size = static_cast<std::size_t>(file_size.QuadPart);
+        if(HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)) {
+            view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); // the view keeps the mapping alive
+        }
+    }
+    CloseHandle(file);
+    if(!view) {
+        set_last_error(EINVAL);
+        return nullptr;
+    }
+#else
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    void* view = MAP_FAILED;
+    std::size_t size = 0u;
+    if(fstat(fd, &st)) {
+        // errno is set
+    } else if(st.st_size <= 0) {
+        set_last_error(EINVAL);
+    } else {
+        size = static_cast<std::size_t>(st.st_size);
+        view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    int err = errno;
+    close(fd);
+    set_last_error(err);
+    if(MAP_FAILED == view) {
+        return nullptr;
+    }
+#endif
+    return std::shared_ptr<const MappedFile>(new MappedFile(static_cast<const char*>(view), size, stamped));
+}
+
+std::uint64_t MappedFile::Stamp(const char* path) {
+    struct stat st;
+    if(stat(path, &st)) {
+        return 0u;
+    }
+    return (static_cast<std::uint64_t>(st.st_mtime) << 24) ^ static_cast<std::uint64_t>(st.st_size) ^ 1u;
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+#else
+    munmap(const_cast<char*>(base), length);
+#endif
+}
+
+} // namespace wusers_impl
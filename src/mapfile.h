@@ -0,0 +1,46 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _MAPFILE_H_
+#define _MAPFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace wusers_impl {
+
+// A whole file mapped read-only, unmapped with the last reference.
+class MappedFile {
+public:
+    // nullptr and errno if the file can't be opened or is empty (EINVAL)
+    static std::shared_ptr<const MappedFile> Open(const char* path);
+
+    // size and modification time of `path`, to tell whether a mapping is outdated;
+    // 0 if there is no such file
+    static std::uint64_t Stamp(const char* path);
+
+    const char* data() const { return base; }
+    std::size_t size() const { return length; }
+    std::uint64_t stamp() const { return stamped; }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+private:
+    MappedFile(const char* base, std::size_t length, std::uint64_t stamped)
+        : base(base), length(length), stamped(stamped) {}
+
+    const char* base;
+    std::size_t length;
+    std::uint64_t stamped;
+};
+
+} // namespace wusers_impl
+
+#endif /* !_MAPFILE_H_ */
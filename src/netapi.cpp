@@ -0,0 +1,124 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "backend.h"
+
+#include <windows.h> // ExpandEnvironmentStringsW, GetFileAttributesW, FindFirstFileExW, GetTokenInformation
+#include <lm.h>      // Net*
+#include <secext.h>  // GetUserNameExW
+
+namespace {
+using namespace wusers_impl;
+
+// the real thing; no state, no opinions
+struct NetApi : public Backend
+{
+    NET_API_STATUS UserEnum(LPCWSTR servername, DWORD level, DWORD filter, LPBYTE* bufptr, DWORD prefmaxlen,
+                            LPDWORD entriesread, LPDWORD totalentries, LPDWORD resume_handle) override {
+        return NetUserEnum(servername, level, filter, bufptr, prefmaxlen, entriesread, totalentries, resume_handle);
+    }
+
+    NET_API_STATUS UserGetInfo(LPCWSTR servername, LPCWSTR username, DWORD level, LPBYTE* bufptr) override {
+        return NetUserGetInfo(servername, username, level, bufptr);
+    }
+
+    NET_API_STATUS GroupEnum(LPCWSTR servername, DWORD level, LPBYTE* bufptr, DWORD prefmaxlen,
+                            LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) override {
+        return NetGroupEnum(servername, level, bufptr, prefmaxlen, entriesread, totalentries, resume_handle);
+    }
+
+    NET_API_STATUS GroupGetInfo(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr) override {
+        return NetGroupGetInfo(servername, groupname, level, bufptr);
+    }
+
+    NET_API_STATUS GroupGetUsers(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr,
+                            DWORD prefmaxlen, LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) override {
+        return NetGroupGetUsers(servername, groupname, level, bufptr, prefmaxlen, entriesread, totalentries, resume_handle);
+    }
+
+    NET_API_STATUS BufferFree(LPVOID buffer) override {
+        return NetApiBufferFree(buffer);
+    }
+
+    DWORD ExpandEnvironment(LPCWSTR src, LPWSTR dst, DWORD size) override {
+        return ExpandEnvironmentStringsW(src, dst, size);
+    }
+
+    DWORD FileAttributes(LPCWSTR path) override {
+        return GetFileAttributesW(path);
+    }
+
+    bool ListDirectories(LPCWSTR path, std::vector<std::wstring>& names) override {
+        WIN32_FIND_DATAW found;
+        HANDLE find = FindFirstFileExW((std::wstring(path) + L"\\*").c_str(), FindExInfoStandard, &found,
+                                        FindExSearchLimitToDirectories, nullptr, 0);
+        if(INVALID_HANDLE_VALUE == find) {
+            return false;
+        }
+        do {
+            const std::wstring name = found.cFileName;
+            if((found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && name != L"." && name != L"..") {
+                names.push_back(name);
+            }
+        } while(FindNextFileW(find, &found));
+        const bool complete = ERROR_NO_MORE_FILES == GetLastError();
+        FindClose(find);
+        return complete;
+    }
+
+    DWORD UserNameSam(LPWSTR name, PULONG size) override {
+        return GetUserNameExW(NameSamCompatible, name, size) ? ERROR_SUCCESS : GetLastError();
+    }
+
+    DWORD TokenRids(LPDWORD user_rid, LPDWORD group_rid) override {
+        HANDLE token;
+        if(!OpenThreadToken(GetCurrentThread(), TOKEN_QUERY, TRUE, &token)) {
+            const DWORD status = GetLastError();
+            if(ERROR_NO_TOKEN != status) {
+                return status;
+            }
+            if(!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+                return GetLastError();
+            }
+        }
+        union {
+            TOKEN_USER user;
+            TOKEN_PRIMARY_GROUP group;
+            BYTE room[sizeof(TOKEN_USER) + SECURITY_MAX_SID_SIZE];
+        } info;
+        DWORD len;
+        DWORD status = ERROR_SUCCESS;
+        if(GetTokenInformation(token, TokenUser, &info, sizeof(info), &len)) {
+            *user_rid = Rid(info.user.User.Sid);
+        } else {
+            status = GetLastError();
+        }
+        if(!status && GetTokenInformation(token, TokenPrimaryGroup, &info, sizeof(info), &len)) {
+            *group_rid = Rid(info.group.PrimaryGroup);
+        } else if(!status) {
+            status = GetLastError();
+        }
+        CloseHandle(token);
+        return status;
+    }
+
+private:
+    static DWORD Rid(PSID sid) {
+        return *GetSidSubAuthority(sid, *GetSidSubAuthorityCount(sid) - 1);
+    }
+};
+
+} // anonymous
+
+namespace wusers_impl {
+
+Backend& netapi_backend() {
+    static NetApi netapi;
+    return netapi;
+}
+
+} // namespace wusers_impl
@@ -0,0 +1,93 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _PACK_H_
+#define _PACK_H_
+
+#include "lmshim.h"
+
+#include <cstdlib>
+#include <cwchar>
+#include <string>
+
+namespace wusers_impl {
+
+// NetAPI-style buffers for the backends that aren't NetAPI (see standin.h, files.h)
+
+// counts the bytes of strings on the first pass and copies them on the second one,
+// so that the record filling code (see Pack() callers) is written exactly once.
+class Strings {
+public:
+    explicit Strings(BYTE* area = nullptr) : out(reinterpret_cast<wchar_t*>(area)) {}
+
+    LPWSTR operator()(const std::wstring& str) {
+        std::size_t len = str.size() + 1u;
+        bytes += len * sizeof(wchar_t);
+        if(!out) {
+            return nullptr;
+        }
+        LPWSTR put = out;
+        std::wmemcpy(out, str.c_str(), len);
+        out += len;
+        return put;
+    }
+
+    std::size_t bytes = 0u;
+
+private:
+    wchar_t* out;
+};
+
+// NetAPI buffers are a single allocation: an array of INFO_T records followed by their strings.
+// As many records as fit in `prefmaxlen` are packed; NERR_BufTooSmall if not even one does.
+// The size of the buffer goes to `packed`, if given.
+template<typename INFO_T, typename ITEM_T, typename FILL_T>
+NET_API_STATUS Pack(const ITEM_T* items, std::size_t count, std::size_t& next, DWORD prefmaxlen, FILL_T fill,
+                    LPBYTE* bufptr, LPDWORD entriesread, LPDWORD totalentries, std::size_t* packed = nullptr) {
+    *bufptr = nullptr;
+    *entriesread = 0u;
+    if(totalentries) *totalentries = count;
+
+    const std::size_t from = next;
+    std::size_t upto = from;
+    std::size_t total = 0u;
+    INFO_T scratch;
+    while(upto < count) {
+        Strings measure;
+        fill(items[upto], scratch, measure);
+        std::size_t bytes = sizeof(INFO_T) + measure.bytes;
+        if(prefmaxlen != MAX_PREFERRED_LENGTH && total + bytes > prefmaxlen) {
+            break;
+        }
+        total += bytes;
+        ++upto;
+    }
+    if(upto == from && from < count) {
+        return NERR_BufTooSmall;
+    }
+    if(packed) *packed = total;
+    if(total) {
+        BYTE* block = static_cast<BYTE*>(std::malloc(total));
+        if(!block) {
+            return ERROR_NOT_ENOUGH_MEMORY;
+        }
+        INFO_T* records = reinterpret_cast<INFO_T*>(block);
+        Strings write(block + sizeof(INFO_T) * (upto - from));
+        for(std::size_t i = from; i < upto; ++i) {
+            records[i - from] = INFO_T{};
+            fill(items[i], records[i - from], write);
+        }
+        *bufptr = block;
+    }
+    *entriesread = upto - from;
+    next = upto;
+    return upto < count ? ERROR_MORE_DATA : NERR_Success;
+}
+
+} // namespace wusers_impl
+
+#endif /* !_PACK_H_ */
@@ -0,0 +1,113 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "pool.h"
+
+namespace wusers_impl {
+
+Pool& Pool::instance() {
+    static Pool pool;
+    return pool;
+}
+
+Pool::Pool() {
+    resize(WORKERS);
+}
+
+Pool::~Pool() {
+    stop();
+}
+
+void Pool::resize(unsigned int count) {
+    std::lock_guard<std::mutex> one_at_a_time(resizing);
+    stop();
+    std::lock_guard<std::mutex> lock(mtx);
+    stopping = false;
+    for(unsigned int i = 0; i < count; ++i) {
+        workers.emplace_back(new Worker());
+    }
+    for(std::size_t i = 0; i < workers.size(); ++i) {
+        workers[i]->thread = std::thread(&Pool::run, this, i);
+    }
+}
+
+unsigned int Pool::size() const {
+    std::lock_guard<std::mutex> lock(mtx);
+    return workers.size();
+}
+
+bool Pool::submit(std::vector<Task>& tasks) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(workers.empty()) {
+        return false;
+    }
+    for(Task& task : tasks) {
+        Worker& worker = *workers[next++ % workers.size()];
+        std::lock_guard<std::mutex> queue(worker.mtx);
+        worker.tasks.push_back(std::move(task));
+    }
+    queued += tasks.size();
+    wake.notify_all();
+    return true;
+}
+
+void Pool::run(std::size_t self) {
+    Task task;
+    std::unique_lock<std::mutex> lock(mtx);
+    for(;;) {
+        wake.wait(lock, [this]() { return stopping || queued; });
+        if(stopping) {
+            return;
+        }
+        lock.unlock();
+        const bool took = take(self, task);
+        lock.lock();
+        if(took) {
+            --queued;
+            lock.unlock();
+            task();
+            task = nullptr;
+            lock.lock();
+        }
+    }
+}
+
+bool Pool::take(std::size_t self, Task& task) {
+    // `workers` doesn't change while any of them runs: stop() joins them first
+    for(std::size_t k = 0; k < workers.size(); ++k) {
+        Worker& victim = *workers[(self + k) % workers.size()];
+        std::lock_guard<std::mutex> queue(victim.mtx);
+        if(!victim.tasks.empty()) {
+            if(k) { // steal the last
+                task = std::move(victim.tasks.back());
+                victim.tasks.pop_back();
+            } else { // take our first
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void Pool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+        wake.notify_all();
+    }
+    // whatever runs now runs to completion; the rest is dropped with the deques
+    for(auto& worker : workers) {
+        worker->thread.join();
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    workers.clear();
+    queued = 0u;
+}
+
+} // namespace wusers_impl
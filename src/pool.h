@@ -0,0 +1,67 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wusers_impl {
+
+// A few threads for directory round trips worth overlapping (member lists ahead of
+// getgrent()). Each worker has a deque of its own: it takes from the front of it and,
+// once that is empty, steals from the back of the others, so that one huge group queued
+// behind small ones doesn't hold them up. Nothing waits on a task that no worker has
+// picked up yet: whoever needs the result first is expected to run it inline instead.
+class Pool {
+public:
+    using Task = std::function<void()>;
+
+    static constexpr unsigned int WORKERS = 4u; // default; see wuser_cache_set_prefetch()
+
+    static Pool& instance();
+
+    // 0 stops the workers; tasks not taken yet are dropped (see above)
+    void resize(unsigned int workers);
+
+    unsigned int size() const;
+
+    // spread over the workers' deques; false if there are no workers to run them
+    bool submit(std::vector<Task>& tasks);
+
+    ~Pool();
+
+private:
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    Pool();
+    void run(std::size_t self);
+    bool take(std::size_t self, Task& task);
+    void stop();
+
+    mutable std::mutex mtx; // guards `queued`, `next` and `stopping`; `workers` changes only when they're stopped
+    std::mutex resizing;
+    std::condition_variable wake;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::size_t queued = 0u;
+    std::size_t next = 0u; // round robin
+    bool stopping = false;
+};
+
+} // namespace wusers_impl
+
+#endif /* !_POOL_H_ */
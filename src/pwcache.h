@@ -0,0 +1,140 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _PWCACHE_H_
+#define _PWCACHE_H_
+
+#include "cache.h" // cache_ttl(), record_generation()
+
+#include <errno.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace wusers_impl {
+
+// What user_from_uid(), uid_from_user() and their group twins remember per thread,
+// after BSD pwcache.c: two fixed-size direct-mapped tables, id -> name and name -> id,
+// with negative entries for what isn't there. A slot owns its string, which is kept
+// inline when short and otherwise in an arena that is never reset: a returned name
+// stays valid memory for the life of the thread, and holds that name until its slot
+// is taken by another id. Numeric fallbacks are formatted into the slot, not the heap.
+// Entries follow the shared cache: they expire with its TTL and go with invalidation.
+template<typename ID_T>
+class NameCache {
+public:
+    static constexpr std::size_t SLOTS = 317u; // prime, as UID_SZ and GID_SZ in pwcache.c
+    static constexpr std::size_t INLINE = 24u; // RID names are up to 20 characters
+
+    struct Slot {
+        char* str;     // the name (by id) or the folded key (by name); nullptr while empty
+        std::size_t capacity;
+        ID_T id;
+        bool found;    // false for a negative entry
+        int error;     // errno of the lookup that came back empty, reported again on a hit
+        unsigned int cp;
+        unsigned long generation;
+        std::chrono::steady_clock::time_point expiry;
+        char small[INLINE];
+    };
+
+    // nullptr unless `id` is cached: then str is its name, or its number if !found
+    const Slot* byId(ID_T id) {
+        Slot& slot = ids()[id % SLOTS];
+        return live(slot) && slot.id == id ? &slot : nullptr;
+    }
+
+    // nullptr unless the fold_name() `key` is cached: then id is its id, if found
+    const Slot* byName(const std::string& key) {
+        Slot& slot = names()[std::hash<std::string>()(key) % SLOTS];
+        return live(slot) && !std::strcmp(slot.str, key.c_str()) ? &slot : nullptr;
+    }
+
+    // remember `name` for `id`; returns the slot's copy
+    const char* putName(ID_T id, const char* name) {
+        Slot& slot = ids()[id % SLOTS];
+        fill(slot, id, name, true, true);
+        return slot.str;
+    }
+
+    // remember that `id` isn't there (if `cacheable`); returns the slot's decimal rendition
+    const char* putAbsentId(ID_T id, bool cacheable) {
+        char num[16];
+        std::snprintf(num, sizeof(num), "%u", static_cast<unsigned int>(id));
+        Slot& slot = ids()[id % SLOTS];
+        fill(slot, id, num, false, cacheable);
+        return slot.str;
+    }
+
+    void putId(const std::string& key, ID_T id) {
+        fill(names()[std::hash<std::string>()(key) % SLOTS], id, key.c_str(), true, true);
+    }
+
+    void putAbsentName(const std::string& key, bool cacheable) {
+        fill(names()[std::hash<std::string>()(key) % SLOTS], ID_T(), key.c_str(), false, cacheable);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Slot* ids() {
+        return by_id ? by_id.get() : (by_id = empty()).get();
+    }
+
+    Slot* names() {
+        return by_name ? by_name.get() : (by_name = empty()).get();
+    }
+
+    // allocated on first use; most threads never call user_from_uid()
+    static std::unique_ptr<Slot[]> empty() {
+        std::unique_ptr<Slot[]> slots(new Slot[SLOTS]);
+        for(std::size_t i = 0; i < SLOTS; ++i) {
+            slots[i].str = nullptr;
+            slots[i].capacity = 0u;
+        }
+        return slots;
+    }
+
+    static bool live(const Slot& slot) {
+        return slot.str && slot.generation == record_generation() && slot.cp == get_cp()
+            && Clock::now() < slot.expiry;
+    }
+
+    void fill(Slot& slot, ID_T id, const char* str, bool found, bool cacheable) {
+        const std::size_t len = std::strlen(str) + 1u;
+        if(len > slot.capacity) {
+            if(len <= INLINE) {
+                slot.str = slot.small;
+                slot.capacity = INLINE;
+            } else {
+                // twice what's needed, so that a slot outgrows its buffer a few times at most
+                slot.capacity = 2u * len;
+                slot.str = strings.allocate(slot.capacity);
+            }
+        }
+        std::memcpy(slot.str, str, len);
+        slot.id = id;
+        slot.found = found;
+        slot.error = found ? 0 : errno;
+        slot.cp = get_cp();
+        slot.generation = record_generation(); // a refresh that finds changes drops them all
+        const auto ttl = cacheable ? cache_ttl() : std::chrono::milliseconds(0);
+        slot.expiry = Clock::now() + ttl; // a zero TTL is never live
+    }
+
+    std::unique_ptr<Slot[]> by_id;
+    std::unique_ptr<Slot[]> by_name;
+    Arena strings; // names too long for a slot; never reset
+};
+
+} // namespace wusers_impl
+
+#endif /* !_PWCACHE_H_ */
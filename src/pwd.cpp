@@ -7,15 +7,31 @@
 
 #include "pwd.h"      // API
 #include "wusers/wuser_eugid.h" // bonus API
+#include "wusers/wuser_batch.h" // bonus API
+#include "wusers/wuser_fields.h" // bonus API
+#include "wusers/wuser_cursor.h" // bonus API
+#include "wusers/wuser_range.h" // C++ API
 
 #include "wus.h"  // library state
-#include <windows.h>  // *backend deps
-#include <lm.h>       // backend
+#include "cache.h"    // shared state
+#include "pwcache.h"  // courtesy names
+#include "backend.h"  // NetAPI or stand-in
+#include "pwfile.h"   // passwd(5) parser
+#include "refresh.h"  // refresh passes
+#include "stats.h"    // hits and misses
 #include <errno.h>    // error codes
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <iostream>
 #include <sstream>
+#include <unordered_set>
+#include <vector>
 
 namespace wusers_impl {
 
@@ -56,6 +72,124 @@ static const char* win_to_text(DWORD priv) {
 }
 };
 
+// What FillFrom() needs to know about the host beyond the account itself: read once per
+// host_generation() rather than once per record, and shared by all threads. The profile
+// directories are listed by setpwent() so that an enumeration tells which accounts have
+// one by a set lookup; until then (and on Windows, whenever listing fails) it probes.
+class HostFacts {
+public:
+    struct Facts {
+        std::wstring user;     // %USERNAME%
+        std::wstring home;     // %USERPROFILE%
+        std::wstring shell;    // %ComSpec%
+        std::wstring profiles; // where %USERPROFILE% is, with a trailing backslash; empty if unknown
+        std::unordered_set<std::wstring> homes; // folded names of what's in `profiles`
+        bool listed = false;   // `homes` is complete
+        unsigned long generation;
+    };
+
+    static HostFacts& instance() {
+        static HostFacts facts;
+        return facts;
+    }
+
+    std::shared_ptr<const Facts> current() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(fresh(facts)) {
+                return facts;
+            }
+        }
+        return update(false);
+    }
+
+    // once per enumeration: what's in the profile directory now
+    void list() {
+        update(true);
+    }
+
+    // whether `name` has a profile directory next to the current user's
+    static bool hasHome(const Facts& host, const wchar_t* name) {
+        if(host.listed) {
+            return host.homes.count(fold_name(name));
+        }
+        const DWORD attrs = backend().FileAttributes((host.profiles + name).c_str());
+        return attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY);
+    }
+
+private:
+    static bool fresh(const std::shared_ptr<const Facts>& host) {
+        return host && host->generation == host_generation();
+    }
+
+    std::shared_ptr<const Facts> update(bool relist) {
+        std::lock_guard<std::mutex> fill(build_mtx); // one thread reads, the rest wait for it
+        std::shared_ptr<const Facts> known;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            known = facts;
+        }
+        const bool stale = !fresh(known);
+        if(!stale && !relist) {
+            return known;
+        }
+        std::shared_ptr<Facts> read = std::make_shared<Facts>();
+        read->generation = host_generation();
+        if(stale) {
+            read->user = ExpandEnvvars(L"%USERNAME%");
+            read->home = ExpandEnvvars(L"%USERPROFILE%");
+            read->shell = ExpandEnvvars(L"%ComSpec%");
+            const std::size_t last_bs = read->home.find_last_of('\\');
+            if(last_bs != std::wstring::npos) {
+                read->profiles = read->home.substr(0u, last_bs + 1u);
+            }
+        } else {
+            read->user = known->user;
+            read->home = known->home;
+            read->shell = known->shell;
+            read->profiles = known->profiles;
+            read->homes = known->homes;
+            read->listed = known->listed;
+        }
+        if(relist && !read->profiles.empty()) {
+            std::vector<std::wstring> names;
+            read->homes.clear();
+            read->listed = backend().ListDirectories(read->profiles.substr(0u, read->profiles.size() - 1u).c_str(), names);
+            for(const std::wstring& name : names) {
+                read->homes.insert(fold_name(name));
+            }
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        facts = read;
+        return facts;
+    }
+
+    std::mutex mtx;
+    std::mutex build_mtx;
+    std::shared_ptr<const Facts> facts;
+};
+
+// The Windows setting for the default shell is
+// HKEY_CLASSES_ROOT\{Drive|Directory|Directory\Background}\shell\cmd\command -- according to
+// https://superuser.com/questions/608194/how-to-set-powershell-as-default-instead-of-cmd-exe
+// -- and the per-user classes root is HKEY_USERS\<SID>\SOFTWARE\Classes (insert actual SID).
+// There is also HKEY_USERS\<SID>\Environment which we can check for user-specific %ComSpec%.
+// Getting the user SID mb our exclusive reason to request USER_INFO_4 (introduced in WinXP)
+// instead of USER_INFO_3 (which is available since Windows 2K). Also, GetEnvironmentVariable
+// and GetEnvironmentStrings have been introduced in XP. ExpandEnvironmentStrings is Win 2K.
+// ExpandEnvironmentStringsForUser needs a user token which our clients don't typically have.
+// Note that usri?_script_path is the logon script path, which is not the same thing.
+char* ShellOf(const wchar_t* name, const HostFacts::Facts& host, const OutWriter& writer) {
+    std::wstring shell = backend().LoginShell(name);
+    if(shell.empty()) {
+        shell = host.shell;
+    }
+    if(shell.empty() || shell[0] == '%') {
+        return const_cast<char*>(SHELL);
+    }
+    return writer(shell.c_str());
+}
+
 bool FillFrom(struct passwd& pwd, const USER_INFO_X& wu_infoX, const OutWriter& writer) {
      // TODO extract code below to support "reentrant" (*_r()) API
     // the user name is available since USER_INFO_1::usri1_name
@@ -77,43 +211,22 @@ bool FillFrom(struct passwd& pwd, const USER_INFO_X& wu_infoX, const OutWriter&
     // the mysterious "gecos" is simply full name and/or contacts; put full name for now
     pwd.pw_gecos = writer(wu_infoX.USRI(full_name));
 
+    std::shared_ptr<const HostFacts::Facts> host = HostFacts::instance().current();
     pwd.pw_dir = writer(wu_infoX.USRI(profile)); // %USERPROFILE% eq %HOMEDRIVE%%HOMEDIR%
 #ifndef _WUSER_NO_HEURISTICS
     if(!pwd.pw_dir || !*pwd.pw_dir) {
-        std::wstring cur_user = ExpandEnvvars(L"%USERNAME%");
-        std::wstring cur_home = ExpandEnvvars(L"%USERPROFILE%");
-        if(_wcsicmp(cur_user.c_str(), wu_infoX.USRI(name))) {
-            // the profile is not the current user
-            std::size_t last_bs = cur_home.find_last_of('\\');
-            if(last_bs != std::wstring::npos) {
-                cur_home.resize(last_bs + 1u);
-                cur_home.append(wu_infoX.USRI(name));
-                if(FILE_ATTRIBUTE_DIRECTORY & GetFileAttributesW(cur_home.c_str())) {
-                    pwd.pw_dir = writer(cur_home.c_str());
-                }
+        if(_wcsicmp(host->user.c_str(), wu_infoX.USRI(name))) {
+            // the profile is not the current user; see if there's one next to theirs
+            if(!host->profiles.empty() && HostFacts::hasHome(*host, wu_infoX.USRI(name))) {
+                pwd.pw_dir = writer((host->profiles + wu_infoX.USRI(name)).c_str());
             }
         } else {
-            pwd.pw_dir = writer(cur_home.c_str());
+            pwd.pw_dir = writer(host->home.c_str());
         }
     }
 #endif
 
-    // The Windows setting for the default shell is
-    // HKEY_CLASSES_ROOT\{Drive|Directory|Directory\Background}\shell\cmd\command -- according to
-    // https://superuser.com/questions/608194/how-to-set-powershell-as-default-instead-of-cmd-exe
-    // -- and the per-user classes root is HKEY_USERS\<SID>\SOFTWARE\Classes (insert actual SID).
-    // There is also HKEY_USERS\<SID>\Environment which we can check for user-specific %ComSpec%.
-    // Getting the user SID mb our exclusive reason to request USER_INFO_4 (introduced in WinXP)
-    // instead of USER_INFO_3 (which is available since Windows 2K). Also, GetEnvironmentVariable
-    // and GetEnvironmentStrings have been introduced in XP. ExpandEnvironmentStrings is Win 2K.
-    // ExpandEnvironmentStringsForUser needs a user token which our clients don't typically have.
-    // Note that usri?_script_path is the logon script path, which is not the same thing.
-    std::wstring shell = ExpandEnvvars(L"%ComSpec%");
-    if(shell.empty() || shell[0] == '%') {
-        pwd.pw_shell = const_cast<char*>(SHELL);
-    } else {
-        pwd.pw_shell = writer(shell.c_str());
-    }
+    pwd.pw_shell = ShellOf(wu_infoX.USRI(name), *host, writer); // see above
 
     // pw_expire stands for account expiration (not password expiration)
     // usri?_acct_expires is, conveniently, seconds since the UNIX epoch
@@ -127,6 +240,38 @@ bool FillFrom(struct passwd& pwd, const USER_INFO_X& wu_infoX, const OutWriter&
     return pwd.pw_name; // if this is defined, consider the record valid
 }
 
+// all six strings, constants included (pw_passwd, pw_class and possibly pw_shell):
+// a packed record must not point anywhere but into itself
+std::size_t Packing<struct passwd>::Measure(const struct passwd& src) {
+    auto len = [](const char* str) { return str ? std::strlen(str) + 1u : 0u; };
+    return len(src.pw_name) + len(src.pw_passwd) + len(src.pw_class)
+         + len(src.pw_gecos) + len(src.pw_dir) + len(src.pw_shell);
+}
+
+void Packing<struct passwd>::Lay(const struct passwd& src, struct passwd& out, char* at) {
+    auto pass = [&at](const char* str) {
+        if(!str) {
+            return static_cast<char*>(nullptr);
+        }
+        const std::size_t len = std::strlen(str) + 1u;
+        char* fld = static_cast<char*>(memcpy(at, str, len));
+        at += len;
+        return fld;
+    };
+    out.pw_name = pass(src.pw_name);
+    out.pw_passwd = pass(src.pw_passwd);
+    out.pw_class = pass(src.pw_class);
+    out.pw_gecos = pass(src.pw_gecos);
+    out.pw_dir = pass(src.pw_dir);
+    out.pw_shell = pass(src.pw_shell);
+}
+
+void Packing<struct passwd>::Relocate(struct passwd& rec, const char* from, char* to) {
+    for(char** fld : {&rec.pw_name, &rec.pw_passwd, &rec.pw_class, &rec.pw_gecos, &rec.pw_dir, &rec.pw_shell}) {
+        if(*fld) *fld = to + (*fld - from);
+    }
+}
+
 template<> struct IA<struct passwd>
 {
     using id_t = uid_t;
@@ -136,20 +281,51 @@ template<> struct IA<struct passwd>
 
     static id_t IdOf(const struct passwd& pwd) { return pwd.pw_uid; }
     static id_t IdOf(const NETAPI_INFO_T* wui) { return wui->USRI(user_id); }
-    static const char* NameOf(struct passwd& pwd) { return pwd.pw_name; }
+    static const char* NameOf(const struct passwd& pwd) { return pwd.pw_name; }
     static const wchar_t* WNameOf(const NETAPI_INFO_T* wui) { return wui->USRI(name); }
 
+    // the name and the RID without the rest (see Stateless::LeanByName())
+    using LEAN_INFO_T = USER_INFO_20;
+    static constexpr int LEAN_LVL = 20;
+    static id_t IdOf(const LEAN_INFO_T* wui) { return wui->usri20_user_id; }
+    static const wchar_t* WNameOf(const LEAN_INFO_T* wui) { return wui->usri20_name; }
+
     static NET_API_STATUS Enumerate(LPCWSTR servername, DWORD level, LPBYTE *bufptr, DWORD prefmaxlen,
                                 LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) {
-        return NetUserEnum(servername, level, FILTER_NORMAL_ACCOUNT /* use 0 to list roaming accounts */,
-                                        bufptr, prefmaxlen, entriesread, totalentries, resume_handle);
+        DWORD user_resume = *resume_handle; // NetUserEnum's resume handle is a plain DWORD
+        NET_API_STATUS status = backend().UserEnum(servername, level, FILTER_NORMAL_ACCOUNT /* use 0 to list roaming accounts */,
+                                        bufptr, prefmaxlen, entriesread, totalentries, &user_resume);
+        *resume_handle = user_resume;
+        return status;
     }
 
+    static PageSizer& Pages() { return user_pages(); }
+
     static NET_API_STATUS GetInfo(LPCWSTR servername, LPCWSTR name, DWORD level, LPBYTE* bufptr) {
-        return NetUserGetInfo(servername, name, level, bufptr);
+        return backend().UserGetInfo(servername, name, level, bufptr);
+    }
+
+    // what FillFrom() translates (see refresh.h); the host facts are not the directory's
+    static std::size_t Digest(const NETAPI_INFO_T& wu_infoX) {
+        std::size_t digest = Mix(0u, wu_infoX.USRI(name));
+        digest = Mix(digest, wu_infoX.USRI(full_name));
+        digest = Mix(digest, wu_infoX.USRI(profile));
+        for(DWORD value : {wu_infoX.USRI(primary_group_id), wu_infoX.USRI(priv), wu_infoX.USRI(acct_expires),
+                           wu_infoX.USRI(password_expired)}) {
+            digest = Mix(digest, value);
+        }
+        return digest;
     }
 };
 
+int UserCensus(Census& census) {
+    return TakeCensus<struct passwd>(census);
+}
+
+void ForgetUsers(const std::vector<Stale>& stale) {
+    ForgetStale<struct passwd>(stale);
+}
+
 } // namespace wusers_impl
 
 namespace {
@@ -157,17 +333,12 @@ using namespace wusers_impl;
 
 static thread_local State<struct passwd> tls;
 
-std::wstring GetRealName() {
-    // inlined in FIllFrom for clarity
-    return ExpandEnvvars(L"%USERNAME%");
-}
-
 struct WhoamiEntry : public passwd {
-    OutBinder bdr;
+    Arena arena;
     bool success;
     
     const WhoamiEntry& lookup(const std::wstring& name) {
-        success = Stateless<struct passwd>::QueryByName(name, this, BinderWriter(bdr));
+        success = Stateless<struct passwd>::QueryByName(name, this, ArenaWriter(arena));
         return *this;
     }
 
@@ -175,8 +346,256 @@ struct WhoamiEntry : public passwd {
     gid_t gid() const { return success ? pw_gid : -1; }
 };
 
+// Who the calling thread runs as. The effective ids come from its token, which is asked every
+// time: impersonation may change it at any moment, and asking takes no directory call. The real
+// user is %USERNAME% (as of HostFacts); its ids, and those of an effective user there is no
+// token to ask about (see Files::TokenRids()), are looked up once per host_generation().
+class Whoami {
+public:
+    struct Ids {
+        uid_t uid;
+        gid_t gid;
+    };
+
+    static Whoami& instance() {
+        static Whoami whoami;
+        return whoami;
+    }
+
+    Ids real() {
+        return byName(HostFacts::instance().current()->user);
+    }
+
+    Ids effective() {
+        DWORD uid, gid;
+        if(ERROR_SUCCESS == backend().TokenRids(&uid, &gid)) {
+            return {uid, gid};
+        }
+        return byName(GetEffectiveName());
+    }
+
+private:
+    struct Known {
+        std::wstring wname;
+        Ids ids;
+        unsigned long generation;
+    };
+
+    Ids byName(const std::wstring& wname) {
+        const unsigned long generation = host_generation();
+        std::lock_guard<std::mutex> lock(mtx); // one thread looks up, the rest wait for it
+        for(const Known& k : known) {
+            if(k.generation == generation && k.wname == wname) {
+                return k.ids;
+            }
+        }
+        WhoamiEntry entry;
+        entry.lookup(wname);
+        const Ids ids = {entry.uid(), entry.gid()};
+        if(entry.success) { // failures are asked again; they may be transient
+            known.erase(std::remove_if(known.begin(), known.end(),
+                [generation](const Known& k) { return k.generation != generation; }), known.end());
+            known.push_back({wname, ids, generation});
+        }
+        return ids;
+    }
+
+    std::mutex mtx;
+    std::vector<Known> known; // the real user and maybe an effective one: a list will do
+};
+
+// fgetpwent(): the last line read, split in place
+struct FileEntry {
+    std::vector<char> line;
+    struct passwd pwd;
+};
+
+static thread_local FileEntry file_entry;
+
+void FillInPlace(struct passwd& pwd, const pwfile::PwLine& pw_line) {
+    pwd.pw_name = pwfile::Terminate(pw_line.name);
+    pwd.pw_passwd = pwfile::Terminate(pw_line.passwd);
+    pwd.pw_uid = pw_line.uid;
+    pwd.pw_gid = pw_line.gid;
+    pwd.pw_change = pw_line.change;
+    pwd.pw_class = pwfile::Terminate(pw_line.klass);
+    pwd.pw_gecos = pwfile::Terminate(pw_line.gecos);
+    pwd.pw_dir = pwfile::Terminate(pw_line.dir);
+    pwd.pw_shell = pwfile::Terminate(pw_line.shell);
+    pwd.pw_expire = pw_line.expire;
+}
+
+// wuser_getpw{nam|uid}_fields(): what levels 0 and 20 have (see FillSparse()); level 3 has everything
+constexpr unsigned int LEVEL0_FIELDS = WUSER_PW_NAME | WUSER_PW_PASSWD | WUSER_PW_SHELL;
+constexpr unsigned int LEVEL20_FIELDS = LEVEL0_FIELDS | WUSER_PW_UID | WUSER_PW_GECOS;
+
+int LevelFor(unsigned int fields) {
+    return !(fields & ~LEVEL0_FIELDS) ? 0 : !(fields & ~LEVEL20_FIELDS) ? 20 : ULVL;
+}
+
+// `full` with only `fields` left in it
+struct passwd Only(const struct passwd& full, unsigned int fields) {
+    struct passwd pwd;
+    std::memset(&pwd, 0, sizeof(pwd));
+    if(fields & WUSER_PW_NAME) pwd.pw_name = full.pw_name;
+    if(fields & WUSER_PW_PASSWD) pwd.pw_passwd = full.pw_passwd;
+    if(fields & WUSER_PW_UID) pwd.pw_uid = full.pw_uid;
+    if(fields & WUSER_PW_GID) pwd.pw_gid = full.pw_gid;
+    if(fields & WUSER_PW_CHANGE) pwd.pw_change = full.pw_change;
+    if(fields & WUSER_PW_CLASS) pwd.pw_class = full.pw_class;
+    if(fields & WUSER_PW_GECOS) pwd.pw_gecos = full.pw_gecos;
+    if(fields & WUSER_PW_DIR) pwd.pw_dir = full.pw_dir;
+    if(fields & WUSER_PW_SHELL) pwd.pw_shell = full.pw_shell;
+    if(fields & WUSER_PW_EXPIRE) pwd.pw_expire = full.pw_expire;
+    return pwd;
+}
+
+// the `fields` of `rec` (a cached, mapped or sparse record) into the caller's buffer
+int CopyFields(const struct passwd& rec, unsigned int fields, struct passwd* out_pwd, char* out_buf, size_t buf_len,
+               struct passwd** out_ptr) {
+    const struct passwd only = Only(rec, fields);
+    if(Packed<struct passwd>(only).copyTo(*out_pwd, out_buf, buf_len)) {
+        *out_ptr = out_pwd;
+    }
+    return errno;
+}
+
+// as FillFrom() would translate them, but only what's asked for and only what these levels have
+void FillSparse(struct passwd& pwd, const wchar_t* name, const wchar_t* full_name, uid_t uid, unsigned int fields,
+                const OutWriter& writer) {
+    std::memset(&pwd, 0, sizeof(pwd));
+    if(fields & WUSER_PW_NAME) pwd.pw_name = writer(name);
+    if(fields & WUSER_PW_PASSWD) pwd.pw_passwd = const_cast<char*>(ASTER);
+    if(fields & WUSER_PW_UID) pwd.pw_uid = uid;
+    if(fields & WUSER_PW_GECOS) pwd.pw_gecos = writer(full_name);
+    if(fields & WUSER_PW_SHELL) pwd.pw_shell = ShellOf(name, *HostFacts::instance().current(), writer);
+}
+
+// NetUserGetInfo at level 0 or 20 and no further; `expected` is the uid `wname` must have, if any.
+// Not cached: these aren't records.
+int LeanFields(const std::wstring& wname, int level, const uid_t* expected, unsigned int fields,
+               struct passwd* out_pwd, char* out_buf, size_t buf_len, struct passwd** out_ptr) {
+    static thread_local Arena scratch;
+    scratch.reset();
+    const ArenaWriter writer(scratch);
+    struct passwd sparse;
+    bool found;
+    if(20 == level) {
+        found = ProcessInfoByName<USER_INFO_20, 20, &IA<struct passwd>::GetInfo, NERR_UserNotFound, bool>(wname,
+            [&](const USER_INFO_20& info) {
+                if(expected && *expected != info.usri20_user_id) {
+                    set_last_error(ENOENT); // renamed or recycled
+                    return false;
+                }
+                FillSparse(sparse, info.usri20_name, info.usri20_full_name, info.usri20_user_id, fields, writer);
+                return true;
+            }, false);
+    } else {
+        found = ProcessInfoByName<USER_INFO_0, 0, &IA<struct passwd>::GetInfo, NERR_UserNotFound, bool>(wname,
+            [&](const USER_INFO_0& info) {
+                FillSparse(sparse, info.usri0_name, nullptr, -1, fields, writer);
+                return true;
+            }, false);
+    }
+    return found && !errno ? CopyFields(sparse, fields, out_pwd, out_buf, buf_len, out_ptr) : errno;
+}
+
+// getpwent_r() and wuser_pwcursor_next(): records as getpwent() translates them, into `out_buf`
+template<typename QUERY_STATE>
+int NextUsers(QUERY_STATE& query, struct passwd* out_pwds, std::size_t max, char* out_buf, size_t buf_len,
+              std::size_t& count) {
+    return FillBatch(query, out_pwds, max, out_buf, buf_len, count,
+        [](struct passwd& pwd, const USER_INFO_X& info, const OutWriter& writer) {
+            return FillFrom(pwd, info, writer);
+        });
+}
+
 } // anonymous
 
+// wusers/wuser_cursor.h: what setpwent() keeps per thread, kept by the caller instead
+struct wuser_pwcursor {
+    State<struct passwd>::QueryState query;
+};
+
+namespace wusers {
+namespace detail {
+
+// wusers::users(): a cursor, and the record at it, which views the current page
+template<> struct enumeration<user> {
+    State<struct passwd>::QueryState query;
+    user current;
+    int error = 0;
+};
+
+std::shared_ptr<enumeration<user>> open_users() {
+    std::shared_ptr<enumeration<user>> opened = std::make_shared<enumeration<user>>();
+    opened->query.reset();
+    opened->query.query();
+    opened->error = errno;
+    return opened;
+}
+
+const user* next(enumeration<user>& from) {
+    Lookup lookup(WUSER_ENTRY_USER_CURSOR);
+    set_last_error(0);
+    const USER_INFO_X* info = from.error ? nullptr : from.query.step();
+    if(!info) {
+        from.error = from.error ? from.error : errno;
+        return nullptr;
+    }
+    user& rec = from.current;
+    rec.uid = IA<struct passwd>::IdOf(info);
+    rec.gid = info->USRI(primary_group_id);
+    rec.name = text(info->USRI(name));
+    rec.gecos = text(info->USRI(full_name));
+    rec.dir = text(info->USRI(profile));
+    rec.expire = info->USRI(acct_expires);
+    return &rec;
+}
+
+int error(const enumeration<user>& of) {
+    return of.error;
+}
+
+} // namespace detail
+
+void found_user::adopt(struct passwd* dup) {
+    err = dup || ENOENT == errno ? 0 : errno;
+    if(!dup) {
+        return;
+    }
+    hold.reset(dup, &std::free);
+    rec.uid = dup->pw_uid;
+    rec.gid = dup->pw_gid;
+    rec.name = text(dup->pw_name);
+    rec.gecos = text(dup->pw_gecos);
+    rec.dir = text(dup->pw_dir);
+    rec.expire = dup->pw_expire;
+}
+
+found_user find_user(uid_t uid) {
+    Lookup lookup(WUSER_ENTRY_GETPWUID_R);
+    set_last_error(0);
+    found_user found;
+    found.adopt(tls.queryByIdAndMap<struct passwd*>(uid,
+        [](const Packed<struct passwd>& pwd) { return pwd.dup(); },
+        &NotFound<struct passwd>));
+    return found;
+}
+
+found_user find_user(std::string_view name) {
+    Lookup lookup(WUSER_ENTRY_GETPWNAM_R);
+    set_last_error(0);
+    found_user found;
+    const std::string key(name); // NUL-terminated
+    found.adopt(Stateless<struct passwd>::QueryByNameAndMap<struct passwd*>(key.c_str(),
+        [](const Packed<struct passwd>& pwd) { return pwd.dup(); },
+        &NotFound<struct passwd>));
+    return found;
+}
+
+} // namespace wusers
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -189,10 +608,12 @@ extern "C" {
 // -- controllers for native user management anyway. TODO put a note in README.md
 
 struct passwd *getpwuid(uid_t uid) {
+    Lookup lookup(WUSER_ENTRY_GETPWUID);
     return tls.queryById(uid);
 }
 
 struct passwd *getpwnam(const char * user_name) {
+    Lookup lookup(WUSER_ENTRY_GETPWNAM);
     return tls.queryByName(user_name);
 }
 
@@ -210,59 +631,37 @@ struct passwd *getpwnam_shadow(const char *) {
 
 // user_name
 int getpwnam_r(const char * user_name, struct passwd * out_pwd, char * out_buf, size_t buf_len, struct passwd ** out_ptr) {
-    set_last_error(0);
+    Lookup lookup(WUSER_ENTRY_GETPWNAM_R);
     *out_ptr = nullptr;
-    const std::wstring wuser_name = to_win_str(user_name);
-    if(wuser_name.size()) {
-        *out_ptr = Stateless<struct passwd>::QueryByName(wuser_name, out_pwd, BufferWriter(out_buf, buf_len));
-        if(errno) *out_ptr = nullptr; // kill partial|inconsistent output
-    }
+    Stateless<struct passwd>::QueryByNameAndMap<int>(user_name,
+        [&](const Packed<struct passwd>& pwd) {
+            return pwd.copyTo(*out_pwd, out_buf, buf_len) ? (*out_ptr = out_pwd, 0) : -1;
+        },
+        [](){ return -1; });
+    if(errno) *out_ptr = nullptr; // kill partial|inconsistent output
     return errno;
 }
 
 int getpwuid_r(uid_t uid, struct passwd * out_pwd, char * out_buf, size_t buf_len, struct passwd ** out_ptr) {
+    Lookup lookup(WUSER_ENTRY_GETPWUID_R);
     set_last_error(0);
     *out_ptr = nullptr;
-    BufferWriter writer(out_buf, buf_len);
     tls.queryByIdAndMap<int>(uid,
-        [&](struct passwd& pwd) {
-            // inefficient double string copy, but we save a (waaay more expensive) trip to the kernel/COM/NET
-            struct passwd* copy = pw_dup(&pwd);
-            // assumes that pw_shell is last (see note under `struct passwd` in <pwd.h>)
-            char* copy_chars =  reinterpret_cast<char*>(copy) + sizeof(struct passwd);
-            std::size_t breq = copy->pw_shell - copy_chars + std::strlen(copy->pw_shell);
-            if(breq > buf_len) {
-                set_last_error(ERANGE);
-                return -1;
-            } else {
-                memcpy(out_pwd, copy, sizeof(struct passwd));
-                memcpy(out_buf, copy_chars, breq);
-                // six char* fields exactly
-                out_pwd->pw_name   = out_buf + (copy->pw_name   - copy_chars);
-                out_pwd->pw_passwd = out_buf + (copy->pw_passwd - copy_chars);
-                out_pwd->pw_class  = out_buf + (copy->pw_class  - copy_chars);
-                out_pwd->pw_gecos  = out_buf + (copy->pw_gecos  - copy_chars);
-                out_pwd->pw_dir    = out_buf + (copy->pw_dir    - copy_chars);
-                out_pwd->pw_shell  = out_buf + (copy->pw_shell  - copy_chars);
-                *out_ptr = out_pwd;
-                free(copy);
-                return 0;
-            }
-        },
-        [&](const USER_INFO_X* wu_info) {
-            return FillFrom(*out_pwd, *wu_info, writer) && !errno
-                ? (*out_ptr = out_pwd, 0)
-                : (*out_ptr = nullptr, -1);
+        [&](const Packed<struct passwd>& pwd) {
+            // a cached record is a single block: one memcpy() and six pointers to rebase
+            return pwd.copyTo(*out_pwd, out_buf, buf_len) ? (*out_ptr = out_pwd, 0) : -1;
         },
         [](){ return -1; });
     return errno;
 }
 
 void setpwent(void) {
+    HostFacts::instance().list();
     tls.beginEnum();
 }
 
 struct passwd *getpwent(void) {
+    Lookup lookup(WUSER_ENTRY_GETPWENT);
     return tls.nextEntry();
 }
 
@@ -270,19 +669,109 @@ void endpwent(void) {
     tls.endEnum();
 }
 
+int getpwent_r(struct passwd *out_pwd, char *out_buf, size_t buf_len, struct passwd **out_ptr) {
+    Lookup lookup(WUSER_ENTRY_USER_CURSOR);
+    std::size_t count;
+    const int err = NextUsers(tls.query_state, out_pwd, 1u, out_buf, buf_len, count);
+    *out_ptr = count ? out_pwd : nullptr;
+    return err;
+}
+
+struct wuser_pwcursor *wuser_pwcursor_open(void) {
+    HostFacts::instance().list(); // as setpwent() does
+    std::unique_ptr<wuser_pwcursor> cursor(new (std::nothrow) wuser_pwcursor);
+    if(!cursor) {
+        set_last_error(ENOMEM);
+        return nullptr;
+    }
+    cursor->query.reset();
+    cursor->query.query();
+    return errno ? nullptr : cursor.release();
+}
+
+int wuser_pwcursor_next(struct wuser_pwcursor *cursor, struct passwd *out_pwds, size_t max,
+                        char *buf, size_t buf_len, size_t *out_count) {
+    Lookup lookup(WUSER_ENTRY_USER_CURSOR);
+    *out_count = 0u;
+    if(!cursor) {
+        set_last_error(EINVAL);
+        return errno;
+    }
+    return NextUsers(cursor->query, out_pwds, max, buf, buf_len, *out_count);
+}
+
+void wuser_pwcursor_close(struct wuser_pwcursor *cursor) {
+    delete cursor;
+}
+
+struct passwd *fgetpwent(FILE *stream) {
+    if(!stream) {
+        set_last_error(EINVAL);
+        return nullptr;
+    }
+    pwfile::PwLine pw_line;
+    std::size_t len;
+    while(pwfile::ReadLine(stream, file_entry.line, len)) {
+        if(pwfile::Parse(file_entry.line.data(), len, pw_line)) {
+            FillInPlace(file_entry.pwd, pw_line);
+            return &file_entry.pwd;
+        }
+    }
+    return nullptr;
+}
+
+int fgetpwent_r(FILE *stream, struct passwd *out_pwd, char *out_buf, size_t buf_len, struct passwd **out_ptr) {
+    *out_ptr = nullptr;
+    if(!stream) {
+        set_last_error(EINVAL);
+        return errno;
+    }
+    pwfile::PwLine pw_line;
+    std::size_t len;
+    int err;
+    while(!(err = pwfile::ReadLine(stream, out_buf, buf_len, len))) {
+        if(pwfile::Parse(out_buf, len, pw_line)) {
+            FillInPlace(*out_pwd, pw_line);
+            *out_ptr = out_pwd;
+            break;
+        }
+    }
+    set_last_error(err);
+    return err;
+}
+
 int setpassent(int) {
     setpwent();
     return !errno;
 }
 
 int uid_from_user(const char * user_name, uid_t * out_uid) {
+    Lookup lookup(WUSER_ENTRY_UID_FROM_USER);
     return tls.nameToId(user_name, out_uid);
 }
 
 const char *user_from_uid(uid_t uid, int nouser) {
+    Lookup lookup(WUSER_ENTRY_USER_FROM_UID);
     return tls.idToName(uid, nouser);
 }
 
+int wuser_getpwuid_batch(const uid_t *uids, size_t count, struct passwd *out_pwds,
+                         char *buf, size_t buf_len, struct passwd **out_ptrs) {
+    Lookup lookup(WUSER_ENTRY_USER_BATCH);
+    return Stateless<struct passwd>::RecordsByIds(uids, count, out_pwds, buf, buf_len, out_ptrs);
+}
+
+int wuser_user_from_uid_batch(const uid_t *uids, size_t count, int nouser,
+                         char *buf, size_t buf_len, const char **out_names) {
+    Lookup lookup(WUSER_ENTRY_USER_BATCH);
+    return Stateless<struct passwd>::NamesByIds(uids, count, nouser, buf, buf_len, out_names);
+}
+
+int wuser_uid_from_user_batch(const char *const *names, size_t count, uid_t *out_uids) {
+    Lookup lookup(WUSER_ENTRY_USER_BATCH);
+    return Stateless<struct passwd>::IdsByNames(names, count, out_uids);
+}
+
 #if _WUSERS_ENABLE_BCRYPT
 char *bcrypt_gensalt(uint8_t) {
     // UNIMPLEMENTED
@@ -306,45 +795,112 @@ int bcrypt_checkpass(const char *, const char *) {
 #endif // _WUSERS_ENABLE_BCRYPT
 
 struct passwd *pw_dup(const struct passwd * src) {
-    std::size_t size = sizeof(struct passwd);
-    auto len = [](const char* str) { return str ? std::strlen(str) + 1u : 0u; };
-    // now allocate space for strings
-    size += len(src->pw_name);
-    size += len(src->pw_passwd);
-    size += len(src->pw_class);
-    size += len(src->pw_gecos);
-    size += len(src->pw_dir);
-    size += len(src->pw_shell);
-
-    struct passwd * trg = reinterpret_cast<struct passwd*>(malloc(size));
-    memcpy(trg, src, sizeof(struct passwd));
-    char* ptr = reinterpret_cast<char*>(trg) + sizeof(struct passwd);
-    auto pass = [&ptr](const char* src_str) {
-        if(src_str) {
-            char* fld = ptr;
-            strcpy(fld, src_str);
-            ptr += strlen(src_str) + 1u;
-            return fld;
+    if(!src) {
+        set_last_error(EINVAL);
+        return nullptr;
+    }
+    return Packed<struct passwd>(*src).dup();
+}
+
+// wusers/wuser_fields.h
+
+int wuser_getpwnam_fields(const char *name, unsigned int fields, struct passwd *out_pwd,
+                          char *out_buf, size_t buf_len, struct passwd **out_ptr) {
+    Lookup lookup(WUSER_ENTRY_USER_FIELDS);
+    set_last_error(0);
+    *out_ptr = nullptr;
+    fields &= WUSER_PW_ALL;
+    const int level = name ? LevelFor(fields) : ULVL; // which says EINVAL
+    if(ULVL == level) {
+        Stateless<struct passwd>::QueryByNameAndMap<int>(name,
+            [&](const Packed<struct passwd>& pwd) { return CopyFields(pwd.record(), fields, out_pwd, out_buf, buf_len, out_ptr); },
+            [](){ return -1; });
+    } else {
+        struct passwd view;
+        std::vector<char*> members;
+        const std::string key = fold_name(name);
+        Cache<struct passwd>& cache = Cache<struct passwd>::instance();
+        Stateless<struct passwd>::Hit hit;
+        if(Mapped<struct passwd>::ByKey(key, view, members)) {
+            CopyFields(view, fields, out_pwd, out_buf, buf_len, out_ptr);
+        } else if((hit = cache.byName(key))) {
+            CopyFields(hit->packed.record(), fields, out_pwd, out_buf, buf_len, out_ptr);
+        } else if(cache.absentName(key)) {
+            set_last_error(ENOENT);
         } else {
-            return static_cast<char*>(nullptr);
+            const std::wstring wname = to_win_str(name);
+            if(!wname.empty() && ENOENT == LeanFields(wname, level, nullptr, fields, out_pwd, out_buf, buf_len, out_ptr)) {
+                cache.putAbsentName(key);
+            } // else EINVAL if there was no name to ask about
         }
-    };
-    trg->pw_name = pass(src->pw_name);
-    trg->pw_passwd = pass(src->pw_passwd);
-    trg->pw_class = pass(src->pw_class);
-    trg->pw_gecos = pass(src->pw_gecos);
-    trg->pw_dir = pass(src->pw_dir);
-    trg->pw_shell = pass(src->pw_shell);
-    return trg;
+    }
+    if(errno) *out_ptr = nullptr; // kill partial|inconsistent output
+    return errno;
+}
+
+int wuser_getpwuid_fields(uid_t uid, unsigned int fields, struct passwd *out_pwd,
+                          char *out_buf, size_t buf_len, struct passwd **out_ptr) {
+    Lookup lookup(WUSER_ENTRY_USER_FIELDS);
+    set_last_error(0);
+    *out_ptr = nullptr;
+    fields &= WUSER_PW_ALL;
+    if(ULVL != LevelFor(fields)) {
+        // without a lookup by RID, the name comes from the RID index; level 20 confirms the RID
+        struct passwd view;
+        std::vector<char*> members;
+        std::wstring wname;
+        Cache<struct passwd>& cache = Cache<struct passwd>::instance();
+        Stateless<struct passwd>::Hit hit;
+        if(Mapped<struct passwd>::ById(uid, view, members)) {
+            return CopyFields(view, fields, out_pwd, out_buf, buf_len, out_ptr);
+        } else if((hit = cache.byId(uid))) {
+            return CopyFields(hit->packed.record(), fields, out_pwd, out_buf, buf_len, out_ptr);
+        } else if(Cache<struct passwd>::FOUND == cache.indexedName(uid, wname)) {
+            const int err = LeanFields(wname, 20, &uid, fields, out_pwd, out_buf, buf_len, out_ptr);
+            if(!err || ERANGE == err) {
+                return err;
+            }
+            set_last_error(0); // renamed, deleted or recycled since indexing: look again
+        }
+    }
+    tls.queryByIdAndMap<int>(uid,
+        [&](const Packed<struct passwd>& pwd) { return CopyFields(pwd.record(), fields, out_pwd, out_buf, buf_len, out_ptr); },
+        [](){ return -1; });
+    if(errno) *out_ptr = nullptr;
+    return errno;
 }
 
 // wusers/wuser_eugid.h
 
-uid_t geteuid(void) { return WhoamiEntry().lookup(GetEffectiveName()).uid(); }
-gid_t getegid(void) { return WhoamiEntry().lookup(GetEffectiveName()).gid(); }
+uid_t geteuid(void) { return Whoami::instance().effective().uid; }
+gid_t getegid(void) { return Whoami::instance().effective().gid; }
 
-uid_t getuid(void) { return WhoamiEntry().lookup(GetRealName()).uid(); }
-gid_t getgid(void) { return WhoamiEntry().lookup(GetRealName()).gid(); }
+uid_t getuid(void) { return Whoami::instance().real().uid; }
+gid_t getgid(void) { return Whoami::instance().real().gid; }
+
+char *getlogin(void) {
+    static thread_local Arena login;
+    login.reset();
+    set_last_error(0);
+    std::shared_ptr<const HostFacts::Facts> host = HostFacts::instance().current();
+    if(host->user.empty()) {
+        set_last_error(ENOENT);
+        return nullptr;
+    }
+    return ArenaWriter(login)(host->user.c_str()); // sets EINVAL if it doesn't convert
+}
+
+int getlogin_r(char *name, size_t namesize) {
+    const char* login = name ? getlogin() : nullptr;
+    if(!name) {
+        set_last_error(EINVAL);
+    } else if(login && std::strlen(login) >= namesize) {
+        set_last_error(ERANGE);
+    } else if(login) {
+        std::memcpy(name, login, std::strlen(login) + 1u);
+    }
+    return errno;
+}
 
 #ifdef __cplusplus
 }
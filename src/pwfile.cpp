@@ -0,0 +1,191 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "pwfile.h"
+
+#include <errno.h>
+
+#include <climits>
+#include <cstring>
+
+namespace {
+using namespace wusers_impl::pwfile;
+
+constexpr std::size_t MAX_FIELDS = 10u;
+
+// returns the field count, or MAX_FIELDS + 1 if there are too many
+std::size_t Split(const char* line, std::size_t len, Span* fields) {
+    const char* end = line + len;
+    std::size_t count = 0u;
+    for(;;) {
+        if(count == MAX_FIELDS) {
+            return MAX_FIELDS + 1u;
+        }
+        const char* sep = static_cast<const char*>(std::memchr(line, ':', end - line));
+        fields[count++] = {line, static_cast<std::size_t>((sep ? sep : end) - line)};
+        if(!sep) {
+            return count;
+        }
+        line = sep + 1;
+    }
+}
+
+template<typename NUM_T>
+bool Number(const Span& field, NUM_T& out, bool empty_is_zero = false) {
+    if(!field.len) {
+        out = 0;
+        return empty_is_zero;
+    }
+    unsigned long long value = 0u;
+    for(std::size_t i = 0; i < field.len; ++i) {
+        unsigned digit = static_cast<unsigned char>(field.str[i]) - '0';
+        if(digit > 9u || value > (0xFFFFFFFFull - digit) / 10u) {
+            return false; // ids are RIDs, times are 32-bit on the directory side too
+        }
+        value = value * 10u + digit;
+    }
+    out = static_cast<NUM_T>(value);
+    return true;
+}
+
+bool Skipped(const char* line, std::size_t len) {
+    return !len || '#' == *line;
+}
+
+} // anonymous
+
+namespace wusers_impl {
+namespace pwfile {
+
+bool Parse(const char* line, std::size_t len, PwLine& out) {
+    Span fields[MAX_FIELDS];
+    if(Skipped(line, len)) {
+        return false;
+    }
+    switch(Split(line, len, fields)) {
+    case 7u:
+        out.klass = {nullptr, 0u};
+        out.change = out.expire = 0;
+        out.gecos = fields[4];
+        out.dir = fields[5];
+        out.shell = fields[6];
+        break;
+    case 10u:
+        out.klass = fields[4];
+        if(!Number(fields[5], out.change, true) || !Number(fields[6], out.expire, true)) {
+            return false;
+        }
+        out.gecos = fields[7];
+        out.dir = fields[8];
+        out.shell = fields[9];
+        break;
+    default:
+        return false;
+    }
+    out.name = fields[0];
+    out.passwd = fields[1];
+    return out.name.len && Number(fields[2], out.uid) && Number(fields[3], out.gid);
+}
+
+bool Parse(const char* line, std::size_t len, GrLine& out) {
+    Span fields[MAX_FIELDS];
+    if(Skipped(line, len) || 4u != Split(line, len, fields)) {
+        return false;
+    }
+    out.name = fields[0];
+    out.passwd = fields[1];
+    out.members = fields[3];
+    return out.name.len && Number(fields[2], out.gid);
+}
+
+bool NextMember(Span& list, Span& member) {
+    while(list.len) {
+        const char* sep = static_cast<const char*>(std::memchr(list.str, ',', list.len));
+        member = {list.str, sep ? static_cast<std::size_t>(sep - list.str) : list.len};
+        list = sep ? Span{sep + 1, list.len - member.len - 1u} : Span{list.str + list.len, 0u};
+        if(member.len) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Lines::next(Span& line) {
+    if(at >= end) {
+        return false;
+    }
+    const char* eol = static_cast<const char*>(std::memchr(at, '\n', end - at));
+    const char* stop = eol ? eol : end;
+    line = {at, static_cast<std::size_t>(stop - at)};
+    if(line.len && '\r' == line.str[line.len - 1u]) {
+        --line.len;
+    }
+    at = eol ? eol + 1 : end;
+    return true;
+}
+
+bool ReadLine(std::FILE* stream, std::vector<char>& buf, std::size_t& len) {
+    if(buf.size() < 256u) {
+        buf.resize(256u);
+    }
+    len = 0u;
+    for(;;) {
+        const std::size_t room = buf.size() - len;
+        if(!std::fgets(buf.data() + len, room < INT_MAX ? room : INT_MAX, stream)) {
+            if(!len) {
+                return false;
+            }
+            break; // the last line has no line break
+        }
+        len += std::strlen(buf.data() + len);
+        if(len && '\n' == buf[len - 1u]) {
+            buf[--len] = '\0';
+            break;
+        }
+        buf.resize(buf.size() * 2u);
+    }
+    if(len && '\r' == buf[len - 1u]) {
+        buf[--len] = '\0';
+    }
+    return true;
+}
+
+int ReadLine(std::FILE* stream, char* buf, std::size_t buflen, std::size_t& len) {
+    std::fpos_t start;
+    const bool rewindable = !std::fgetpos(stream, &start);
+    if(buflen < 2u) {
+        return ERANGE;
+    }
+    if(!std::fgets(buf, buflen < INT_MAX ? buflen : INT_MAX, stream)) {
+        return std::ferror(stream) ? EIO : ENOENT;
+    }
+    len = std::strlen(buf);
+    if(len && '\n' == buf[len - 1u]) {
+        buf[--len] = '\0';
+    } else if(EOF != std::getc(stream)) { // else the last line has no line break
+        if(rewindable) {
+            std::fsetpos(stream, &start);
+        }
+        return ERANGE;
+    }
+    if(len && '\r' == buf[len - 1u]) {
+        buf[--len] = '\0';
+    }
+    return 0;
+}
+
+char* Terminate(const Span& span) {
+    if(!span.str) {
+        return const_cast<char*>("");
+    }
+    char* str = const_cast<char*>(span.str);
+    str[span.len] = '\0';
+    return str;
+}
+
+} // namespace pwfile
+} // namespace wusers_impl
@@ -0,0 +1,78 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _PWFILE_H_
+#define _PWFILE_H_
+
+#include "wusers/wuser_types.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+namespace wusers_impl {
+
+// passwd(5) and group(5) lines, split where they lie: fields are spans into the line,
+// which may be read-only mapped memory. nothing is copied and nothing is allocated.
+namespace pwfile {
+
+struct Span {
+    const char* str; // nullptr if the field is absent from this flavor of the format
+    std::size_t len;
+};
+
+// name:passwd:uid:gid:gecos:dir:shell, or the BSD master.passwd(5) flavor
+// name:passwd:uid:gid:class:change:expire:gecos:dir:shell
+struct PwLine {
+    Span name, passwd, klass, gecos, dir, shell;
+    uid_t uid;
+    gid_t gid;
+    time_t change, expire;
+};
+
+// name:passwd:gid:member,member,...
+struct GrLine {
+    Span name, passwd, members;
+    gid_t gid;
+};
+
+// false for blank lines, comments and lines that aren't well-formed
+bool Parse(const char* line, std::size_t len, PwLine& out);
+bool Parse(const char* line, std::size_t len, GrLine& out);
+
+// the next comma-separated name in `list`, which is consumed; false when there are no more
+bool NextMember(Span& list, Span& member);
+
+// splits a block of memory (a mapped file) into lines; '\r' before '\n' is dropped
+class Lines {
+public:
+    Lines(const char* data, std::size_t size) : at(data), end(data + size) {}
+
+    bool next(Span& line);
+
+private:
+    const char* at;
+    const char* end;
+};
+
+// the next line of `stream` in `buf`, null-terminated and without the line break;
+// false at the end of the stream
+bool ReadLine(std::FILE* stream, std::vector<char>& buf, std::size_t& len);
+
+// the same for the _r functions, into the caller's buffer: 0, ENOENT at the end of the
+// stream, or ERANGE if the line doesn't fit. the stream is then rewound to the start of
+// the line, so that the caller may retry with a larger buffer (unless it's a pipe).
+int ReadLine(std::FILE* stream, char* buf, std::size_t buflen, std::size_t& len);
+
+// for lines in writable memory: terminates `span` in place (overwriting its separator)
+// and returns it as a C string. absent fields become "".
+char* Terminate(const Span& span);
+
+} // namespace pwfile
+} // namespace wusers_impl
+
+#endif /* !_PWFILE_H_ */
@@ -0,0 +1,83 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "rcu.h"
+
+namespace wusers_impl {
+
+namespace {
+
+// hands the slot back when its thread exits
+struct Owner {
+    Rcu::Slot* slot = nullptr;
+
+    ~Owner() {
+        if(slot) {
+            slot->active.store(0u);
+            slot->owned.store(false, std::memory_order_release);
+            slot = nullptr;
+        }
+    }
+};
+
+}
+
+Rcu& Rcu::instance() {
+    static Rcu* rcu = new Rcu; // never destroyed: there may be readers (and writers) until the very end
+    return *rcu;
+}
+
+Rcu::Slot* Rcu::mine() {
+    static thread_local Owner owner;
+    return owner.slot ? owner.slot : (owner.slot = acquire());
+}
+
+Rcu::Slot* Rcu::acquire() {
+    for(Slot* slot = slots.load(std::memory_order_acquire); slot; slot = slot->next) {
+        bool left = false;
+        if(!slot->owned.load(std::memory_order_relaxed) && slot->owned.compare_exchange_strong(left, true)) {
+            slot->depth = 0u;
+            return slot;
+        }
+    }
+    Slot* slot = new Slot;
+    slot->next = slots.load(std::memory_order_relaxed);
+    while(!slots.compare_exchange_weak(slot->next, slot)) {}
+    return slot;
+}
+
+// A reader stores the epoch it came in at before it loads the pointer it's after, and the
+// writer bumps the epoch after it has replaced that pointer (all seq_cst). A reader whose
+// slot says `stamp` or later, or nothing at all, therefore can't be holding what's retired.
+void Rcu::retire(std::function<void()> garbage) {
+    std::vector<std::function<void()>> reclaimed;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        const unsigned long stamp = epoch.fetch_add(1u) + 1u;
+        retired.emplace_back(stamp, std::move(garbage));
+        unsigned long oldest = stamp + 1u; // nobody reading
+        for(Slot* slot = slots.load(); slot; slot = slot->next) {
+            const unsigned long active = slot->active.load();
+            if(active && active < oldest) {
+                oldest = active;
+            }
+        }
+        for(auto itr = retired.begin(); itr != retired.end();) {
+            if(itr->first <= oldest) { // everyone reading came in after this was retired
+                reclaimed.push_back(std::move(itr->second));
+                itr = retired.erase(itr);
+            } else {
+                ++itr;
+            }
+        }
+    }
+    for(auto& reclaim : reclaimed) {
+        reclaim();
+    }
+}
+
+} // namespace wusers_impl
@@ -0,0 +1,76 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _RCU_H_
+#define _RCU_H_
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace wusers_impl {
+
+// Epoch-based reclamation, RCU style, for structures that readers use without a lock: a
+// writer swaps in a new (immutable) version and retires the old one, which is destroyed
+// once every thread that may still be looking at it has left its read section. A reader
+// writes to a slot of its own and reads the global epoch: no lock, no shared counter.
+class Rcu {
+public:
+    struct alignas(64) Slot {
+        std::atomic<unsigned long> active{0u}; // the epoch the reader came in at; 0 if it isn't reading
+        std::atomic<bool> owned{true};         // by a live thread
+        unsigned int depth = 0u;               // read sections may nest
+        Slot* next = nullptr;
+    };
+
+    static Rcu& instance();
+
+    // marks the calling thread as reading for its lifetime
+    class Reader {
+    public:
+        Reader() : rcu(instance()), slot(rcu.mine()) {
+            if(!slot->depth++) {
+                slot->active.store(rcu.epoch.load()); // both seq_cst: see retire()
+            }
+        }
+
+        ~Reader() {
+            if(!--slot->depth) {
+                slot->active.store(0u, std::memory_order_release);
+            }
+        }
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+    private:
+        Rcu& rcu;
+        Slot* const slot;
+    };
+
+    // destroy `garbage` once no reader that could have seen it is left. call after whatever
+    // pointed to it has been replaced. doesn't wait: what may still be in use is kept for
+    // a later call.
+    void retire(std::function<void()> garbage);
+
+private:
+    Rcu() = default;
+
+    Slot* mine();    // the calling thread's slot
+    Slot* acquire(); // a slot for a new thread: one a thread has left behind, or a new one
+
+    std::atomic<unsigned long> epoch{1u};
+    std::atomic<Slot*> slots{nullptr}; // never shrinks; slots are reused
+    std::mutex mtx;                    // writers only
+    std::vector<std::pair<unsigned long, std::function<void()>>> retired; // by the epoch they were retired in
+};
+
+} // namespace wusers_impl
+
+#endif /* !_RCU_H_ */
@@ -0,0 +1,213 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "wusers/wuser_changes.h"
+#include "refresh.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace {
+using namespace wusers_impl;
+
+constexpr std::size_t KEPT = 4096u; // changes, give or take a generation
+
+// What refresh passes have found, oldest first. Generations are dropped from the front
+// as a whole, so that whatever is kept after a generation is all there is.
+class Feed {
+public:
+    static Feed& instance() {
+        static Feed feed;
+        return feed;
+    }
+
+    // the changes a pass has found: the next generation
+    void publish(std::vector<wuser_change>& found) {
+        std::lock_guard<std::mutex> lock(mtx);
+        const unsigned long generation = bump_directory_generation();
+        for(wuser_change& change : found) {
+            change.generation = generation;
+            kept.push_back(change);
+        }
+        while(kept.size() > KEPT && kept.front().generation != generation) {
+            floor = kept.front().generation;
+            while(kept.front().generation == floor) {
+                kept.pop_front();
+            }
+        }
+    }
+
+    int since(unsigned long generation, struct wuser_change* out_changes, std::size_t max_changes, std::size_t* out_count) {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(generation < floor) {
+            return EOVERFLOW;
+        }
+        auto first = std::upper_bound(kept.begin(), kept.end(), generation,
+            [](unsigned long gen, const wuser_change& change) { return gen < change.generation; });
+        const std::size_t count = kept.end() - first;
+        *out_count = count;
+        if(count > max_changes) {
+            return ERANGE;
+        }
+        std::copy(first, kept.end(), out_changes);
+        return 0;
+    }
+
+private:
+    std::mutex mtx;
+    std::deque<wuser_change> kept;
+    unsigned long floor = 0u; // everything after this generation is kept
+};
+
+// what changed between two passes, by RID
+void Diff(int account, const Census& before, const Census& after,
+          std::vector<wuser_change>& changes, std::vector<Stale>& stale) {
+    const std::size_t from = changes.size();
+    for(const auto& now : after) {
+        auto was = before.find(now.first);
+        if(was == before.end()) {
+            changes.push_back({0u, account, WUSER_CHANGE_ADDED, now.first});
+            stale.push_back({now.first, std::wstring(), now.second.name});
+        } else if(was->second.digest != now.second.digest || was->second.name != now.second.name) {
+            changes.push_back({0u, account, WUSER_CHANGE_MODIFIED, now.first});
+            stale.push_back({now.first, was->second.name, now.second.name});
+        }
+    }
+    for(const auto& was : before) {
+        if(!after.count(was.first)) {
+            changes.push_back({0u, account, WUSER_CHANGE_REMOVED, was.first});
+            stale.push_back({was.first, was.second.name, std::wstring()});
+        }
+    }
+    std::sort(changes.begin() + from, changes.end(),
+        [](const wuser_change& a, const wuser_change& b) { return a.id < b.id; });
+}
+
+// Passes on demand and, once started, every so often on a thread of its own.
+class Refresher {
+public:
+    static Refresher& instance() {
+        static Refresher refresher;
+        return refresher;
+    }
+
+    // one at a time; 0 or an errno value
+    int pass() {
+        std::lock_guard<std::mutex> lock(passing);
+        Census users_now, groups_now;
+        int error = UserCensus(users_now);
+        if(!error) {
+            error = GroupCensus(groups_now);
+        }
+        if(error) {
+            return error;
+        }
+        if(taken) {
+            std::vector<wuser_change> changes;
+            std::vector<Stale> stale_users, stale_groups;
+            Diff(WUSER_ACCOUNT_USER, users, users_now, changes, stale_users);
+            Diff(WUSER_ACCOUNT_GROUP, groups, groups_now, changes, stale_groups);
+            if(!changes.empty()) {
+                // before the generation moves: whoever sees it must not find the old records
+                ForgetUsers(stale_users);
+                ForgetGroups(stale_groups);
+                Feed::instance().publish(changes);
+            }
+        }
+        users.swap(users_now);
+        groups.swap(groups_now);
+        taken = true;
+        return 0;
+    }
+
+    void start(unsigned int interval_ms) {
+        std::unique_lock<std::mutex> lock(mtx);
+        interval = std::chrono::milliseconds(interval_ms);
+        if(interval_ms && !thread.joinable()) {
+            stopping = false;
+            thread = std::thread(&Refresher::run, this);
+        } else if(!interval_ms && thread.joinable()) {
+            stopping = true;
+            wake.notify_all();
+            lock.unlock();
+            thread.join();
+            return;
+        }
+        wake.notify_all(); // a new interval starts now
+    }
+
+    ~Refresher() {
+        start(0u);
+    }
+
+private:
+    Refresher() {
+        // the caches and the feed must outlive the thread, hence be there before it
+        ForgetUsers(std::vector<Stale>());
+        ForgetGroups(std::vector<Stale>());
+        Feed::instance();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while(!stopping) {
+            if(wake.wait_for(lock, interval) == std::cv_status::timeout) {
+                lock.unlock();
+                pass();
+                lock.lock();
+            }
+        }
+    }
+
+    std::mutex passing;
+    Census users;
+    Census groups;
+    bool taken = false; // stock of the directory, to compare the next pass with
+
+    std::mutex mtx; // guards the rest
+    std::condition_variable wake;
+    std::thread thread;
+    std::chrono::milliseconds interval{0};
+    bool stopping = false;
+};
+
+} // anonymous
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void wuser_refresh_start(unsigned int interval_ms) {
+    Refresher::instance().start(interval_ms);
+}
+
+int wuser_refresh_now(void) {
+    const int error = Refresher::instance().pass();
+    set_last_error(error);
+    return error;
+}
+
+unsigned long wuser_generation(void) {
+    return directory_generation();
+}
+
+int wuser_changes_since(unsigned long generation, struct wuser_change *out_changes, size_t max_changes,
+                        size_t *out_count) {
+    const int error = Feed::instance().since(generation, out_changes, max_changes, out_count);
+    set_last_error(error);
+    return error;
+}
+
+#ifdef __cplusplus
+}
+#endif
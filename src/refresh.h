@@ -0,0 +1,91 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _REFRESH_H_
+#define _REFRESH_H_
+
+#include "cache.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace wusers_impl {
+
+// What a refresh pass (see wusers/wuser_changes.h) has seen of an account: its name and
+// a digest of the rest (whatever FillFrom() would translate), by RID.
+struct Seen {
+    std::wstring name;
+    std::size_t digest;
+};
+using Census = std::unordered_map<unsigned int, Seen>;
+
+// An account that a pass found changed: what the cache has under its RID and under
+// either name goes. `was` is empty for an account that has appeared, `is` for one that has gone.
+struct Stale {
+    unsigned int id;
+    std::wstring was;
+    std::wstring is;
+};
+
+inline std::size_t Mix(std::size_t digest, std::size_t value) {
+    return digest ^ (value + static_cast<std::size_t>(0x9e3779b97f4a7c15ull) + (digest << 6) + (digest >> 2));
+}
+
+inline std::size_t Mix(std::size_t digest, const wchar_t* str) {
+    return Mix(digest, std::hash<std::wstring>()(str ? str : L""));
+}
+
+// one full enumeration into `census`, with IA::Digest(); 0 or an errno value
+template<typename POSIX_RECORD_T>
+int TakeCensus(Census& census) {
+    using IA = InfoAdapter<POSIX_RECORD_T>;
+    using QueryState = EnumQueryState<typename IA::NETAPI_INFO_T, IA::LVL, &IA::Enumerate, &IA::Pages>;
+    set_last_error(0);
+    QueryState query;
+    query.reset();
+    query.query();
+    while(const typename IA::NETAPI_INFO_T* info = query.step()) {
+        census[IA::IdOf(info)] = {IA::WNameOf(info), IA::Digest(*info)};
+        if(errno) break; // IA::Digest() may have to ask for more
+    }
+    return errno;
+}
+
+template<typename POSIX_RECORD_T>
+void ForgetStale(const std::vector<Stale>& stale) {
+    using id_t = typename InfoAdapter<POSIX_RECORD_T>::id_t;
+    Cache<POSIX_RECORD_T>& cache = Cache<POSIX_RECORD_T>::instance();
+    if(stale.empty()) {
+        return;
+    }
+    Arena scratch;
+    const ArenaWriter writer(scratch);
+    std::vector<id_t> ids;
+    std::vector<std::string> keys;
+    bool reindex = false;
+    for(const Stale& account : stale) {
+        ids.push_back(account.id);
+        for(const std::wstring* wname : {&account.was, &account.is}) {
+            const char* name = wname->empty() ? nullptr : writer(wname->c_str());
+            if(name) keys.push_back(fold_name(name));
+        }
+        reindex |= account.was != account.is; // appeared, gone or renamed
+    }
+    cache.forget(ids, keys, reindex);
+    set_last_error(0); // a name that doesn't convert can't be cached under it either
+}
+
+// defined next to the respective IA<>
+int UserCensus(Census& census);
+int GroupCensus(Census& census); // members included, one NetGroupGetUsers() per group
+void ForgetUsers(const std::vector<Stale>& stale);  // nothing to forget constructs the cache
+void ForgetGroups(const std::vector<Stale>& stale);
+
+} // namespace wusers_impl
+
+#endif /* !_REFRESH_H_ */
@@ -0,0 +1,480 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "pwd.h"      // struct passwd, enumeration API
+#include "grp.h"      // struct group, ditto
+#include "wusers/wuser_snapshot.h" // API
+
+#include "snapshot.h" // file layout
+#include "mapfile.h"  // MappedFile
+#include "cache.h"    // cache_generation()
+#include "wus.h"      // fold_name(), get_cp()
+#include <errno.h>    // error codes
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <numeric>
+#include <unordered_set>
+
+namespace wusers_impl {
+namespace snap {
+
+std::uint32_t Mix(std::uint64_t hash, std::uint32_t seed) {
+    std::uint64_t x = hash ^ (seed * 0x9E3779B97F4A7C15ull);
+    x ^= x >> 33; // murmur3 finalizer
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    x ^= x >> 33;
+    return static_cast<std::uint32_t>(x);
+}
+
+std::uint64_t Hash(std::uint32_t id) {
+    return id;
+}
+
+std::uint64_t Hash(const char* key) {
+    std::uint64_t hash = 0xCBF29CE484222325ull; // FNV-1a
+    for(; *key; ++key) {
+        hash = (hash ^ static_cast<unsigned char>(*key)) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+} // namespace snap
+} // namespace wusers_impl
+
+namespace {
+using namespace wusers_impl;
+using namespace wusers_impl::snap;
+
+constexpr unsigned int SNAP_CP = 65001; // CP_UTF8 per <winnls.h>
+
+struct Mapping {
+    std::shared_ptr<const MappedFile> file;
+    const char* base;
+    std::size_t size;
+    unsigned long generation; // of the cache at mapping time
+
+    const Header& header() const {
+        return *reinterpret_cast<const Header*>(base);
+    }
+
+    template<typename T>
+    const T* at(std::uint32_t offset) const {
+        return reinterpret_cast<const T*>(base + offset);
+    }
+
+    char* str(std::uint32_t offset) const {
+        // the file ends with a null byte, so any offset within it is a terminated string
+        return offset && offset < size ? const_cast<char*>(base + offset) : nullptr;
+    }
+
+    template<typename REC_T>
+    const REC_T* find(const Table& table, std::uint64_t hash, std::uint32_t recs, std::uint32_t count) const {
+        const std::uint32_t bucket = Mix(hash, 0u) % table.buckets;
+        const std::uint32_t index = at<std::uint32_t>(table.slot)[Mix(hash, at<std::uint32_t>(table.disp)[bucket]) % table.slots];
+        return index < count ? at<REC_T>(recs) + index : nullptr;
+    }
+};
+
+// mappings are never released (hence never unmapped): records handed out point into them
+std::atomic<const Mapping*> current{nullptr};
+std::once_flag from_env;
+
+// the header and the tables are checked once; record fields are checked on use
+bool Valid(const char* base, std::size_t size) {
+    if(size < sizeof(Header) || size > 0xFFFFFFFFu || base[size - 1u]) {
+        return false;
+    }
+    const Header& hdr = *reinterpret_cast<const Header*>(base);
+    auto fits = [size](std::uint32_t offset, std::uint64_t count, std::size_t elem, std::size_t align) {
+        return !(offset % align) && offset <= size && count * elem <= size - offset;
+    };
+    auto table = [&](const Table& tbl) {
+        return tbl.buckets && tbl.slots && fits(tbl.disp, tbl.buckets, 4u, 4u) && fits(tbl.slot, tbl.slots, 4u, 4u);
+    };
+    return !std::memcmp(hdr.magic, MAGIC, sizeof(MAGIC)) && hdr.order == ORDER && hdr.size == size
+        && fits(hdr.user_recs, hdr.users, sizeof(PwRec), 8u) && fits(hdr.group_recs, hdr.groups, sizeof(GrRec), 8u)
+        && table(hdr.uid) && table(hdr.user_key) && table(hdr.gid) && table(hdr.group_key);
+}
+
+bool Expired(const Header& hdr) {
+    return hdr.expires && std::time(nullptr) >= hdr.expires;
+}
+
+int Open(const char* path) {
+    std::shared_ptr<const MappedFile> file = MappedFile::Open(path);
+    if(!file) {
+        return -1;
+    }
+    if(!Valid(file->data(), file->size())) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    if(Expired(*reinterpret_cast<const Header*>(file->data()))) {
+        set_last_error(ETIMEDOUT);
+        return -1;
+    }
+    current.store(new Mapping{file, file->data(), file->size(), cache_generation()}, std::memory_order_release);
+    return 0;
+}
+
+const Mapping* Usable() {
+    std::call_once(from_env, []() {
+        const char* path = std::getenv("WUSERS_SNAPSHOT");
+        if(path && *path) {
+            int err = errno;
+            Open(path); // a broken snapshot is no snapshot
+            set_last_error(err);
+        }
+    });
+    const Mapping* mapping = current.load(std::memory_order_acquire);
+    if(!mapping || mapping->generation != cache_generation() || get_cp() != SNAP_CP || Expired(mapping->header())) {
+        return nullptr;
+    }
+    return mapping;
+}
+
+bool Fill(const Mapping& mapping, const PwRec& rec, struct passwd& pwd) {
+    if(!(pwd.pw_name = mapping.str(rec.name))) {
+        return false;
+    }
+    pwd.pw_passwd = mapping.str(rec.passwd);
+    pwd.pw_uid = rec.uid;
+    pwd.pw_gid = rec.gid;
+    pwd.pw_change = rec.change;
+    pwd.pw_class = mapping.str(rec.klass);
+    pwd.pw_gecos = mapping.str(rec.gecos);
+    pwd.pw_dir = mapping.str(rec.dir);
+    pwd.pw_shell = mapping.str(rec.shell);
+    pwd.pw_expire = rec.expire;
+    return true;
+}
+
+bool Fill(const Mapping& mapping, const GrRec& rec, struct group& grp, std::vector<char*>& members) {
+    if(!mapping.str(rec.name) || rec.mem % 4u || rec.mem > mapping.size
+        || rec.nmem > (mapping.size - rec.mem) / sizeof(std::uint32_t)) {
+        return false;
+    }
+    members.clear();
+    const std::uint32_t* mem = mapping.at<std::uint32_t>(rec.mem);
+    for(std::uint32_t i = 0; i < rec.nmem; ++i) {
+        if(char* member = mapping.str(mem[i])) members.push_back(member);
+    }
+    members.push_back(nullptr);
+    grp.gr_name = mapping.str(rec.name);
+    grp.gr_passwd = mapping.str(rec.passwd);
+    grp.gr_gid = rec.gid;
+    grp.gr_mem = members.data();
+    return true;
+}
+
+// what the writer collects before laying anything out
+struct UserRow {
+    uid_t uid;
+    gid_t gid;
+    time_t change, expire;
+    std::string name, key, passwd, klass, gecos, dir, shell;
+};
+
+struct GroupRow {
+    gid_t gid;
+    std::string name, key, passwd;
+    std::vector<std::string> members;
+};
+
+struct BuiltTable {
+    std::vector<std::uint32_t> disp;
+    std::vector<std::uint32_t> slot;
+};
+
+// hash and displace: buckets go largest first, each trying seeds until all of its keys
+// land in free slots. duplicate keys keep the first record. the table grows on failure.
+BuiltTable Build(const std::vector<std::uint64_t>& hashes) {
+    std::vector<std::uint32_t> keys; // record indices, duplicates dropped
+    std::unordered_set<std::uint64_t> seen;
+    for(std::uint32_t i = 0; i < hashes.size(); ++i) {
+        if(seen.insert(hashes[i]).second) keys.push_back(i);
+    }
+    const std::size_t n = keys.size();
+    const std::uint32_t buckets = n / 4u + 1u;
+    for(std::uint32_t slots = n + n / 4u + 1u;; slots *= 2u) {
+        std::vector<std::vector<std::uint32_t>> members(buckets);
+        for(std::uint32_t key : keys) {
+            members[Mix(hashes[key], 0u) % buckets].push_back(key);
+        }
+        std::vector<std::uint32_t> order(buckets);
+        std::iota(order.begin(), order.end(), 0u);
+        std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+            return members[a].size() > members[b].size();
+        });
+
+        BuiltTable built{std::vector<std::uint32_t>(buckets, 0u), std::vector<std::uint32_t>(slots, NONE)};
+        std::vector<std::uint32_t> placed;
+        bool complete = true;
+        for(std::uint32_t bucket : order) {
+            if(members[bucket].empty()) {
+                break;
+            }
+            bool fits = false;
+            for(std::uint32_t seed = 1u; !fits && seed < (1u << 16); ++seed) {
+                placed.clear();
+                fits = true;
+                for(std::uint32_t key : members[bucket]) {
+                    const std::uint32_t at = Mix(hashes[key], seed) % slots;
+                    if(NONE != built.slot[at] || placed.end() != std::find(placed.begin(), placed.end(), at)) {
+                        fits = false;
+                        break;
+                    }
+                    placed.push_back(at);
+                }
+                if(fits) {
+                    built.disp[bucket] = seed;
+                    for(std::size_t k = 0; k < placed.size(); ++k) {
+                        built.slot[placed[k]] = members[bucket][k];
+                    }
+                }
+            }
+            if(!fits) {
+                complete = false;
+                break;
+            }
+        }
+        if(complete) {
+            return built;
+        }
+    }
+}
+
+std::uint32_t Align(std::size_t offset) {
+    return static_cast<std::uint32_t>((offset + 7u) & ~std::size_t(7u));
+}
+
+std::string Layout(const std::vector<UserRow>& users, const std::vector<GroupRow>& groups, unsigned long max_age) {
+    std::vector<std::uint64_t> uid_hashes, ukey_hashes, gid_hashes, gkey_hashes;
+    for(const UserRow& row : users) {
+        uid_hashes.push_back(Hash(static_cast<std::uint32_t>(row.uid)));
+        ukey_hashes.push_back(Hash(row.key.c_str()));
+    }
+    for(const GroupRow& row : groups) {
+        gid_hashes.push_back(Hash(static_cast<std::uint32_t>(row.gid)));
+        gkey_hashes.push_back(Hash(row.key.c_str()));
+    }
+    const BuiltTable built[] = {Build(uid_hashes), Build(ukey_hashes), Build(gid_hashes), Build(gkey_hashes)};
+
+    // header, records, tables, member arrays, strings
+    Header hdr;
+    std::memset(&hdr, 0, sizeof(hdr));
+    std::memcpy(hdr.magic, MAGIC, sizeof(MAGIC));
+    hdr.order = ORDER;
+    hdr.created = std::time(nullptr);
+    hdr.expires = max_age ? hdr.created + static_cast<std::int64_t>(max_age) : 0;
+    hdr.users = users.size();
+    hdr.groups = groups.size();
+    hdr.user_recs = Align(sizeof(Header));
+    hdr.group_recs = Align(hdr.user_recs + users.size() * sizeof(PwRec));
+    std::uint32_t offset = Align(hdr.group_recs + groups.size() * sizeof(GrRec));
+    Table* tables[] = {&hdr.uid, &hdr.user_key, &hdr.gid, &hdr.group_key};
+    for(std::size_t t = 0; t < 4u; ++t) {
+        tables[t]->buckets = built[t].disp.size();
+        tables[t]->slots = built[t].slot.size();
+        tables[t]->disp = offset;
+        tables[t]->slot = offset += built[t].disp.size() * sizeof(std::uint32_t);
+        offset += built[t].slot.size() * sizeof(std::uint32_t);
+    }
+    const std::uint32_t mem_base = offset;
+    for(const GroupRow& row : groups) {
+        offset += row.members.size() * sizeof(std::uint32_t);
+    }
+    const std::uint32_t str_base = Align(offset);
+
+    std::string strings(1u, '\0'); // nothing lives at str_base: keeps offsets nonzero
+    auto put = [&](const std::string& str) {
+        std::uint32_t at = str_base + strings.size();
+        strings.append(str).push_back('\0');
+        return at;
+    };
+
+    std::string image(str_base, '\0');
+    PwRec* pw_recs = reinterpret_cast<PwRec*>(&image[hdr.user_recs]);
+    for(std::size_t i = 0; i < users.size(); ++i) {
+        const UserRow& row = users[i];
+        PwRec rec;
+        std::memset(&rec, 0, sizeof(rec));
+        rec.uid = row.uid;
+        rec.gid = row.gid;
+        rec.change = row.change;
+        rec.expire = row.expire;
+        rec.name = put(row.name);
+        rec.key = put(row.key);
+        rec.passwd = put(row.passwd);
+        rec.klass = put(row.klass);
+        rec.gecos = put(row.gecos);
+        rec.dir = put(row.dir);
+        rec.shell = put(row.shell);
+        std::memcpy(pw_recs + i, &rec, sizeof(rec));
+    }
+    GrRec* gr_recs = reinterpret_cast<GrRec*>(&image[hdr.group_recs]);
+    std::uint32_t mem_at = mem_base;
+    for(std::size_t i = 0; i < groups.size(); ++i) {
+        const GroupRow& row = groups[i];
+        GrRec rec;
+        std::memset(&rec, 0, sizeof(rec));
+        rec.gid = row.gid;
+        rec.name = put(row.name);
+        rec.key = put(row.key);
+        rec.passwd = put(row.passwd);
+        rec.mem = mem_at;
+        rec.nmem = row.members.size();
+        for(const std::string& member : row.members) {
+            std::uint32_t str_at = put(member);
+            std::memcpy(&image[mem_at], &str_at, sizeof(str_at));
+            mem_at += sizeof(std::uint32_t);
+        }
+        std::memcpy(gr_recs + i, &rec, sizeof(rec));
+    }
+    for(std::size_t t = 0; t < 4u; ++t) {
+        std::memcpy(&image[tables[t]->disp], built[t].disp.data(), built[t].disp.size() * sizeof(std::uint32_t));
+        std::memcpy(&image[tables[t]->slot], built[t].slot.data(), built[t].slot.size() * sizeof(std::uint32_t));
+    }
+    image.append(strings); // ends with a null byte
+    hdr.size = image.size();
+    std::memcpy(&image[0], &hdr, sizeof(hdr));
+    return image;
+}
+
+std::string Str(const char* str) {
+    return str ? str : "";
+}
+
+} // anonymous
+
+namespace wusers_impl {
+
+bool Mapped<struct passwd>::ById(uid_t uid, struct passwd& view, std::vector<char*>&) {
+    const Mapping* mapping = Usable();
+    if(!mapping) {
+        return false;
+    }
+    const Header& hdr = mapping->header();
+    const PwRec* rec = mapping->find<PwRec>(hdr.uid, Hash(static_cast<std::uint32_t>(uid)), hdr.user_recs, hdr.users);
+    return rec && rec->uid == uid && Fill(*mapping, *rec, view);
+}
+
+bool Mapped<struct passwd>::ByKey(const std::string& key, struct passwd& view, std::vector<char*>&) {
+    const Mapping* mapping = Usable();
+    if(!mapping) {
+        return false;
+    }
+    const Header& hdr = mapping->header();
+    const PwRec* rec = mapping->find<PwRec>(hdr.user_key, Hash(key.c_str()), hdr.user_recs, hdr.users);
+    const char* rec_key = rec ? mapping->str(rec->key) : nullptr;
+    return rec_key && key == rec_key && Fill(*mapping, *rec, view);
+}
+
+bool Mapped<struct group>::ById(gid_t gid, struct group& view, std::vector<char*>& members) {
+    const Mapping* mapping = Usable();
+    if(!mapping) {
+        return false;
+    }
+    const Header& hdr = mapping->header();
+    const GrRec* rec = mapping->find<GrRec>(hdr.gid, Hash(static_cast<std::uint32_t>(gid)), hdr.group_recs, hdr.groups);
+    return rec && rec->gid == gid && Fill(*mapping, *rec, view, members);
+}
+
+bool Mapped<struct group>::ByKey(const std::string& key, struct group& view, std::vector<char*>& members) {
+    const Mapping* mapping = Usable();
+    if(!mapping) {
+        return false;
+    }
+    const Header& hdr = mapping->header();
+    const GrRec* rec = mapping->find<GrRec>(hdr.group_key, Hash(key.c_str()), hdr.group_recs, hdr.groups);
+    const char* rec_key = rec ? mapping->str(rec->key) : nullptr;
+    return rec_key && key == rec_key && Fill(*mapping, *rec, view, members);
+}
+
+} // namespace wusers_impl
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int wuser_snapshot_write(const char* path, unsigned long max_age) {
+    set_last_error(0);
+    if(!path || !*path || get_cp() != SNAP_CP) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+
+    std::vector<UserRow> users;
+    setpwent();
+    while(!errno) {
+        const struct passwd* pwd = getpwent();
+        if(!pwd) break;
+        users.push_back({pwd->pw_uid, pwd->pw_gid, pwd->pw_change, pwd->pw_expire,
+            Str(pwd->pw_name), fold_name(pwd->pw_name), Str(pwd->pw_passwd), Str(pwd->pw_class),
+            Str(pwd->pw_gecos), Str(pwd->pw_dir), Str(pwd->pw_shell)});
+    }
+    endpwent();
+    std::vector<GroupRow> groups;
+    setgrent();
+    while(!errno) {
+        const struct group* grp = getgrent();
+        if(!grp) break;
+        groups.push_back({grp->gr_gid, Str(grp->gr_name), fold_name(grp->gr_name), Str(grp->gr_passwd), {}});
+        for(char** member = grp->gr_mem; member && *member; ++member) {
+            groups.back().members.push_back(*member);
+        }
+    }
+    endgrent();
+    if(errno) {
+        return -1; // an incomplete snapshot would hide accounts
+    }
+
+    const std::string image = Layout(users, groups, max_age);
+    const std::string temp = std::string(path) + ".tmp";
+    std::FILE* file = std::fopen(temp.c_str(), "wb");
+    if(!file) {
+        return -1;
+    }
+    bool written = std::fwrite(image.data(), 1u, image.size(), file) == image.size();
+    written &= !std::fclose(file);
+#ifdef _WIN32
+    std::remove(path); // rename() doesn't replace on Windows
+#endif
+    if(!written || std::rename(temp.c_str(), path)) {
+        int err = errno ? errno : EIO;
+        std::remove(temp.c_str());
+        set_last_error(err);
+        return -1;
+    }
+    return 0;
+}
+
+int wuser_snapshot_open(const char* path) {
+    set_last_error(0);
+    if(!path) {
+        set_last_error(EINVAL);
+        return -1;
+    }
+    Usable(); // WUSERS_SNAPSHOT, if any, must not override this one later
+    return Open(path);
+}
+
+void wuser_snapshot_close() {
+    current.store(nullptr, std::memory_order_release);
+}
+
+#ifdef __cplusplus
+}
+#endif
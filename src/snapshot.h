@@ -0,0 +1,97 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "wusers/wuser_types.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct passwd;
+struct group;
+
+namespace wusers_impl {
+
+// On-disk layout of a directory snapshot (see wusers/wuser_snapshot.h). Everything is
+// addressed by offsets from the start of the file, so the file is mapped read-only and
+// used in place; records handed out point straight into the mapping. Native byte order
+// (`order` tells), strings are UTF-8 and null-terminated, offset 0 stands for nullptr.
+namespace snap {
+
+constexpr const char MAGIC[8] = {'W', 'U', 'S', 'N', 'A', 'P', '1', '\n'};
+constexpr std::uint32_t ORDER = 0x01020304u;
+
+// perfect hash table: `slot[Mix(key, disp[Mix(key, 0) % buckets]) % slots]` is the index
+// of the only record that may match `key`, or NONE. the caller still compares the key.
+struct Table {
+    std::uint32_t buckets;
+    std::uint32_t slots;
+    std::uint32_t disp; // -> uint32_t[buckets]
+    std::uint32_t slot; // -> uint32_t[slots]
+};
+
+constexpr std::uint32_t NONE = ~0u;
+
+struct Header {
+    char magic[8];
+    std::uint32_t order;
+    std::uint32_t size;    // of the whole file, which ends with a null byte
+    std::int64_t created;  // time(nullptr) at generation
+    std::int64_t expires;  // ditto, 0 if never
+    std::uint32_t users;
+    std::uint32_t groups;
+    std::uint32_t user_recs;  // -> PwRec[users]
+    std::uint32_t group_recs; // -> GrRec[groups]
+    Table uid, user_key, gid, group_key;
+};
+
+struct PwRec {
+    std::uint32_t uid, gid;
+    std::int64_t change, expire;
+    std::uint32_t name, key; // key is fold_name(name)
+    std::uint32_t passwd, klass, gecos, dir, shell;
+    std::uint32_t reserved;
+};
+
+struct GrRec {
+    std::uint32_t gid;
+    std::uint32_t name, key;
+    std::uint32_t passwd;
+    std::uint32_t mem;  // -> uint32_t[nmem], string offsets
+    std::uint32_t nmem;
+};
+
+std::uint32_t Mix(std::uint64_t hash, std::uint32_t seed);
+std::uint64_t Hash(std::uint32_t id);
+std::uint64_t Hash(const char* key);
+
+} // namespace snap
+
+// Lookups in the current snapshot, if one is mapped and still usable: not expired,
+// not outdated by wuser_cache_invalidate(), and the code page is UTF-8. `view` is
+// filled with pointers into the mapping, which stays mapped for the process lifetime;
+// for groups, `members` provides the gr_mem array and must outlive `view`.
+// `key` is the fold_name() of the name asked for.
+// false means "ask the backend", whether the snapshot is missing or the key is.
+template<typename POSIX_RECORD_T> struct Mapped;
+
+template<> struct Mapped<struct passwd> {
+    static bool ById(uid_t uid, struct passwd& view, std::vector<char*>& members);
+    static bool ByKey(const std::string& key, struct passwd& view, std::vector<char*>& members);
+};
+
+template<> struct Mapped<struct group> {
+    static bool ById(gid_t gid, struct group& view, std::vector<char*>& members);
+    static bool ByKey(const std::string& key, struct group& view, std::vector<char*>& members);
+};
+
+} // namespace wusers_impl
+
+#endif /* !_SNAPSHOT_H_ */
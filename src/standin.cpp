@@ -0,0 +1,452 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "standin.h"
+#include "pack.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cwchar>
+#include <cwctype>
+#include <random>
+#include <thread>
+
+namespace {
+using namespace wusers_impl;
+
+#ifndef ERROR_NONE_MAPPED
+constexpr DWORD ERROR_NONE_MAPPED = 1332;
+#endif
+
+constexpr const wchar_t* DOMAIN = L"STANDIN\\";
+
+std::wstring Fold(std::wstring str) {
+    for(auto& chr : str) chr = std::towlower(chr);
+    return str;
+}
+
+std::wstring Numbered(const wchar_t* prefix, std::size_t num) {
+    wchar_t digits[24];
+    std::swprintf(digits, sizeof(digits) / sizeof(wchar_t), L"%06zu", num);
+    return prefix + std::wstring(digits);
+}
+
+// "user000042", plus a tail of lowercase letters as long as `shape` asks: ASCII ones, or in a
+// `non_ascii` percentage of the names Latin, Cyrillic, Greek or CJK ones (two and three bytes in UTF-8)
+std::wstring Shaped(const wchar_t* prefix, std::size_t num, const StandIn::Shape& shape, std::mt19937& rng) {
+    std::wstring name = Numbered(prefix, num);
+    if(!shape.name_len && !shape.non_ascii) {
+        return name;
+    }
+    static const wchar_t ASCII[] = L"abcdefghijklmnopqrstuvwxyz";
+    static const wchar_t OTHER[] = L"\u00e4\u00f6\u00fc\u00df\u00e9\u00e8\u00e7\u00f1\u00f8\u00e5\u0142\u017c\u0161\u017e"
+                                   L"\u0436\u0449\u044e\u044f\u0434\u043b\u03bb\u03c9\u65e5\u672c\u540d\u524d";
+    std::uniform_int_distribution<std::size_t> length(0u, 2u * shape.name_len);
+    std::uniform_int_distribution<unsigned int> percent(0u, 99u);
+    const bool other = percent(rng) < shape.non_ascii;
+    const wchar_t* alphabet = other ? OTHER : ASCII;
+    std::uniform_int_distribution<std::size_t> pick(0u, (other ? sizeof(OTHER) : sizeof(ASCII)) / sizeof(wchar_t) - 2u);
+    std::size_t tail = length(rng);
+    for(tail += other && !tail; tail; --tail) {
+        name += alphabet[pick(rng)];
+    }
+    return name;
+}
+
+void FillUser0(const StandIn::User& usr, USER_INFO_0& out, Strings& str) {
+    out.usri0_name = str(usr.name);
+}
+
+void FillUser20(const StandIn::User& usr, USER_INFO_20& out, Strings& str) {
+    out.usri20_name = str(usr.name);
+    out.usri20_full_name = str(usr.full_name);
+    out.usri20_comment = str(std::wstring());
+    out.usri20_flags = 0x0201u; // UF_SCRIPT | UF_NORMAL_ACCOUNT
+    out.usri20_user_id = usr.rid;
+}
+
+void FillUser3(const StandIn::User& usr, USER_INFO_3& out, Strings& str) {
+    static const std::wstring none;
+    out.usri3_name = str(usr.name);
+    out.usri3_priv = usr.priv;
+    out.usri3_home_dir = str(none);
+    out.usri3_comment = str(none);
+    out.usri3_script_path = str(none);
+    out.usri3_full_name = str(usr.full_name);
+    out.usri3_usr_comment = str(none);
+    out.usri3_parms = str(none);
+    out.usri3_workstations = str(none);
+    out.usri3_acct_expires = usr.acct_expires;
+    out.usri3_max_storage = ~DWORD(0);
+    out.usri3_logon_server = str(L"\\\\*");
+    out.usri3_user_id = usr.rid;
+    out.usri3_primary_group_id = usr.primary_gid;
+    out.usri3_profile = str(usr.profile);
+    out.usri3_home_dir_drive = str(none);
+    out.usri3_password_expired = usr.password_expired;
+}
+
+void FillGroup0(const StandIn::Group& grp, GROUP_INFO_0& out, Strings& str) {
+    out.grpi0_name = str(grp.name);
+}
+
+void FillGroup2(const StandIn::Group& grp, GROUP_INFO_2& out, Strings& str) {
+    out.grpi2_name = str(grp.name);
+    out.grpi2_comment = str(grp.comment);
+    out.grpi2_group_id = grp.rid;
+    out.grpi2_attributes = 0x7u; // SE_GROUP_MANDATORY | SE_GROUP_ENABLED_BY_DEFAULT | SE_GROUP_ENABLED
+}
+
+void FillMember0(const std::wstring& name, GROUP_USERS_INFO_0& out, Strings& str) {
+    out.grui0_name = str(name);
+}
+
+template<typename ITEM_T>
+NET_API_STATUS PackUsers(const ITEM_T* items, std::size_t count, std::size_t& next, DWORD level, DWORD prefmaxlen,
+                    LPBYTE* bufptr, LPDWORD entriesread, LPDWORD totalentries, std::size_t* packed = nullptr) {
+    switch(level) {
+    case 0:
+        return Pack<USER_INFO_0>(items, count, next, prefmaxlen, &FillUser0, bufptr, entriesread, totalentries, packed);
+    case 20:
+        return Pack<USER_INFO_20>(items, count, next, prefmaxlen, &FillUser20, bufptr, entriesread, totalentries, packed);
+    case 3:
+        return Pack<USER_INFO_3>(items, count, next, prefmaxlen, &FillUser3, bufptr, entriesread, totalentries, packed);
+    default:
+        return ERROR_INVALID_LEVEL;
+    }
+}
+
+template<typename ITEM_T>
+NET_API_STATUS PackGroups(const ITEM_T* items, std::size_t count, std::size_t& next, DWORD level, DWORD prefmaxlen,
+                    LPBYTE* bufptr, LPDWORD entriesread, LPDWORD totalentries) {
+    switch(level) {
+    case 0:
+        return Pack<GROUP_INFO_0>(items, count, next, prefmaxlen, &FillGroup0, bufptr, entriesread, totalentries);
+    case 2:
+        return Pack<GROUP_INFO_2>(items, count, next, prefmaxlen, &FillGroup2, bufptr, entriesread, totalentries);
+    default:
+        return ERROR_INVALID_LEVEL;
+    }
+}
+
+} // anonymous
+
+namespace wusers_impl {
+
+void StandIn::Populate(const Shape& shape) {
+    Clear();
+    SetLatency(shape.latency);
+
+    std::mt19937 rng(shape.seed);
+    std::mt19937 spell(shape.seed + 1u); // names have a stream of their own
+    const DWORD NONE = 513u;
+    AddUser({L"Administrator", L"", L"", 500u, NONE, USER_PRIV_ADMIN, TIMEQ_FOREVER, false});
+    AddUser({L"Guest", L"", L"", 501u, NONE, USER_PRIV_GUEST, TIMEQ_FOREVER, false});
+    for(std::size_t i = 0; i < shape.users; ++i) {
+        AddUser({Shaped(L"user", i, shape, spell), L"Test User " + std::to_wstring(i), L"",
+                static_cast<DWORD>(1000u + i), NONE, USER_PRIV_USER, TIMEQ_FOREVER, false});
+    }
+
+    Group none{L"None", L"Ordinary users", NONE, {}};
+    for(const User& usr : users) {
+        none.members.push_back(usr.name);
+    }
+    AddGroup(none);
+    std::uniform_int_distribution<std::size_t> pick(0u, users.size() - 1u);
+    for(std::size_t i = 0; i < shape.groups; ++i) {
+        Group grp{Shaped(L"group", i, shape, spell), L"", static_cast<DWORD>(1000u + shape.users + i), {}};
+        std::unordered_set<std::size_t> taken;
+        while(taken.size() < std::min(shape.fanout, users.size())) {
+            std::size_t who = pick(rng);
+            if(taken.insert(who).second) {
+                grp.members.push_back(users[who].name);
+            }
+        }
+        AddGroup(grp);
+    }
+
+    const std::wstring& logon = users[shape.users ? 2u : 0u].name;
+    const std::wstring home = L"C:\\Users\\";
+    AddDirectory(L"C:\\Users");
+    for(const User& usr : users) {
+        AddDirectory(home + usr.name);
+    }
+    SetEnv(L"USERNAME", logon);
+    SetEnv(L"USERPROFILE", home + logon);
+    SetEnv(L"ComSpec", L"C:\\Windows\\system32\\cmd.exe");
+    SetIdentity(logon);
+}
+
+void StandIn::Clear() {
+    std::lock_guard<std::mutex> lock(mtx);
+    users.clear();
+    groups.clear();
+    user_at.clear();
+    group_at.clear();
+    env.clear();
+    dirs.clear();
+    identity.clear();
+}
+
+void StandIn::AddUser(const User& user) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto itr = user_at.emplace(Fold(user.name), users.size());
+    if(itr.second) {
+        users.push_back(user);
+    } else {
+        users[itr.first->second] = user;
+    }
+}
+
+void StandIn::AddGroup(const Group& group) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto itr = group_at.emplace(Fold(group.name), groups.size());
+    if(itr.second) {
+        groups.push_back(group);
+    } else {
+        groups[itr.first->second] = group;
+    }
+}
+
+bool StandIn::RemoveUser(const std::wstring& name) {
+    std::lock_guard<std::mutex> lock(mtx);
+    const std::wstring key = Fold(name);
+    auto itr = user_at.find(key);
+    if(itr == user_at.end()) {
+        return false;
+    }
+    users.erase(users.begin() + itr->second);
+    user_at.clear();
+    for(std::size_t i = 0; i < users.size(); ++i) {
+        user_at.emplace(Fold(users[i].name), i);
+    }
+    for(Group& grp : groups) {
+        grp.members.erase(std::remove_if(grp.members.begin(), grp.members.end(),
+            [&key](const std::wstring& member) { return Fold(member) == key; }), grp.members.end());
+    }
+    return true;
+}
+
+bool StandIn::RemoveGroup(const std::wstring& name) {
+    std::lock_guard<std::mutex> lock(mtx);
+    auto itr = group_at.find(Fold(name));
+    if(itr == group_at.end()) {
+        return false;
+    }
+    groups.erase(groups.begin() + itr->second);
+    group_at.clear();
+    for(std::size_t i = 0; i < groups.size(); ++i) {
+        group_at.emplace(Fold(groups[i].name), i);
+    }
+    return true;
+}
+
+void StandIn::SetEnv(const std::wstring& name, const std::wstring& value) {
+    std::lock_guard<std::mutex> lock(mtx);
+    env[Fold(name)] = value;
+}
+
+void StandIn::AddDirectory(const std::wstring& path) {
+    std::lock_guard<std::mutex> lock(mtx);
+    dirs.insert(Fold(path));
+}
+
+void StandIn::SetIdentity(const std::wstring& name) {
+    std::lock_guard<std::mutex> lock(mtx);
+    identity = name;
+}
+
+void StandIn::SetLatency(std::chrono::microseconds per_call) {
+    latency_us = per_call.count();
+}
+
+StandIn::Counts StandIn::counts() const {
+    return {calls.user_enum, calls.user_get_info, calls.group_enum, calls.group_get_info, calls.group_get_users,
+            calls.expand_environment, calls.file_attributes, calls.list_directories, calls.user_name_sam,
+            calls.token_rids, calls.user_info_bytes};
+}
+
+void StandIn::ResetCounts() {
+    calls.user_enum = 0u;
+    calls.user_get_info = 0u;
+    calls.group_enum = 0u;
+    calls.group_get_info = 0u;
+    calls.group_get_users = 0u;
+    calls.expand_environment = 0u;
+    calls.file_attributes = 0u;
+    calls.list_directories = 0u;
+    calls.user_name_sam = 0u;
+    calls.token_rids = 0u;
+    calls.user_info_bytes = 0u;
+}
+
+void StandIn::pause() const {
+    long long us = latency_us;
+    if(us > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(us));
+    }
+}
+
+NET_API_STATUS StandIn::UserEnum(LPCWSTR, DWORD level, DWORD, LPBYTE* bufptr, DWORD prefmaxlen,
+                        LPDWORD entriesread, LPDWORD totalentries, LPDWORD resume_handle) {
+    ++calls.user_enum;
+    pause();
+    std::lock_guard<std::mutex> lock(mtx);
+    std::size_t next = resume_handle ? *resume_handle : 0u;
+    NET_API_STATUS status = PackUsers(users.data(), users.size(), next, level, prefmaxlen,
+                                        bufptr, entriesread, totalentries);
+    if(resume_handle) *resume_handle = next < users.size() ? next : 0u;
+    return status;
+}
+
+NET_API_STATUS StandIn::UserGetInfo(LPCWSTR, LPCWSTR username, DWORD level, LPBYTE* bufptr) {
+    ++calls.user_get_info;
+    pause();
+    std::lock_guard<std::mutex> lock(mtx);
+    *bufptr = nullptr;
+    auto itr = user_at.find(Fold(username));
+    if(itr == user_at.end()) {
+        return NERR_UserNotFound;
+    }
+    std::size_t next = 0u;
+    DWORD read;
+    std::size_t packed = 0u;
+    NET_API_STATUS status = PackUsers(&users[itr->second], 1u, next, level, MAX_PREFERRED_LENGTH, bufptr, &read, nullptr, &packed);
+    calls.user_info_bytes += packed;
+    return status;
+}
+
+NET_API_STATUS StandIn::GroupEnum(LPCWSTR, DWORD level, LPBYTE* bufptr, DWORD prefmaxlen,
+                        LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) {
+    ++calls.group_enum;
+    pause();
+    std::lock_guard<std::mutex> lock(mtx);
+    std::size_t next = resume_handle ? *resume_handle : 0u;
+    NET_API_STATUS status = PackGroups(groups.data(), groups.size(), next, level, prefmaxlen,
+                                        bufptr, entriesread, totalentries);
+    if(resume_handle) *resume_handle = next < groups.size() ? next : 0u;
+    return status;
+}
+
+NET_API_STATUS StandIn::GroupGetInfo(LPCWSTR, LPCWSTR groupname, DWORD level, LPBYTE* bufptr) {
+    ++calls.group_get_info;
+    pause();
+    std::lock_guard<std::mutex> lock(mtx);
+    *bufptr = nullptr;
+    auto itr = group_at.find(Fold(groupname));
+    if(itr == group_at.end()) {
+        return NERR_GroupNotFound;
+    }
+    std::size_t next = 0u;
+    DWORD read;
+    return PackGroups(&groups[itr->second], 1u, next, level, MAX_PREFERRED_LENGTH, bufptr, &read, nullptr);
+}
+
+NET_API_STATUS StandIn::GroupGetUsers(LPCWSTR, LPCWSTR groupname, DWORD level, LPBYTE* bufptr,
+                        DWORD prefmaxlen, LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) {
+    ++calls.group_get_users;
+    pause();
+    std::lock_guard<std::mutex> lock(mtx);
+    *bufptr = nullptr;
+    auto itr = group_at.find(Fold(groupname));
+    if(itr == group_at.end()) {
+        return NERR_GroupNotFound;
+    }
+    if(level) {
+        return ERROR_INVALID_LEVEL;
+    }
+    const std::vector<std::wstring>& members = groups[itr->second].members;
+    std::size_t next = resume_handle ? *resume_handle : 0u;
+    NET_API_STATUS status = Pack<GROUP_USERS_INFO_0>(members.data(), members.size(), next, prefmaxlen,
+                                        &FillMember0, bufptr, entriesread, totalentries);
+    if(resume_handle) *resume_handle = next < members.size() ? next : 0u;
+    return status;
+}
+
+NET_API_STATUS StandIn::BufferFree(LPVOID buffer) {
+    std::free(buffer);
+    return NERR_Success;
+}
+
+DWORD StandIn::ExpandEnvironment(LPCWSTR src, LPWSTR dst, DWORD size) {
+    ++calls.expand_environment;
+    std::wstring out;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        const wchar_t* chr = src;
+        while(*chr) {
+            const wchar_t* end = L'%' == *chr ? std::wcschr(chr + 1, L'%') : nullptr;
+            if(end) {
+                auto itr = env.find(Fold(std::wstring(chr + 1, end)));
+                if(itr != env.end()) {
+                    out += itr->second;
+                } else { // unknown %NAMES% are kept verbatim
+                    out.append(chr, end + 1);
+                }
+                chr = end + 1;
+            } else {
+                out.push_back(*chr++);
+            }
+        }
+    }
+    DWORD required = out.size() + 1u;
+    if(dst && size >= required) {
+        std::wmemcpy(dst, out.c_str(), required);
+    }
+    return required;
+}
+
+DWORD StandIn::FileAttributes(LPCWSTR path) {
+    ++calls.file_attributes;
+    std::lock_guard<std::mutex> lock(mtx);
+    return dirs.count(Fold(path)) ? FILE_ATTRIBUTE_DIRECTORY : INVALID_FILE_ATTRIBUTES;
+}
+
+bool StandIn::ListDirectories(LPCWSTR path, std::vector<std::wstring>& names) {
+    ++calls.list_directories;
+    std::lock_guard<std::mutex> lock(mtx);
+    const std::wstring parent = Fold(path) + L'\\';
+    if(!dirs.count(Fold(path))) {
+        return false;
+    }
+    for(const std::wstring& dir : dirs) { // folded, as FileAttributes() sees them
+        if(!dir.compare(0, parent.size(), parent) && dir.find(L'\\', parent.size()) == std::wstring::npos) {
+            names.push_back(dir.substr(parent.size()));
+        }
+    }
+    return true;
+}
+
+DWORD StandIn::UserNameSam(LPWSTR name, PULONG size) {
+    ++calls.user_name_sam;
+    std::lock_guard<std::mutex> lock(mtx);
+    if(identity.empty()) {
+        return ERROR_NONE_MAPPED;
+    }
+    const std::wstring sam = DOMAIN + identity;
+    if(*size <= sam.size()) {
+        *size = sam.size() + 1u;
+        return ERROR_MORE_DATA;
+    }
+    std::wmemcpy(name, sam.c_str(), sam.size() + 1u);
+    *size = sam.size();
+    return ERROR_SUCCESS;
+}
+
+DWORD StandIn::TokenRids(LPDWORD user_rid, LPDWORD group_rid) {
+    ++calls.token_rids;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto itr = user_at.find(Fold(identity));
+    if(itr == user_at.end()) {
+        return ERROR_NONE_MAPPED;
+    }
+    *user_rid = users[itr->second].rid;
+    *group_rid = users[itr->second].primary_gid;
+    return ERROR_SUCCESS;
+}
+
+} // namespace wusers_impl
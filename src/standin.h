@@ -0,0 +1,149 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _STANDIN_H_
+#define _STANDIN_H_
+
+#include "backend.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace wusers_impl {
+
+// In-memory directory that answers the NetAPI calls the way a (very obedient)
+// domain controller would: same levels, same packed buffers, same paging and
+// the same status codes. Lets the lookup paths be profiled at production scale
+// on any host. Thread-safe; the injected latency is slept outside of the lock.
+class StandIn : public Backend
+{
+public:
+    struct User {
+        std::wstring name;
+        std::wstring full_name;
+        std::wstring profile; // usri3_profile; servers only, so usually empty
+        DWORD rid;
+        DWORD primary_gid;
+        DWORD priv;
+        DWORD acct_expires;
+        bool password_expired;
+    };
+
+    struct Group {
+        std::wstring name;
+        std::wstring comment;
+        DWORD rid;
+        std::vector<std::wstring> members;
+    };
+
+    // fixture generator parameters, see Populate()
+    struct Shape {
+        std::size_t users = 10u;     // ordinary accounts, on top of Administrator and Guest
+        std::size_t groups = 4u;     // ordinary groups, on top of "None" (which has everyone)
+        std::size_t fanout = 8u;     // members per ordinary group
+        std::size_t name_len = 0u;   // extra characters after the number: 0 to twice this many
+        unsigned int non_ascii = 0u; // percentage of ordinary names whose extra characters aren't ASCII
+        std::chrono::microseconds latency{0};
+        unsigned int seed = 1u;
+    };
+
+    // directory and host calls served since the last ResetCounts()
+    struct Counts {
+        unsigned long user_enum;
+        unsigned long user_get_info;
+        unsigned long group_enum;
+        unsigned long group_get_info;
+        unsigned long group_get_users;
+        unsigned long expand_environment;
+        unsigned long file_attributes;
+        unsigned long list_directories;
+        unsigned long user_name_sam;
+        unsigned long token_rids;
+        unsigned long user_info_bytes; // the size of what UserGetInfo() returned, at whatever level
+
+        unsigned long directory() const {
+            return user_enum + user_get_info + group_enum + group_get_info + group_get_users;
+        }
+    };
+
+    StandIn() = default;
+
+    // replace the directory with a generated one: Administrator (500), Guest (501)
+    // and `shape.users` users from RID 1000 up, all in "None" (513), plus `shape.groups`
+    // groups of `shape.fanout` random members each. Ordinary accounts are named "user000000",
+    // "group000000" etc., with as many extra characters as `shape.name_len` asks for. The environment and the file system
+    // are set up as if the first ordinary user (or Administrator) were logged on.
+    void Populate(const Shape& shape);
+
+    void Clear();
+    void AddUser(const User& user);
+    void AddGroup(const Group& group);
+    bool RemoveUser(const std::wstring& name);
+    bool RemoveGroup(const std::wstring& name);
+
+    // host environment: %VARIABLES%, existing directories and the logged on account
+    void SetEnv(const std::wstring& name, const std::wstring& value);
+    void AddDirectory(const std::wstring& path);
+    void SetIdentity(const std::wstring& name);
+
+    // slept on every directory call (not on host calls)
+    void SetLatency(std::chrono::microseconds per_call);
+
+    Counts counts() const;
+    void ResetCounts();
+
+    NET_API_STATUS UserEnum(LPCWSTR servername, DWORD level, DWORD filter, LPBYTE* bufptr, DWORD prefmaxlen,
+                            LPDWORD entriesread, LPDWORD totalentries, LPDWORD resume_handle) override;
+    NET_API_STATUS UserGetInfo(LPCWSTR servername, LPCWSTR username, DWORD level, LPBYTE* bufptr) override;
+    NET_API_STATUS GroupEnum(LPCWSTR servername, DWORD level, LPBYTE* bufptr, DWORD prefmaxlen,
+                            LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) override;
+    NET_API_STATUS GroupGetInfo(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr) override;
+    NET_API_STATUS GroupGetUsers(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr,
+                            DWORD prefmaxlen, LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) override;
+    NET_API_STATUS BufferFree(LPVOID buffer) override;
+    DWORD ExpandEnvironment(LPCWSTR src, LPWSTR dst, DWORD size) override;
+    DWORD FileAttributes(LPCWSTR path) override;
+    bool ListDirectories(LPCWSTR path, std::vector<std::wstring>& names) override;
+    DWORD UserNameSam(LPWSTR name, PULONG size) override;
+    DWORD TokenRids(LPDWORD user_rid, LPDWORD group_rid) override;
+
+private:
+    void pause() const;
+
+    mutable std::mutex mtx;
+    std::vector<User> users;
+    std::vector<Group> groups;
+    std::unordered_map<std::wstring, std::size_t> user_at;  // by folded name
+    std::unordered_map<std::wstring, std::size_t> group_at; // ditto
+    std::unordered_map<std::wstring, std::wstring> env;     // ditto
+    std::unordered_set<std::wstring> dirs;                  // ditto
+    std::wstring identity;
+    std::atomic<long long> latency_us{0};
+
+    struct {
+        std::atomic<unsigned long> user_enum{0};
+        std::atomic<unsigned long> user_get_info{0};
+        std::atomic<unsigned long> group_enum{0};
+        std::atomic<unsigned long> group_get_info{0};
+        std::atomic<unsigned long> group_get_users{0};
+        std::atomic<unsigned long> expand_environment{0};
+        std::atomic<unsigned long> file_attributes{0};
+        std::atomic<unsigned long> list_directories{0};
+        std::atomic<unsigned long> user_name_sam{0};
+        std::atomic<unsigned long> token_rids{0};
+        std::atomic<unsigned long> user_info_bytes{0};
+    } calls;
+};
+
+} // namespace wusers_impl
+
+#endif /* !_STANDIN_H_ */
@@ -0,0 +1,295 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "stats.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+using Counter = std::atomic<unsigned long long>;
+
+// what one thread counts; cache lines of its own, so that counting never bounces them
+struct alignas(64) Slot {
+    Counter calls[WUSER_CALL_COUNT];
+    Counter call_us[WUSER_CALL_COUNT];
+    Counter latency[WUSER_CALL_COUNT][WUSER_LATENCY_BUCKETS];
+    Counter hits[WUSER_ENTRY_COUNT];
+    Counter misses[WUSER_ENTRY_COUNT];
+    Counter bytes_transcoded;
+    Counter bytes_to_buffer;
+    Counter erange;
+    Counter calls_made; // all of `calls`, for Lookup
+};
+
+// only the owner writes to a slot: no need for an atomic read-modify-write
+inline void Bump(Counter& counter, unsigned long long by = 1u) {
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+// `f` on each pair of counterparts: Slot or wuser_stats, whichever way round
+template<typename A, typename B, typename F>
+void Zip(A& a, B& b, F f) {
+    for(int c = 0; c < WUSER_CALL_COUNT; ++c) {
+        f(a.calls[c], b.calls[c]);
+        f(a.call_us[c], b.call_us[c]);
+        for(int k = 0; k < WUSER_LATENCY_BUCKETS; ++k) {
+            f(a.latency[c][k], b.latency[c][k]);
+        }
+    }
+    for(int e = 0; e < WUSER_ENTRY_COUNT; ++e) {
+        f(a.hits[e], b.hits[e]);
+        f(a.misses[e], b.misses[e]);
+    }
+    f(a.bytes_transcoded, b.bytes_transcoded);
+    f(a.bytes_to_buffer, b.bytes_to_buffer);
+    f(a.erange, b.erange);
+}
+
+void Add(wuser_stats& sum, const Slot& slot) {
+    Zip(sum, slot, [](unsigned long long& to, const Counter& from) { to += from.load(std::memory_order_relaxed); });
+}
+
+void Subtract(wuser_stats& from, const wuser_stats& what) {
+    Zip(from, what, [](unsigned long long& to, const unsigned long long& sub) { to -= sub; });
+}
+
+// The slots of all live threads, and what exited threads have left behind.
+struct Registry {
+    std::mutex mtx;
+    std::vector<Slot*> live;
+    Slot retired{}; // also counts into, under `mtx`, for threads past their teardown
+    wuser_stats baseline{};
+
+    wuser_stats total() {
+        wuser_stats sum{};
+        for(const Slot* slot : live) {
+            Add(sum, *slot);
+        }
+        Add(sum, retired);
+        return sum;
+    }
+};
+
+// never destroyed: threads may exit (and retire their slots) during static destruction
+Registry& registry() {
+    static Registry* const instance = new Registry();
+    return *instance;
+}
+
+static thread_local Slot* mine = nullptr;
+static thread_local bool gone = false;
+
+// hands this thread's counts over to Registry::retired when it exits
+struct Retire {
+    bool armed = false;
+
+    ~Retire() {
+        if(!armed) return;
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mtx);
+        Zip(r.retired, *mine, [](Counter& to, const Counter& from) { Bump(to, from.load(std::memory_order_relaxed)); });
+        r.live.erase(std::find(r.live.begin(), r.live.end(), mine));
+        delete mine;
+        mine = nullptr;
+        gone = true;
+    }
+};
+
+static thread_local Retire retire;
+
+Slot* Enroll() {
+    Slot* slot = new Slot();
+    Registry& r = registry();
+    {
+        std::lock_guard<std::mutex> lock(r.mtx);
+        r.live.push_back(slot);
+    }
+    retire.armed = true;
+    return mine = slot;
+}
+
+template<typename F>
+void Count(F add) {
+    if(Slot* slot = mine ? mine : gone ? nullptr : Enroll()) {
+        add(*slot);
+    } else {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mtx);
+        add(r.retired);
+    }
+}
+
+std::size_t Bucket(unsigned long long us) {
+    std::size_t k = 0u;
+    while(us >= 2u && k + 1u < WUSER_LATENCY_BUCKETS) {
+        us >>= 1;
+        ++k;
+    }
+    return k;
+}
+
+template<typename R, typename F>
+R Timed(int call, F forward) {
+    const auto start = std::chrono::steady_clock::now();
+    R result = forward();
+    wusers_impl::count_call(call, std::chrono::steady_clock::now() - start);
+    return result;
+}
+
+const char* const CALL_NAMES[WUSER_CALL_COUNT] = {
+    "NetUserGetInfo", "NetUserEnum", "NetGroupGetInfo", "NetGroupEnum", "NetGroupGetUsers",
+    "GetUserNameExW", "ExpandEnvironmentStringsW", "GetFileAttributesW", "FindFirstFileExW",
+    "GetTokenInformation",
+};
+
+const char* const ENTRY_NAMES[WUSER_ENTRY_COUNT] = {
+    "getpwnam", "getpwuid", "getpwnam_r", "getpwuid_r", "getpwent", "uid_from_user", "user_from_uid", "user batch",
+    "user fields", "user cursor",
+    "getgrnam", "getgrgid", "getgrnam_r", "getgrgid_r", "getgrent", "gid_from_group", "group_from_gid", "group batch",
+    "group cursor",
+    "getgrouplist",
+};
+
+} // anonymous
+
+namespace wusers_impl {
+
+void count_call(int call, std::chrono::steady_clock::duration took) {
+    const unsigned long long us = std::chrono::duration_cast<std::chrono::microseconds>(took).count();
+    Count([call, us](Slot& slot) {
+        Bump(slot.calls[call]);
+        Bump(slot.call_us[call], us);
+        Bump(slot.latency[call][Bucket(us)]);
+        Bump(slot.calls_made);
+    });
+}
+
+void count_lookup(int entry, bool hit) {
+    Count([entry, hit](Slot& slot) { Bump(hit ? slot.hits[entry] : slot.misses[entry]); });
+}
+
+void count_transcoded(std::size_t bytes) {
+    Count([bytes](Slot& slot) { Bump(slot.bytes_transcoded, bytes); });
+}
+
+void count_to_buffer(std::size_t bytes) {
+    Count([bytes](Slot& slot) { Bump(slot.bytes_to_buffer, bytes); });
+}
+
+void count_erange() {
+    Count([](Slot& slot) { Bump(slot.erange); });
+}
+
+unsigned long long calls_made() {
+    return mine ? mine->calls_made.load(std::memory_order_relaxed) : 0u;
+}
+
+Lookup::~Lookup() {
+    const int error = errno;
+    count_lookup(entry, calls_made() == before);
+    if(ERANGE == error) {
+        count_erange();
+    }
+}
+
+NET_API_STATUS Metered::UserEnum(LPCWSTR servername, DWORD level, DWORD filter, LPBYTE* bufptr, DWORD prefmaxlen,
+                        LPDWORD entriesread, LPDWORD totalentries, LPDWORD resume_handle) {
+    return Timed<NET_API_STATUS>(WUSER_CALL_USER_ENUM, [&]() {
+        return target().UserEnum(servername, level, filter, bufptr, prefmaxlen, entriesread, totalentries, resume_handle);
+    });
+}
+
+NET_API_STATUS Metered::UserGetInfo(LPCWSTR servername, LPCWSTR username, DWORD level, LPBYTE* bufptr) {
+    return Timed<NET_API_STATUS>(WUSER_CALL_USER_GET_INFO, [&]() {
+        return target().UserGetInfo(servername, username, level, bufptr);
+    });
+}
+
+NET_API_STATUS Metered::GroupEnum(LPCWSTR servername, DWORD level, LPBYTE* bufptr, DWORD prefmaxlen,
+                        LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) {
+    return Timed<NET_API_STATUS>(WUSER_CALL_GROUP_ENUM, [&]() {
+        return target().GroupEnum(servername, level, bufptr, prefmaxlen, entriesread, totalentries, resume_handle);
+    });
+}
+
+NET_API_STATUS Metered::GroupGetInfo(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr) {
+    return Timed<NET_API_STATUS>(WUSER_CALL_GROUP_GET_INFO, [&]() {
+        return target().GroupGetInfo(servername, groupname, level, bufptr);
+    });
+}
+
+NET_API_STATUS Metered::GroupGetUsers(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr,
+                        DWORD prefmaxlen, LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) {
+    return Timed<NET_API_STATUS>(WUSER_CALL_GROUP_GET_USERS, [&]() {
+        return target().GroupGetUsers(servername, groupname, level, bufptr, prefmaxlen, entriesread, totalentries, resume_handle);
+    });
+}
+
+NET_API_STATUS Metered::BufferFree(LPVOID buffer) {
+    return target().BufferFree(buffer); // local; not worth a count
+}
+
+DWORD Metered::ExpandEnvironment(LPCWSTR src, LPWSTR dst, DWORD size) {
+    return Timed<DWORD>(WUSER_CALL_EXPAND_ENVIRONMENT, [&]() { return target().ExpandEnvironment(src, dst, size); });
+}
+
+DWORD Metered::FileAttributes(LPCWSTR path) {
+    return Timed<DWORD>(WUSER_CALL_FILE_ATTRIBUTES, [&]() { return target().FileAttributes(path); });
+}
+
+bool Metered::ListDirectories(LPCWSTR path, std::vector<std::wstring>& names) {
+    return Timed<bool>(WUSER_CALL_LIST_DIRECTORIES, [&]() { return target().ListDirectories(path, names); });
+}
+
+DWORD Metered::UserNameSam(LPWSTR name, PULONG size) {
+    return Timed<DWORD>(WUSER_CALL_USER_NAME_SAM, [&]() { return target().UserNameSam(name, size); });
+}
+
+DWORD Metered::TokenRids(LPDWORD user_rid, LPDWORD group_rid) {
+    return Timed<DWORD>(WUSER_CALL_TOKEN_RIDS, [&]() { return target().TokenRids(user_rid, group_rid); });
+}
+
+std::wstring Metered::LoginShell(LPCWSTR username) {
+    return target().LoginShell(username); // from the files backend, which has already been counted
+}
+
+} // namespace wusers_impl
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void wuser_stats_snapshot(struct wuser_stats* out) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    *out = r.total();
+    Subtract(*out, r.baseline);
+}
+
+void wuser_stats_reset(void) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    r.baseline = r.total();
+}
+
+const char* wuser_stats_call_name(int call) {
+    return call >= 0 && call < WUSER_CALL_COUNT ? CALL_NAMES[call] : nullptr;
+}
+
+const char* wuser_stats_entry_name(int entry) {
+    return entry >= 0 && entry < WUSER_ENTRY_COUNT ? ENTRY_NAMES[entry] : nullptr;
+}
+
+#ifdef __cplusplus
+}
+#endif
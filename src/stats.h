@@ -0,0 +1,79 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include "wusers/wuser_stats.h"
+#include "backend.h"
+
+#include <chrono>
+#include <cstddef>
+
+namespace wusers_impl {
+
+// The counters behind wusers/wuser_stats.h. Each thread writes to a slot of its own
+// (relaxed loads and stores, no read-modify-write), and readers add the slots up.
+
+void count_call(int call, std::chrono::steady_clock::duration took);
+
+void count_lookup(int entry, bool hit);
+
+void count_transcoded(std::size_t bytes);
+
+void count_to_buffer(std::size_t bytes);
+
+void count_erange();
+
+// backend calls made by this thread so far; see Lookup
+unsigned long long calls_made();
+
+// Counts one call to a public entry point: a hit unless the calling thread has made
+// a backend call in the meantime, and an ERANGE if that's what errno ends up as.
+class Lookup {
+public:
+    explicit Lookup(int entry) : entry(entry), before(calls_made()) {}
+    ~Lookup();
+
+    Lookup(const Lookup&) = delete;
+    Lookup& operator=(const Lookup&) = delete;
+
+private:
+    const int entry;
+    const unsigned long long before;
+};
+
+// The backend as seen by the rest of the library: forwards to `target()`, timing and
+// counting the directory and host calls on the way.
+class Metered : public Backend
+{
+public:
+    explicit Metered(Backend& (*target)()) : target(target) {}
+
+    NET_API_STATUS UserEnum(LPCWSTR servername, DWORD level, DWORD filter, LPBYTE* bufptr, DWORD prefmaxlen,
+                            LPDWORD entriesread, LPDWORD totalentries, LPDWORD resume_handle) override;
+    NET_API_STATUS UserGetInfo(LPCWSTR servername, LPCWSTR username, DWORD level, LPBYTE* bufptr) override;
+    NET_API_STATUS GroupEnum(LPCWSTR servername, DWORD level, LPBYTE* bufptr, DWORD prefmaxlen,
+                            LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) override;
+    NET_API_STATUS GroupGetInfo(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr) override;
+    NET_API_STATUS GroupGetUsers(LPCWSTR servername, LPCWSTR groupname, DWORD level, LPBYTE* bufptr,
+                            DWORD prefmaxlen, LPDWORD entriesread, LPDWORD totalentries, PDWORD_PTR resume_handle) override;
+    NET_API_STATUS BufferFree(LPVOID buffer) override;
+    DWORD ExpandEnvironment(LPCWSTR src, LPWSTR dst, DWORD size) override;
+    DWORD FileAttributes(LPCWSTR path) override;
+    bool ListDirectories(LPCWSTR path, std::vector<std::wstring>& names) override;
+    DWORD UserNameSam(LPWSTR name, PULONG size) override;
+    DWORD TokenRids(LPDWORD user_rid, LPDWORD group_rid) override;
+    std::wstring LoginShell(LPCWSTR username) override;
+
+private:
+    Backend& (* const target)();
+};
+
+} // namespace wusers_impl
+
+#endif /* !_STATS_H_ */
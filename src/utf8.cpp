@@ -0,0 +1,439 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#include "utf8.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WUSERS_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WUSERS_SSE2 1
+#endif
+
+namespace {
+
+constexpr bool UTF16 = sizeof(wchar_t) == 2u;
+
+// wchar_t as an unsigned code unit (it is signed on some platforms)
+using Unit = std::conditional<UTF16, std::uint16_t, std::uint32_t>::type;
+
+// What a single character or byte adds to a length. In UTF-16, surrogates count two bytes
+// each, so that a pair counts four. Invalid input is counted somehow; it won't convert.
+inline std::size_t NarrowCount(Unit chr) {
+    return chr < 0x80u ? 1u : chr < 0x800u ? 2u : UTF16 && chr - 0xD800u < 0x800u ? 2u : chr < 0x10000u ? 3u : 4u;
+}
+
+// one per byte that isn't a continuation byte; a second one for the four-byte leads in UTF-16
+inline std::size_t WidenCount(unsigned char byte) {
+    return (0x80u != (byte & 0xC0u)) + (UTF16 && byte >= 0xF0u);
+}
+
+// Blocks of BLOCK wide characters or bytes: their length in the other encoding; are they
+// all ASCII; if so, convert them. The vector versions do without per-character branches.
+
+#if WUSERS_AVX2 || WUSERS_SSE2
+inline std::size_t Sum(__m128i lanes) { // two 64-bit lanes
+    lanes = _mm_add_epi64(lanes, _mm_unpackhi_epi64(lanes, lanes));
+#if defined(_M_X64) || defined(__x86_64__)
+    return static_cast<std::size_t>(_mm_cvtsi128_si64(lanes));
+#else
+    return static_cast<std::size_t>(_mm_cvtsi128_si32(lanes));
+#endif
+}
+#endif
+
+#if WUSERS_AVX2
+constexpr std::size_t BLOCK = 32u;
+
+inline __m256i Load(const void* at, std::size_t k = 0u) {
+    return _mm256_loadu_si256(static_cast<const __m256i*>(at) + k);
+}
+
+inline std::uint32_t Mask(__m256i lanes) {
+    return static_cast<std::uint32_t>(_mm256_movemask_epi8(lanes));
+}
+
+// Lengths of whole blocks: compare results are -1 per lane, and add up to how far each
+// character is from 3 bytes (4 in UTF-32), or to minus one per wide character. The lanes
+// are widened to 64 bits (bytes) or 32 bits (wide characters) as they go, and only added
+// up across at the end.
+
+inline std::size_t Sum(__m256i lanes) { // four 64-bit lanes
+    return Sum(_mm_add_epi64(_mm256_castsi256_si128(lanes), _mm256_extracti128_si256(lanes, 1)));
+}
+
+inline std::size_t NarrowBlocksLength(const wchar_t* in, std::size_t blocks) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i less = zero; // 64-bit lanes
+    for(std::size_t b = 0u; b < blocks; ++b, in += BLOCK) {
+        __m256i block = zero;
+        for(std::size_t k = 0u; k < sizeof(wchar_t); ++k) {
+            const __m256i v = Load(in, k);
+            if(UTF16) { // less one below 0x80, one below 0x800, one per surrogate
+                const __m256i top5 = _mm256_and_si256(v, _mm256_set1_epi16(static_cast<short>(0xF800)));
+                block = _mm256_add_epi16(block, _mm256_cmpeq_epi16(_mm256_and_si256(v, _mm256_set1_epi16(static_cast<short>(0xFF80))), zero));
+                block = _mm256_add_epi16(block, _mm256_cmpeq_epi16(top5, zero));
+                block = _mm256_add_epi16(block, _mm256_cmpeq_epi16(top5, _mm256_set1_epi16(static_cast<short>(0xD800))));
+            } else { // less one below 0x80, one below 0x800, one below 0x10000
+                block = _mm256_add_epi32(block, _mm256_cmpgt_epi32(_mm256_set1_epi32(0x80), v));
+                block = _mm256_add_epi32(block, _mm256_cmpgt_epi32(_mm256_set1_epi32(0x800), v));
+                block = _mm256_add_epi32(block, _mm256_cmpgt_epi32(_mm256_set1_epi32(0x10000), v));
+            }
+        }
+        // negate, and widen: 16 to 32 bits pairwise in UTF-16, then 32 to 64
+        block = UTF16 ? _mm256_madd_epi16(block, _mm256_set1_epi16(-1)) : _mm256_sub_epi32(zero, block);
+        less = _mm256_add_epi64(less, _mm256_add_epi64(_mm256_unpacklo_epi32(block, zero), _mm256_unpackhi_epi32(block, zero)));
+    }
+    return (UTF16 ? 3u : 4u) * BLOCK * blocks - Sum(less);
+}
+
+inline std::size_t WidenBlocksLength(const char* in, std::size_t blocks) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lead4 = _mm256_set1_epi8(static_cast<char>(0xF0));
+    __m256i count = zero;
+    for(std::size_t b = 0u; b < blocks; ++b, in += BLOCK) {
+        const __m256i v = Load(in);
+        __m256i ones = _mm256_cmpgt_epi8(v, _mm256_set1_epi8(-65)); // not 0x80-0xBF
+        if(UTF16) { // 0xF0 and up, once more
+            ones = _mm256_add_epi8(ones, _mm256_cmpeq_epi8(_mm256_max_epu8(v, lead4), v));
+        }
+        count = _mm256_add_epi64(count, _mm256_sad_epu8(_mm256_sub_epi8(zero, ones), zero));
+    }
+    return Sum(count);
+}
+
+inline bool AsciiWide(const wchar_t* in) {
+    const __m256i high = UTF16 ? _mm256_set1_epi16(static_cast<short>(0xFF80))
+                               : _mm256_set1_epi32(static_cast<int>(0xFFFFFF80u));
+    __m256i any = Load(in, 0u);
+    for(std::size_t k = 1u; k < sizeof(wchar_t); ++k) {
+        any = _mm256_or_si256(any, Load(in, k));
+    }
+    return _mm256_testz_si256(any, high);
+}
+
+inline bool AsciiBytes(const char* in) {
+    return !Mask(Load(in));
+}
+
+inline void NarrowBlock(const wchar_t* in, char* out) {
+    __m256i packed;
+    if(UTF16) {
+        // packing works within 128-bit lanes; the permutation puts the quarters back in order
+        packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(Load(in, 0u), Load(in, 1u)), 0xD8);
+    } else {
+        const __m256i lo = _mm256_packs_epi32(Load(in, 0u), Load(in, 1u));
+        const __m256i hi = _mm256_packs_epi32(Load(in, 2u), Load(in, 3u));
+        packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi), _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), packed);
+}
+
+inline void WidenBlock(const char* in, wchar_t* out) {
+    __m256i* at = reinterpret_cast<__m256i*>(out);
+    if(UTF16) {
+        for(std::size_t k = 0u; k < 2u; ++k) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16u * k));
+            _mm256_storeu_si256(at + k, _mm256_cvtepu8_epi16(bytes));
+        }
+    } else {
+        for(std::size_t k = 0u; k < 4u; ++k) {
+            const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + 8u * k));
+            _mm256_storeu_si256(at + k, _mm256_cvtepu8_epi32(bytes));
+        }
+    }
+}
+
+#elif WUSERS_SSE2
+constexpr std::size_t BLOCK = 16u;
+
+inline __m128i Load(const void* at, std::size_t k = 0u) {
+    return _mm_loadu_si128(static_cast<const __m128i*>(at) + k);
+}
+
+inline std::uint32_t Mask(__m128i lanes) {
+    return static_cast<std::uint32_t>(_mm_movemask_epi8(lanes));
+}
+
+// see the AVX2 version
+
+inline std::size_t NarrowBlocksLength(const wchar_t* in, std::size_t blocks) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i less = zero;
+    for(std::size_t b = 0u; b < blocks; ++b, in += BLOCK) {
+        __m128i block = zero;
+        for(std::size_t k = 0u; k < sizeof(wchar_t); ++k) {
+            const __m128i v = Load(in, k);
+            if(UTF16) {
+                const __m128i top5 = _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xF800)));
+                block = _mm_add_epi16(block, _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xFF80))), zero));
+                block = _mm_add_epi16(block, _mm_cmpeq_epi16(top5, zero));
+                block = _mm_add_epi16(block, _mm_cmpeq_epi16(top5, _mm_set1_epi16(static_cast<short>(0xD800))));
+            } else {
+                block = _mm_add_epi32(block, _mm_cmplt_epi32(v, _mm_set1_epi32(0x80)));
+                block = _mm_add_epi32(block, _mm_cmplt_epi32(v, _mm_set1_epi32(0x800)));
+                block = _mm_add_epi32(block, _mm_cmplt_epi32(v, _mm_set1_epi32(0x10000)));
+            }
+        }
+        block = UTF16 ? _mm_madd_epi16(block, _mm_set1_epi16(-1)) : _mm_sub_epi32(zero, block);
+        less = _mm_add_epi64(less, _mm_add_epi64(_mm_unpacklo_epi32(block, zero), _mm_unpackhi_epi32(block, zero)));
+    }
+    return (UTF16 ? 3u : 4u) * BLOCK * blocks - Sum(less);
+}
+
+inline std::size_t WidenBlocksLength(const char* in, std::size_t blocks) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lead4 = _mm_set1_epi8(static_cast<char>(0xF0));
+    __m128i count = zero;
+    for(std::size_t b = 0u; b < blocks; ++b, in += BLOCK) {
+        const __m128i v = Load(in);
+        __m128i ones = _mm_cmpgt_epi8(v, _mm_set1_epi8(-65));
+        if(UTF16) {
+            ones = _mm_add_epi8(ones, _mm_cmpeq_epi8(_mm_max_epu8(v, lead4), v));
+        }
+        count = _mm_add_epi64(count, _mm_sad_epu8(_mm_sub_epi8(zero, ones), zero));
+    }
+    return Sum(count);
+}
+
+inline bool AsciiWide(const wchar_t* in) {
+    const __m128i high = UTF16 ? _mm_set1_epi16(static_cast<short>(0xFF80))
+                               : _mm_set1_epi32(static_cast<int>(0xFFFFFF80u));
+    __m128i any = Load(in, 0u);
+    for(std::size_t k = 1u; k < sizeof(wchar_t); ++k) {
+        any = _mm_or_si128(any, Load(in, k));
+    }
+    return 0xFFFFu == Mask(_mm_cmpeq_epi8(_mm_and_si128(any, high), _mm_setzero_si128()));
+}
+
+inline bool AsciiBytes(const char* in) {
+    return !Mask(Load(in));
+}
+
+inline void NarrowBlock(const wchar_t* in, char* out) {
+    __m128i packed;
+    if(UTF16) {
+        packed = _mm_packus_epi16(Load(in, 0u), Load(in, 1u));
+    } else {
+        const __m128i lo = _mm_packs_epi32(Load(in, 0u), Load(in, 1u));
+        const __m128i hi = _mm_packs_epi32(Load(in, 2u), Load(in, 3u));
+        packed = _mm_packus_epi16(lo, hi);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), packed);
+}
+
+inline void WidenBlock(const char* in, wchar_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bytes = Load(in);
+    __m128i* at = reinterpret_cast<__m128i*>(out);
+    const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+    const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+    if(UTF16) {
+        _mm_storeu_si128(at, lo);
+        _mm_storeu_si128(at + 1, hi);
+    } else {
+        _mm_storeu_si128(at, _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128(at + 1, _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128(at + 2, _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128(at + 3, _mm_unpackhi_epi16(hi, zero));
+    }
+}
+
+#else
+constexpr std::size_t BLOCK = 8u;
+
+inline std::size_t NarrowBlocksLength(const wchar_t* in, std::size_t blocks) {
+    std::size_t len = 0u;
+    for(std::size_t k = 0u; k < BLOCK * blocks; ++k) {
+        len += NarrowCount(static_cast<Unit>(in[k]));
+    }
+    return len;
+}
+
+inline std::size_t WidenBlocksLength(const char* in, std::size_t blocks) {
+    std::size_t len = 0u;
+    for(std::size_t k = 0u; k < BLOCK * blocks; ++k) {
+        len += WidenCount(static_cast<unsigned char>(in[k]));
+    }
+    return len;
+}
+
+inline bool AsciiWide(const wchar_t* in) {
+    Unit any = 0u;
+    for(std::size_t k = 0u; k < BLOCK; ++k) {
+        any |= static_cast<Unit>(in[k]);
+    }
+    return any < 0x80u;
+}
+
+inline bool AsciiBytes(const char* in) {
+    unsigned char any = 0u;
+    for(std::size_t k = 0u; k < BLOCK; ++k) {
+        any |= static_cast<unsigned char>(in[k]);
+    }
+    return any < 0x80u;
+}
+
+inline void NarrowBlock(const wchar_t* in, char* out) {
+    for(std::size_t k = 0u; k < BLOCK; ++k) {
+        out[k] = static_cast<char>(in[k]);
+    }
+}
+
+inline void WidenBlock(const char* in, wchar_t* out) {
+    for(std::size_t k = 0u; k < BLOCK; ++k) {
+        out[k] = static_cast<wchar_t>(in[k]);
+    }
+}
+#endif
+
+// One character at a time, for what isn't a block of ASCII: converts the character at in[i]
+// and moves `i` past it, or returns nullptr if it isn't valid.
+
+inline char* NarrowOne(const wchar_t* in, std::size_t wlen, std::size_t& i, char* out) {
+    std::uint32_t chr = static_cast<Unit>(in[i++]);
+    if(chr < 0x80u) {
+        *out++ = static_cast<char>(chr);
+        return out;
+    } else if(chr < 0x800u) {
+        *out++ = static_cast<char>(0xC0u | (chr >> 6));
+        *out++ = static_cast<char>(0x80u | (chr & 0x3Fu));
+        return out;
+    } else if(chr - 0xD800u < 0x800u) {
+        // a surrogate pair; in UTF-32 surrogates aren't characters at all
+        const std::uint32_t low = UTF16 && chr < 0xDC00u && i < wlen ? static_cast<Unit>(in[i]) : 0u;
+        if(low - 0xDC00u >= 0x400u) {
+            return nullptr;
+        }
+        ++i;
+        chr = 0x10000u + ((chr - 0xD800u) << 10) + (low - 0xDC00u);
+    } else if(chr > 0x10FFFFu) {
+        return nullptr;
+    }
+    if(chr < 0x10000u) {
+        *out++ = static_cast<char>(0xE0u | (chr >> 12));
+    } else {
+        *out++ = static_cast<char>(0xF0u | (chr >> 18));
+        *out++ = static_cast<char>(0x80u | ((chr >> 12) & 0x3Fu));
+    }
+    *out++ = static_cast<char>(0x80u | ((chr >> 6) & 0x3Fu));
+    *out++ = static_cast<char>(0x80u | (chr & 0x3Fu));
+    return out;
+}
+
+inline std::uint32_t Continuation(const char* in, std::size_t at) {
+    return static_cast<unsigned char>(in[at]) ^ 0x80u; // below 0x40 if it is one
+}
+
+// rejects stray continuation bytes, overlong forms, surrogates, what is past U+10FFFF and
+// what is cut short
+inline wchar_t* WidenOne(const char* in, std::size_t len, std::size_t& i, wchar_t* out) {
+    const std::uint32_t lead = static_cast<unsigned char>(in[i]);
+    const std::size_t left = len - i;
+    std::uint32_t chr;
+    if(lead < 0x80u) {
+        chr = lead;
+        i += 1u;
+    } else if(lead < 0xC2u) { // continuation bytes; C0 and C1 can only start overlong forms
+        return nullptr;
+    } else if(lead < 0xE0u) {
+        const std::uint32_t c1 = left > 1u ? Continuation(in, i + 1u) : 0xFFu;
+        if(c1 > 0x3Fu) return nullptr;
+        chr = ((lead & 0x1Fu) << 6) | c1;
+        i += 2u;
+    } else if(lead < 0xF0u) {
+        const std::uint32_t c1 = left > 2u ? Continuation(in, i + 1u) : 0xFFu;
+        const std::uint32_t c2 = left > 2u ? Continuation(in, i + 2u) : 0xFFu;
+        chr = ((lead & 0x0Fu) << 12) | (c1 << 6) | c2;
+        if((c1 | c2) > 0x3Fu || chr < 0x800u || chr - 0xD800u < 0x800u) return nullptr;
+        i += 3u;
+    } else if(lead < 0xF5u) { // F5 and up would be past U+10FFFF
+        const std::uint32_t c1 = left > 3u ? Continuation(in, i + 1u) : 0xFFu;
+        const std::uint32_t c2 = left > 3u ? Continuation(in, i + 2u) : 0xFFu;
+        const std::uint32_t c3 = left > 3u ? Continuation(in, i + 3u) : 0xFFu;
+        chr = ((lead & 0x07u) << 18) | (c1 << 12) | (c2 << 6) | c3;
+        if((c1 | c2 | c3) > 0x3Fu || chr < 0x10000u || chr > 0x10FFFFu) return nullptr;
+        i += 4u;
+        if(UTF16) {
+            chr -= 0x10000u;
+            *out++ = static_cast<wchar_t>(0xD800u + (chr >> 10));
+            chr = 0xDC00u + (chr & 0x3FFu);
+        }
+    } else {
+        return nullptr;
+    }
+    *out++ = static_cast<wchar_t>(chr);
+    return out;
+}
+
+} // anonymous
+
+namespace wusers_impl {
+
+std::size_t utf8_narrow_length(const wchar_t* wstr, std::size_t wlen) {
+    std::size_t i = wlen - wlen % BLOCK;
+    std::size_t len = NarrowBlocksLength(wstr, wlen / BLOCK);
+    for(; i < wlen; ++i) {
+        len += NarrowCount(static_cast<Unit>(wstr[i]));
+    }
+    return len;
+}
+
+std::size_t utf8_widen_length(const char* str, std::size_t len) {
+    std::size_t i = len - len % BLOCK;
+    std::size_t wlen = WidenBlocksLength(str, len / BLOCK);
+    for(; i < len; ++i) {
+        wlen += WidenCount(static_cast<unsigned char>(str[i]));
+    }
+    return wlen;
+}
+
+// The conversions go a block at a time while the blocks are ASCII, and character by
+// character through the rest of a block that isn't.
+
+std::size_t utf8_narrow(const wchar_t* wstr, std::size_t wlen, char* out) {
+    char* const start = out;
+    for(std::size_t i = 0u; i < wlen;) {
+        if(i + BLOCK <= wlen && AsciiWide(wstr + i)) {
+            NarrowBlock(wstr + i, out);
+            out += BLOCK;
+            i += BLOCK;
+            continue;
+        }
+        for(const std::size_t stop = std::min(wlen, i + BLOCK); i < stop;) {
+            if(!(out = NarrowOne(wstr, wlen, i, out))) {
+                return UTF8_INVALID;
+            }
+        }
+    }
+    return out - start;
+}
+
+std::size_t utf8_widen(const char* str, std::size_t len, wchar_t* out) {
+    wchar_t* const start = out;
+    for(std::size_t i = 0u; i < len;) {
+        if(i + BLOCK <= len && AsciiBytes(str + i)) {
+            WidenBlock(str + i, out);
+            out += BLOCK;
+            i += BLOCK;
+            continue;
+        }
+        for(const std::size_t stop = std::min(len, i + BLOCK); i < stop;) {
+            if(!(out = WidenOne(str, len, i, out))) {
+                return UTF8_INVALID;
+            }
+        }
+    }
+    return out - start;
+}
+
+} // namespace wusers_impl
@@ -0,0 +1,35 @@
+/**
+ * This file has no copyright assigned and is placed in the public domain.
+ * This file is part of the libwusers compatibility library:
+ *   https://github.com/treeswift/libwusers
+ * No warranty is given; refer to the LICENSE file in the project root.
+ */
+
+#ifndef _UTF8_H_
+#define _UTF8_H_
+
+#include <cstddef>
+
+namespace wusers_impl {
+
+// UTF-8 from and to wchar_t strings (UTF-16 on Windows, UTF-32 elsewhere), strictly: lone or
+// misplaced surrogates, overlong forms and anything past U+10FFFF are rejected, as are
+// truncated sequences. Lengths are counted a vector at a time whatever the text; the
+// conversions go a vector at a time through ASCII and one character at a time otherwise.
+// Vectors are AVX2 where the build targets it, otherwise SSE2, otherwise plain words.
+
+constexpr std::size_t UTF8_INVALID = ~std::size_t(0);
+
+// the exact length of the conversion if the input is valid; something if it isn't (it
+// then doesn't convert, and the conversion stays within that length on its way to failing)
+std::size_t utf8_narrow_length(const wchar_t* wstr, std::size_t wlen);
+std::size_t utf8_widen_length(const char* str, std::size_t len);
+
+// convert into as much space as the respective length says: returns that length, or
+// UTF8_INVALID if the input isn't valid. No terminator is written.
+std::size_t utf8_narrow(const wchar_t* wstr, std::size_t wlen, char* out);
+std::size_t utf8_widen(const char* str, std::size_t len, wchar_t* out);
+
+} // namespace wusers_impl
+
+#endif /* !_UTF8_H_ */
@@ -6,16 +6,26 @@
  */
 
 #include "wusers/wuser_cpage.h"
+#include "wusers/wuser_cache.h" // wuser_cache_refresh_host()
+#include "wusers/wuser_range.h" // wusers::text
 #include "wus.h"
+#include "standin.h"
+#include "files.h"
+#include "stats.h"
+#include "utf8.h"
 
 #include <errno.h>
 #include <stdlib.h>
+#include <atomic>
+#include <cstdio>
 #include <cstring>
 #include <cwchar>
-#include <sstream>
+#include <cwctype>
+#include <string>
 
-#include <windows.h> // stringapiset.h, errhandlingapi.h, userenv.h
-#include <secext.h>  // GetUserNameExW
+#ifdef _WIN32
+#include <windows.h> // stringapiset.h, errhandlingapi.h
+#endif
 
 namespace {
 constexpr unsigned int WUSER_UNSET_CP = ~0u;
@@ -26,6 +36,96 @@ static volatile \
 
 static thread_local \
     unsigned int tls_cp = WUSER_UNSET_CP;
+
+static std::atomic<wusers_impl::Backend*> installed{nullptr};
+
+wusers_impl::Backend& default_backend() {
+    static wusers_impl::Backend* const files = wusers_impl::files_from_env(wusers_impl::platform_backend());
+    return files ? *files : wusers_impl::platform_backend();
+}
+
+// what backend() forwards to
+wusers_impl::Backend& unmetered_backend() {
+    wusers_impl::Backend* bkd = installed.load(std::memory_order_acquire);
+    return bkd ? *bkd : default_backend();
+}
+
+// the UTF-8 fast path: the exact length first, then the conversion proper, which validates
+std::size_t NarrowUtf8(const wchar_t* wstr, std::size_t wlen, char* out, std::size_t len, int& err) {
+    const std::size_t conv_len = wusers_impl::utf8_narrow_length(wstr, wlen);
+    if(conv_len > len) {
+        // too long if valid; ERANGE only if a bigger buffer would help
+        std::string scratch(conv_len, '\0');
+        err = wusers_impl::UTF8_INVALID == wusers_impl::utf8_narrow(wstr, wlen, &scratch[0]) ? EINVAL : ERANGE;
+        return 0u;
+    }
+    const std::size_t put = wusers_impl::utf8_narrow(wstr, wlen, out);
+    err = wusers_impl::UTF8_INVALID == put ? EINVAL : 0;
+    return err ? 0u : put;
+}
+
+std::size_t WidenUtf8(const char* str, std::size_t len, wchar_t* out, std::size_t wlen) {
+    if(wusers_impl::utf8_widen_length(str, len) > wlen) {
+        return 0u;
+    }
+    const std::size_t put = wusers_impl::utf8_widen(str, len, out);
+    return wusers_impl::UTF8_INVALID == put ? 0u : put;
+}
+
+#ifdef _WIN32
+// code page conversions are WideCharToMultiByte/MultiByteToWideChar, with the error mapped to errno;
+// UTF-8, the default, takes the fast path instead
+
+std::size_t Narrow(unsigned int cp, const wchar_t* wstr, std::size_t wlen, char* out, std::size_t len, int& err) {
+    if(WUSER_USE_UTF8 == cp) {
+        return NarrowUtf8(wstr, wlen, out, len, err);
+    }
+    int conv_len = WideCharToMultiByte(cp, 0 /* flags */, wstr, wlen, out, len, nullptr, nullptr);
+    err = conv_len ? 0 : ERROR_INSUFFICIENT_BUFFER == GetLastError() ? ERANGE : EINVAL;
+    return conv_len;
+}
+
+std::size_t Widen(unsigned int cp, const char* str, std::size_t len, wchar_t* out, std::size_t wlen) {
+    if(WUSER_USE_UTF8 == cp) {
+        return WidenUtf8(str, len, out, wlen);
+    }
+    return MultiByteToWideChar(cp, 0 /* flags */, str, len, out, wlen);
+}
+
+// the exact output lengths, if the input converts at all
+std::size_t NarrowLength(unsigned int cp, const wchar_t* wstr, std::size_t wlen) {
+    if(WUSER_USE_UTF8 == cp) {
+        return wusers_impl::utf8_narrow_length(wstr, wlen);
+    }
+    return WideCharToMultiByte(cp, 0 /* flags */, wstr, wlen, nullptr, 0, nullptr, nullptr);
+}
+
+std::size_t WidenLength(unsigned int cp, const char* str, std::size_t len) {
+    if(WUSER_USE_UTF8 == cp) {
+        return wusers_impl::utf8_widen_length(str, len);
+    }
+    return MultiByteToWideChar(cp, 0 /* flags */, str, len, nullptr, 0);
+}
+#else
+// there are no code pages outside of Windows; everything is UTF-8, and wchar_t is UTF-32
+
+std::size_t Narrow(unsigned int, const wchar_t* wstr, std::size_t wlen, char* out, std::size_t len, int& err) {
+    return NarrowUtf8(wstr, wlen, out, len, err);
+}
+
+std::size_t Widen(unsigned int, const char* str, std::size_t len, wchar_t* out, std::size_t wlen) {
+    return WidenUtf8(str, len, out, wlen);
+}
+
+// the exact output lengths, if the input converts at all
+std::size_t NarrowLength(unsigned int, const wchar_t* wstr, std::size_t wlen) {
+    return wusers_impl::utf8_narrow_length(wstr, wlen);
+}
+
+std::size_t WidenLength(unsigned int, const char* str, std::size_t len) {
+    return wusers_impl::utf8_widen_length(str, len);
+}
+#endif
 }
 
 namespace wusers_impl {
@@ -48,8 +148,10 @@ std::wstring to_win_str(const char* posix_str, std::size_t in_len, bool einval_i
         }
         return {};
     }
-    std::wstring wuser_name(in_len, L'\0'); // a conservative estimate
-    wuser_name.resize(MultiByteToWideChar(get_cp(), 0 /* flags */, posix_str, in_len, &wuser_name[0], in_len));
+    const unsigned int cp = get_cp();
+    const std::size_t wlen = WidenLength(cp, posix_str, in_len);
+    std::wstring wuser_name(wlen, L'\0');
+    wuser_name.resize(wlen ? Widen(cp, posix_str, in_len, &wuser_name[0], wlen) : 0u);
     if(wuser_name.empty()) {
         set_last_error(EINVAL);
     }
@@ -60,6 +162,57 @@ std::wstring to_win_str(const std::string& posix_str, bool einval_if_empty) {
     return to_win_str(posix_str.c_str(), posix_str.size(), einval_if_empty);
 }
 
+std::wstring from_utf8(const char* str, std::size_t len) {
+    std::wstring wstr(utf8_widen_length(str, len), L'\0');
+    const std::size_t put = utf8_widen(str, len, &wstr[0]);
+    wstr.resize(UTF8_INVALID == put ? 0u : put);
+    return wstr;
+}
+
+bool to_posix_str(const wchar_t* wstr, std::size_t wlen, std::string& out) {
+    out.resize(wlen * 4u);
+    int conv_err = 0;
+    const std::size_t put = wlen ? Narrow(get_cp(), wstr, wlen, &out[0], out.size(), conv_err) : 0u;
+    out.resize(put);
+    if(wlen && !put) {
+        set_last_error(conv_err ? conv_err : EINVAL);
+        return false;
+    }
+    count_transcoded(put);
+    return true;
+}
+
+std::string fold_name(const char* posix_str) {
+    std::string folded(posix_str ? posix_str : "");
+    bool ascii = true;
+    for(char& c : folded) {
+        ascii &= !(c & 0x80);
+        if(c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    }
+    if(ascii) {
+        return folded; // the common case; no conversion round trip
+    }
+    std::wstring wfolded(folded.size(), L'\0');
+    wfolded.resize(Widen(get_cp(), posix_str, folded.size(), &wfolded[0], wfolded.size()));
+    if(wfolded.empty()) {
+        return folded;
+    }
+    for(wchar_t& wc : wfolded) {
+        wc = std::towlower(wc);
+    }
+    std::string refolded(wfolded.size() * 4u, '\0');
+    int conv_err = 0;
+    refolded.resize(Narrow(get_cp(), wfolded.data(), wfolded.size(), &refolded[0], refolded.size(), conv_err));
+    return (conv_err || refolded.empty()) ? folded : refolded;
+}
+
+std::wstring fold_name(std::wstring wname) {
+    for(wchar_t& wc : wname) {
+        wc = std::towlower(wc);
+    }
+    return wname;
+}
+
 std::wstring to_win_str(const char* posix_str, bool einval_if_empty) {
     if(posix_str) {
         return to_win_str(posix_str, std::strlen(posix_str), einval_if_empty);
@@ -80,35 +233,32 @@ char* BufferWriter::operator()(const wchar_t* out_wstr) const {
     char* out_put = out_buf;
     std::size_t out_wlen = std::wcslen(out_wstr);
     if(out_wlen) {
-        int conv_len = WideCharToMultiByte(get_cp(), 0 /* flags */, out_wstr, out_wlen, out_put, buf_len - 1, nullptr, nullptr);
+        int conv_err;
+        std::size_t conv_len = Narrow(get_cp(), out_wstr, out_wlen, out_put, buf_len - 1, conv_err);
         if(conv_len) {
             out_buf += conv_len;
             buf_len -= conv_len;
+            count_transcoded(conv_len);
         }
         else {
-            switch(GetLastError()) {
-            case ERROR_INSUFFICIENT_BUFFER:
-                set_last_error(ERANGE);
-                break;
-            default:
-                set_last_error(EINVAL);
-                break;
-            }
+            set_last_error(conv_err);
             return nullptr;
         }
     }
-    return (*out_buf = '\0'), out_buf++, buf_len++, out_put;
+    count_to_buffer(out_buf - out_put + 1u);
+    return (*out_buf = '\0'), out_buf++, buf_len--, out_put;
 }
 
 char* BufferWriter::operator()(const void* buf, std::size_t len) const {
     if(!buf) {
         return nullptr;
     }
-    // harmless implicit alignment to uintptr_t
+    // harmless implicit alignment to uintptr_t: skip to the next multiple, if not at one
     constexpr uintptr_t mask = sizeof(uintptr_t) - 1;
     uintptr_t uiptrbuf = reinterpret_cast<uintptr_t>(out_buf);
-    uintptr_t fraction = ((uiptrbuf & mask) + mask) & ~mask;
+    uintptr_t fraction = (sizeof(uintptr_t) - (uiptrbuf & mask)) & mask;
     if(len + fraction > buf_len) {
+        set_last_error(ERANGE);
         return nullptr;
     }
     // slightly suboptimal arithmetic, for clarity
@@ -118,76 +268,115 @@ char* BufferWriter::operator()(const void* buf, std::size_t len) const {
     memcpy(out_buf, buf, len);
     out_buf += len;
     buf_len -= len;
+    count_to_buffer(len);
     return out_put;
 }
 
-char* BinderWriter::operator()(const wchar_t* out_wstr) const {
+char* BufferWriter::operator()(const char* str) const {
+    if(!str) {
+        return nullptr;
+    }
+    std::size_t len = std::strlen(str) + 1u;
+    if(len > buf_len) {
+        set_last_error(ERANGE);
+        return nullptr;
+    }
+    char* out_put = out_buf;
+    memcpy(out_buf, str, len);
+    out_buf += len;
+    buf_len -= len;
+    count_to_buffer(len);
+    return out_put;
+}
+
+char* Arena::allocate(std::size_t len, std::size_t align) {
+    if(!blocks.empty()) {
+        char* base = blocks.back().mem.get();
+        const uintptr_t at = (reinterpret_cast<uintptr_t>(base + used) + align - 1u) & ~uintptr_t(align - 1u);
+        const std::size_t offset = at - reinterpret_cast<uintptr_t>(base);
+        if(offset + len <= blocks.back().size) {
+            used = offset + len;
+            return base + offset;
+        }
+    }
+    // operator new[] is aligned for any fundamental type, hence `align` at the start of a block
+    std::size_t size = blocks.empty() ? BLOCK : blocks.back().size * 2u;
+    if(size < len) {
+        size = len;
+    }
+    blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+    used = len;
+    return blocks.back().mem.get();
+}
+
+void Arena::reset() {
+    if(blocks.size() > 1u) {
+        std::size_t total = 0u;
+        for(const Block& block : blocks) {
+            total += block.size;
+        }
+        blocks.clear();
+        if(total <= KEEP) {
+            // one block that fits everything this arena has held so far
+            blocks.push_back({std::unique_ptr<char[]>(new char[total]), total});
+        }
+    } else if(!blocks.empty() && blocks.back().size > KEEP) {
+        blocks.clear();
+    }
+    used = 0u;
+}
+
+char* ArenaWriter::operator()(const wchar_t* out_wstr) const {
     if(!out_wstr) {
         return nullptr;
     }
-    out_bdr.push_back({});
-    std::size_t out_wlen = std::wcslen(out_wstr);
-    std::string& out_str = out_bdr.back();
+    const unsigned int cp = get_cp();
+    const std::size_t out_wlen = std::wcslen(out_wstr);
+    // exactly as much as it takes
+    const std::size_t conv_len = out_wlen ? NarrowLength(cp, out_wstr, out_wlen) : 0u;
+    char* out_str = out_arena.allocate(conv_len + 1u);
     if(out_wlen) {
-        std::size_t grow_amt = sizeof(wchar_t) * out_wlen;
-        int conv_len, last_err;
-        do {
-            out_str.resize(out_str.size() + grow_amt);
-            conv_len = WideCharToMultiByte(get_cp(), 0 /* flags */, out_wstr, out_wlen, &out_str[0], out_str.size(), nullptr, nullptr);
-            last_err = conv_len ? ERROR_SUCCESS : GetLastError();
-        }
-        while(!conv_len && ERROR_INSUFFICIENT_BUFFER == last_err);
-        if(ERROR_SUCCESS != last_err) {
+        int last_err;
+        if(!conv_len || !Narrow(cp, out_wstr, out_wlen, out_str, conv_len, last_err)) {
             set_last_error(EINVAL);
             return nullptr;
         }
     }
-    return &out_str[0];
+    out_str[conv_len] = '\0';
+    count_transcoded(conv_len);
+    return out_str;
 }
 
-char* BinderWriter::operator()(const void* buf, std::size_t len) const {
-    // we _hope_ your string heap is aligned... but check as well
-    constexpr uintptr_t mask = sizeof(uintptr_t) - 1;
-    out_bdr.emplace_back(len + sizeof(uintptr_t), '\0');
-    char* out_buf = &out_bdr.back()[0];
-    uintptr_t uiptrbuf = reinterpret_cast<uintptr_t>(out_buf);
-    uintptr_t fraction = ((uiptrbuf & mask) + mask) & ~mask;
-    out_buf += fraction;
+char* ArenaWriter::operator()(const void* buf, std::size_t len) const {
+    // raw data is pointer arrays (gr_mem); align accordingly
+    char* out_buf = out_arena.allocate(len, alignof(uintptr_t));
     memcpy(out_buf, buf, len);
     return out_buf;
 }
 
-const char* IDToA(OutBinder& out_bdr, unsigned int id, bool no) {
-    if(no) return nullptr;
-    std::stringstream ss;
-    ss << id;
-    out_bdr.push_back(ss.str());
-    return out_bdr.back().c_str();
-}
-
-void GC(OutBinder& bdr) {
-    // memory leak prevention; constants:=arbitrary within reasonable
-    if(bdr.size() > 512u) {
-        // too many entries used...
-        auto itr = bdr.begin();
-        // keep the last complete entry intact, but keep erasing
-        // those singular strings that are piling up on top of it
-        for(std::size_t i = 0; i < 12u; ++i) {
-            ++itr;
-        }
-        // ...yep, this. looks old enough.
-        bdr.erase(itr);
+char* ArenaWriter::operator()(const char* str) const {
+    if(!str) {
+        return nullptr;
     }
+    const std::size_t len = std::strlen(str) + 1u;
+    return static_cast<char*>(memcpy(out_arena.allocate(len), str, len));
+}
+
+const char* IDToA(Arena& out_arena, unsigned int id, bool no) {
+    if(no) return nullptr;
+    char num[16];
+    std::snprintf(num, sizeof(num), "%u", id);
+    return ArenaWriter(out_arena)(num);
 }
 
 std::wstring ExpandEnvvars(const wchar_t * percent_str) {
     std::size_t def_len = MAX_PATH;
     std::wstring out(def_len, L'\0');
-    std::size_t out_len = ExpandEnvironmentStringsW(percent_str, &out[0], out.size());
+    std::size_t out_len = backend().ExpandEnvironment(percent_str, &out[0], out.size());
     out.resize(out_len, L'\0');
     if(out_len > def_len) {
         // request complete data
-        ExpandEnvironmentStringsW(percent_str, &out[0], out.size());
+        backend().ExpandEnvironment(percent_str, &out[0], out.size());
     }
     return out;
 }
@@ -195,28 +384,73 @@ std::wstring ExpandEnvvars(const wchar_t * percent_str) {
 std::wstring GetEffectiveName() {
     std::wstring qual_name(MAX_PATH, L'\0');
     ULONG namelen = qual_name.size();
-    int complete = GetUserNameExW(NameSamCompatible, &qual_name[0], &namelen);
+    DWORD status = backend().UserNameSam(&qual_name[0], &namelen);
     qual_name.resize(namelen);
-    if(!complete) {
-        if(ERROR_MORE_DATA == GetLastError()) {
-            GetUserNameExW(NameSamCompatible, &qual_name[0], &namelen);
-        } else {
+    if(ERROR_SUCCESS != status) {
+        if(ERROR_MORE_DATA != status || ERROR_SUCCESS != backend().UserNameSam(&qual_name[0], &namelen)) {
             return {};
         }
+        qual_name.resize(namelen);
     }
     std::size_t last_bs = qual_name.find_last_of('\\');
     return (std::wstring::npos == last_bs)
             ? qual_name : qual_name.substr(last_bs + 1);
 }
 
-void FreeNetBuffer::operator()(BYTE* ptr) const { if(ptr) NetApiBufferFree(ptr); }
+void FreeNetBuffer::operator()(BYTE* ptr) const { if(ptr) backend().BufferFree(ptr); }
 
+#ifdef _WIN32
 unsigned int GetRID(PSID sid) {
     return *GetSidSubAuthority(sid, *GetSidSubAuthorityCount(sid)-1);
 }
+#endif
+
+Backend& platform_backend() {
+#ifdef _WIN32
+    return netapi_backend();
+#else
+    static StandIn standin;
+    return standin;
+#endif
+}
+
+Backend& backend() {
+    static Metered metered(&unmetered_backend);
+    return metered;
+}
+
+void set_backend(Backend* bkd) {
+    installed.store(bkd, std::memory_order_release);
+    wuser_cache_refresh_host(); // the environment and the file system are the backend's too
+}
 
 } // namespace wusers_impl
 
+namespace wusers {
+
+std::string text::str() const {
+    std::string out;
+    if(narrow_) {
+        out = narrow_;
+    } else if(wide_) {
+        wusers_impl::to_posix_str(wide_, std::wcslen(wide_), out);
+    }
+    return out;
+}
+
+std::string_view text::view(std::string& scratch) const {
+    if(narrow_) {
+        return narrow_;
+    }
+    scratch.clear();
+    if(wide_) {
+        wusers_impl::to_posix_str(wide_, std::wcslen(wide_), scratch);
+    }
+    return scratch;
+}
+
+} // namespace wusers
+
 #ifdef __cplusplus
 extern "C" {
 #endif
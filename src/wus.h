@@ -8,12 +8,20 @@
 #ifndef _CHR_H_
 #define _CHR_H_
 
-#include <list>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
-#include <windows.h> // SID -> sid.h, sid.cpp
-#include <lm.h>      // NetApiBufferFree
+#include "backend.h" // NetAPI types and calls
+#include "snapshot.h" // mapped records
+#include "stats.h" // bytes to buffer
 
 namespace wusers_impl {
 
@@ -26,7 +34,48 @@ std::wstring to_win_str(const char* posix_str, bool einval_if_empty = true);
 
 std::wstring to_win_str(const std::string& posix_str, bool einval_if_empty = true);
 
-using OutBinder = std::list<std::string>;
+// files and snapshots are UTF-8 whatever the code page; empty if `str` isn't
+std::wstring from_utf8(const char* str, std::size_t len);
+
+// the other way around, into the code page of the thread: `out` (whose capacity is reused)
+// has `wstr` transcoded; false (EINVAL) if it doesn't transcode
+bool to_posix_str(const wchar_t* wstr, std::size_t wlen, std::string& out);
+
+// account names are case-insensitive: "Administrator", "ADMINISTRATOR" and "administrator"
+// fold to the same key. never fails; what doesn't convert is folded as ASCII only.
+std::string fold_name(const char* posix_str);
+
+// the same for names as they come from the directory
+std::wstring fold_name(std::wstring wname);
+
+// Library-owned memory for translated records: a bump allocator over a few blocks.
+// Nothing is freed piecemeal; reset() releases everything at once but keeps the memory
+// (up to KEEP bytes, coalesced into one block), so that refilling a thread's record
+// with another of about the same size doesn't touch the heap at all.
+class Arena {
+public:
+    static constexpr std::size_t BLOCK = 128u;  // the first block; then each is twice the last
+    static constexpr std::size_t KEEP = 65536u; // more than that goes back to the heap on reset()
+
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // `len` bytes aligned to `align` (a power of two)
+    char* allocate(std::size_t len, std::size_t align = 1u);
+
+    // everything allocated so far is gone
+    void reset();
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> mem;
+        std::size_t size;
+    };
+
+    std::vector<Block> blocks; // allocations come from the last one
+    std::size_t used = 0u;     // ...which is filled up to here
+};
 
 struct OutWriter
 {
@@ -36,6 +85,9 @@ struct OutWriter
     // store a chunk of data verbatim
     virtual char* operator()(const void* buf, std::size_t len) const = 0;
 
+    // copy an already converted null-terminated string
+    virtual char* operator()(const char* str) const = 0;
+
     // default constructor (for sub-smart compilers)
     OutWriter() = default;
 
@@ -55,6 +107,7 @@ public:
 
     char* operator()(const wchar_t* wstr) const override;
     char* operator()(const void* buf, std::size_t len) const override;
+    char* operator()(const char* str) const override;
 
 private:
     char * &out_buf;
@@ -62,20 +115,124 @@ private:
 };
 
 // conversions into library-owned memory
-class BinderWriter : public OutWriter {
+class ArenaWriter : public OutWriter {
 public:
-    BinderWriter(OutBinder& bdr) : out_bdr(bdr) {}
-    
+    ArenaWriter(Arena& arena) : out_arena(arena) {}
+
     char* operator()(const wchar_t* wstr) const override;
     char* operator()(const void* buf, std::size_t len) const override;
+    char* operator()(const char* str) const override;
 
 private:
-    OutBinder& out_bdr;
+    Arena& out_arena;
+};
+
+const char* IDToA(Arena& out_arena, unsigned int id, bool no = false);
+
+// Where the variable part of a record (strings and, for groups, the gr_mem array) goes when
+// the record is laid out in one block: see Packed. Specialized in pwd.cpp and grp.cpp.
+template<typename POSIX_RECORD_T> struct Packing;
+
+template<> struct Packing<struct passwd> {
+    static constexpr std::size_t ALIGN = 1u; // of the variable part
+    // the bytes the variable part of `src` takes
+    static std::size_t Measure(const struct passwd& src);
+    // copy it to `at` (Measure() bytes, aligned to ALIGN); `out` has the fixed part already
+    static void Lay(const struct passwd& src, struct passwd& out, char* at);
+    // every pointer of `rec` points into a variable part that has moved from `from` to `to`
+    static void Relocate(struct passwd& rec, const char* from, char* to);
+};
+
+template<> struct Packing<struct group> {
+    static constexpr std::size_t ALIGN = alignof(char*); // gr_mem comes first
+    static std::size_t Measure(const struct group& src);
+    static void Lay(const struct group& src, struct group& out, char* at);
+    static void Relocate(struct group& rec, const char* from, char* to);
 };
 
-const char* IDToA(OutBinder& out_str, unsigned int id, bool no = false);
+// A translated record in one contiguous block: the fixed part first, then the variable part
+// (see Packing), to which every pointer in the record points. Copying it anywhere is therefore
+// one memcpy() of a known size and a rebase of each pointer, with no assumptions about which
+// field comes last. A Packed may also merely view a record that isn't laid out like that (one
+// from a snapshot); copies of a view are laid out field by field.
+template<typename POSIX_RECORD_T>
+class Packed {
+public:
+    using Fields = Packing<POSIX_RECORD_T>;
+
+    Packed() = default;
+    explicit Packed(const POSIX_RECORD_T& view) : rec(&view) {}
+    Packed(const Packed&) = delete;
+    Packed& operator=(const Packed&) = delete;
+
+    // lay out a copy of `src`, which may be anywhere
+    void pack(const POSIX_RECORD_T& src) {
+        tail = Fields::Measure(src);
+        block.reset(new char[sizeof(POSIX_RECORD_T) + tail]); // aligned for the record
+        POSIX_RECORD_T* packed = reinterpret_cast<POSIX_RECORD_T*>(block.get());
+        *packed = src;
+        Fields::Lay(src, *packed, block.get() + sizeof(POSIX_RECORD_T));
+        rec = packed;
+    }
+
+    const POSIX_RECORD_T& record() const { return *rec; }
+
+    // the reentrant API: the variable part goes to `out_buf`, which is advanced past it.
+    // false (ERANGE) if it doesn't fit; nothing is written then.
+    bool copyTo(POSIX_RECORD_T& out, char*& out_buf, size_t& buf_len) const {
+        const std::size_t need = bytes();
+        const std::size_t pad = (Fields::ALIGN - reinterpret_cast<uintptr_t>(out_buf) % Fields::ALIGN) % Fields::ALIGN;
+        if(pad > buf_len || need > buf_len - pad) {
+            set_last_error(ERANGE);
+            return false;
+        }
+        place(out, out_buf + pad);
+        out_buf += pad + need;
+        buf_len -= pad + need;
+        count_to_buffer(need);
+        return true;
+    }
+
+    // the same into thread-owned memory
+    bool copyTo(POSIX_RECORD_T& out, Arena& arena) const {
+        const std::size_t need = bytes();
+        place(out, arena.allocate(need, Fields::ALIGN));
+        return true;
+    }
+
+    // pw_dup() and gr_dup(): one allocation that free() releases; nullptr (ENOMEM) if none
+    POSIX_RECORD_T* dup() const {
+        const std::size_t need = bytes();
+        void* mem = std::malloc(sizeof(POSIX_RECORD_T) + need);
+        if(!mem) {
+            set_last_error(ENOMEM);
+            return nullptr;
+        }
+        POSIX_RECORD_T* out = static_cast<POSIX_RECORD_T*>(mem);
+        place(*out, static_cast<char*>(mem) + sizeof(POSIX_RECORD_T));
+        return out;
+    }
+
+private:
+    static_assert(sizeof(POSIX_RECORD_T) % alignof(char*) == 0, "the variable part follows the record");
+
+    std::size_t bytes() const { return block ? tail : Fields::Measure(*rec); }
+
+    void place(POSIX_RECORD_T& out, char* at) const {
+        out = *rec;
+        if(block) {
+            char* from = block.get() + sizeof(POSIX_RECORD_T);
+            std::memcpy(at, from, tail);
+            Fields::Relocate(out, from, at);
+        } else {
+            Fields::Lay(*rec, out, at);
+        }
+    }
 
-void GC(OutBinder& bdr); // trim oldies that probably aren't goldies
+    std::unique_ptr<char[]> block; // the record, then `tail` bytes of variable part
+    std::size_t tail = 0u;
+    const POSIX_RECORD_T* rec = nullptr;
+};
 
 // miscellaneous utility functions
 
@@ -87,19 +244,23 @@ struct FreeNetBuffer { void operator()(BYTE* ptr) const; };
 
 unsigned int GetRID(PSID sid);
 
-template<typename POSIX_RECORD_T> POSIX_RECORD_T* PointerTo(POSIX_RECORD_T& rec) { return &rec; }
 template<typename POSIX_RECORD_T> POSIX_RECORD_T* NotFound() { return nullptr; }
 
 template<typename POSIX_RECORD_T> struct IA;
+template<typename POSIX_RECORD_T> using InfoAdapter = IA<POSIX_RECORD_T>; // for member aliases named IA
+
+template<typename POSIX_RECORD_T> class Cache; // cache.h
+
+template<typename ID_T> class NameCache; // pwcache.h
 
 template<typename POSIX_RECORD_T, typename NETAPI_INFO_T>
 bool FillFrom(POSIX_RECORD_T& out, const NETAPI_INFO_T& wu_infoX, const OutWriter& writer);
 
-template<typename POSIX_RECORD_T, typename NETAPI_INFO_T, int LVL,
+template<typename NETAPI_INFO_T, int LVL,
         NET_API_STATUS (*GetInfo)(LPCWSTR, LPCWSTR, DWORD, LPBYTE*),
-        NET_API_STATUS StatusNotFound>
-POSIX_RECORD_T* QueryInfoByName(const std::wstring& name, POSIX_RECORD_T* out_ptr, const OutWriter& writer) {
-    POSIX_RECORD_T * retval = nullptr;
+        NET_API_STATUS StatusNotFound, typename R>
+R ProcessInfoByName(const std::wstring& name, std::function<R(const NETAPI_INFO_T&)> process, R failed) {
+    R retval = failed;
     NETAPI_INFO_T * wu_infoX = nullptr;
     switch((*GetInfo)(nullptr, name.c_str(), LVL, reinterpret_cast<unsigned char**>(&wu_infoX))) {
     case ERROR_ACCESS_DENIED:
@@ -113,40 +274,158 @@ POSIX_RECORD_T* QueryInfoByName(const std::wstring& name, POSIX_RECORD_T* out_pt
         set_last_error(ENOENT);
         break;
     case NERR_Success:
-        retval = out_ptr;
-        FillFrom(*retval, *wu_infoX, writer);
+        retval = process(*wu_infoX);
         break;
     default:
         set_last_error(EIO);
     }
     if(wu_infoX) {
-        NetApiBufferFree(wu_infoX);
+        backend().BufferFree(wu_infoX);
     }
-    // BinderWriter can't fail with ERANGE (but BufferWriter can)
     return retval;
 }
 
-template<typename NETAPI_INFO_T, int LVL,
-        NET_API_STATUS (*Enumerate)(LPCWSTR, DWORD, LPBYTE *, DWORD, LPDWORD, LPDWORD, PDWORD_PTR)>
-struct EnumQueryState {
+template<typename POSIX_RECORD_T, typename NETAPI_INFO_T, int LVL,
+        NET_API_STATUS (*GetInfo)(LPCWSTR, LPCWSTR, DWORD, LPBYTE*),
+        NET_API_STATUS StatusNotFound>
+POSIX_RECORD_T* QueryInfoByName(const std::wstring& name, POSIX_RECORD_T* out_ptr, const OutWriter& writer) {
+    // ArenaWriter can't fail with ERANGE (but BufferWriter can)
+    return ProcessInfoByName<NETAPI_INFO_T, LVL, GetInfo, StatusNotFound, POSIX_RECORD_T*>(name,
+        [&](const NETAPI_INFO_T& wu_infoX) { return FillFrom(*out_ptr, wu_infoX, writer), out_ptr; },
+        nullptr);
+}
+
+// queue `fetch` for a Pool worker if enumerations read ahead (wuser_cache_set_readahead());
+// false if they don't, or if there are no workers to run it
+bool ReadAhead(std::function<void()> fetch);
+
+// How many bytes to ask NetXxxEnum for, learned process-wide for one kind of account: each
+// page asks for all that's left of the enumeration, going by the total and the bytes per
+// entry seen so far (in this enumeration or, for its first page, in earlier ones), within
+// the bounds set by wuser_cache_set_page_bounds().
+class PageSizer {
+public:
     // set large enough to fit in a single query on a workstation
     // but small enough to avoid hoarding too much memory.
-    // MAX_PREFERRED_LENGTH will request as much memory as needed
-    // to finish enumeration in one pass even on a server.
-    static constexpr const std::size_t PAGE = 32768u;
+    // used until the first enumeration has told us how many accounts there are.
+    static constexpr std::size_t PAGE = 32768u;
+
+    // the first page of an enumeration; `record` is the size of the fixed part of an entry
+    std::size_t first(std::size_t record);
+
+    // any other page, with `left` entries still to come
+    std::size_t next(std::size_t left, std::size_t record);
+
+    // a page of `page` bytes came back with `read` of `full` entries; `more` if it's not the last
+    void observe(std::size_t page, std::size_t read, std::size_t full, bool more);
+
+    std::size_t last() const { return chosen; } // for wuser_cache_get_page_sizes()
+
+private:
+    std::size_t fit(std::size_t entries, std::size_t record);
+
+    std::atomic<std::size_t> bytes_per_entry{0u}; // 0 until a full page has been seen
+    std::atomic<std::size_t> total{0u};           // 0 until the first page
+    std::atomic<std::size_t> chosen{0u};
+};
+
+PageSizer& user_pages();
+PageSizer& group_pages();
+
+template<typename NETAPI_INFO_T, int LVL,
+        NET_API_STATUS (*Enumerate)(LPCWSTR, DWORD, LPBYTE *, DWORD, LPDWORD, LPDWORD, PDWORD_PTR),
+        PageSizer& (*Pages)()>
+struct EnumQueryState {
+    // one round trip: the page at `resume`, which is advanced past it. 0 or an errno value.
+    // `page` is the size to ask for, and is doubled if not even one entry fits.
+    static int Page(LPBYTE& optr, DWORD& entries_read, DWORD& entries_full, DWORD_PTR& resume, std::size_t page) {
+        for(;;) switch((*Enumerate)(nullptr, LVL, &optr, page, &entries_read, &entries_full, &resume)) {
+        case ERROR_ACCESS_DENIED:
+            return EACCES;
+        case ERROR_INVALID_LEVEL:
+            return EINVAL;
+        case NERR_InvalidComputer:
+            return EHOSTUNREACH;
+        case ERROR_MORE_DATA:
+            (*Pages)().observe(page, entries_read, entries_full, true);
+            return 0;
+        case NERR_Success:
+            (*Pages)().observe(page, entries_read, entries_full, false);
+            return 0;
+        case NERR_BufTooSmall:
+            page <<= 1;
+            break;
+        default:
+            return EIO;
+        }
+    }
+
+    // The page after the current one, requested while the caller goes through the current
+    // one: by a Pool worker, or by query() itself if no worker has started on it yet.
+    struct Ahead {
+        enum { QUEUED, FETCHING, FETCHED };
+        std::atomic<int> state{QUEUED};
+        std::atomic<bool> cancelled{false};
+        std::unique_ptr<BYTE, FreeNetBuffer> buf; // freed with the last reference, enumeration or worker
+        DWORD entries_read = 0u;
+        DWORD entries_full = 0u;
+        DWORD_PTR resume;
+        std::size_t page;
+        int error = 0;
+        std::mutex mtx;
+        std::condition_variable done;
+
+        Ahead(DWORD_PTR from, std::size_t size) : resume(from), page(size) {}
+
+        // false if someone else has fetched it, or it's no longer wanted
+        bool fetch() {
+            int queued = QUEUED;
+            if(cancelled || !state.compare_exchange_strong(queued, FETCHING)) {
+                return false;
+            }
+            LPBYTE optr = nullptr;
+            if(!(error = Page(optr, entries_read, entries_full, resume, page))) {
+                buf.reset(optr);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                state = FETCHED;
+            }
+            done.notify_all();
+            return true;
+        }
+
+        void await() {
+            if(!fetch()) {
+                std::unique_lock<std::mutex> lock(mtx);
+                done.wait(lock, [this]() { return FETCHED == state; });
+            }
+        }
+    };
 
     std::unique_ptr<BYTE, FreeNetBuffer> buf;
     std::size_t offset;
     std::size_t cursor;
     DWORD entries_full;
     DWORD entries_read;
-    DWORD query_resume;
+    DWORD_PTR query_resume;
+    std::shared_ptr<Ahead> ahead; // the next page, if on its way
 
     const NETAPI_INFO_T* buffer() const { return reinterpret_cast<const NETAPI_INFO_T*>(buf.get()); }
 
+    EnumQueryState() = default;
+    EnumQueryState(const EnumQueryState&) = delete;
+    EnumQueryState& operator=(const EnumQueryState&) = delete;
+
+    ~EnumQueryState() {
+        drop();
+    }
+
     void reset() {
+        drop();
         buf.reset();
         offset = 0u;
+        cursor = 0u;
         entries_read = 0u;
         entries_full = 0u;
         query_resume = 0u;
@@ -154,31 +433,37 @@ struct EnumQueryState {
 
     void query() {
         set_last_error(0);
-        LPBYTE optr;
-        auto page = PAGE;
-        do switch((*Enumerate)(nullptr, LVL, &optr, page, &entries_read, &entries_full, &query_resume)) {
-        case ERROR_ACCESS_DENIED:
-            set_last_error(EACCES);
-            return;
-        case ERROR_INVALID_LEVEL:
-            set_last_error(EINVAL);
-            return;
-        case NERR_InvalidComputer:
-            set_last_error(EHOSTUNREACH);
-            return;
-        case ERROR_MORE_DATA:
-        case NERR_Success:
-            buf.reset(optr);
-            offset += cursor;
-            cursor = 0u;
-            return;
-        case NERR_BufTooSmall:
-            page <<= 1;
-            break;
-        default:
-            set_last_error(EIO);
+        LPBYTE optr = nullptr;
+        int error = 0;
+        if(ahead) {
+            ahead->await();
+            if(!(error = ahead->error)) {
+                optr = ahead->buf.release();
+                entries_read = ahead->entries_read;
+                entries_full = ahead->entries_full;
+                query_resume = ahead->resume;
+            }
+            ahead.reset(); // on error, a retry starts over from query_resume
+        } else {
+            const std::size_t page = buf ? (*Pages)().next(entries_full - offset - cursor, sizeof(NETAPI_INFO_T))
+                                         : (*Pages)().first(sizeof(NETAPI_INFO_T));
+            error = Page(optr, entries_read, entries_full, query_resume, page);
+        }
+        if(error) {
+            set_last_error(error);
             return;
-        } while(!errno);
+        }
+        buf.reset(optr);
+        offset += cursor;
+        cursor = 0u;
+        if(offset + entries_read < entries_full) {
+            const std::size_t left = entries_full - offset - entries_read;
+            ahead = std::make_shared<Ahead>(query_resume, (*Pages)().next(left, sizeof(NETAPI_INFO_T)));
+            std::shared_ptr<Ahead> hold = ahead; // a worker may outlive the enumeration
+            if(!ReadAhead([hold]() { hold->fetch(); })) {
+                ahead.reset();
+            }
+        }
     }
 
     const NETAPI_INFO_T* curr() const {
@@ -192,6 +477,7 @@ struct EnumQueryState {
                     return nullptr;
                 } else {
                     query();
+                    if(errno) return nullptr; // the page is gone, so is the enumeration
                 }
             }
             return &buffer()[cursor++];
@@ -199,35 +485,281 @@ struct EnumQueryState {
             return nullptr;
         }
     }
+
+    // give back the entry step() has just returned: the next step() returns it again
+    void unstep() {
+        --cursor;
+    }
+
+private:
+    // a page no worker has started on is never fetched; one in flight is freed on arrival
+    void drop() {
+        if(ahead) {
+            ahead->cancelled = true;
+            ahead.reset();
+        }
+    }
 };
 
+// The reentrant enumeration (getpwent_r(), wusers/wuser_cursor.h): up to `max` entries of
+// `query`, translated by `fill(record, entry, writer)` into the caller's buffer, until one
+// doesn't fit -- that one is given back and comes first next time. `count` is how many there
+// are. 0 if any; otherwise ENOENT at the end, ERANGE if not even one fits, or the error of
+// the failed step or translation. Errors after the first record are the next call's to report.
+template<typename POSIX_RECORD_T, typename QUERY_STATE, typename FILL>
+int FillBatch(QUERY_STATE& query, POSIX_RECORD_T* out, std::size_t max, char* buf, size_t buf_len,
+              std::size_t& count, FILL fill) {
+    count = 0u;
+    if(!max) {
+        set_last_error(EINVAL);
+        return errno;
+    }
+    while(count < max) {
+        set_last_error(0);
+        const auto* info = query.step();
+        if(!info) {
+            break; // the end, or errno
+        }
+        char* const mark = buf;
+        const size_t left = buf_len;
+        if(fill(out[count], *info, BufferWriter(buf, buf_len)) && ERANGE != errno) {
+            ++count;
+            continue;
+        }
+        buf = mark;
+        buf_len = left;
+        if(ERANGE == errno || count) {
+            query.unstep(); // retried, or reported, by the next call
+        }
+        break;
+    }
+    if(count) {
+        set_last_error(0);
+        return 0;
+    }
+    if(!errno) {
+        set_last_error(ENOENT);
+    }
+    return errno;
+}
+
 template<typename POSIX_RECORD_T>
 struct Stateless {
-    using IA = IA<POSIX_RECORD_T>;
+    using IA = InfoAdapter<POSIX_RECORD_T>;
+    using id_t = typename IA::id_t;
     using NETAPI_INFO_T = typename IA::NETAPI_INFO_T;
+    using Cache = wusers_impl::Cache<POSIX_RECORD_T>;
+    using Hit = typename Cache::Hit;
+    using Found = Packed<POSIX_RECORD_T>; // a cache entry or a snapshot view
+    // batch results, by position; nullptr if there is no such account. false stops the batch.
+    using Report = std::function<bool(std::size_t, const Found*)>;
 
+    // uncached, straight into `out_ptr` (used where the answer must be live)
     static POSIX_RECORD_T* QueryByName(const std::wstring& name, POSIX_RECORD_T* out_ptr, const OutWriter& writer) {
         return QueryInfoByName<POSIX_RECORD_T, NETAPI_INFO_T, IA::LVL, &IA::GetInfo, IA::NotFound>(name, out_ptr, writer);
     }
+
+    // the name and the id and nothing else, from the cheapest NetXxxGetInfo level that has
+    // both (IA::LEAN_LVL); not cached, as it isn't a record. false (errno) if there's no such account
+    static bool LeanByName(const std::wstring& wname, id_t& id, std::wstring& canonical) {
+        using LEAN_INFO_T = typename IA::LEAN_INFO_T;
+        return ProcessInfoByName<LEAN_INFO_T, IA::LEAN_LVL, &IA::GetInfo, IA::NotFound, bool>(wname,
+            [&](const LEAN_INFO_T& info) { id = IA::IdOf(&info), canonical = IA::WNameOf(&info); return true; },
+            false);
+    }
+
+    // snapshot first, then shared cache (records, then what LeanByName() found before), then LeanByName()
+    static bool IdByName(const char* name, const std::string& key, id_t& id) {
+        POSIX_RECORD_T view;
+        std::vector<char*> members;
+        if(Mapped<POSIX_RECORD_T>::ByKey(key, view, members)) {
+            return id = IA::IdOf(view), true;
+        }
+        Cache& cache = Cache::instance();
+        if(cache.readByName(key, [&id](const Found& rec) { id = IA::IdOf(rec.record()); })) {
+            return true;
+        }
+        if(Hit hit = cache.byName(key)) {
+            return id = IA::IdOf(hit->packed.record()), true;
+        }
+        if(cache.leanId(key, id)) {
+            return true;
+        }
+        if(cache.absentName(key)) {
+            set_last_error(ENOENT);
+            return false;
+        }
+        const std::wstring wname = to_win_str(name);
+        std::wstring canonical;
+        if(wname.empty() || !LeanByName(wname, id, canonical)) {
+            if(ENOENT == errno) cache.putAbsentName(key);
+            return false; // EINVAL if there was no name to ask about
+        }
+        cache.putLeanId(key, id);
+        return true;
+    }
+
+    // snapshot first, then shared cache, then NetXxxGetInfo; the answer (or that there's no
+    // such account) is published for everyone else
+    template<typename R>
+    static R QueryByNameAndMap(const char* name, std::function<R(const Found&)> report,
+                                    std::function<R()> not_found) {
+        set_last_error(0);
+        if(!name) {
+            set_last_error(EINVAL);
+            return not_found();
+        }
+        const std::string key = fold_name(name);
+        POSIX_RECORD_T view;
+        std::vector<char*> members;
+        if(Mapped<POSIX_RECORD_T>::ByKey(key, view, members)) {
+            return report(Found(view));
+        }
+        Cache& cache = Cache::instance();
+        R result = R();
+        if(cache.readByName(key, [&](const Found& rec) { result = report(rec); })) {
+            return result;
+        }
+        Hit hit = cache.byName(key);
+        if(!hit) {
+            if(cache.absentName(key)) {
+                set_last_error(ENOENT);
+                return not_found();
+            }
+            const std::wstring wname = to_win_str(name);
+            if(wname.empty()) {
+                return not_found(); // sets EINVAL
+            }
+            std::lock_guard<std::mutex> fill(cache.fillLock(std::hash<std::string>()(key)));
+            if(!(hit = cache.byName(key)) && !cache.absentName(key)) { // else fetched while we were waiting
+                hit = cache.fetch(wname);
+                if(!hit && ENOENT == errno) cache.putAbsentName(key);
+            } else if(!hit) {
+                set_last_error(ENOENT);
+            }
+        }
+        return hit ? report(hit->packed) : not_found();
+    }
+
+    // the batch API: snapshot first, then shared cache, then a single enumeration for
+    // everything else. false if `report` has stopped the batch.
+    static bool QueryByIds(const id_t* ids, std::size_t count, const Report& report) {
+        set_last_error(0);
+        std::vector<std::size_t> missing;
+        std::vector<id_t> missing_ids;
+        POSIX_RECORD_T view;
+        std::vector<char*> members;
+        const Found found(view);
+        for(std::size_t i = 0; i < count; ++i) {
+            if(!Mapped<POSIX_RECORD_T>::ById(ids[i], view, members)) {
+                missing.push_back(i);
+                missing_ids.push_back(ids[i]);
+            } else if(!report(i, &found)) {
+                return false;
+            }
+        }
+        return missing.empty() || ReportHits(missing, Cache::instance().byIds(missing_ids), report);
+    }
+
+    static bool QueryByNames(const char* const* names, std::size_t count, const Report& report) {
+        set_last_error(0);
+        std::vector<std::size_t> missing;
+        std::vector<std::string> missing_keys;
+        POSIX_RECORD_T view;
+        std::vector<char*> members;
+        const Found found(view);
+        for(std::size_t i = 0; i < count; ++i) {
+            const std::string key = fold_name(names[i]);
+            if(key.empty()) {
+                if(!report(i, nullptr)) return false;
+            } else if(!Mapped<POSIX_RECORD_T>::ByKey(key, view, members)) {
+                missing.push_back(i);
+                missing_keys.push_back(key);
+            } else if(!report(i, &found)) {
+                return false;
+            }
+        }
+        return missing.empty() || ReportHits(missing, Cache::instance().byNames(missing_keys), report);
+    }
+
+    // wuser_getpwuid_batch() and wuser_getgrgid_batch()
+    static int RecordsByIds(const id_t* ids, std::size_t count, POSIX_RECORD_T* out_recs,
+                                char* out_buf, size_t buf_len, POSIX_RECORD_T** out_ptrs) {
+        const bool fits = QueryByIds(ids, count, [&](std::size_t i, const Found* rec) {
+            out_ptrs[i] = rec && rec->copyTo(out_recs[i], out_buf, buf_len) ? &out_recs[i] : nullptr;
+            return !rec || out_ptrs[i];
+        });
+        return fits ? errno : ERANGE;
+    }
+
+    // wuser_user_from_uid_batch() and wuser_group_from_gid_batch()
+    static int NamesByIds(const id_t* ids, std::size_t count, bool no,
+                                char* out_buf, size_t buf_len, const char** out_names) {
+        BufferWriter writer(out_buf, buf_len);
+        const bool fits = QueryByIds(ids, count, [&](std::size_t i, const Found* rec) {
+            char number[16];
+            const char* name = rec ? IA::NameOf(rec->record()) : no ? nullptr : number;
+            std::snprintf(number, sizeof(number), "%u", static_cast<unsigned int>(ids[i]));
+            out_names[i] = name ? writer(name) : nullptr;
+            return !name || out_names[i];
+        });
+        return fits ? errno : ERANGE;
+    }
+
+    // wuser_uid_from_user_batch() and wuser_gid_from_group_batch()
+    static int IdsByNames(const char* const* names, std::size_t count, id_t* out_ids) {
+        QueryByNames(names, count, [&](std::size_t i, const Found* rec) {
+            out_ids[i] = rec ? IA::IdOf(rec->record()) : static_cast<id_t>(-1);
+            return true;
+        });
+        return errno;
+    }
+
+private:
+    // errno is that of the lookup, not of whatever `report` does with the results
+    static bool ReportHits(const std::vector<std::size_t>& at, const std::vector<Hit>& hits, const Report& report) {
+        const int error = errno;
+        for(std::size_t k = 0; k < at.size(); ++k) {
+            set_last_error(0);
+            if(!report(at[k], hits[k] ? &hits[k]->packed : nullptr)) {
+                return false;
+            }
+        }
+        set_last_error(error);
+        return true;
+    }
 };
 
 template<typename POSIX_RECORD_T>
 struct State : public Stateless<POSIX_RECORD_T> {
-    using IA = IA<POSIX_RECORD_T>;
+    using IA = InfoAdapter<POSIX_RECORD_T>;
     using id_t  = typename IA::id_t;
     using NETAPI_INFO_T = typename IA::NETAPI_INFO_T;
-    using QueryState = EnumQueryState<NETAPI_INFO_T, IA::LVL, &IA::Enumerate>;
+    using QueryState = EnumQueryState<NETAPI_INFO_T, IA::LVL, &IA::Enumerate, &IA::Pages>;
+    using Cache = typename Stateless<POSIX_RECORD_T>::Cache;
+    using Hit = typename Cache::Hit;
+    using Found = typename Stateless<POSIX_RECORD_T>::Found;
 
+    // what BSD semantics require us to own per thread: the last returned record,
+    // the enumeration cursor and the pwcache of courtesy names. everything else is shared.
     POSIX_RECORD_T owned_record;
-    OutBinder owned_binder;
+    Arena owned_arena;
+    NameCache<id_t> names;
+    std::vector<char*> owned_members; // gr_mem of a mapped owned_record
     QueryState query_state;
 
-    POSIX_RECORD_T* queryByName(const std::wstring& name) {
-        return this->QueryByName(name, &owned_record, BinderWriter(owned_binder = {}));
+    // copy a (shared) record into thread-owned memory
+    POSIX_RECORD_T* adopt(const Found& rec) {
+        owned_arena.reset();
+        return rec.copyTo(owned_record, owned_arena) ? &owned_record : nullptr;
     }
 
     POSIX_RECORD_T* fillInternalEntry(const NETAPI_INFO_T* wu_info) {
-        return (wu_info && FillFrom(owned_record, *wu_info, BinderWriter(owned_binder = {}))) ? &owned_record : nullptr;
+        if(!wu_info) {
+            return nullptr;
+        }
+        owned_arena.reset();
+        return FillFrom(owned_record, *wu_info, ArenaWriter(owned_arena)) ? &owned_record : nullptr;
     }
 
     POSIX_RECORD_T* nextEntry() {
@@ -236,52 +768,61 @@ struct State : public Stateless<POSIX_RECORD_T> {
 
     // note that we could extract the condition predicate as well; but there is no POSIX API to request a generic query
     template<typename R>
-    R queryByIdAndMap(id_t id, std::function<R(POSIX_RECORD_T&)> report_asis,
-                            std::function<R(const NETAPI_INFO_T*)> process,
+    R queryByIdAndMap(id_t id, std::function<R(const Found&)> report,
                             std::function<R()> not_found) {
         // let's examine our caches first
-        if(IA::IdOf(owned_record) == id) { // lucky!
-            return report_asis(owned_record);
+        POSIX_RECORD_T view;
+        std::vector<char*> members;
+        if(Mapped<POSIX_RECORD_T>::ById(id, view, members)) {
+            return report(Found(view));
+        }
+        Cache& cache = Cache::instance();
+        R result = R();
+        if(cache.readById(id, [&](const Found& rec) { result = report(rec); })) {
+            return result; // no lock taken
+        }
+        Hit hit = cache.byId(id);
+        if(hit) { // lucky!
+            return report(hit->packed);
+        }
+        std::lock_guard<std::mutex> fill(cache.fillLock(std::hash<id_t>()(id)));
+        if((hit = cache.byId(id))) { // fetched by another thread while we were waiting
+            return report(hit->packed);
         }
         if(query_state.buffer() && query_state.entries_read) {
             for(std::size_t i = 0; i < query_state.entries_read; ++i) {
                 const NETAPI_INFO_T * candidate = query_state.buffer()+i;
                 if(IA::IdOf(candidate) == id) { // lucky too
-                    return process(candidate);
+                    return (hit = cache.insert(*candidate)) ? report(hit->packed) : not_found();
                 }
             }
         }
-        // bummer. run a full query, albeit without touching state.
-        // we could pull the remainder of this method into Stateless
-        // but let's keep the logic in one place (+encourage caching)
-        QueryState local_query;
-        local_query.reset();
-        local_query.query();
-        const NETAPI_INFO_T * candidate = nullptr;
-        while((candidate = local_query.step())) {
-            if(IA::IdOf(candidate) == id) {
-                return process(candidate);
-            }
-        }
-        return not_found();
+        // bummer. go through the RID index, which costs a full query
+        // the first time around (albeit without touching our state)
+        return (hit = cache.byIdIndexed(id)) ? report(hit->packed) : not_found();
     }
 
     POSIX_RECORD_T* queryById(id_t id) {
+        set_last_error(0);
+        if(Mapped<POSIX_RECORD_T>::ById(id, owned_record, owned_members)) {
+            return &owned_record; // points into the snapshot; nothing to copy
+        }
         return queryByIdAndMap<POSIX_RECORD_T*>(id,
-            &PointerTo<POSIX_RECORD_T>,
             // the following could be `std::bind` but I had issues with it before
-            [this](const NETAPI_INFO_T* info) { return fillInternalEntry(info); },
+            [this](const Found& rec) { return adopt(rec); },
             &NotFound<POSIX_RECORD_T>);
     }
 
     // utter damn sugar, but let's keep final specializations as thin as possible
 
     POSIX_RECORD_T* queryByName(const char* name) {
-        set_last_error(0);
-        const std::wstring wname = to_win_str(name);
-        return wname.empty()
-            ? nullptr // sets EINVAL
-            : queryByName(wname);
+        if(name && Mapped<POSIX_RECORD_T>::ByKey(fold_name(name), owned_record, owned_members)) {
+            set_last_error(0);
+            return &owned_record; // ditto
+        }
+        return this->template QueryByNameAndMap<POSIX_RECORD_T*>(name,
+            [this](const Found& rec) { return adopt(rec); },
+            &NotFound<POSIX_RECORD_T>);
     }
 
     void beginEnum() {
@@ -294,26 +835,68 @@ struct State : public Stateless<POSIX_RECORD_T> {
     }
 
     const char* idToName(id_t id, bool nouser) {
-        GC(owned_binder);
-        return queryByIdAndMap<const char*>(id, &IA::NameOf,
-            [&](const NETAPI_INFO_T* wu_info) {
-                return BinderWriter(owned_binder)(IA::WNameOf(wu_info));
-            },
-            [&]() { return IDToA(owned_binder, id, nouser); }
-        );
+        set_last_error(0);
+        if(const auto* slot = names.byId(id)) {
+            set_last_error(slot->error);
+            return slot->found || !nouser ? slot->str : nullptr;
+        }
+        // shared entries may be evicted at any time; courtesy copies stay in the pwcache
+        if(const char* name = leanName(id)) {
+            return name;
+        }
+        return queryByIdAndMap<const char*>(id,
+            [this, id](const Found& rec) { return names.putName(id, IA::NameOf(rec.record())); },
+            [this, id, nouser]() {
+                const char* number = names.putAbsentId(id, !errno || ENOENT == errno);
+                return nouser ? nullptr : number;
+            });
     }
 
     int nameToId(const char* name, id_t* out_id) {
+        set_last_error(0);
         if(!name) {
             set_last_error(EINVAL);
             return -1;
         }
-        if((owned_binder.size() && IA::NameOf(owned_record) && !std::strcmp(IA::NameOf(owned_record), name))
-            || queryByName(name) /* modifies owned_record used in the next line */) {
-            *out_id = IA::IdOf(owned_record);
-            return 0;
+        const std::string key = fold_name(name);
+        if(const auto* slot = names.byName(key)) {
+            set_last_error(slot->error);
+            return slot->found ? (*out_id = slot->id, 0) : -1;
+        }
+        id_t id;
+        if(!this->IdByName(name, key, id)) {
+            names.putAbsentName(key, ENOENT == errno);
+            return -1;
+        }
+        names.putId(key, id);
+        return *out_id = id, 0;
+    }
+
+private:
+    // the name of `id`, put in the pwcache, if it can be had without translating its record:
+    // from a snapshot, the shared cache or the RID index, which is trusted as long as cached
+    // records are. nullptr otherwise, for queryByIdAndMap() to take it from there.
+    const char* leanName(id_t id) {
+        POSIX_RECORD_T view;
+        std::vector<char*> members;
+        if(Mapped<POSIX_RECORD_T>::ById(id, view, members)) {
+            return names.putName(id, IA::NameOf(view));
+        }
+        Cache& cache = Cache::instance();
+        const char* name = nullptr;
+        if(cache.readById(id, [&](const Found& rec) { name = names.putName(id, IA::NameOf(rec.record())); })) {
+            return name;
+        }
+        if(Hit hit = cache.byId(id)) {
+            return names.putName(id, IA::NameOf(hit->packed.record()));
+        }
+        std::wstring wname;
+        if(Cache::FOUND != cache.indexedName(id, wname)) {
+            return nullptr;
         }
-        return -1;
+        Arena scratch;
+        name = ArenaWriter(scratch)(wname.c_str());
+        return name ? names.putName(id, name) : nullptr; // EINVAL if it doesn't convert
     }
 };
 